@@ -0,0 +1,673 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "ctpl-codegen.h"
+#include <glib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "ctpl-i18n.h"
+#include "ctpl-escape.h"
+#include "ctpl-lexer-private.h"
+#include "ctpl-output-stream.h"
+#include "ctpl-token.h"
+#include "ctpl-token-private.h"
+#include "ctpl-value.h"
+#include "ctpl-version.h"
+
+
+/**
+ * SECTION: codegen
+ * @short_description: C code generation
+ * @include: ctpl/ctpl.h
+ * 
+ * ctpl_codegen_emit_c() writes a token tree as the source code of a C function
+ * rendering it, that can be compiled and linked into an application to render
+ * the template without lexing it nor walking its tree.
+ * 
+ * The data of the template is written as constant arrays, expressions as
+ * straight-line code calling ctpl_eval_lookup(), ctpl_eval_operator_values(),
+ * ctpl_eval_index_value() and ctpl_function_call(), and <code>for</code> and
+ * <code>if</code> statements as C loops and conditions. The generated function
+ * renders the template like ctpl_parser_parse() would, and has the following
+ * prototype:
+ * |[
+ * gboolean function_name (CtplEnviron       *env,
+ *                         CtplOutputStream  *output,
+ *                         GError           **error);
+ * ]|
+ * It only differs from ctpl_parser_parse() in that it does not flush @output,
+ * and that it does not use the fragment cache of @output: <code>cache</code>
+ * blocks are always rendered.
+ * The generated code only depends on the public API of CTPL.
+ */
+
+
+/* maximum length of the pieces of the string literals written */
+#define CODEGEN_STRING_PIECE_LEN 64
+
+
+typedef struct _Codegen     Codegen;
+typedef struct _CodegenExpr CodegenExpr;
+
+/* state of the generation of a function */
+struct _Codegen
+{
+  const gchar  *name;     /* the name of the function */
+  GString      *decls;    /* data arrays and expression functions */
+  GString      *body;     /* body of the function */
+  guint         n_data;   /* number of data arrays written */
+  guint         n_exprs;  /* number of expression functions written */
+};
+
+/* state of the generation of an expression function */
+struct _CodegenExpr
+{
+  GString  *code;
+  guint     n_values; /* number of temporary values used */
+};
+
+
+/*<standard>*/
+GQuark
+ctpl_codegen_error_quark (void)
+{
+  static GQuark error_quark = 0;
+  
+  if (G_UNLIKELY (error_quark == 0)) {
+    error_quark = g_quark_from_static_string ("CtplCodegen");
+  }
+  
+  return error_quark;
+}
+
+/* gets whether @name is a valid C identifier */
+static gboolean
+codegen_is_identifier (const gchar *name)
+{
+  const gchar *p;
+  
+  if (! g_ascii_isalpha (*name) && *name != '_') {
+    return FALSE;
+  }
+  for (p = name + 1; *p; p++) {
+    if (! g_ascii_isalnum (*p) && *p != '_') {
+      return FALSE;
+    }
+  }
+  
+  return TRUE;
+}
+
+/* appends a line indented by @indent spaces to @code */
+static void
+codegen_line (GString      *code,
+              guint         indent,
+              const gchar  *format,
+              ...)
+{
+  va_list ap;
+  
+  g_string_append_printf (code, "%*s", (gint) indent, "");
+  va_start (ap, format);
+  g_string_append_vprintf (code, format, ap);
+  va_end (ap);
+  g_string_append_c (code, '\n');
+}
+
+/* appends @data as C string literals, one per line of @data or
+ * CODEGEN_STRING_PIECE_LEN bytes, the ones after the first being indented by
+ * @indent spaces */
+static void
+codegen_string (GString      *code,
+                const gchar  *data,
+                gsize         length,
+                guint         indent)
+{
+  gsize i;
+  gsize piece_len = 0;
+  
+  g_string_append_c (code, '"');
+  for (i = 0; i < length; i++) {
+    guchar c = (guchar) data[i];
+    
+    if (piece_len >= CODEGEN_STRING_PIECE_LEN) {
+      g_string_append_printf (code, "\"\n%*s\"", (gint) indent, "");
+      piece_len = 0;
+    }
+    switch (c) {
+      case '"':   g_string_append (code, "\\\""); break;
+      case '\\':  g_string_append (code, "\\\\"); break;
+      /* escaped not to form trigraphs */
+      case '?':   g_string_append (code, "\\?");  break;
+      case '\n':  g_string_append (code, "\\n");  break;
+      case '\t':  g_string_append (code, "\\t");  break;
+      
+      default:
+        if (c < 0x20 || c >= 0x7f) {
+          /* always 3 digits not to be continued by a digit following */
+          g_string_append_printf (code, "\\%03o", c);
+        } else {
+          g_string_append_c (code, (gchar) c);
+        }
+    }
+    piece_len++;
+    if (c == '\n' && i + 1 < length) {
+      piece_len = CODEGEN_STRING_PIECE_LEN;
+    }
+  }
+  g_string_append_c (code, '"');
+}
+
+/* gets the C expression of the escape mode @escape */
+static const gchar *
+codegen_escape_mode (gint escape)
+{
+  switch (escape) {
+    case CTPL_ESCAPE_NONE:  return "CTPL_ESCAPE_NONE";
+    case CTPL_ESCAPE_HTML:  return "CTPL_ESCAPE_HTML";
+    case CTPL_ESCAPE_URL:   return "CTPL_ESCAPE_URL";
+    case CTPL_ESCAPE_JSON:  return "CTPL_ESCAPE_JSON";
+    case CTPL_ESCAPE_SHELL: return "CTPL_ESCAPE_SHELL";
+  }
+  
+  return "ctpl_output_stream_get_escape_mode (output)";
+}
+
+/* gets the C constant of the operator @op */
+static const gchar *
+codegen_operator (CtplOperator op)
+{
+  switch (op) {
+    case CTPL_OPERATOR_AND:    return "CTPL_OPERATOR_AND";
+    case CTPL_OPERATOR_DIV:    return "CTPL_OPERATOR_DIV";
+    case CTPL_OPERATOR_EQUAL:  return "CTPL_OPERATOR_EQUAL";
+    case CTPL_OPERATOR_INFEQ:  return "CTPL_OPERATOR_INFEQ";
+    case CTPL_OPERATOR_INF:    return "CTPL_OPERATOR_INF";
+    case CTPL_OPERATOR_MINUS:  return "CTPL_OPERATOR_MINUS";
+    case CTPL_OPERATOR_MODULO: return "CTPL_OPERATOR_MODULO";
+    case CTPL_OPERATOR_MUL:    return "CTPL_OPERATOR_MUL";
+    case CTPL_OPERATOR_NEQ:    return "CTPL_OPERATOR_NEQ";
+    case CTPL_OPERATOR_OR:     return "CTPL_OPERATOR_OR";
+    case CTPL_OPERATOR_PLUS:   return "CTPL_OPERATOR_PLUS";
+    case CTPL_OPERATOR_SUPEQ:  return "CTPL_OPERATOR_SUPEQ";
+    case CTPL_OPERATOR_SUP:    return "CTPL_OPERATOR_SUP";
+    case CTPL_OPERATOR_NONE:   break;
+  }
+  
+  return "CTPL_OPERATOR_NONE";
+}
+
+/* gets a new temporary value in @ce */
+static gchar *
+codegen_expr_new_value (CodegenExpr *ce)
+{
+  return g_strdup_printf ("&v[%u]", ce->n_values++);
+}
+
+/* writes code setting @target to @value */
+static void
+codegen_value (CodegenExpr     *ce,
+               const CtplValue *value,
+               const gchar     *target)
+{
+  switch (ctpl_value_get_held_type (value)) {
+    case CTPL_VTYPE_INT: {
+      glong i = ctpl_value_get_int (value);
+      
+      if (i == G_MINLONG) {
+        codegen_line (ce->code, 2, "ctpl_value_set_int (%s, G_MINLONG);",
+                      target);
+      } else {
+        codegen_line (ce->code, 2, "ctpl_value_set_int (%s, %ldL);",
+                      target, i);
+      }
+      break;
+    }
+    
+    case CTPL_VTYPE_FLOAT: {
+      gdouble f = ctpl_value_get_float (value);
+      
+      if (f != f || f > G_MAXDOUBLE || f < -G_MAXDOUBLE) {
+        /* there is no portable literal for these */
+        codegen_line (ce->code, 2,
+                      "ctpl_value_set_float (%s, "
+                                            "g_ascii_strtod (\"%s\", NULL));",
+                      target, f != f ? "nan" : f > 0 ? "inf" : "-inf");
+      } else {
+        gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+        
+        /* 17 significant digits are enough for any double to read back */
+        codegen_line (ce->code, 2, "ctpl_value_set_float (%s, %s);", target,
+                      g_ascii_formatd (buf, sizeof buf, "%.17g", f));
+      }
+      break;
+    }
+    
+    case CTPL_VTYPE_STRING: {
+      const gchar *str = ctpl_value_get_string (value);
+      
+      g_string_append_printf (ce->code, "  ctpl_value_set_string (%s, ",
+                              target);
+      codegen_string (ce->code, str, strlen (str), 4);
+      g_string_append (ce->code, ");\n");
+      break;
+    }
+    
+    case CTPL_VTYPE_ARRAY: {
+      const GSList *item;
+      
+      codegen_line (ce->code, 2,
+                    "ctpl_value_set_array (%s, CTPL_VTYPE_INT, 0, NULL);",
+                    target);
+      for (item = ctpl_value_get_array (value); item; item = item->next) {
+        gchar *item_value = codegen_expr_new_value (ce);
+        
+        codegen_value (ce, item->data, item_value);
+        codegen_line (ce->code, 2, "ctpl_value_array_append (%s, %s);",
+                      target, item_value);
+        g_free (item_value);
+      }
+      break;
+    }
+  }
+}
+
+/* writes code computing @expr into @target */
+static void
+codegen_expr_to (CodegenExpr          *ce,
+                 const CtplTokenExpr  *expr,
+                 const gchar          *target)
+{
+  const GSList *indexes;
+  
+  switch (expr->type) {
+    case CTPL_TOKEN_EXPR_TYPE_VALUE:
+      codegen_value (ce, &expr->token.t_value, target);
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_SYMBOL:
+      g_string_append (ce->code, "  rv = rv && ctpl_eval_lookup (env, ");
+      codegen_string (ce->code, expr->token.t_symbol,
+                      strlen (expr->token.t_symbol), 4);
+      g_string_append_printf (ce->code, ", %s, error);\n", target);
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_OPERATOR: {
+      const CtplTokenExprOperator  *op = expr->token.t_operator;
+      gchar                        *lvalue = codegen_expr_new_value (ce);
+      gchar                        *rvalue = codegen_expr_new_value (ce);
+      
+      codegen_expr_to (ce, op->loperand, lvalue);
+      codegen_expr_to (ce, op->roperand, rvalue);
+      codegen_line (ce->code, 2,
+                    "rv = rv && ctpl_eval_operator_values (%s, %s, %s, %s,",
+                    codegen_operator (op->operator), lvalue, rvalue, target);
+      codegen_line (ce->code, 40, "error);");
+      g_free (lvalue);
+      g_free (rvalue);
+      break;
+    }
+    
+    case CTPL_TOKEN_EXPR_TYPE_CALL: {
+      const CtplTokenExprCall  *call = expr->token.t_call;
+      const GSList             *arg;
+      guint                     first = ce->n_values;
+      guint                     i = first;
+      
+      /* the arguments are computed in consecutive values, to be passed as an
+       * array */
+      ce->n_values += call->n_args;
+      for (arg = call->args; arg; arg = arg->next) {
+        gchar *arg_value = g_strdup_printf ("&v[%u]", i++);
+        
+        codegen_expr_to (ce, arg->data, arg_value);
+        g_free (arg_value);
+      }
+      g_string_append (ce->code, "  rv = rv && ctpl_function_call (");
+      codegen_string (ce->code, call->name, strlen (call->name), 4);
+      if (call->n_args > 0) {
+        g_string_append_printf (ce->code, ", &v[%u], %u, %s, error);\n",
+                                first, call->n_args, target);
+      } else {
+        g_string_append_printf (ce->code, ", NULL, 0, %s, error);\n", target);
+      }
+      break;
+    }
+  }
+  for (indexes = expr->indexes; indexes; indexes = indexes->next) {
+    gchar *index_value = codegen_expr_new_value (ce);
+    
+    /* like ctpl_eval_value(), check the value can be indexed before computing
+     * the index, not to report another error */
+    codegen_line (ce->code, 2,
+                  "rv = rv && (CTPL_VALUE_HOLDS_ARRAY (%s) ||", target);
+    codegen_line (ce->code, 14, "ctpl_eval_index_value (%s, %s, error));",
+                  target, index_value);
+    codegen_expr_to (ce, indexes->data, index_value);
+    codegen_line (ce->code, 2,
+                  "rv = rv && ctpl_eval_index_value (%s, %s, error);",
+                  target, index_value);
+    g_free (index_value);
+  }
+}
+
+/* writes a function computing @expr, and returns its number */
+static guint
+codegen_expr (Codegen              *cg,
+              const CtplTokenExpr  *expr)
+{
+  CodegenExpr ce;
+  guint       n = cg->n_exprs++;
+  gint        pad;
+  
+  ce.code = g_string_new (NULL);
+  ce.n_values = 0;
+  codegen_expr_to (&ce, expr, "value");
+  
+  pad = (gint) (strlen (cg->name) + strlen ("_expr_ (") +
+                g_snprintf (NULL, 0, "%u", n));
+  g_string_append_printf (cg->decls,
+                          "static gboolean\n"
+                          "%s_expr_%u (CtplEnviron  *env G_GNUC_UNUSED,\n"
+                          "%*sCtplValue    *value,\n"
+                          "%*sGError      **error G_GNUC_UNUSED)\n"
+                          "{\n",
+                          cg->name, n, pad, "", pad, "");
+  if (ce.n_values > 0) {
+    g_string_append_printf (cg->decls,
+                            "  CtplValue v[%u];\n"
+                            "  gboolean  rv = TRUE;\n"
+                            "  guint     i;\n"
+                            "\n"
+                            "  for (i = 0; i < G_N_ELEMENTS (v); i++) {\n"
+                            "    ctpl_value_init (&v[i]);\n"
+                            "  }\n"
+                            "%s"
+                            "  for (i = 0; i < G_N_ELEMENTS (v); i++) {\n"
+                            "    ctpl_value_free_value (&v[i]);\n"
+                            "  }\n",
+                            ce.n_values, ce.code->str);
+  } else {
+    g_string_append_printf (cg->decls,
+                            "  gboolean rv = TRUE;\n"
+                            "\n"
+                            "%s",
+                            ce.code->str);
+  }
+  g_string_append (cg->decls,
+                   "\n"
+                   "  return rv;\n"
+                   "}\n"
+                   "\n");
+  g_string_free (ce.code, TRUE);
+  
+  return n;
+}
+
+static void   codegen_tree  (Codegen         *cg,
+                             const CtplToken *tree,
+                             guint            indent,
+                             guint            level);
+
+/* writes the code rendering a data token */
+static void
+codegen_token_data (Codegen              *cg,
+                    const CtplTokenData  *data,
+                    guint                 indent)
+{
+  guint n = cg->n_data++;
+  
+  g_string_append_printf (cg->decls, "static const gchar %s_data_%u[] =\n  ",
+                          cg->name, n);
+  codegen_string (cg->decls, data->data, data->length, 2);
+  g_string_append (cg->decls, ";\n\n");
+  
+  codegen_line (cg->body, indent,
+                "rv = rv && ctpl_output_stream_write (output, %s_data_%u,",
+                cg->name, n);
+  codegen_line (cg->body, indent + 37,
+                "(gssize) (sizeof %s_data_%u - 1),", cg->name, n);
+  codegen_line (cg->body, indent + 37, "error);");
+}
+
+/* writes the code rendering an expression token */
+static void
+codegen_token_expr (Codegen              *cg,
+                    const CtplTokenExpr  *expr,
+                    gint                  escape,
+                    guint                 indent,
+                    guint                 level)
+{
+  guint n = codegen_expr (cg, expr);
+  
+  codegen_line (cg->body, indent, "if (rv) {");
+  codegen_line (cg->body, indent + 2, "CtplValue value_%u;", level);
+  g_string_append_c (cg->body, '\n');
+  codegen_line (cg->body, indent + 2, "ctpl_value_init (&value_%u);", level);
+  codegen_line (cg->body, indent + 2,
+                "rv = (%s_expr_%u (env, &value_%u, error) &&",
+                cg->name, n, level);
+  codegen_line (cg->body, indent + 8,
+                "ctpl_parser_write_value (&value_%u, %s, output, error));",
+                level, codegen_escape_mode (escape));
+  codegen_line (cg->body, indent + 2, "ctpl_value_free_value (&value_%u);",
+                level);
+  codegen_line (cg->body, indent, "}");
+}
+
+/* writes the code rendering a `for` token */
+static void
+codegen_token_for (Codegen            *cg,
+                   const CtplTokenFor *token,
+                   guint               indent,
+                   guint               level)
+{
+  guint n = codegen_expr (cg, token->array);
+  
+  codegen_line (cg->body, indent, "if (rv) {");
+  codegen_line (cg->body, indent + 2, "CtplValue array_%u;", level);
+  g_string_append_c (cg->body, '\n');
+  codegen_line (cg->body, indent + 2, "ctpl_value_init (&array_%u);", level);
+  codegen_line (cg->body, indent + 2,
+                "rv = (%s_expr_%u (env, &array_%u, error) &&",
+                cg->name, n, level);
+  codegen_line (cg->body, indent + 8,
+                "ctpl_parser_check_loop_array (&array_%u, error));", level);
+  codegen_line (cg->body, indent + 2, "if (rv) {");
+  codegen_line (cg->body, indent + 4, "const GSList *item_%u;", level);
+  g_string_append_c (cg->body, '\n');
+  codegen_line (cg->body, indent + 4,
+                "for (item_%u = ctpl_value_get_array (&array_%u);",
+                level, level);
+  codegen_line (cg->body, indent + 9, "rv && item_%u;", level);
+  codegen_line (cg->body, indent + 9, "item_%u = item_%u->next) {",
+                level, level);
+  g_string_append_printf (cg->body, "%*sctpl_environ_push (env, ",
+                          (gint) indent + 6, "");
+  codegen_string (cg->body, token->iter, strlen (token->iter), indent + 8);
+  g_string_append_printf (cg->body, ", item_%u->data);\n", level);
+  codegen_tree (cg, token->children, indent + 6, level + 1);
+  g_string_append_printf (cg->body, "%*sctpl_environ_pop (env, ",
+                          (gint) indent + 6, "");
+  codegen_string (cg->body, token->iter, strlen (token->iter), indent + 8);
+  g_string_append (cg->body, ", NULL);\n");
+  codegen_line (cg->body, indent + 4, "}");
+  codegen_line (cg->body, indent + 2, "}");
+  codegen_line (cg->body, indent + 2, "ctpl_value_free_value (&array_%u);",
+                level);
+  codegen_line (cg->body, indent, "}");
+}
+
+/* writes the code rendering an `if` token */
+static void
+codegen_token_if (Codegen           *cg,
+                  const CtplTokenIf *token,
+                  guint              indent,
+                  guint              level)
+{
+  guint n = codegen_expr (cg, token->condition);
+  
+  codegen_line (cg->body, indent, "if (rv) {");
+  codegen_line (cg->body, indent + 2, "CtplValue value_%u;", level);
+  codegen_line (cg->body, indent + 2, "gboolean  cond_%u = FALSE;", level);
+  g_string_append_c (cg->body, '\n');
+  codegen_line (cg->body, indent + 2, "ctpl_value_init (&value_%u);", level);
+  codegen_line (cg->body, indent + 2,
+                "rv = %s_expr_%u (env, &value_%u, error);",
+                cg->name, n, level);
+  codegen_line (cg->body, indent + 2, "if (rv) {");
+  codegen_line (cg->body, indent + 4,
+                "cond_%u = ctpl_eval_bool_value (&value_%u);", level, level);
+  codegen_line (cg->body, indent + 2, "}");
+  codegen_line (cg->body, indent + 2, "ctpl_value_free_value (&value_%u);",
+                level);
+  if (token->if_children) {
+    codegen_line (cg->body, indent + 2, "if (rv && cond_%u) {", level);
+    codegen_tree (cg, token->if_children, indent + 4, level + 1);
+    codegen_line (cg->body, indent + 2, "}");
+  }
+  if (token->else_children) {
+    codegen_line (cg->body, indent + 2, "if (rv && ! cond_%u) {", level);
+    codegen_tree (cg, token->else_children, indent + 4, level + 1);
+    codegen_line (cg->body, indent + 2, "}");
+  }
+  codegen_line (cg->body, indent, "}");
+}
+
+/* writes the code rendering the tokens of @tree */
+static void
+codegen_tree (Codegen         *cg,
+              const CtplToken *tree,
+              guint            indent,
+              guint            level)
+{
+  for (; tree; tree = tree->next) {
+    switch (ctpl_token_get_type (tree)) {
+      case CTPL_TOKEN_TYPE_DATA:
+        codegen_token_data (cg, tree->token.t_data, indent);
+        break;
+      
+      case CTPL_TOKEN_TYPE_FOR:
+        codegen_token_for (cg, tree->token.t_for, indent, level);
+        break;
+      
+      case CTPL_TOKEN_TYPE_IF:
+        codegen_token_if (cg, tree->token.t_if, indent, level);
+        break;
+      
+      case CTPL_TOKEN_TYPE_EXPR:
+        codegen_token_expr (cg, tree->token.t_expr, tree->escape, indent,
+                            level);
+        break;
+      
+      case CTPL_TOKEN_TYPE_CACHE:
+        /* the output of cache blocks is not cached, it is rendered as is */
+        codegen_tree (cg, tree->token.t_cache->children, indent, level);
+        break;
+      
+      default:
+        g_critical ("Invalid/unknown token type %d",
+                    ctpl_token_get_type (tree));
+        g_assert_not_reached ();
+    }
+  }
+}
+
+/**
+ * ctpl_codegen_emit_c:
+ * @tree: A #CtplToken tree
+ * @function_name: The name of the C function to write
+ * @output: A #CtplOutputStream where write the code
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes the C source code of a function named @function_name that renders
+ * @tree. See the <link linkend="ctpl-codegen.description">description of
+ * this section</link> for details.
+ * 
+ * The code includes <code>&lt;ctpl/ctpl.h&gt;</code> and only defines
+ * @function_name, all the other symbols it defines are static and prefixed
+ * with @function_name.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_codegen_emit_c (const CtplToken   *tree,
+                     const gchar       *function_name,
+                     CtplOutputStream  *output,
+                     GError           **error)
+{
+  Codegen   cg;
+  GString  *code;
+  gint      len;
+  gboolean  rv;
+  
+  g_return_val_if_fail (function_name != NULL, FALSE);
+  
+  if (! codegen_is_identifier (function_name)) {
+    g_set_error (error, CTPL_CODEGEN_ERROR, CTPL_CODEGEN_ERROR_INVALID_NAME,
+                 _("'%s' is not a valid C function name"), function_name);
+    return FALSE;
+  }
+  
+  cg.name = function_name;
+  cg.decls = g_string_new (NULL);
+  cg.body = g_string_new (NULL);
+  cg.n_data = 0;
+  cg.n_exprs = 0;
+  codegen_tree (&cg, tree, 2, 0);
+  
+  len = (gint) strlen (function_name);
+  code = g_string_new (NULL);
+  g_string_append_printf (code,
+                          "/* Generated by CTPL %d.%d.%d, do not edit. */\n"
+                          "\n"
+                          "#include <ctpl/ctpl.h>\n"
+                          "\n"
+                          "gboolean  %s (CtplEnviron       *env,\n"
+                          "%*sCtplOutputStream  *output,\n"
+                          "%*sGError           **error);\n"
+                          "\n"
+                          "\n"
+                          "%s"
+                          "gboolean\n"
+                          "%s (CtplEnviron       *env G_GNUC_UNUSED,\n"
+                          "%*sCtplOutputStream  *output G_GNUC_UNUSED,\n"
+                          "%*sGError           **error G_GNUC_UNUSED)\n"
+                          "{\n"
+                          "  gboolean rv = TRUE;\n"
+                          "\n"
+                          "%s"
+                          "\n"
+                          "  return rv;\n"
+                          "}\n",
+                          CTPL_MAJOR_VERSION, CTPL_MINOR_VERSION,
+                          CTPL_MICRO_VERSION,
+                          function_name, len + 12, "", len + 12, "",
+                          cg.decls->str,
+                          function_name, len + 2, "", len + 2, "",
+                          cg.body->str);
+  rv = ctpl_output_stream_write (output, code->str, (gssize) code->len, error);
+  g_string_free (code, TRUE);
+  g_string_free (cg.body, TRUE);
+  g_string_free (cg.decls, TRUE);
+  
+  return rv;
+}
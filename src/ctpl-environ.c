@@ -18,6 +18,7 @@
  */
 
 #include "ctpl-environ.h"
+#include "ctpl-environ-private.h"
 #include <glib.h>
 #include "ctpl-i18n.h"
 #include "ctpl-stack.h"
@@ -63,6 +64,12 @@
  * For more details, see the
  * <link linkend="environment-description-syntax">environment description
  * syntax</link>.
+ * 
+ * Each push or pop increments the version of the environment, as given by
+ * ctpl_environ_get_version(), and records it as the version of the symbol.
+ * This allows to know which symbols changed since a given version with
+ * ctpl_environ_get_changes() or ctpl_environ_get_symbol_version(), for example
+ * to only re-render what depends on them.
  */
 
 
@@ -75,7 +82,20 @@ struct _CtplEnviron
 {
   /*<private>*/
   gint            ref_count;
-  GHashTable     *symbol_table; /* hash table containing stacks of symbols */
+  GHashTable     *symbol_table; /* hash table containing EnvironSymbols */
+  CtplEnviron    *parent;       /* environ in which to look up symbols not
+                                 * found in @symbol_table, or %NULL */
+  guint64         version;      /* number of changes made to @symbol_table */
+};
+
+typedef struct _EnvironSymbol EnvironSymbol;
+
+/* a symbol of an environ */
+struct _EnvironSymbol
+{
+  CtplStack  *stack;    /* the values of the symbol */
+  guint64     version;  /* version of the environ when the symbol last
+                         * changed */
 };
 
 
@@ -93,9 +113,12 @@ ctpl_environ_error_quark (void)
 }
 
 static void
-free_stack (void *stack)
+free_symbol (void *data)
 {
-  ctpl_stack_free (stack, (GFreeFunc) ctpl_value_free);
+  EnvironSymbol *symbol = data;
+  
+  ctpl_stack_free (symbol->stack, (GFreeFunc) ctpl_value_free);
+  g_slice_free1 (sizeof *symbol, symbol);
 }
 
 /*
@@ -108,8 +131,10 @@ static void
 ctpl_environ_init (CtplEnviron *env)
 {
   env->ref_count = 1;
+  env->parent = NULL;
+  env->version = 0;
   env->symbol_table = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                             g_free, free_stack);
+                                             g_free, free_symbol);
 }
 
 /**
@@ -132,6 +157,29 @@ ctpl_environ_new (void)
   return env;
 }
 
+/*
+ * ctpl_environ_new_child:
+ * @parent: A #CtplEnviron
+ * 
+ * Creates a new #CtplEnviron that sees all the symbols of @parent, but in which
+ * pushing and popping doesn't affect @parent.
+ * This is used to give each thread rendering a loop concurrently its own scope
+ * for the iterator: @parent is only read, so it must not be modified while the
+ * child is in use.
+ * 
+ * Returns: A new #CtplEnviron.
+ */
+CtplEnviron *
+ctpl_environ_new_child (CtplEnviron *parent)
+{
+  CtplEnviron *env;
+  
+  env = ctpl_environ_new ();
+  env->parent = ctpl_environ_ref (parent);
+  
+  return env;
+}
+
 /**
  * ctpl_environ_ref:
  * @env: a #CtplEnviron
@@ -164,6 +212,9 @@ ctpl_environ_unref (CtplEnviron *env)
 {
   if (g_atomic_int_dec_and_test (&env->ref_count)) {
     g_hash_table_destroy (env->symbol_table);
+    if (env->parent) {
+      ctpl_environ_unref (env->parent);
+    }
     g_slice_free1 (sizeof *env, env);
   }
 }
@@ -181,7 +232,11 @@ static CtplStack *
 ctpl_environ_lookup_stack (const CtplEnviron *env,
                            const gchar       *symbol)
 {
-  return g_hash_table_lookup (env->symbol_table, symbol);
+  EnvironSymbol *sym;
+  
+  sym = g_hash_table_lookup (env->symbol_table, symbol);
+  
+  return sym ? sym->stack : NULL;
 }
 
 /**
@@ -205,6 +260,9 @@ ctpl_environ_lookup (const CtplEnviron *env,
   if (stack) {
     value = ctpl_stack_peek (stack);
   }
+  if (! value && env->parent) {
+    value = (CtplValue *) ctpl_environ_lookup (env->parent, symbol);
+  }
   
   return value;
 }
@@ -227,20 +285,18 @@ ctpl_environ_push (CtplEnviron     *env,
                    const gchar     *symbol,
                    const CtplValue *value)
 {
-  CtplStack *stack;
+  EnvironSymbol *sym;
   
   /* FIXME: perhaps warn if overriding an identifier?
    *        or if the overriding value is not of the same type? */
-  stack = g_hash_table_lookup (env->symbol_table, symbol);
-  if (! stack) {
-    stack = ctpl_stack_new ();
-    if (stack) {
-      g_hash_table_insert (env->symbol_table, g_strdup (symbol), stack);
-    }
-  }
-  if (stack) {
-    ctpl_stack_push (stack, ctpl_value_dup (value));
+  sym = g_hash_table_lookup (env->symbol_table, symbol);
+  if (! sym) {
+    sym = g_slice_alloc (sizeof *sym);
+    sym->stack = ctpl_stack_new ();
+    g_hash_table_insert (env->symbol_table, g_strdup (symbol), sym);
   }
+  ctpl_stack_push (sym->stack, ctpl_value_dup (value));
+  sym->version = ++env->version;
 }
 
 /**
@@ -331,12 +387,15 @@ ctpl_environ_pop (CtplEnviron *env,
                   const gchar *symbol,
                   CtplValue  **poped_value)
 {
-  CtplStack  *stack;
-  CtplValue  *value = NULL;
+  EnvironSymbol *sym;
+  CtplValue     *value = NULL;
   
-  stack = ctpl_environ_lookup_stack (env, symbol);
-  if (stack) {
-    value = ctpl_stack_pop (stack);
+  sym = g_hash_table_lookup (env->symbol_table, symbol);
+  if (sym) {
+    value = ctpl_stack_pop (sym->stack);
+    if (value) {
+      sym->version = ++env->version;
+    }
     if (poped_value) {
       *poped_value = value;
     } else {
@@ -347,6 +406,82 @@ ctpl_environ_pop (CtplEnviron *env,
   return value != NULL;
 }
 
+/**
+ * ctpl_environ_get_version:
+ * @env: A #CtplEnviron
+ * 
+ * Gets the version of a #CtplEnviron. It is incremented each time a symbol is
+ * pushed or popped, starting from 0 for an empty environ.
+ * 
+ * Returns: The current version of @env.
+ * 
+ * Since: 0.4
+ */
+guint64
+ctpl_environ_get_version (const CtplEnviron *env)
+{
+  return env->version;
+}
+
+/**
+ * ctpl_environ_get_symbol_version:
+ * @env: A #CtplEnviron
+ * @symbol: A symbol name
+ * 
+ * Gets the version @env had when @symbol was last pushed or popped.
+ * A symbol changed since a version if its own version is greater.
+ * 
+ * Returns: The version of @symbol, or 0 if it was never pushed.
+ * 
+ * Since: 0.4
+ */
+guint64
+ctpl_environ_get_symbol_version (const CtplEnviron *env,
+                                 const gchar       *symbol)
+{
+  EnvironSymbol *sym;
+  
+  sym = g_hash_table_lookup (env->symbol_table, symbol);
+  
+  return sym ? sym->version : 0;
+}
+
+/**
+ * ctpl_environ_get_changes:
+ * @env: A #CtplEnviron
+ * @since: A version of @env, as returned by ctpl_environ_get_version()
+ * 
+ * Gets the symbols that were pushed or popped after @env reached version
+ * @since.
+ * 
+ * Returns: (array zero-terminated=1) (transfer full): A %NULL-terminated
+ *          array of symbol names, that should be freed with g_strfreev().
+ * 
+ * Since: 0.4
+ */
+gchar **
+ctpl_environ_get_changes (const CtplEnviron *env,
+                          guint64            since)
+{
+  GPtrArray *changes = g_ptr_array_new ();
+  
+  if (since < env->version) {
+    GHashTableIter  iter;
+    gpointer        symbol;
+    gpointer        sym;
+    
+    g_hash_table_iter_init (&iter, env->symbol_table);
+    while (g_hash_table_iter_next (&iter, &symbol, &sym)) {
+      if (((EnvironSymbol *) sym)->version > since) {
+        g_ptr_array_add (changes, g_strdup (symbol));
+      }
+    }
+  }
+  g_ptr_array_add (changes, NULL);
+  
+  return (gchar **) g_ptr_array_free (changes, FALSE);
+}
+
 /* data for ctpl_environ_foreach() */
 struct _CtplEnvironForeachData
 {
@@ -359,7 +494,7 @@ struct _CtplEnvironForeachData
 /* callback for ctpl_environ_foreach() */
 static void
 ctpl_environ_foreach_hfunc (gpointer  symbol,
-                            gpointer  stack,
+                            gpointer  sym,
                             gpointer  user_data)
 {
   struct _CtplEnvironForeachData *data = user_data;
@@ -367,7 +502,7 @@ ctpl_environ_foreach_hfunc (gpointer  symbol,
   if (data->run) {
     CtplValue *value;
     
-    value = ctpl_stack_peek (stack);
+    value = ctpl_stack_peek (((EnvironSymbol *) sym)->stack);
     if (value) {
       data->run = data->func (data->env, symbol, value, data->user_data);
     }
@@ -406,7 +541,7 @@ struct _CtplEnvironMergeData
 /* callback for ctpl_environ_merge() */
 static void
 ctpl_environ_merge_hfunc (gpointer  symbol,
-                          gpointer  stack,
+                          gpointer  sym,
                           gpointer  user_data)
 {
   struct _CtplEnvironMergeData *data = user_data;
@@ -417,7 +552,7 @@ ctpl_environ_merge_hfunc (gpointer  symbol,
     CtplValue *value;
     
     /* FIXME: merge the whole stack and not its top value */
-    value = ctpl_stack_peek (stack);
+    value = ctpl_stack_peek (((EnvironSymbol *) sym)->stack);
     if (value) {
       ctpl_environ_push (data->env, symbol, value);
     }
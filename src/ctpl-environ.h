@@ -97,6 +97,12 @@ void              ctpl_environ_push_string      (CtplEnviron     *env,
 gboolean          ctpl_environ_pop              (CtplEnviron *env,
                                                  const gchar *symbol,
                                                  CtplValue  **poped_value);
+guint64           ctpl_environ_get_version      (const CtplEnviron *env);
+guint64           ctpl_environ_get_symbol_version
+                                                (const CtplEnviron *env,
+                                                 const gchar       *symbol);
+gchar           **ctpl_environ_get_changes      (const CtplEnviron *env,
+                                                 guint64            since);
 void              ctpl_environ_foreach          (CtplEnviron           *env,
                                                  CtplEnvironForeachFunc func,
                                                  gpointer               user_data);
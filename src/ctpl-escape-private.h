@@ -0,0 +1,57 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#ifndef H_CTPL_ESCAPE_PRIVATE_H
+#define H_CTPL_ESCAPE_PRIVATE_H
+
+#include <glib.h>
+#include "ctpl-escape.h"
+
+G_BEGIN_DECLS
+
+
+/*
+ * CtplEscapeWriteFunc:
+ * @user_data: The user data passed to ctpl_escape_write()
+ * @data: Some escaped data
+ * @length: The length of @data
+ * @error: Return location for errors
+ * 
+ * Writes a piece of escaped data.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+typedef gboolean  (*CtplEscapeWriteFunc)  (gpointer      user_data,
+                                           const gchar  *data,
+                                           gsize         length,
+                                           GError      **error);
+
+G_GNUC_INTERNAL
+gboolean    ctpl_escape_write   (CtplEscapeMode        mode,
+                                 const gchar          *data,
+                                 gsize                 length,
+                                 CtplEscapeWriteFunc   func,
+                                 gpointer              user_data,
+                                 GError              **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,420 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "ctpl-escape.h"
+#include "ctpl-escape-private.h"
+#include <glib.h>
+#include <string.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+
+/**
+ * SECTION: escape
+ * @short_description: Escaping of output values
+ * @include: ctpl/ctpl.h
+ * 
+ * Escapes the values output by expressions so they can be safely embedded in
+ * HTML, URLs, JSON strings or shell commands, without having to escape the
+ * values stored in the environment.
+ * 
+ * The escape mode applies to the values of expressions only, never to the raw
+ * data of the template. It can be set for a whole output with
+ * ctpl_output_stream_set_escape_mode() and overridden for each expression
+ * with the <code>{expression|mode}</code> syntax, where <code>mode</code> is
+ * one of the names returned by ctpl_escape_mode_to_string().
+ * 
+ * Values are scanned 16 bytes at a time where SSE2 is available, so that the
+ * runs that need no escaping are found quickly and written in bulk.
+ */
+
+
+/* indexed by CtplEscapeMode */
+static const gchar *const escape_mode_names[] = {
+  "none",
+  "html",
+  "url",
+  "json",
+  "shell"
+};
+
+
+/* whether @c has to be escaped in @mode.  For the shell mode, this tells
+ * whether @c requires the value to be quoted */
+static inline gboolean
+escape_needed (CtplEscapeMode mode,
+               guchar         c)
+{
+  switch (mode) {
+    case CTPL_ESCAPE_HTML:
+      return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+    
+    case CTPL_ESCAPE_URL:
+      return ! (g_ascii_isalnum (c) ||
+                c == '-' || c == '.' || c == '_' || c == '~');
+    
+    case CTPL_ESCAPE_JSON:
+      return c < 0x20 || c == '"' || c == '\\';
+    
+    case CTPL_ESCAPE_SHELL:
+      return ! (g_ascii_isalnum (c) ||
+                c == '-' || c == '.' || c == '_' || c == '/' || c == ',' ||
+                c == ':' || c == '+' || c == '@' || c == '=' || c == '%');
+    
+    default:
+      return FALSE;
+  }
+}
+
+#ifdef __SSE2__
+
+/* mask of the bytes of @v equal to @c */
+static inline __m128i
+sse2_eq (__m128i  v,
+         gchar    c)
+{
+  return _mm_cmpeq_epi8 (v, _mm_set1_epi8 (c));
+}
+
+/* mask of the bytes of @v in the [@lo, @hi] range */
+static inline __m128i
+sse2_in_range (__m128i  v,
+               guchar   lo,
+               guchar   hi)
+{
+  __m128i off = _mm_sub_epi8 (v, _mm_set1_epi8 ((gchar) lo));
+  
+  return _mm_cmpeq_epi8 (_mm_min_epu8 (off, _mm_set1_epi8 ((gchar) (hi - lo))),
+                         off);
+}
+
+/* mask of the ASCII alphanumeric bytes of @v */
+static inline __m128i
+sse2_alnum (__m128i v)
+{
+  return _mm_or_si128 (sse2_in_range (v, '0', '9'),
+                       sse2_in_range (_mm_or_si128 (v, _mm_set1_epi8 (0x20)),
+                                      'a', 'z'));
+}
+
+/* gets a bit mask of the bytes of @v that escape_needed() */
+static inline guint
+sse2_escape_needed (CtplEscapeMode  mode,
+                    __m128i         v)
+{
+  __m128i m;
+  
+  switch (mode) {
+    case CTPL_ESCAPE_HTML:
+      m = _mm_or_si128 (_mm_or_si128 (sse2_eq (v, '&'), sse2_eq (v, '<')),
+                        _mm_or_si128 (_mm_or_si128 (sse2_eq (v, '>'),
+                                                    sse2_eq (v, '"')),
+                                      sse2_eq (v, '\'')));
+      return (guint) _mm_movemask_epi8 (m);
+    
+    case CTPL_ESCAPE_URL:
+      m = _mm_or_si128 (_mm_or_si128 (sse2_alnum (v), sse2_eq (v, '~')),
+                        _mm_or_si128 (sse2_in_range (v, '-', '.'),
+                                      sse2_eq (v, '_')));
+      return (guint) _mm_movemask_epi8 (m) ^ 0xffff;
+    
+    case CTPL_ESCAPE_JSON:
+      m = _mm_or_si128 (sse2_in_range (v, 0x00, 0x1f),
+                        _mm_or_si128 (sse2_eq (v, '"'), sse2_eq (v, '\\')));
+      return (guint) _mm_movemask_epi8 (m);
+    
+    case CTPL_ESCAPE_SHELL:
+      /* + , - . / are contiguous in ASCII, and so are : and = with @ */
+      m = _mm_or_si128 (_mm_or_si128 (sse2_alnum (v), sse2_eq (v, '_')),
+                        _mm_or_si128 (_mm_or_si128 (sse2_in_range (v, '+', '/'),
+                                                    sse2_eq (v, ':')),
+                                      _mm_or_si128 (_mm_or_si128 (sse2_eq (v, '='),
+                                                                  sse2_eq (v, '@')),
+                                                    sse2_eq (v, '%'))));
+      return (guint) _mm_movemask_epi8 (m) ^ 0xffff;
+    
+    default:
+      return 0;
+  }
+}
+
+#endif /* __SSE2__ */
+
+/* gets the length of the run at the start of @data that needs no escaping */
+static gsize
+escape_span (CtplEscapeMode mode,
+             const gchar   *data,
+             gsize          length)
+{
+  gsize i = 0;
+  
+#ifdef __SSE2__
+  for (; i + 16 <= length; i += 16) {
+    guint mask;
+    
+    mask = sse2_escape_needed (mode,
+                               _mm_loadu_si128 ((const __m128i *) &data[i]));
+    if (mask) {
+      return i + (gsize) g_bit_nth_lsf (mask, -1);
+    }
+  }
+#endif
+  while (i < length && ! escape_needed (mode, (guchar) data[i])) {
+    i++;
+  }
+  
+  return i;
+}
+
+/* writes the replacement of @c for @mode in @buf, which must be at least 7
+ * bytes, and returns its length */
+static gsize
+escape_char (CtplEscapeMode mode,
+             guchar         c,
+             gchar         *buf)
+{
+  static const gchar  hex[] = "0123456789ABCDEF";
+  const gchar        *str = NULL;
+  
+  switch (mode) {
+    case CTPL_ESCAPE_HTML:
+      switch (c) {
+        case '&':   str = "&amp;";  break;
+        case '<':   str = "&lt;";   break;
+        case '>':   str = "&gt;";   break;
+        case '"':   str = "&quot;"; break;
+        case '\'':  str = "&#39;";  break;
+      }
+      break;
+    
+    case CTPL_ESCAPE_URL:
+      buf[0] = '%';
+      buf[1] = hex[c >> 4];
+      buf[2] = hex[c & 0xf];
+      return 3;
+    
+    case CTPL_ESCAPE_JSON:
+      switch (c) {
+        case '"':   str = "\\\""; break;
+        case '\\':  str = "\\\\"; break;
+        case '\b':  str = "\\b";  break;
+        case '\f':  str = "\\f";  break;
+        case '\n':  str = "\\n";  break;
+        case '\r':  str = "\\r";  break;
+        case '\t':  str = "\\t";  break;
+        default:
+          memcpy (buf, "\\u00", 4);
+          buf[4] = hex[c >> 4];
+          buf[5] = hex[c & 0xf];
+          return 6;
+      }
+      break;
+    
+    default:
+      break;
+  }
+  if (! str) {
+    buf[0] = (gchar) c;
+    return 1;
+  } else {
+    gsize len = strlen (str);
+    
+    memcpy (buf, str, len);
+    return len;
+  }
+}
+
+/* quotes @data as a single shell word if it contains special characters */
+static gboolean
+escape_write_shell (const gchar          *data,
+                    gsize                 length,
+                    CtplEscapeWriteFunc   func,
+                    gpointer              user_data,
+                    GError              **error)
+{
+  const gchar *quote;
+  
+  if (length > 0 && escape_span (CTPL_ESCAPE_SHELL, data, length) == length) {
+    return func (user_data, data, length, error);
+  }
+  
+  if (! func (user_data, "'", 1, error)) {
+    return FALSE;
+  }
+  while ((quote = memchr (data, '\'', length)) != NULL) {
+    gsize n = (gsize) (quote - data);
+    
+    if (! func (user_data, data, n, error) ||
+        ! func (user_data, "'\\''", 4, error)) {
+      return FALSE;
+    }
+    data += n + 1;
+    length -= n + 1;
+  }
+  
+  return (func (user_data, data, length, error) &&
+          func (user_data, "'", 1, error));
+}
+
+/*
+ * ctpl_escape_write:
+ * @mode: A #CtplEscapeMode
+ * @data: The data to escape
+ * @length: The length of @data
+ * @func: A function to call to write the escaped data
+ * @user_data: Data to pass to @func
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Escapes @data according to @mode, passing the result to @func.
+ * The runs of @data that need no escaping are passed to @func as a whole.
+ * 
+ * Returns: %TRUE on success, %FALSE if @func failed.
+ */
+gboolean
+ctpl_escape_write (CtplEscapeMode        mode,
+                   const gchar          *data,
+                   gsize                 length,
+                   CtplEscapeWriteFunc   func,
+                   gpointer              user_data,
+                   GError              **error)
+{
+  if (mode == CTPL_ESCAPE_NONE) {
+    return func (user_data, data, length, error);
+  } else if (mode == CTPL_ESCAPE_SHELL) {
+    return escape_write_shell (data, length, func, user_data, error);
+  }
+  
+  while (length > 0) {
+    gsize n;
+    
+    n = escape_span (mode, data, length);
+    if (n > 0 && ! func (user_data, data, n, error)) {
+      return FALSE;
+    }
+    data += n;
+    length -= n;
+    if (length > 0) {
+      gchar buf[8];
+      
+      n = escape_char (mode, (guchar) *data, buf);
+      if (! func (user_data, buf, n, error)) {
+        return FALSE;
+      }
+      data++;
+      length--;
+    }
+  }
+  
+  return TRUE;
+}
+
+/**
+ * ctpl_escape_mode_to_string:
+ * @mode: A #CtplEscapeMode
+ * 
+ * Gets the name of an escape mode, as used in templates.
+ * 
+ * Returns: A static string naming @mode, or %NULL if @mode is invalid.
+ * 
+ * Since: 0.4
+ */
+const gchar *
+ctpl_escape_mode_to_string (CtplEscapeMode mode)
+{
+  if ((guint) mode >= G_N_ELEMENTS (escape_mode_names)) {
+    return NULL;
+  }
+  
+  return escape_mode_names[mode];
+}
+
+/**
+ * ctpl_escape_mode_from_string:
+ * @string: The name of an escape mode
+ * @mode: (out): Return location for the escape mode
+ * 
+ * Gets the escape mode named @string, see ctpl_escape_mode_to_string().
+ * 
+ * Returns: %TRUE if @string names an escape mode, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_escape_mode_from_string (const gchar    *string,
+                              CtplEscapeMode *mode)
+{
+  guint i;
+  
+  for (i = 0; i < G_N_ELEMENTS (escape_mode_names); i++) {
+    if (strcmp (string, escape_mode_names[i]) == 0) {
+      *mode = (CtplEscapeMode) i;
+      return TRUE;
+    }
+  }
+  
+  return FALSE;
+}
+
+/* appends to a GString, for ctpl_escape_string() */
+static gboolean
+escape_append (gpointer      user_data,
+               const gchar  *data,
+               gsize         length,
+               GError      **error)
+{
+  g_string_append_len (user_data, data, (gssize) length);
+  
+  return TRUE;
+}
+
+/**
+ * ctpl_escape_string:
+ * @mode: A #CtplEscapeMode
+ * @string: The string to escape
+ * @length: The length of @string, or -1 if it is 0-terminated
+ * 
+ * Escapes a string the same way expression values are escaped in the output.
+ * 
+ * Returns: A newly allocated string holding the escaped version of @string,
+ *          that should be freed with g_free().
+ * 
+ * Since: 0.4
+ */
+gchar *
+ctpl_escape_string (CtplEscapeMode  mode,
+                    const gchar    *string,
+                    gssize          length)
+{
+  GString *escaped;
+  
+  if (length < 0) {
+    length = (gssize) strlen (string);
+  }
+  escaped = g_string_sized_new ((gsize) length);
+  ctpl_escape_write (mode, string, (gsize) length, escape_append, escaped,
+                     NULL);
+  
+  return g_string_free (escaped, FALSE);
+}
@@ -0,0 +1,66 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_ESCAPE_H
+#define H_CTPL_ESCAPE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+/**
+ * CtplEscapeMode:
+ * @CTPL_ESCAPE_NONE: Values are output as-is
+ * @CTPL_ESCAPE_HTML: Characters special in HTML and XML (<code>&amp;</code>,
+ *                    <code>&lt;</code>, <code>&gt;</code>, <code>"</code> and
+ *                    <code>'</code>) are replaced by entities
+ * @CTPL_ESCAPE_URL: Everything but unreserved URL characters is
+ *                   percent-encoded
+ * @CTPL_ESCAPE_JSON: Values are escaped to be used inside a JSON string
+ * @CTPL_ESCAPE_SHELL: Values are quoted to be used as a single shell word
+ * 
+ * How values are escaped when written to the output.
+ * 
+ * Since: 0.4
+ */
+typedef enum _CtplEscapeMode
+{
+  CTPL_ESCAPE_NONE,
+  CTPL_ESCAPE_HTML,
+  CTPL_ESCAPE_URL,
+  CTPL_ESCAPE_JSON,
+  CTPL_ESCAPE_SHELL
+} CtplEscapeMode;
+
+const gchar  *ctpl_escape_mode_to_string    (CtplEscapeMode mode);
+gboolean      ctpl_escape_mode_from_string  (const gchar    *string,
+                                             CtplEscapeMode *mode);
+gchar        *ctpl_escape_string            (CtplEscapeMode  mode,
+                                             const gchar    *string,
+                                             gssize          length);
+
+
+G_END_DECLS
+
+#endif /* guard */
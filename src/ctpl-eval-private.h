@@ -0,0 +1,64 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#ifndef H_CTPL_EVAL_PRIVATE_H
+#define H_CTPL_EVAL_PRIVATE_H
+
+#include <glib.h>
+#include "ctpl-environ.h"
+#include "ctpl-token.h"
+#include "ctpl-value.h"
+
+G_BEGIN_DECLS
+
+
+/*
+ * CtplEvalWriteFunc:
+ * @user_data: The user data passed to ctpl_eval_write()
+ * @data: A piece of the string form of the evaluated expression
+ * @length: The length of @data
+ * @error: Return location for errors
+ * 
+ * Writes a piece of the result of an expression.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+typedef gboolean  (*CtplEvalWriteFunc)  (gpointer      user_data,
+                                         const gchar  *data,
+                                         gsize         length,
+                                         GError      **error);
+
+G_GNUC_INTERNAL
+gboolean    ctpl_eval_write         (const CtplTokenExpr  *expr,
+                                     CtplEnviron          *env,
+                                     CtplEvalWriteFunc     func,
+                                     gpointer              user_data,
+                                     GError              **error);
+G_GNUC_INTERNAL
+gboolean    ctpl_eval_write_value   (const CtplValue    *value,
+                                     glong               repeat,
+                                     CtplEvalWriteFunc   func,
+                                     gpointer            user_data,
+                                     GError            **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -18,11 +18,13 @@
  */
 
 #include "ctpl-eval.h"
+#include "ctpl-eval-private.h"
 #include <string.h>
 #include <glib.h>
 #include "ctpl-i18n.h"
 #include "ctpl-lexer-private.h"
 #include "ctpl-environ.h"
+#include "ctpl-function.h"
 #include "ctpl-value.h"
 #include "ctpl-token.h"
 #include "ctpl-token-private.h"
@@ -41,6 +43,7 @@
  * the result.
  * To evaluate an expression, use ctpl_eval_value(). You can evaluate an
  * expression to a boolean with ctpl_eval_bool().
+ * Function calls in expressions are resolved with ctpl_function_call().
  */
 
 
@@ -58,9 +61,6 @@ ctpl_eval_error_quark (void)
 }
 
 
-static gboolean   ctpl_eval_bool_value      (const CtplValue *value);
-
-
 /* check if value types matches @vtype and try to convert if necessary
  * throw a CTPL_EVAL_ERROR_INVALID_OPERAND if cannot convert to requested type */
 static gboolean
@@ -184,6 +184,27 @@ ctpl_eval_operator_plus (CtplValue *lvalue,
   return rv;
 }
 
+/* checks whether the result of the multiplication of a string of @str_len
+ * bytes by @n (> 1) is small enough for its size to be represented */
+static gboolean
+check_multiply_string (gsize    str_len,
+                       glong    n,
+                       GError **error)
+{
+  /* detect possible integer overflow. last check is because we allocate one
+   * more byte (string termination) */
+  if (G_UNLIKELY ((str_len > 0 && (gsize)n > G_MAXSIZE / str_len) ||
+                  str_len * (gsize)n >= G_MAXSIZE)) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_FAILED,
+                 "String multiplication would overflow allocating "
+                 "%"G_GSIZE_FORMAT"*%"G_GSIZE_FORMAT"+1 bytes",
+                 (gsize)n, str_len);
+    return FALSE;
+  }
+  
+  return TRUE;
+}
+
 /*
  * do_multiply_string:
  * @str: A string to multiply
@@ -213,15 +234,7 @@ do_multiply_string (const gchar  *str,
     gsize       i;
     
     str_len = strlen (str);
-    /* detect possible integer overflow. last check is because we allocate one
-     * more byte (string termination) */
-    if (G_UNLIKELY ((str_len > 0 && (gsize)n > G_MAXSIZE / str_len) ||
-                    str_len * (gsize)n >= G_MAXSIZE)) {
-      g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_FAILED,
-                   "String multiplication would overflow allocating "
-                   "%"G_GSIZE_FORMAT"*%"G_GSIZE_FORMAT"+1 bytes",
-                   (gsize)n, str_len);
-    } else {
+    if (check_multiply_string (str_len, n, error)) {
       buf_len = str_len * (gsize)n;
       buf = g_try_malloc (buf_len + 1);
       if (G_UNLIKELY (! buf)) {
@@ -692,6 +705,93 @@ ctpl_eval_operator (const CtplTokenExpr  *operator,
   return rv;
 }
 
+/**
+ * ctpl_eval_operator_values:
+ * @op: The operator to compute
+ * @lvalue: The left operand
+ * @rvalue: The right operand
+ * @value: #CtplValue where store the result on success
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Computes the operation @op on @lvalue and @rvalue, like it is done when
+ * evaluating an operator expression. The operands may be converted in place to
+ * the types the operator works on.
+ * 
+ * This is mostly useful to code computing expressions without a
+ * #CtplTokenExpr, like the code written by ctpl_codegen_emit_c().
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_eval_operator_values (CtplOperator  op,
+                           CtplValue    *lvalue,
+                           CtplValue    *rvalue,
+                           CtplValue    *value,
+                           GError      **error)
+{
+  g_return_val_if_fail (op < CTPL_OPERATOR_NONE, FALSE);
+  
+  return ctpl_eval_operator_internal (op, lvalue, rvalue, value, error);
+}
+
+/**
+ * ctpl_eval_index_value:
+ * @value: An array #CtplValue, replaced with the indexed item on success
+ * @index_value: The index, converted in place to an integer
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Indexes @value at @index_value, like it is done when evaluating an
+ * expression followed by an index. @value is freed on error.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_eval_index_value (CtplValue  *value,
+                       CtplValue  *index_value,
+                       GError    **error)
+{
+  gboolean  rv = FALSE;
+  gchar    *value_str = NULL;
+  
+  #define VALUE_AS_STRING (value_str = ctpl_value_to_string (value))
+  
+  /* FIXME: improve error messages? */
+  if (! CTPL_VALUE_HOLDS_ARRAY (value)) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+                 _("Value '%s' cannot be indexed"), VALUE_AS_STRING);
+  } else if (! ctpl_value_convert (index_value, CTPL_VTYPE_INT)) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+                 _("Cannot convert index of value '%s' to integer"),
+                 VALUE_AS_STRING);
+  } else {
+    const CtplValue  *new_value;
+    glong             idx = ctpl_value_get_int (index_value);
+    
+    if (idx < 0 ||
+        ! (new_value = ctpl_value_array_index (value, (gsize)idx))) {
+      g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_FAILED,
+                   _("Cannot index value '%s' at %ld"),
+                   VALUE_AS_STRING, idx);
+    } else {
+      ctpl_value_copy (new_value, value);
+      rv = TRUE;
+    }
+  }
+  
+  #undef VALUE_AS_STRING
+  
+  g_free (value_str);
+  if (! rv) {
+    ctpl_value_free_value (value);
+  }
+  
+  return rv;
+}
+
 static gboolean
 ctpl_eval_value_index (const CtplTokenExpr  *expr,
                        CtplEnviron          *env,
@@ -702,48 +802,103 @@ ctpl_eval_value_index (const CtplTokenExpr  *expr,
   GSList   *indexes;
   
   for (indexes = expr->indexes; rv && indexes; indexes = indexes->next) {
-    gchar *value_str = NULL;
-    
-    #define VALUE_AS_STRING (value_str = ctpl_value_to_string (value))
+    CtplValue idx_value;
     
-    rv = FALSE;
-    /* FIXME: improve error messages? */
+    ctpl_value_init (&idx_value);
     if (! CTPL_VALUE_HOLDS_ARRAY (value)) {
-      g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
-                   _("Value '%s' cannot be indexed"), VALUE_AS_STRING);
+      /* report the error before evaluating the index */
+      rv = ctpl_eval_index_value (value, &idx_value, error);
+    } else if (! ctpl_eval_value (indexes->data, env, &idx_value, error)) {
+      ctpl_value_free_value (value);
+      rv = FALSE;
     } else {
-      CtplValue idx_value;
-      
-      ctpl_value_init (&idx_value);
-      if (ctpl_eval_value (indexes->data, env, &idx_value, error)) {
-        if (! ctpl_value_convert (&idx_value, CTPL_VTYPE_INT)) {
-          g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
-                       _("Cannot convert index of value '%s' to integer"),
-                       VALUE_AS_STRING);
-        } else {
-          const CtplValue  *new_value;
-          glong             idx = ctpl_value_get_int (&idx_value);
-          
-          if (idx < 0 ||
-              ! (new_value = ctpl_value_array_index (value, (gsize)idx))) {
-            g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_FAILED,
-                         _("Cannot index value '%s' at %ld"),
-                         VALUE_AS_STRING, idx);
-          } else {
-            ctpl_value_copy (new_value, value);
-            rv = TRUE;
-          }
-        }
-        ctpl_value_free_value (&idx_value);
-      }
+      rv = ctpl_eval_index_value (value, &idx_value, error);
     }
-    
-    #undef VALUE_AS_STRING
-    
-    g_free (value_str);
+    ctpl_value_free_value (&idx_value);
   }
-  if (! rv) {
-    ctpl_value_free_value (value);
+  
+  return rv;
+}
+
+/* looks up the value of @symbol in @env */
+static const CtplValue *
+ctpl_eval_lookup_symbol (const gchar  *symbol,
+                         CtplEnviron  *env,
+                         GError      **error)
+{
+  const CtplValue *value;
+  
+  value = ctpl_environ_lookup (env, symbol);
+  if (! value) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND,
+                 _("Symbol '%s' cannot be found in the environment"),
+                 symbol);
+  }
+  
+  return value;
+}
+
+/**
+ * ctpl_eval_lookup:
+ * @env: A #CtplEnviron
+ * @symbol: The name of a symbol
+ * @value: #CtplValue where store the value of @symbol on success
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Gets the value of @symbol in @env like it is done when evaluating a symbol
+ * expression, that is reporting a %CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND error if
+ * the symbol is not defined.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_eval_lookup (CtplEnviron  *env,
+                  const gchar  *symbol,
+                  CtplValue    *value,
+                  GError      **error)
+{
+  const CtplValue *symbol_value;
+  
+  symbol_value = ctpl_eval_lookup_symbol (symbol, env, error);
+  if (symbol_value) {
+    ctpl_value_copy (symbol_value, value);
+  }
+  
+  return symbol_value != NULL;
+}
+
+/* evaluates the arguments of @call and calls the function with them */
+static gboolean
+ctpl_eval_call (const CtplTokenExprCall  *call,
+                CtplEnviron              *env,
+                CtplValue                *value,
+                GError                  **error)
+{
+  gboolean      rv = TRUE;
+  CtplValue     stack_args[8];
+  CtplValue    *args = stack_args;
+  guint         n_args = 0;
+  guint         i;
+  const GSList *arg;
+  
+  /* most calls have few arguments, don't allocate them */
+  if (call->n_args > G_N_ELEMENTS (stack_args)) {
+    args = g_new (CtplValue, call->n_args);
+  }
+  for (arg = call->args; rv && arg; arg = arg->next) {
+    ctpl_value_init (&args[n_args]);
+    rv = ctpl_eval_value (arg->data, env, &args[n_args++], error);
+  }
+  if (rv) {
+    rv = ctpl_function_call (call->name, args, n_args, value, error);
+  }
+  for (i = 0; i < n_args; i++) {
+    ctpl_value_free_value (&args[i]);
+  }
+  if (args != stack_args) {
+    g_free (args);
   }
   
   return rv;
@@ -779,13 +934,11 @@ ctpl_eval_value (const CtplTokenExpr  *expr,
     case CTPL_TOKEN_EXPR_TYPE_SYMBOL: {
       const CtplValue *symbol_value;
       
-      symbol_value = ctpl_environ_lookup (env, expr->token.t_symbol);
+      symbol_value = ctpl_eval_lookup_symbol (expr->token.t_symbol, env,
+                                              error);
       if (symbol_value) {
         ctpl_value_copy (symbol_value, value);
       } else {
-        g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND,
-                     _("Symbol '%s' cannot be found in the environment"),
-                     expr->token.t_symbol);
         rv = FALSE;
       }
       break;
@@ -794,6 +947,10 @@ ctpl_eval_value (const CtplTokenExpr  *expr,
     case CTPL_TOKEN_EXPR_TYPE_OPERATOR:
       rv = ctpl_eval_operator (expr, env, value, error);
       break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_CALL:
+      rv = ctpl_eval_call (expr->token.t_call, env, value, error);
+      break;
   }
   if (rv) {
     rv = ctpl_eval_value_index (expr, env, value, error);
@@ -802,8 +959,19 @@ ctpl_eval_value (const CtplTokenExpr  *expr,
   return rv;
 }
 
-/* Gets a boolean form a value */
-static gboolean
+/**
+ * ctpl_eval_bool_value:
+ * @value: A #CtplValue
+ * 
+ * Gets whether @value is considered true, like ctpl_eval_bool() does with the
+ * value of an expression: empty arrays and strings and null numbers are false,
+ * everything else is true.
+ * 
+ * Returns: The boolean form of @value.
+ * 
+ * Since: 0.4
+ */
+gboolean
 ctpl_eval_bool_value (const CtplValue *value)
 {
   /* Should we allow non-existing symbol check if it is alone? e.g.
@@ -871,3 +1039,272 @@ ctpl_eval_bool (const CtplTokenExpr  *expr,
   
   return rv;
 }
+
+
+/* number of operands of a `+` chain ctpl_eval_write() handles without
+ * allocating memory */
+#define EVAL_WRITE_STACK_PIECES 8
+
+/* whether @expr is a `+` operation whose operands can be written separately */
+#define IS_PLUS_CHAIN(expr)                                                    \
+  ((expr)->type == CTPL_TOKEN_EXPR_TYPE_OPERATOR && ! (expr)->indexes &&       \
+   (expr)->token.t_operator->operator == CTPL_OPERATOR_PLUS)
+
+typedef struct _EvalPiece EvalPiece;
+
+/* an operand of an expression written by ctpl_eval_write() */
+struct _EvalPiece
+{
+  const CtplTokenExpr  *expr;
+  const CtplValue      *value;    /* the value of @expr, possibly borrowed */
+  glong                 repeat;   /* how many times to write @value */
+  CtplValue             storage;  /* holds @value if it is not borrowed */
+};
+
+/* evaluates @expr into @piece, borrowing values from the expression or the
+ * environment rather than copying them when possible */
+static gboolean
+eval_piece_borrow (EvalPiece            *piece,
+                   const CtplTokenExpr  *expr,
+                   CtplEnviron          *env,
+                   GError              **error)
+{
+  gboolean rv = TRUE;
+  
+  piece->value = &piece->storage;
+  piece->repeat = 1;
+  if (expr->indexes) {
+    rv = ctpl_eval_value (expr, env, &piece->storage, error);
+  } else if (expr->type == CTPL_TOKEN_EXPR_TYPE_VALUE) {
+    piece->value = &expr->token.t_value;
+  } else if (expr->type == CTPL_TOKEN_EXPR_TYPE_SYMBOL) {
+    piece->value = ctpl_eval_lookup_symbol (expr->token.t_symbol, env, error);
+    rv = piece->value != NULL;
+  } else {
+    rv = ctpl_eval_value (expr, env, &piece->storage, error);
+  }
+  
+  return rv;
+}
+
+/* tries to evaluate a string multiplication as the string and a repeat count
+ * rather than as the resulting string.
+ * Returns: %TRUE if @piece was filled, %FALSE if @piece's expression is not a
+ *          valid string multiplication.  Errors are not reported, they are
+ *          left to a regular evaluation. */
+static gboolean
+eval_piece_repeat (EvalPiece   *piece,
+                   CtplEnviron *env)
+{
+  const CtplTokenExprOperator  *op = piece->expr->token.t_operator;
+  EvalPiece                     operands[2];
+  gboolean                      handled = FALSE;
+  
+  ctpl_value_init (&operands[0].storage);
+  ctpl_value_init (&operands[1].storage);
+  if (eval_piece_borrow (&operands[0], op->loperand, env, NULL) &&
+      eval_piece_borrow (&operands[1], op->roperand, env, NULL)) {
+    guint             s = CTPL_VALUE_HOLDS_STRING (operands[0].value) ? 0 : 1;
+    const CtplValue  *num = operands[1 - s].value;
+    
+    if (CTPL_VALUE_HOLDS_STRING (operands[s].value) &&
+        (CTPL_VALUE_HOLDS_INT (num) || CTPL_VALUE_HOLDS_FLOAT (num))) {
+      CtplValue count;
+      
+      ctpl_value_init (&count);
+      ctpl_value_copy (num, &count);
+      if (ctpl_value_convert (&count, CTPL_VTYPE_INT)) {
+        glong n = ctpl_value_get_int (&count);
+        
+        if (n <= 1 ||
+            check_multiply_string (strlen (ctpl_value_get_string (operands[s].value)),
+                                   n, NULL)) {
+          /* steal the string operand */
+          piece->storage = operands[s].storage;
+          ctpl_value_init (&operands[s].storage);
+          piece->value = (operands[s].value == &operands[s].storage
+                          ? &piece->storage
+                          : operands[s].value);
+          piece->repeat = MAX (n, 0);
+          handled = TRUE;
+        }
+      }
+      ctpl_value_free_value (&count);
+    }
+  }
+  ctpl_value_free_value (&operands[0].storage);
+  ctpl_value_free_value (&operands[1].storage);
+  
+  return handled;
+}
+
+/* evaluates the operand of @piece */
+static gboolean
+eval_piece (EvalPiece    *piece,
+            CtplEnviron  *env,
+            GError      **error)
+{
+  const CtplTokenExpr *expr = piece->expr;
+  
+  if (expr->type == CTPL_TOKEN_EXPR_TYPE_OPERATOR && ! expr->indexes &&
+      expr->token.t_operator->operator == CTPL_OPERATOR_MUL &&
+      eval_piece_repeat (piece, env)) {
+    return TRUE;
+  }
+  
+  return eval_piece_borrow (piece, expr, env, error);
+}
+
+/*
+ * ctpl_eval_write_value:
+ * @value: A #CtplValue
+ * @repeat: How many times to write @value
+ * @func: A function to call to write @value
+ * @user_data: Data to pass to @func
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes the string form of @value @repeat times with @func, without building
+ * it when possible.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_eval_write_value (const CtplValue    *value,
+                       glong               repeat,
+                       CtplEvalWriteFunc   func,
+                       gpointer            user_data,
+                       GError            **error)
+{
+  gboolean rv = TRUE;
+  
+  switch (ctpl_value_get_held_type (value)) {
+    case CTPL_VTYPE_STRING: {
+      const gchar  *str = ctpl_value_get_string (value);
+      gsize         len = strlen (str);
+      
+      for (; rv && repeat > 0; repeat--) {
+        rv = func (user_data, str, len, error);
+      }
+      break;
+    }
+    
+    case CTPL_VTYPE_INT: {
+      gchar buf[32];
+      
+      g_snprintf (buf, sizeof buf, "%ld", ctpl_value_get_int (value));
+      rv = func (user_data, buf, strlen (buf), error);
+      break;
+    }
+    
+    case CTPL_VTYPE_FLOAT: {
+      gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+      
+      ctpl_math_dtostr (buf, sizeof buf, ctpl_value_get_float (value));
+      rv = func (user_data, buf, strlen (buf), error);
+      break;
+    }
+    
+    case CTPL_VTYPE_ARRAY: {
+      gchar *str = ctpl_value_to_string (value);
+      
+      rv = func (user_data, str, strlen (str), error);
+      g_free (str);
+      break;
+    }
+  }
+  
+  return rv;
+}
+
+/*
+ * ctpl_eval_write:
+ * @expr: The #CtplTokenExpr to evaluate
+ * @env: The expression's environment, where lookup symbols
+ * @func: A function to call to write the result
+ * @user_data: Data to pass to @func
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Computes @expr like ctpl_eval_value() and writes the string form of the
+ * result with @func, in as many pieces as needed.
+ * 
+ * The operands of string concatenations (<code>a + b + c</code>) are written
+ * one after the other, and string repetitions (<code>"=" * n</code>) are
+ * written by repeating the string, so none of the intermediate strings is
+ * built. Values of symbols and literals are written from where they are
+ * stored without being copied.
+ * All operands are evaluated before anything is written, so nothing is
+ * written on error.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_eval_write (const CtplTokenExpr  *expr,
+                 CtplEnviron          *env,
+                 CtplEvalWriteFunc     func,
+                 gpointer              user_data,
+                 GError              **error)
+{
+  EvalPiece             stack_pieces[EVAL_WRITE_STACK_PIECES];
+  EvalPiece            *pieces = stack_pieces;
+  const CtplTokenExpr  *node;
+  gsize                 n_pieces = 1;
+  gsize                 n_evaluated = 0;
+  gsize                 i;
+  gboolean              concat = TRUE;
+  gboolean              rv = TRUE;
+  
+  /* a + b + c is (a + b) + c, so the operands are the leftmost one and the
+   * right operands along the left side of the tree */
+  for (node = expr; IS_PLUS_CHAIN (node);
+       node = node->token.t_operator->loperand) {
+    n_pieces++;
+  }
+  if (n_pieces > G_N_ELEMENTS (stack_pieces)) {
+    pieces = g_new (EvalPiece, n_pieces);
+  }
+  i = n_pieces;
+  for (node = expr; IS_PLUS_CHAIN (node);
+       node = node->token.t_operator->loperand) {
+    pieces[--i].expr = node->token.t_operator->roperand;
+  }
+  pieces[0].expr = node;
+  
+  for (i = 0; rv && concat && i < n_pieces; i++) {
+    ctpl_value_init (&pieces[i].storage);
+    n_evaluated++;
+    rv = eval_piece (&pieces[i], env, error);
+    if (! rv) {
+      /* error */
+    } else if (i == 0) {
+      /* only concatenations of strings can be written piece by piece */
+      concat = n_pieces == 1 || CTPL_VALUE_HOLDS_STRING (pieces[0].value);
+    } else if (CTPL_VALUE_HOLDS_ARRAY (pieces[i].value)) {
+      g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+                   _("Operator '+' cannot be used with '%s' and '%s' types"),
+                   ctpl_value_type_get_name (CTPL_VTYPE_STRING),
+                   ctpl_value_get_held_type_name (pieces[i].value));
+      rv = FALSE;
+    }
+  }
+  if (rv && ! concat) {
+    CtplValue value;
+    
+    ctpl_value_init (&value);
+    rv = (ctpl_eval_value (expr, env, &value, error) &&
+          ctpl_eval_write_value (&value, 1, func, user_data, error));
+    ctpl_value_free_value (&value);
+  } else {
+    for (i = 0; rv && i < n_pieces; i++) {
+      rv = ctpl_eval_write_value (pieces[i].value, pieces[i].repeat, func,
+                                  user_data, error);
+    }
+  }
+  for (i = 0; i < n_evaluated; i++) {
+    ctpl_value_free_value (&pieces[i].storage);
+  }
+  if (pieces != stack_pieces) {
+    g_free (pieces);
+  }
+  
+  return rv;
+}
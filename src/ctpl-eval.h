@@ -46,6 +46,8 @@ G_BEGIN_DECLS
  *                                    environment.
  * @CTPL_EVAL_ERROR_FAILED: An error occurred without any precision on what
  *                          failed.
+ * @CTPL_EVAL_ERROR_FUNCTION_NOT_FOUND: A called function is not registered
+ *                                      (Since: 0.4).
  * 
  * Error codes that eval functions can throw, from the %CTPL_EVAL_ERROR domain.
  */
@@ -53,19 +55,33 @@ typedef enum _CtplEvalError
 {
   CTPL_EVAL_ERROR_INVALID_OPERAND,
   CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND,
-  CTPL_EVAL_ERROR_FAILED
+  CTPL_EVAL_ERROR_FAILED,
+  CTPL_EVAL_ERROR_FUNCTION_NOT_FOUND
 } CtplEvalError;
 
 
-GQuark      ctpl_eval_error_quark   (void) G_GNUC_CONST;
-gboolean    ctpl_eval_value         (const CtplTokenExpr  *expr,
-                                     CtplEnviron          *env,
-                                     CtplValue            *value,
-                                     GError              **error);
-gboolean    ctpl_eval_bool          (const CtplTokenExpr *expr,
-                                     CtplEnviron         *env,
-                                     gboolean            *result,
-                                     GError             **error);
+GQuark      ctpl_eval_error_quark     (void) G_GNUC_CONST;
+gboolean    ctpl_eval_value           (const CtplTokenExpr  *expr,
+                                       CtplEnviron          *env,
+                                       CtplValue            *value,
+                                       GError              **error);
+gboolean    ctpl_eval_bool            (const CtplTokenExpr *expr,
+                                       CtplEnviron         *env,
+                                       gboolean            *result,
+                                       GError             **error);
+gboolean    ctpl_eval_lookup          (CtplEnviron  *env,
+                                       const gchar  *symbol,
+                                       CtplValue    *value,
+                                       GError      **error);
+gboolean    ctpl_eval_operator_values (CtplOperator  op,
+                                       CtplValue    *lvalue,
+                                       CtplValue    *rvalue,
+                                       CtplValue    *value,
+                                       GError      **error);
+gboolean    ctpl_eval_index_value     (CtplValue  *value,
+                                       CtplValue  *index_value,
+                                       GError    **error);
+gboolean    ctpl_eval_bool_value      (const CtplValue *value);
 
 
 G_END_DECLS
@@ -0,0 +1,40 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef H_CTPL_FRAGMENT_CACHE_PRIVATE_H
+#define H_CTPL_FRAGMENT_CACHE_PRIVATE_H
+
+#include <glib.h>
+#include "ctpl-fragment-cache.h"
+
+G_BEGIN_DECLS
+
+
+G_GNUC_INTERNAL
+GBytes   *ctpl_fragment_cache_lookup  (CtplFragmentCache *cache,
+                                       const gchar       *key);
+G_GNUC_INTERNAL
+void      ctpl_fragment_cache_store   (CtplFragmentCache *cache,
+                                       const gchar       *key,
+                                       GBytes            *data);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,335 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#include "ctpl-fragment-cache.h"
+#include "ctpl-fragment-cache-private.h"
+#include "ctpl-lru-private.h"
+#include <glib.h>
+#include <string.h>
+
+
+/**
+ * SECTION: fragment-cache
+ * @short_description: Rendered fragment cache
+ * @include: ctpl/ctpl.h
+ * 
+ * A #CtplFragmentCache keeps the output of the <code>cache</code> blocks of
+ * templates, so that parts of the output that rarely change (like navigation
+ * bars or footers) are only rendered once.
+ * 
+ * The symbols a <code>cache</code> block depends on are found when the
+ * template is lexed, and the output of the block is stored for the current
+ * values of these symbols. The next time the block is rendered with the same
+ * values, the stored output is written again rather than rendering the block.
+ * 
+ * A cache is used by setting it on the output with
+ * ctpl_output_stream_set_fragment_cache(). Without a cache, <code>cache</code>
+ * blocks are rendered like their content.
+ * 
+ * A cache can be limited to a memory budget, approximated by the size of the
+ * outputs and of the values they were rendered for. When it is exceeded, the
+ * least recently used outputs are evicted.
+ * ctpl_fragment_cache_get_hits() and ctpl_fragment_cache_get_misses() tell
+ * how effective the cache is.
+ * 
+ * A #CtplFragmentCache can be used from several threads at the same time, and
+ * shared by several outputs.
+ * 
+ * |[
+ * CtplFragmentCache *cache = ctpl_fragment_cache_new (16 << 20);
+ * 
+ * ctpl_output_stream_set_fragment_cache (output, cache);
+ * ctpl_parser_parse (tree, env, output, &error);
+ * ]|
+ */
+
+
+typedef struct _FragmentEntry FragmentEntry;
+
+/* a cached output */
+struct _FragmentEntry
+{
+  CtplFragmentCache  *cache;
+  const gchar        *key;      /* owned by the hash table */
+  GBytes             *data;
+  gsize               size;     /* size accounted for the entry */
+  GList               lru_link;
+};
+
+/**
+ * CtplFragmentCache:
+ * 
+ * An opaque reference counted object caching the output of
+ * <code>cache</code> blocks.
+ */
+struct _CtplFragmentCache
+{
+  /*< private >*/
+  gint        ref_count;
+  GRWLock     lock;
+  GHashTable *entries;  /* key -> FragmentEntry */
+  CtplLru     lru;
+  gsize       max_size;
+  gsize       size;
+  gint        hits;     /* atomic */
+  gint        misses;   /* atomic */
+};
+
+
+/* frees a FragmentEntry */
+static void
+fragment_entry_free (gpointer data)
+{
+  FragmentEntry *entry = data;
+  
+  ctpl_lru_remove (&entry->cache->lru, &entry->lru_link);
+  g_bytes_unref (entry->data);
+  g_slice_free1 (sizeof *entry, entry);
+}
+
+/* evicts the least recently used entries but @keep until the cache fits its
+ * budget. Must be called with the lock held for writing. */
+static void
+fragment_cache_evict (CtplFragmentCache *cache,
+                      FragmentEntry     *keep)
+{
+  FragmentEntry *lru;
+  
+  while (cache->max_size > 0 && cache->size > cache->max_size &&
+         (lru = ctpl_lru_get_oldest (&cache->lru, keep)) != NULL) {
+    cache->size -= lru->size;
+    g_hash_table_remove (cache->entries, lru->key);
+  }
+}
+
+/*
+ * ctpl_fragment_cache_lookup:
+ * @cache: A #CtplFragmentCache
+ * @key: The key of the fragment, identifying the block and the values it was
+ *       rendered for
+ * 
+ * Looks up the output stored for @key, counting a hit or a miss.
+ * 
+ * Returns: A reference to the stored output, or %NULL if there is none.
+ */
+GBytes *
+ctpl_fragment_cache_lookup (CtplFragmentCache *cache,
+                            const gchar       *key)
+{
+  GBytes         *data = NULL;
+  FragmentEntry  *entry;
+  
+  g_rw_lock_reader_lock (&cache->lock);
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry) {
+    ctpl_lru_touch (&cache->lru, &entry->lru_link);
+    data = g_bytes_ref (entry->data);
+  }
+  g_rw_lock_reader_unlock (&cache->lock);
+  g_atomic_int_inc (data ? &cache->hits : &cache->misses);
+  
+  return data;
+}
+
+/*
+ * ctpl_fragment_cache_store:
+ * @cache: A #CtplFragmentCache
+ * @key: The key of the fragment
+ * @data: The output of the fragment
+ * 
+ * Stores the output of a fragment, evicting older ones if needed. Outputs
+ * larger than the whole budget of @cache are not stored.
+ */
+void
+ctpl_fragment_cache_store (CtplFragmentCache *cache,
+                           const gchar       *key,
+                           GBytes            *data)
+{
+  gsize size;
+  
+  size = strlen (key) + g_bytes_get_size (data) + sizeof (FragmentEntry);
+  if (cache->max_size == 0 || size <= cache->max_size) {
+    FragmentEntry *entry;
+    
+    g_rw_lock_writer_lock (&cache->lock);
+    entry = g_hash_table_lookup (cache->entries, key);
+    if (entry) {
+      /* rendered concurrently by another thread */
+      cache->size -= entry->size;
+      g_bytes_unref (entry->data);
+      ctpl_lru_touch (&cache->lru, &entry->lru_link);
+    } else {
+      entry = g_slice_alloc (sizeof *entry);
+      entry->cache = cache;
+      entry->key = g_strdup (key);
+      g_hash_table_insert (cache->entries, (gchar *) entry->key, entry);
+      ctpl_lru_add (&cache->lru, &entry->lru_link, entry);
+    }
+    entry->data = g_bytes_ref (data);
+    entry->size = size;
+    cache->size += size;
+    fragment_cache_evict (cache, entry);
+    g_rw_lock_writer_unlock (&cache->lock);
+  }
+}
+
+/**
+ * ctpl_fragment_cache_new:
+ * @max_size: The memory budget of the cache, or 0 for no limit
+ * 
+ * Creates a new #CtplFragmentCache. If @max_size is not 0, the least recently
+ * used outputs are evicted when the total size of the cached outputs exceeds
+ * it.
+ * 
+ * Returns: A new #CtplFragmentCache.
+ * 
+ * Since: 0.4
+ */
+CtplFragmentCache *
+ctpl_fragment_cache_new (gsize max_size)
+{
+  CtplFragmentCache *self;
+  
+  self = g_slice_alloc (sizeof *self);
+  self->ref_count = 1;
+  g_rw_lock_init (&self->lock);
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         fragment_entry_free);
+  ctpl_lru_init (&self->lru);
+  self->max_size = max_size;
+  self->size = 0;
+  self->hits = 0;
+  self->misses = 0;
+  
+  return self;
+}
+
+/**
+ * ctpl_fragment_cache_ref:
+ * @cache: A #CtplFragmentCache
+ * 
+ * Adds a reference to a #CtplFragmentCache.
+ * 
+ * Returns: The cache
+ * 
+ * Since: 0.4
+ */
+CtplFragmentCache *
+ctpl_fragment_cache_ref (CtplFragmentCache *cache)
+{
+  g_atomic_int_inc (&cache->ref_count);
+  
+  return cache;
+}
+
+/**
+ * ctpl_fragment_cache_unref:
+ * @cache: A #CtplFragmentCache
+ * 
+ * Removes a reference from a #CtplFragmentCache. If the reference count drops
+ * to 0, frees the cache.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_fragment_cache_unref (CtplFragmentCache *cache)
+{
+  if (g_atomic_int_dec_and_test (&cache->ref_count)) {
+    g_hash_table_destroy (cache->entries);
+    ctpl_lru_clear (&cache->lru);
+    g_rw_lock_clear (&cache->lock);
+    g_slice_free1 (sizeof *cache, cache);
+  }
+}
+
+/**
+ * ctpl_fragment_cache_get_size:
+ * @cache: A #CtplFragmentCache
+ * 
+ * Gets the total size of the outputs in @cache, which is what its memory
+ * budget limits.
+ * 
+ * Returns: The size of the cached outputs.
+ * 
+ * Since: 0.4
+ */
+gsize
+ctpl_fragment_cache_get_size (CtplFragmentCache *cache)
+{
+  gsize size;
+  
+  g_rw_lock_reader_lock (&cache->lock);
+  size = cache->size;
+  g_rw_lock_reader_unlock (&cache->lock);
+  
+  return size;
+}
+
+/**
+ * ctpl_fragment_cache_get_hits:
+ * @cache: A #CtplFragmentCache
+ * 
+ * Gets the number of times the output of a <code>cache</code> block was found
+ * in @cache.
+ * 
+ * Returns: The number of hits.
+ * 
+ * Since: 0.4
+ */
+guint
+ctpl_fragment_cache_get_hits (CtplFragmentCache *cache)
+{
+  return (guint) g_atomic_int_get (&cache->hits);
+}
+
+/**
+ * ctpl_fragment_cache_get_misses:
+ * @cache: A #CtplFragmentCache
+ * 
+ * Gets the number of times a <code>cache</code> block had to be rendered
+ * because its output was not in @cache.
+ * 
+ * Returns: The number of misses.
+ * 
+ * Since: 0.4
+ */
+guint
+ctpl_fragment_cache_get_misses (CtplFragmentCache *cache)
+{
+  return (guint) g_atomic_int_get (&cache->misses);
+}
+
+/**
+ * ctpl_fragment_cache_clear:
+ * @cache: A #CtplFragmentCache
+ * 
+ * Removes all the outputs from @cache, e.g. after a change that the values of
+ * the symbols don't reflect. The hit and miss counters are kept.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_fragment_cache_clear (CtplFragmentCache *cache)
+{
+  g_rw_lock_writer_lock (&cache->lock);
+  g_hash_table_remove_all (cache->entries);
+  cache->size = 0;
+  g_rw_lock_writer_unlock (&cache->lock);
+}
@@ -0,0 +1,45 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_FRAGMENT_CACHE_H
+#define H_CTPL_FRAGMENT_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplFragmentCache CtplFragmentCache;
+
+CtplFragmentCache  *ctpl_fragment_cache_new         (gsize max_size);
+CtplFragmentCache  *ctpl_fragment_cache_ref         (CtplFragmentCache *cache);
+void                ctpl_fragment_cache_unref       (CtplFragmentCache *cache);
+gsize               ctpl_fragment_cache_get_size    (CtplFragmentCache *cache);
+guint               ctpl_fragment_cache_get_hits    (CtplFragmentCache *cache);
+guint               ctpl_fragment_cache_get_misses  (CtplFragmentCache *cache);
+void                ctpl_fragment_cache_clear       (CtplFragmentCache *cache);
+
+
+G_END_DECLS
+
+#endif /* guard */
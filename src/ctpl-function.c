@@ -0,0 +1,666 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#include "ctpl-function.h"
+#include <glib.h>
+#include <string.h>
+#include "ctpl-i18n.h"
+#include "ctpl-eval.h"
+#include "ctpl-mathutils.h"
+#include "ctpl-value.h"
+
+
+/**
+ * SECTION: function
+ * @short_description: Native functions callable from expressions
+ * @include: ctpl/ctpl.h
+ * 
+ * Expressions can call native functions with the
+ * <code>name(arguments...)</code> syntax (see the
+ * <link linkend="ctpl-CtplLexerExpr">expression syntax</link>), allowing
+ * templates to compute values from the ones in the environment without them
+ * to be added to the environment beforehand.
+ * 
+ * Functions are looked up by name in a registry shared by the whole process,
+ * to which new ones can be added with ctpl_function_register() and from which
+ * they can be removed with ctpl_function_unregister().
+ * Calling a function that is not registered fails with the
+ * %CTPL_EVAL_ERROR_FUNCTION_NOT_FOUND error.
+ * The result of a function should only depend on its arguments, as it may be
+ * computed ahead of rendering by ctpl_token_specialize().
+ * 
+ * The registry initially contains the following functions:
+ * <variablelist>
+ *   <varlistentry>
+ *     <term><code>len(value)</code></term>
+ *     <listitem>
+ *       <para>
+ *         The number of items of an array, or the length in bytes of a
+ *         string, not in characters: a non-ASCII character counts as
+ *         several bytes. Neither length is stored, so both are counted on
+ *         each call, in a time proportional to the length.
+ *       </para>
+ *     </listitem>
+ *   </varlistentry>
+ *   <varlistentry>
+ *     <term><code>sum(values...)</code></term>
+ *     <listitem>
+ *       <para>
+ *         The sum of numbers, an integer if they all are integers and a
+ *         floating point value otherwise.
+ *       </para>
+ *     </listitem>
+ *   </varlistentry>
+ *   <varlistentry>
+ *     <term><code>min(values...)</code> and <code>max(values...)</code></term>
+ *     <listitem>
+ *       <para>
+ *         The smallest and the greatest of several numbers, strings or
+ *         arrays.
+ *       </para>
+ *     </listitem>
+ *   </varlistentry>
+ *   <varlistentry>
+ *     <term><code>join(array, separator)</code></term>
+ *     <listitem>
+ *       <para>
+ *         A string made of the items of an array separated by the optional
+ *         separator.
+ *       </para>
+ *     </listitem>
+ *   </varlistentry>
+ *   <varlistentry>
+ *     <term><code>contains(haystack, needle)</code></term>
+ *     <listitem>
+ *       <para>
+ *         1 if an array contains an item equal to the needle or if a string
+ *         contains the needle as a substring, 0 otherwise.
+ *       </para>
+ *     </listitem>
+ *   </varlistentry>
+ * </variablelist>
+ * <code>sum</code>, <code>min</code> and <code>max</code> work on the items of
+ * their argument if they are given a single array, and on their arguments
+ * otherwise.
+ * 
+ * |[
+ * static gboolean
+ * upper (const CtplValue  *args,
+ *        guint             n_args,
+ *        CtplValue        *result,
+ *        gpointer          user_data,
+ *        GError          **error)
+ * {
+ *   gchar *string;
+ *   
+ *   if (n_args != 1) {
+ *     g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+ *                  "upper() takes exactly one argument");
+ *     return FALSE;
+ *   }
+ *   string = ctpl_value_to_string (&args[0]);
+ *   ctpl_value_take_string (result, g_utf8_strup (string, -1));
+ *   g_free (string);
+ *   
+ *   return TRUE;
+ * }
+ * 
+ * ctpl_function_register ("upper", upper, NULL, NULL);
+ * ]|
+ */
+
+
+typedef struct _FunctionEntry FunctionEntry;
+
+/* a registered function */
+struct _FunctionEntry
+{
+  gint            ref_count; /* atomic */
+  CtplFunction    func;
+  gpointer        user_data;
+  GDestroyNotify  destroy_func;
+};
+
+/* name -> FunctionEntry */
+static GHashTable  *functions = NULL;
+static GRWLock      functions_lock;
+
+
+static FunctionEntry *
+function_entry_ref (FunctionEntry *entry)
+{
+  g_atomic_int_inc (&entry->ref_count);
+  
+  return entry;
+}
+
+static void
+function_entry_unref (gpointer data)
+{
+  FunctionEntry *entry = data;
+  
+  if (g_atomic_int_dec_and_test (&entry->ref_count)) {
+    if (entry->destroy_func) {
+      entry->destroy_func (entry->user_data);
+    }
+    g_slice_free1 (sizeof *entry, entry);
+  }
+}
+
+/* checks that a function was given between @min and @max arguments */
+static gboolean
+check_n_args (const gchar *name,
+              guint        n_args,
+              guint        min,
+              guint        max,
+              GError     **error)
+{
+  gboolean rv = TRUE;
+  
+  if (n_args < min || n_args > max) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+                 _("Wrong number of arguments for function '%s' (%u given)"),
+                 name, n_args);
+    rv = FALSE;
+  }
+  
+  return rv;
+}
+
+/* reports that function @name cannot work on @value */
+static void
+set_invalid_arg_error (GError          **error,
+                       const gchar      *name,
+                       const CtplValue  *value)
+{
+  g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+               _("Invalid argument for function '%s' (have '%s')"),
+               name, ctpl_value_get_held_type_name (value));
+}
+
+typedef struct _ValuesIter ValuesIter;
+
+/* iterates over the values a variadic function works on: the items of its
+ * argument if it is a single array, or its arguments otherwise */
+struct _ValuesIter
+{
+  const GSList     *item;
+  const CtplValue  *args;
+  guint             n_args;
+};
+
+static void
+values_iter_init (ValuesIter      *iter,
+                  const CtplValue *args,
+                  guint            n_args)
+{
+  if (n_args == 1 && CTPL_VALUE_HOLDS_ARRAY (&args[0])) {
+    iter->item    = ctpl_value_get_array (&args[0]);
+    iter->args    = NULL;
+    iter->n_args  = 0;
+  } else {
+    iter->item    = NULL;
+    iter->args    = args;
+    iter->n_args  = n_args;
+  }
+}
+
+static const CtplValue *
+values_iter_next (ValuesIter *iter)
+{
+  const CtplValue *value = NULL;
+  
+  if (iter->item) {
+    value = iter->item->data;
+    iter->item = iter->item->next;
+  } else if (iter->n_args > 0) {
+    value = iter->args++;
+    iter->n_args--;
+  }
+  
+  return value;
+}
+
+/* compares two values to a strcmp()-like value. Numbers only compare to
+ * numbers, strings to strings and arrays to arrays */
+static gboolean
+compare_values (const gchar      *name,
+                const CtplValue  *lvalue,
+                const CtplValue  *rvalue,
+                gint             *result,
+                GError          **error)
+{
+  gboolean      rv = TRUE;
+  CtplValueType ltype = ctpl_value_get_held_type (lvalue);
+  CtplValueType rtype = ctpl_value_get_held_type (rvalue);
+  
+  #define IS_NUMBER(t) ((t) == CTPL_VTYPE_INT || (t) == CTPL_VTYPE_FLOAT)
+  
+  *result = 0;
+  if (ltype == CTPL_VTYPE_INT && rtype == CTPL_VTYPE_INT) {
+    glong lval = ctpl_value_get_int (lvalue);
+    glong rval = ctpl_value_get_int (rvalue);
+    
+    *result = (lval > rval) - (lval < rval);
+  } else if (IS_NUMBER (ltype) && IS_NUMBER (rtype)) {
+    gdouble lval;
+    gdouble rval;
+    
+    lval = (ltype == CTPL_VTYPE_INT) ? (gdouble) ctpl_value_get_int (lvalue)
+                                     : ctpl_value_get_float (lvalue);
+    rval = (rtype == CTPL_VTYPE_INT) ? (gdouble) ctpl_value_get_int (rvalue)
+                                     : ctpl_value_get_float (rvalue);
+    if (! CTPL_MATH_FLOAT_EQ (lval, rval)) {
+      *result = (lval < rval) ? -1 : 1;
+    }
+  } else if (ltype == CTPL_VTYPE_STRING && rtype == CTPL_VTYPE_STRING) {
+    *result = strcmp (ctpl_value_get_string (lvalue),
+                      ctpl_value_get_string (rvalue));
+  } else if (ltype == CTPL_VTYPE_ARRAY && rtype == CTPL_VTYPE_ARRAY) {
+    const GSList *litem = ctpl_value_get_array (lvalue);
+    const GSList *ritem = ctpl_value_get_array (rvalue);
+    
+    for (; rv && *result == 0 && litem && ritem;
+         litem = litem->next, ritem = ritem->next) {
+      rv = compare_values (name, litem->data, ritem->data, result, error);
+    }
+    if (rv && *result == 0) {
+      *result = (litem != NULL) - (ritem != NULL);
+    }
+  } else {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+                 _("Function '%s' cannot compare '%s' and '%s'"), name,
+                 ctpl_value_get_held_type_name (lvalue),
+                 ctpl_value_get_held_type_name (rvalue));
+    rv = FALSE;
+  }
+  
+  #undef IS_NUMBER
+  
+  return rv;
+}
+
+/* len(value) */
+static gboolean
+function_len (const CtplValue  *args,
+              guint             n_args,
+              CtplValue        *result,
+              gpointer          user_data G_GNUC_UNUSED,
+              GError          **error)
+{
+  gboolean rv = check_n_args ("len", n_args, 1, 1, error);
+  
+  if (! rv) {
+    /* nothing to do */
+  } else if (CTPL_VALUE_HOLDS_ARRAY (&args[0])) {
+    ctpl_value_set_int (result, (glong) ctpl_value_array_length (&args[0]));
+  } else if (CTPL_VALUE_HOLDS_STRING (&args[0])) {
+    const gchar *string = ctpl_value_get_string (&args[0]);
+    
+    ctpl_value_set_int (result, (glong) strlen (string));
+  } else {
+    set_invalid_arg_error (error, "len", &args[0]);
+    rv = FALSE;
+  }
+  
+  return rv;
+}
+
+/* sum(values...) */
+static gboolean
+function_sum (const CtplValue  *args,
+              guint             n_args,
+              CtplValue        *result,
+              gpointer          user_data G_GNUC_UNUSED,
+              GError          **error)
+{
+  gboolean          rv = TRUE;
+  gboolean          is_float = FALSE;
+  glong             int_sum = 0;
+  gdouble           float_sum = 0.0;
+  ValuesIter        iter;
+  const CtplValue  *value;
+  
+  /* integers and floats are summed apart not to lose precision on the
+   * integers when there are no floats */
+  values_iter_init (&iter, args, n_args);
+  while (rv && (value = values_iter_next (&iter)) != NULL) {
+    if (CTPL_VALUE_HOLDS_INT (value)) {
+      int_sum += ctpl_value_get_int (value);
+    } else if (CTPL_VALUE_HOLDS_FLOAT (value)) {
+      float_sum += ctpl_value_get_float (value);
+      is_float = TRUE;
+    } else {
+      set_invalid_arg_error (error, "sum", value);
+      rv = FALSE;
+    }
+  }
+  if (rv) {
+    if (is_float) {
+      ctpl_value_set_float (result, float_sum + (gdouble) int_sum);
+    } else {
+      ctpl_value_set_int (result, int_sum);
+    }
+  }
+  
+  return rv;
+}
+
+/* finds the smallest (@sign < 0) or greatest (@sign > 0) value */
+static gboolean
+function_min_max (const gchar      *name,
+                  gint              sign,
+                  const CtplValue  *args,
+                  guint             n_args,
+                  CtplValue        *result,
+                  GError          **error)
+{
+  gboolean          rv = TRUE;
+  ValuesIter        iter;
+  const CtplValue  *value;
+  const CtplValue  *best = NULL;
+  
+  values_iter_init (&iter, args, n_args);
+  while (rv && (value = values_iter_next (&iter)) != NULL) {
+    gint cmp = 0;
+    
+    if (! best) {
+      best = value;
+    } else if ((rv = compare_values (name, value, best, &cmp, error)) &&
+               cmp * sign > 0) {
+      best = value;
+    }
+  }
+  if (rv && ! best) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+                 _("Function '%s' needs at least one value"), name);
+    rv = FALSE;
+  }
+  if (rv) {
+    ctpl_value_copy (best, result);
+  }
+  
+  return rv;
+}
+
+/* min(values...) */
+static gboolean
+function_min (const CtplValue  *args,
+              guint             n_args,
+              CtplValue        *result,
+              gpointer          user_data G_GNUC_UNUSED,
+              GError          **error)
+{
+  return function_min_max ("min", -1, args, n_args, result, error);
+}
+
+/* max(values...) */
+static gboolean
+function_max (const CtplValue  *args,
+              guint             n_args,
+              CtplValue        *result,
+              gpointer          user_data G_GNUC_UNUSED,
+              GError          **error)
+{
+  return function_min_max ("max", 1, args, n_args, result, error);
+}
+
+/* join(array, separator) */
+static gboolean
+function_join (const CtplValue  *args,
+               guint             n_args,
+               CtplValue        *result,
+               gpointer          user_data G_GNUC_UNUSED,
+               GError          **error)
+{
+  gboolean rv = check_n_args ("join", n_args, 1, 2, error);
+  
+  if (! rv) {
+    /* nothing to do */
+  } else if (! CTPL_VALUE_HOLDS_ARRAY (&args[0])) {
+    set_invalid_arg_error (error, "join", &args[0]);
+    rv = FALSE;
+  } else {
+    gchar        *sep;
+    gsize         sep_len;
+    gsize         size = 0;
+    GString      *string;
+    const GSList *item;
+    
+    sep = (n_args > 1) ? ctpl_value_to_string (&args[1]) : g_strdup ("");
+    sep_len = strlen (sep);
+    /* size the string for the common case of an array of strings so it is
+     * allocated only once */
+    for (item = ctpl_value_get_array (&args[0]); item; item = item->next) {
+      if (CTPL_VALUE_HOLDS_STRING (item->data)) {
+        size += strlen (ctpl_value_get_string (item->data));
+      }
+      size += item->next ? sep_len : 0;
+    }
+    string = g_string_sized_new (size);
+    for (item = ctpl_value_get_array (&args[0]); item; item = item->next) {
+      if (CTPL_VALUE_HOLDS_STRING (item->data)) {
+        g_string_append (string, ctpl_value_get_string (item->data));
+      } else {
+        gchar *tmp = ctpl_value_to_string (item->data);
+        
+        g_string_append (string, tmp);
+        g_free (tmp);
+      }
+      if (item->next) {
+        g_string_append_len (string, sep, (gssize) sep_len);
+      }
+    }
+    ctpl_value_take_string (result, g_string_free (string, FALSE));
+    g_free (sep);
+  }
+  
+  return rv;
+}
+
+/* contains(haystack, needle) */
+static gboolean
+function_contains (const CtplValue  *args,
+                   guint             n_args,
+                   CtplValue        *result,
+                   gpointer          user_data G_GNUC_UNUSED,
+                   GError          **error)
+{
+  gboolean rv = check_n_args ("contains", n_args, 2, 2, error);
+  gboolean found = FALSE;
+  
+  if (! rv) {
+    /* nothing to do */
+  } else if (CTPL_VALUE_HOLDS_STRING (&args[0])) {
+    const gchar  *haystack = ctpl_value_get_string (&args[0]);
+    const gchar  *needle;
+    gchar        *tmp = NULL;
+    
+    if (CTPL_VALUE_HOLDS_STRING (&args[1])) {
+      needle = ctpl_value_get_string (&args[1]);
+    } else {
+      needle = tmp = ctpl_value_to_string (&args[1]);
+    }
+    found = strstr (haystack, needle) != NULL;
+    g_free (tmp);
+  } else if (CTPL_VALUE_HOLDS_ARRAY (&args[0])) {
+    const GSList *item;
+    
+    for (item = ctpl_value_get_array (&args[0]); ! found && item;
+         item = item->next) {
+      gint cmp;
+      
+      /* values that cannot be compared are not equal */
+      found = (compare_values ("contains", item->data, &args[1], &cmp, NULL) &&
+               cmp == 0);
+    }
+  } else {
+    set_invalid_arg_error (error, "contains", &args[0]);
+    rv = FALSE;
+  }
+  if (rv) {
+    ctpl_value_set_int (result, found ? 1 : 0);
+  }
+  
+  return rv;
+}
+
+/* adds a function to the registry, replacing any previous one */
+static void
+functions_insert (const gchar    *name,
+                  CtplFunction    func,
+                  gpointer        user_data,
+                  GDestroyNotify  destroy_func)
+{
+  FunctionEntry *entry;
+  
+  entry = g_slice_alloc (sizeof *entry);
+  entry->ref_count    = 1;
+  entry->func         = func;
+  entry->user_data    = user_data;
+  entry->destroy_func = destroy_func;
+  
+  g_rw_lock_writer_lock (&functions_lock);
+  g_hash_table_replace (functions, g_strdup (name), entry);
+  g_rw_lock_writer_unlock (&functions_lock);
+}
+
+/* creates the registry with the builtin functions if not already done */
+static void
+ensure_functions_initialized (void)
+{
+  static gsize init = FALSE;
+  
+  if (g_once_init_enter (&init)) {
+    functions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       function_entry_unref);
+    functions_insert ("len",      function_len,       NULL, NULL);
+    functions_insert ("sum",      function_sum,       NULL, NULL);
+    functions_insert ("min",      function_min,       NULL, NULL);
+    functions_insert ("max",      function_max,       NULL, NULL);
+    functions_insert ("join",     function_join,      NULL, NULL);
+    functions_insert ("contains", function_contains,  NULL, NULL);
+    
+    g_once_init_leave (&init, TRUE);
+  }
+}
+
+/**
+ * ctpl_function_register:
+ * @name: The name under which the function can be called
+ * @func: The function
+ * @user_data: Data to pass to @func
+ * @destroy_func: (allow-none): Function to call on @user_data when the
+ *                              function is unregistered or replaced, or %NULL
+ * 
+ * Registers a function, so that expressions can call it under @name.
+ * If a function was already registered under @name, it is replaced.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_function_register (const gchar    *name,
+                        CtplFunction    func,
+                        gpointer        user_data,
+                        GDestroyNotify  destroy_func)
+{
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (func != NULL);
+  
+  ensure_functions_initialized ();
+  functions_insert (name, func, user_data, destroy_func);
+}
+
+/**
+ * ctpl_function_unregister:
+ * @name: The name of a registered function
+ * 
+ * Removes a function from the ones expressions can call. Calls to the
+ * function already in progress are not affected.
+ * 
+ * Returns: %TRUE if a function was registered under @name, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_function_unregister (const gchar *name)
+{
+  gboolean rv;
+  
+  g_return_val_if_fail (name != NULL, FALSE);
+  
+  ensure_functions_initialized ();
+  
+  g_rw_lock_writer_lock (&functions_lock);
+  rv = g_hash_table_remove (functions, name);
+  g_rw_lock_writer_unlock (&functions_lock);
+  
+  return rv;
+}
+
+/**
+ * ctpl_function_call:
+ * @name: The name of the function to call
+ * @args: (array length=n_args): The values of the arguments
+ * @n_args: The number of arguments in @args
+ * @result: #CtplValue where store the result of the call on success
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Calls the function registered under @name, like it is done when evaluating
+ * a function call expression.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_function_call (const gchar      *name,
+                    const CtplValue  *args,
+                    guint             n_args,
+                    CtplValue        *result,
+                    GError          **error)
+{
+  gboolean        rv = FALSE;
+  FunctionEntry  *entry;
+  
+  g_return_val_if_fail (name != NULL, FALSE);
+  g_return_val_if_fail (args != NULL || n_args == 0, FALSE);
+  g_return_val_if_fail (result != NULL, FALSE);
+  
+  ensure_functions_initialized ();
+  
+  /* hold a reference so the function can be unregistered during the call */
+  g_rw_lock_reader_lock (&functions_lock);
+  entry = g_hash_table_lookup (functions, name);
+  if (entry) {
+    function_entry_ref (entry);
+  }
+  g_rw_lock_reader_unlock (&functions_lock);
+  
+  if (! entry) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_FUNCTION_NOT_FOUND,
+                 _("Function '%s' is not defined"), name);
+  } else {
+    rv = entry->func (args, n_args, result, entry->user_data, error);
+    function_entry_unref (entry);
+  }
+  
+  return rv;
+}
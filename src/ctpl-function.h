@@ -0,0 +1,71 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_FUNCTION_H
+#define H_CTPL_FUNCTION_H
+
+#include <glib.h>
+#include "ctpl-value.h"
+
+G_BEGIN_DECLS
+
+
+/**
+ * CtplFunction:
+ * @args: (array length=n_args): The values of the arguments of the call
+ * @n_args: The number of arguments in @args
+ * @result: An initialized #CtplValue where store the result of the call
+ * @user_data: The data given to ctpl_function_register()
+ * @error: Return location for errors
+ * 
+ * Type of the native functions that expressions can call.
+ * Errors should be reported in the %CTPL_EVAL_ERROR domain, generally with
+ * the %CTPL_EVAL_ERROR_INVALID_OPERAND code when the arguments are not
+ * appropriate.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+typedef gboolean  (*CtplFunction) (const CtplValue  *args,
+                                   guint             n_args,
+                                   CtplValue        *result,
+                                   gpointer          user_data,
+                                   GError          **error);
+
+
+void      ctpl_function_register    (const gchar     *name,
+                                     CtplFunction     func,
+                                     gpointer         user_data,
+                                     GDestroyNotify   destroy_func);
+gboolean  ctpl_function_unregister  (const gchar *name);
+gboolean  ctpl_function_call        (const gchar      *name,
+                                     const CtplValue  *args,
+                                     guint             n_args,
+                                     CtplValue        *result,
+                                     GError          **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
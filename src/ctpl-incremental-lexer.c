@@ -0,0 +1,505 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "ctpl-render-iter.h"
+#include "ctpl-incremental-lexer.h"
+#include <glib.h>
+#include <string.h>
+#include "ctpl-lexer.h"
+#include "ctpl-lexer-private.h"
+#include "ctpl-token.h"
+#include "ctpl-token-private.h"
+
+
+/**
+ * SECTION: incremental-lexer
+ * @short_description: Incremental syntax analyser
+ * @include: ctpl/ctpl.h
+ * 
+ * A #CtplIncrementalLexer holds a template and its token tree, and updates the
+ * tree when the template is edited by only lexing again the top-level
+ * statements or blocks the edit touches.
+ * The tokens of the other statements are kept as they are, so the cost of an
+ * edit doesn't depend on the size of the template.
+ * 
+ * A #CtplIncrementalLexer is created with ctpl_incremental_lexer_new() and
+ * freed with ctpl_incremental_lexer_free().
+ * 
+ * |[
+ * CtplIncrementalLexer *lexer;
+ * 
+ * lexer = ctpl_incremental_lexer_new ();
+ * if (! ctpl_incremental_lexer_set_template (lexer, template, -1, &error)) {
+ *   /<!-- -->* handle the error *<!-- -->/
+ * }
+ * /<!-- -->* replace 3 bytes at offset 42 with "foo" *<!-- -->/
+ * if (! ctpl_incremental_lexer_edit (lexer, 42, 3, "foo", -1, &error)) {
+ *   /<!-- -->* handle the error *<!-- -->/
+ * }
+ * ctpl_parser_parse (ctpl_incremental_lexer_get_tree (lexer), env, output,
+ *                    &error);
+ * ctpl_incremental_lexer_free (lexer);
+ * ]|
+ * 
+ * The errors this module can throw are the same as ctpl_lexer_lex() ones.
+ */
+
+
+typedef struct _LexerUnit LexerUnit;
+
+/* a top-level statement or block of the template, or the data between them */
+struct _LexerUnit
+{
+  gsize       start;
+  gsize       end;
+  CtplToken  *token;  /* the token lexed from the unit, or %NULL if it didn't
+                       * produce any */
+};
+
+/**
+ * CtplIncrementalLexer:
+ * 
+ * An opaque object holding a template and its token tree.
+ */
+struct _CtplIncrementalLexer
+{
+  /*< private >*/
+  GString    *template;
+  CtplToken  *tree;
+  /* the units of the template and the tokens they produced, if @synced */
+  GArray     *units;
+  gboolean    synced;
+};
+
+
+/**
+ * ctpl_incremental_lexer_new:
+ * 
+ * Creates a new #CtplIncrementalLexer holding an empty template.
+ * 
+ * Returns: A new #CtplIncrementalLexer, to be freed with
+ *          ctpl_incremental_lexer_free().
+ * 
+ * Since: 0.4
+ */
+CtplIncrementalLexer *
+ctpl_incremental_lexer_new (void)
+{
+  CtplIncrementalLexer *lexer;
+  
+  lexer = g_slice_alloc (sizeof *lexer);
+  lexer->template = g_string_new (NULL);
+  lexer->tree = NULL;
+  lexer->units = g_array_new (FALSE, FALSE, sizeof (LexerUnit));
+  lexer->synced = TRUE;
+  
+  return lexer;
+}
+
+/**
+ * ctpl_incremental_lexer_free:
+ * @lexer: A #CtplIncrementalLexer
+ * 
+ * Frees a #CtplIncrementalLexer, its template and its tree.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_incremental_lexer_free (CtplIncrementalLexer *lexer)
+{
+  ctpl_token_free (lexer->tree);
+  g_array_free (lexer->units, TRUE);
+  g_string_free (lexer->template, TRUE);
+  g_slice_free1 (sizeof *lexer, lexer);
+}
+
+/* lexes @length bytes of the template from @start.
+ * Returns: %TRUE on success, in which case @tree is set to the tree, or %NULL
+ *          if it is empty */
+static gboolean
+incremental_lexer_lex (CtplIncrementalLexer  *lexer,
+                       gsize                  start,
+                       gsize                  length,
+                       CtplToken            **tree,
+                       GError               **error)
+{
+  GBytes *bytes;
+  
+  /* the data tokens reference their own copy, so they remain valid after the
+   * template is edited */
+  bytes = g_bytes_new (lexer->template->str + start, length);
+  *tree = ctpl_lexer_lex_bytes (bytes, error);
+  g_bytes_unref (bytes);
+  if (*tree && ! (*tree)->next &&
+      ctpl_token_get_type (*tree) == CTPL_TOKEN_TYPE_DATA &&
+      (*tree)->token.t_data->length == 0) {
+    /* ctpl_lexer_lex() gives an empty data token for empty templates */
+    ctpl_token_free (*tree);
+    *tree = NULL;
+    return TRUE;
+  }
+  
+  return *tree != NULL;
+}
+
+/* lexes the whole template, and splits it in units.
+ * If the template can't be split, the next edit will lex it all again */
+static gboolean
+incremental_lexer_lex_all (CtplIncrementalLexer  *lexer,
+                           GError               **error)
+{
+  const gchar  *data = lexer->template->str;
+  gsize         length = lexer->template->len;
+  CtplToken    *tree;
+  CtplToken    *token;
+  gsize         i;
+  
+  g_array_set_size (lexer->units, 0);
+  lexer->synced = FALSE;
+  if (! incremental_lexer_lex (lexer, 0, length, &tree, error)) {
+    return FALSE;
+  }
+  ctpl_token_free (lexer->tree);
+  lexer->tree = tree;
+  
+  lexer->synced = TRUE;
+  token = tree;
+  for (i = 0; lexer->synced && i < length; ) {
+    LexerUnit unit;
+    
+    unit.start = i;
+    unit.end = ctpl_lexer_scan_unit (data, i, length);
+    unit.token = NULL;
+    if (unit.end == 0) {
+      lexer->synced = FALSE;
+    } else if (data[i] != CTPL_START_CHAR) {
+      /* data units don't produce a token if the data is only escapes */
+      if (token && ctpl_token_get_type (token) == CTPL_TOKEN_TYPE_DATA) {
+        unit.token = token;
+        token = token->next;
+      }
+    } else if (! token || ctpl_token_get_type (token) == CTPL_TOKEN_TYPE_DATA) {
+      lexer->synced = FALSE;
+    } else {
+      unit.token = token;
+      token = token->next;
+    }
+    g_array_append_val (lexer->units, unit);
+    i = unit.end;
+  }
+  if (token) {
+    lexer->synced = FALSE;
+  }
+  if (! lexer->synced) {
+    g_array_set_size (lexer->units, 0);
+  }
+  
+  return TRUE;
+}
+
+/**
+ * ctpl_incremental_lexer_set_template:
+ * @lexer: A #CtplIncrementalLexer
+ * @template: The template data
+ * @length: The length of @template, or -1 if it is 0-terminated
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Replaces the template of a #CtplIncrementalLexer, and lexes it entirely.
+ * 
+ * On error, the template is still replaced, but the tree is left unchanged
+ * until a successful edit.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_incremental_lexer_set_template (CtplIncrementalLexer  *lexer,
+                                     const gchar           *template,
+                                     gssize                 length,
+                                     GError               **error)
+{
+  g_string_truncate (lexer->template, 0);
+  g_string_append_len (lexer->template, template,
+                       length < 0 ? (gssize) strlen (template) : length);
+  
+  return incremental_lexer_lex_all (lexer, error);
+}
+
+/* finds the index of the unit containing @offset, or of the last unit if
+ * @offset is past the end */
+static guint
+incremental_lexer_find_unit (CtplIncrementalLexer *lexer,
+                             gsize                 offset)
+{
+  guint lo = 0;
+  guint hi = lexer->units->len;
+  
+  while (hi - lo > 1) {
+    guint mid = lo + (hi - lo) / 2;
+    
+    if (g_array_index (lexer->units, LexerUnit, mid).start <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  return lo;
+}
+
+/* links the tokens of the units from @first to @last (excluded) in the tree,
+ * between the ones of the surrounding units */
+static void
+incremental_lexer_link (CtplIncrementalLexer *lexer,
+                        guint                 first,
+                        guint                 last)
+{
+  CtplToken  *prev = NULL;
+  CtplToken  *tail = NULL;
+  guint       i;
+  
+  for (i = first; ! prev && i > 0; i--) {
+    prev = g_array_index (lexer->units, LexerUnit, i - 1).token;
+  }
+  for (i = first; i < lexer->units->len; i++) {
+    CtplToken *token = g_array_index (lexer->units, LexerUnit, i).token;
+    
+    if (token) {
+      if (prev) {
+        prev->next = token;
+      } else {
+        lexer->tree = token;
+      }
+      prev = token;
+      if (i >= last) {
+        /* the following tokens are already linked */
+        break;
+      }
+    }
+  }
+  if (prev) {
+    if (i >= lexer->units->len) {
+      prev->next = NULL;
+    }
+  } else {
+    lexer->tree = NULL;
+  }
+  /* keep the root's hint of the last token valid */
+  for (i = lexer->units->len; ! tail && i > 0; i--) {
+    tail = g_array_index (lexer->units, LexerUnit, i - 1).token;
+  }
+  if (lexer->tree) {
+    lexer->tree->last = (tail != lexer->tree) ? tail : NULL;
+  }
+}
+
+/* re-lexes the units touched by replacing @removed bytes at @offset with
+ * @inserted ones, the template being already edited */
+static gboolean
+incremental_lexer_relex (CtplIncrementalLexer  *lexer,
+                         gsize                  offset,
+                         gsize                  removed,
+                         gsize                  inserted,
+                         GError               **error)
+{
+  const gchar  *data = lexer->template->str;
+  gsize         length = lexer->template->len;
+  GArray       *units = lexer->units;
+  gssize        delta = (gssize) inserted - (gssize) removed;
+  GArray       *new_units;
+  guint         first = 0;
+  guint         last;
+  gsize         pos = 0;
+  gboolean      rv = TRUE;
+  guint         i;
+  
+  if (units->len > 0) {
+    /* start with the unit before the edit, so that data inserted at its end
+     * can be merged with it */
+    first = incremental_lexer_find_unit (lexer, offset > 0 ? offset - 1 : 0);
+    pos = g_array_index (units, LexerUnit, first).start;
+  }
+  /* scan the edited template until the end of a unit is the start of an old
+   * unit following the edit, from which point the units are the same */
+  new_units = g_array_new (FALSE, FALSE, sizeof (LexerUnit));
+  last = first;
+  while (pos < length) {
+    LexerUnit unit;
+    
+    while (last < units->len &&
+           (g_array_index (units, LexerUnit, last).start < offset + removed ||
+            (gssize) g_array_index (units, LexerUnit, last).start + delta <
+              (gssize) pos)) {
+      last++;
+    }
+    if (last < units->len && pos >= offset + inserted &&
+        (gssize) g_array_index (units, LexerUnit, last).start + delta ==
+          (gssize) pos) {
+      break;
+    }
+    unit.start = pos;
+    unit.end = ctpl_lexer_scan_unit (data, pos, length);
+    unit.token = NULL;
+    if (unit.end == 0) {
+      rv = FALSE;
+      break;
+    }
+    g_array_append_val (new_units, unit);
+    pos = unit.end;
+  }
+  if (pos >= length) {
+    last = units->len;
+  }
+  for (i = 0; rv && i < new_units->len; i++) {
+    LexerUnit  *unit = &g_array_index (new_units, LexerUnit, i);
+    
+    rv = incremental_lexer_lex (lexer, unit->start, unit->end - unit->start,
+                                &unit->token, NULL);
+    /* a unit gives at most one token, of the same kind */
+    if (rv && unit->token &&
+        (unit->token->next ||
+         ((data[unit->start] == CTPL_START_CHAR) !=
+          (ctpl_token_get_type (unit->token) != CTPL_TOKEN_TYPE_DATA)))) {
+      rv = FALSE;
+    }
+  }
+  
+  if (! rv) {
+    for (i = 0; i < new_units->len; i++) {
+      ctpl_token_free (g_array_index (new_units, LexerUnit, i).token);
+    }
+    /* lex the whole template, for the reported error to be the same as
+     * ctpl_lexer_lex() one */
+    rv = incremental_lexer_lex_all (lexer, error);
+  } else {
+    for (i = first; i < last; i++) {
+      CtplToken *token = g_array_index (units, LexerUnit, i).token;
+      
+      if (token) {
+        token->next = NULL;
+        ctpl_token_free (token);
+      }
+    }
+    g_array_remove_range (units, first, last - first);
+    g_array_insert_vals (units, first, new_units->data, new_units->len);
+    for (i = first + new_units->len; i < units->len; i++) {
+      LexerUnit *unit = &g_array_index (units, LexerUnit, i);
+      
+      unit->start = (gsize) ((gssize) unit->start + delta);
+      unit->end = (gsize) ((gssize) unit->end + delta);
+    }
+    incremental_lexer_link (lexer, first, first + new_units->len);
+  }
+  g_array_free (new_units, TRUE);
+  
+  return rv;
+}
+
+/**
+ * ctpl_incremental_lexer_edit:
+ * @lexer: A #CtplIncrementalLexer
+ * @offset: The offset in bytes of the edit in the template
+ * @removed: The number of bytes removed at @offset
+ * @inserted: (allow-none): The data inserted at @offset, or %NULL to only
+ *            remove data
+ * @length: The length of @inserted, or -1 if it is 0-terminated. Must be 0 if
+ *          @inserted is %NULL
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Edits the template of a #CtplIncrementalLexer, and updates its tree.
+ * Only the top-level statements or blocks touched by the edit are lexed again,
+ * as well as the ones an edit opening or closing a block changes; the tokens of
+ * the others are kept.
+ * 
+ * On error, the template is still edited, but the tree is left unchanged
+ * until a successful edit.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_incremental_lexer_edit (CtplIncrementalLexer  *lexer,
+                             gsize                  offset,
+                             gsize                  removed,
+                             const gchar           *inserted,
+                             gssize                 length,
+                             GError               **error)
+{
+  gsize inserted_len;
+  
+  g_return_val_if_fail (offset <= lexer->template->len, FALSE);
+  g_return_val_if_fail (removed <= lexer->template->len - offset, FALSE);
+  g_return_val_if_fail (inserted != NULL || length == 0, FALSE);
+  
+  inserted_len = length < 0 ? strlen (inserted) : (gsize) length;
+  g_string_erase (lexer->template, (gssize) offset, (gssize) removed);
+  if (inserted_len > 0) {
+    g_string_insert_len (lexer->template, (gssize) offset, inserted,
+                         (gssize) inserted_len);
+  }
+  if (! lexer->synced) {
+    return incremental_lexer_lex_all (lexer, error);
+  } else {
+    return incremental_lexer_relex (lexer, offset, removed, inserted_len,
+                                    error);
+  }
+}
+
+/**
+ * ctpl_incremental_lexer_get_template:
+ * @lexer: A #CtplIncrementalLexer
+ * @length: (out) (allow-none): Return location for the length of the template,
+ *          or %NULL
+ * 
+ * Gets the template of a #CtplIncrementalLexer.
+ * 
+ * Returns: The 0-terminated template, that belongs to @lexer and is valid until
+ *          its next edit.
+ * 
+ * Since: 0.4
+ */
+const gchar *
+ctpl_incremental_lexer_get_template (const CtplIncrementalLexer *lexer,
+                                     gsize                      *length)
+{
+  if (length) {
+    *length = lexer->template->len;
+  }
+  
+  return lexer->template->str;
+}
+
+/**
+ * ctpl_incremental_lexer_get_tree:
+ * @lexer: A #CtplIncrementalLexer
+ * 
+ * Gets the token tree of the last template a #CtplIncrementalLexer
+ * successfully lexed.
+ * 
+ * Returns: The tree, that belongs to @lexer and is valid until its next edit,
+ *          or %NULL if the template is empty.
+ * 
+ * Since: 0.4
+ */
+const CtplToken *
+ctpl_incremental_lexer_get_tree (const CtplIncrementalLexer *lexer)
+{
+  return lexer->tree;
+}
@@ -0,0 +1,59 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_INCREMENTAL_LEXER_H
+#define H_CTPL_INCREMENTAL_LEXER_H
+
+#include <glib.h>
+#include "ctpl-token.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplIncrementalLexer CtplIncrementalLexer;
+
+CtplIncrementalLexer *ctpl_incremental_lexer_new
+                                          (void);
+void          ctpl_incremental_lexer_free (CtplIncrementalLexer *lexer);
+gboolean      ctpl_incremental_lexer_set_template
+                                          (CtplIncrementalLexer  *lexer,
+                                           const gchar           *template,
+                                           gssize                 length,
+                                           GError               **error);
+gboolean      ctpl_incremental_lexer_edit (CtplIncrementalLexer  *lexer,
+                                           gsize                  offset,
+                                           gsize                  removed,
+                                           const gchar           *inserted,
+                                           gssize                 length,
+                                           GError               **error);
+const gchar  *ctpl_incremental_lexer_get_template
+                                          (const CtplIncrementalLexer *lexer,
+                                           gsize                      *length);
+const CtplToken *
+              ctpl_incremental_lexer_get_tree
+                                          (const CtplIncrementalLexer *lexer);
+
+
+G_END_DECLS
+
+#endif /* guard */
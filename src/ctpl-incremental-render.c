@@ -0,0 +1,311 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "ctpl-render-iter.h"
+#include "ctpl-incremental-render.h"
+#include <glib.h>
+#include <string.h>
+#include "ctpl-environ.h"
+#include "ctpl-escape.h"
+#include "ctpl-output-stream.h"
+#include "ctpl-output-stream-private.h"
+#include "ctpl-parser-private.h"
+#include "ctpl-token-private.h"
+
+
+/**
+ * SECTION: incremental-render
+ * @short_description: Incremental rendering
+ * @include: ctpl/ctpl.h
+ * 
+ * A #CtplIncrementalRender keeps the output of a token tree in memory, and
+ * updates it when the environment changes by only rendering again the
+ * top-level tokens that depend on symbols that changed.
+ * It remembers which part of the output each top-level token produced and
+ * which symbols it depends on, and uses the versions of the symbols (see
+ * ctpl_environ_get_symbol_version()) to know which ones changed since the
+ * last update.
+ * 
+ * A #CtplIncrementalRender is created with ctpl_incremental_render_new() and
+ * freed with ctpl_incremental_render_free().
+ * 
+ * |[
+ * CtplIncrementalRender *render;
+ * const gchar           *output;
+ * gsize                  length;
+ * 
+ * render = ctpl_incremental_render_new (tree, env);
+ * output = ctpl_incremental_render_update (render, &length, &error);
+ * /<!-- -->* ... *<!-- -->/
+ * ctpl_environ_push_int (env, "load", 42);
+ * /<!-- -->* only the tokens depending on "load" are rendered again *<!-- -->/
+ * output = ctpl_incremental_render_update (render, &length, &error);
+ * /<!-- -->* ... *<!-- -->/
+ * ctpl_incremental_render_free (render);
+ * ]|
+ * 
+ * The errors this module can throw are the same as ctpl_parser_parse() ones.
+ */
+
+
+typedef struct _RenderSegment RenderSegment;
+
+/* the part of the output produced by a top-level token */
+struct _RenderSegment
+{
+  const CtplToken  *token;
+  gchar           **symbols;  /* the symbols @token depends on */
+  gsize             offset;   /* offset of the output of @token */
+  gsize             length;   /* length of the output of @token */
+  gboolean          valid;    /* whether the output was rendered successfully
+                               * and is up to date as of the last update */
+};
+
+/**
+ * CtplIncrementalRender:
+ * 
+ * An opaque object holding the output of a token tree and what it depends on.
+ */
+struct _CtplIncrementalRender
+{
+  /*< private >*/
+  CtplEnviron      *env;
+  GArray           *segments;
+  GString          *output;
+  guint64           version;    /* version of the environ after the last
+                                 * update */
+  /* storage for the output of a token being rendered */
+  GString          *scratch;
+  CtplOutputStream *scratch_stream;
+  guint             n_rendered;
+};
+
+
+/**
+ * ctpl_incremental_render_new:
+ * @tree: A #CtplToken tree to render
+ * @env: The #CtplEnviron to render @tree against
+ * 
+ * Creates a new #CtplIncrementalRender for @tree and @env.
+ * @tree must stay alive and unchanged as long as the returned object is alive.
+ * Nothing is rendered until ctpl_incremental_render_update() is called.
+ * 
+ * Returns: A new #CtplIncrementalRender, to be freed with
+ *          ctpl_incremental_render_free().
+ * 
+ * Since: 0.4
+ */
+CtplIncrementalRender *
+ctpl_incremental_render_new (const CtplToken *tree,
+                             CtplEnviron     *env)
+{
+  CtplIncrementalRender *render;
+  
+  g_return_val_if_fail (env != NULL, NULL);
+  
+  render = g_slice_alloc (sizeof *render);
+  render->env = ctpl_environ_ref (env);
+  render->segments = g_array_new (FALSE, FALSE, sizeof (RenderSegment));
+  render->output = g_string_new (NULL);
+  render->version = 0;
+  render->scratch = g_string_new (NULL);
+  render->scratch_stream = ctpl_output_stream_new_for_gstring (render->scratch);
+  render->n_rendered = 0;
+  for (; tree; tree = tree->next) {
+    RenderSegment segment;
+    
+    segment.token = tree;
+    segment.symbols = ctpl_token_get_symbols (tree);
+    segment.offset = 0;
+    segment.length = 0;
+    segment.valid = FALSE;
+    g_array_append_val (render->segments, segment);
+  }
+  
+  return render;
+}
+
+/**
+ * ctpl_incremental_render_free:
+ * @render: A #CtplIncrementalRender
+ * 
+ * Frees a #CtplIncrementalRender and its output.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_incremental_render_free (CtplIncrementalRender *render)
+{
+  guint i;
+  
+  for (i = 0; i < render->segments->len; i++) {
+    g_strfreev (g_array_index (render->segments, RenderSegment, i).symbols);
+  }
+  g_array_free (render->segments, TRUE);
+  ctpl_output_stream_unref (render->scratch_stream);
+  g_string_free (render->scratch, TRUE);
+  g_string_free (render->output, TRUE);
+  ctpl_environ_unref (render->env);
+  g_slice_free1 (sizeof *render, render);
+}
+
+/* marks all the segments to be rendered on next update */
+static void
+incremental_render_invalidate (CtplIncrementalRender *render)
+{
+  guint i;
+  
+  for (i = 0; i < render->segments->len; i++) {
+    g_array_index (render->segments, RenderSegment, i).valid = FALSE;
+  }
+}
+
+/**
+ * ctpl_incremental_render_set_escape_mode:
+ * @render: A #CtplIncrementalRender
+ * @mode: A #CtplEscapeMode
+ * 
+ * Sets the escape mode of the values of the expressions that don't specify one,
+ * see ctpl_output_stream_set_escape_mode().
+ * The whole output is rendered again on next update if the mode changed.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_incremental_render_set_escape_mode (CtplIncrementalRender *render,
+                                         CtplEscapeMode         mode)
+{
+  if (ctpl_output_stream_get_escape_mode (render->scratch_stream) != mode) {
+    ctpl_output_stream_set_escape_mode (render->scratch_stream, mode);
+    incremental_render_invalidate (render);
+  }
+}
+
+/* checks whether the output of @segment is outdated */
+static gboolean
+incremental_render_segment_is_outdated (CtplIncrementalRender *render,
+                                        const RenderSegment   *segment)
+{
+  gchar **symbol;
+  
+  if (! segment->valid) {
+    return TRUE;
+  }
+  for (symbol = segment->symbols; *symbol; symbol++) {
+    guint64 symbol_version;
+    
+    symbol_version = ctpl_environ_get_symbol_version (render->env, *symbol);
+    if (symbol_version > render->version) {
+      return TRUE;
+    }
+  }
+  
+  return FALSE;
+}
+
+/**
+ * ctpl_incremental_render_update:
+ * @render: A #CtplIncrementalRender
+ * @length: (out) (allow-none): Return location for the length of the output,
+ *          or %NULL
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Updates the output of a #CtplIncrementalRender.
+ * The first call renders the whole tree, and the next ones only render again
+ * the top-level tokens depending on symbols pushed or popped since the
+ * previous call.
+ * The output of these tokens is then replaced in place, so the cost of an
+ * update is proportional to the size of what changed rather than to the size of
+ * the whole output.
+ * 
+ * If a token fails to render, the other ones are still updated, and it is
+ * rendered again on next update.
+ * 
+ * Returns: The output, that belongs to @render and is valid until the next
+ *          call to this function; or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+const gchar *
+ctpl_incremental_render_update (CtplIncrementalRender  *render,
+                                gsize                  *length,
+                                GError                **error)
+{
+  gssize    shift = 0;
+  gboolean  rv = TRUE;
+  guint     i;
+  
+  render->n_rendered = 0;
+  for (i = 0; i < render->segments->len; i++) {
+    RenderSegment *segment;
+    
+    segment = &g_array_index (render->segments, RenderSegment, i);
+    segment->offset = (gsize) ((gssize) segment->offset + shift);
+    if (incremental_render_segment_is_outdated (render, segment)) {
+      g_string_truncate (render->scratch, 0);
+      render->n_rendered++;
+      /* only report the first error */
+      if (! ctpl_parser_parse_token (segment->token, render->env,
+                                     render->scratch_stream,
+                                     rv ? error : NULL)) {
+        rv = FALSE;
+        segment->valid = FALSE;
+      } else {
+        /* splice the new output in place of the old one */
+        if (segment->length == render->scratch->len) {
+          memcpy (&render->output->str[segment->offset], render->scratch->str,
+                  render->scratch->len);
+        } else {
+          g_string_erase (render->output, (gssize) segment->offset,
+                          (gssize) segment->length);
+          g_string_insert_len (render->output, (gssize) segment->offset,
+                               render->scratch->str,
+                               (gssize) render->scratch->len);
+          shift += (gssize) render->scratch->len - (gssize) segment->length;
+          segment->length = render->scratch->len;
+        }
+        segment->valid = TRUE;
+      }
+    }
+  }
+  /* the iterators pushed while rendering are not changes to consider on next
+   * update, as they are popped afterwards */
+  render->version = ctpl_environ_get_version (render->env);
+  if (length) {
+    *length = rv ? render->output->len : 0;
+  }
+  
+  return rv ? render->output->str : NULL;
+}
+
+/**
+ * ctpl_incremental_render_get_n_rendered:
+ * @render: A #CtplIncrementalRender
+ * 
+ * Gets how many top-level tokens the last call to
+ * ctpl_incremental_render_update() rendered.
+ * 
+ * Returns: The number of tokens rendered by the last update.
+ * 
+ * Since: 0.4
+ */
+guint
+ctpl_incremental_render_get_n_rendered (const CtplIncrementalRender *render)
+{
+  return render->n_rendered;
+}
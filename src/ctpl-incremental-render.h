@@ -0,0 +1,55 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_INCREMENTAL_RENDER_H
+#define H_CTPL_INCREMENTAL_RENDER_H
+
+#include <glib.h>
+#include "ctpl-token.h"
+#include "ctpl-environ.h"
+#include "ctpl-escape.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplIncrementalRender CtplIncrementalRender;
+
+CtplIncrementalRender *ctpl_incremental_render_new
+                                          (const CtplToken *tree,
+                                           CtplEnviron     *env);
+void          ctpl_incremental_render_free
+                                          (CtplIncrementalRender *render);
+void          ctpl_incremental_render_set_escape_mode
+                                          (CtplIncrementalRender *render,
+                                           CtplEscapeMode         mode);
+const gchar  *ctpl_incremental_render_update
+                                          (CtplIncrementalRender  *render,
+                                           gsize                  *length,
+                                           GError                **error);
+guint         ctpl_incremental_render_get_n_rendered
+                                          (const CtplIncrementalRender *render);
+
+
+G_END_DECLS
+
+#endif /* guard */
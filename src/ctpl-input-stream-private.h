@@ -0,0 +1,67 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef H_CTPL_INPUT_STREAM_PRIVATE_H
+#define H_CTPL_INPUT_STREAM_PRIVATE_H
+
+#include <glib.h>
+#include "ctpl-input-stream.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplSourceFile CtplSourceFile;
+
+/*
+ * CtplSourceFile:
+ * @path: The path of the file
+ * @device: The device of the file when it was mapped
+ * @inode: The inode of the file when it was mapped
+ * @size: The size of the file when it was mapped
+ * @mtime: The modification time of the file when it was mapped
+ * @mtime_nsec: The nanoseconds of @mtime, or 0 if not supported
+ * 
+ * A file a stream created with ctpl_input_stream_new_for_mapped_path() maps,
+ * see ctpl_source_file_check().
+ */
+struct _CtplSourceFile
+{
+  gchar    *path;
+  guint64   device;
+  guint64   inode;
+  goffset   size;
+  gint64    mtime;
+  gint32    mtime_nsec;
+};
+
+G_GNUC_INTERNAL
+GBytes           *ctpl_input_stream_get_source  (const CtplInputStream *stream,
+                                                 gsize                 *offset,
+                                                 const CtplSourceFile **file);
+G_GNUC_INTERNAL
+CtplInputStream  *ctpl_input_stream_new_region  (const CtplInputStream *stream,
+                                                 gsize                  length);
+G_GNUC_INTERNAL
+gboolean          ctpl_source_file_check        (const CtplSourceFile  *file,
+                                                 gint                   fd);
+
+
+G_END_DECLS
+
+#endif /* guard */
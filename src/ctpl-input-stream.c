@@ -17,13 +17,23 @@
  * 
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
 #include "ctpl-input-stream.h"
+#include "ctpl-input-stream-private.h"
 #include <stdlib.h>
 #include <glib.h>
 #include <gio/gio.h>
 #include <string.h>
 #include <errno.h>
 #include <stdarg.h>
+#ifdef G_OS_UNIX
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
 #include "ctpl-i18n.h"
 #include "ctpl-io.h"
 #include "ctpl-lexer-private.h"
@@ -45,7 +55,8 @@
  * (ctpl_input_stream_new_for_memory()), #GFile<!-- -->s
  * (ctpl_input_stream_new_for_gfile()), path
  * (ctpl_input_stream_new_for_path()) and URIs
- * (ctpl_input_stream_new_for_uri()).
+ * (ctpl_input_stream_new_for_uri()), or to map a file in memory
+ * (ctpl_input_stream_new_for_mapped_path()).
  * #CtplInputStream object uses a #GObject<!-- -->-like refcounting, via
  * ctpl_input_stream_ref() and ctpl_input_stream_unref().
  * 
@@ -67,6 +78,8 @@ struct _CtplInputStream
   /*< private >*/
   gint          ref_count;
   GInputStream *stream;
+  GBytes       *source; /* if set, @buffer holds its whole data */
+  const CtplSourceFile *source_file; /* the file @source maps, or %NULL */
   gchar        *buffer;
   gsize         buf_size;
   gsize         buf_pos;
@@ -98,6 +111,8 @@ ctpl_input_stream_new (GInputStream *stream,
   self = g_slice_alloc (sizeof *self);
   self->ref_count = 1;
   self->stream = g_object_ref (stream);
+  self->source = NULL;
+  self->source_file = NULL;
   self->buf_size = INPUT_STREAM_BUF_SIZE;
   self->buffer = g_malloc (self->buf_size);
   self->buf_pos = self->buf_size; /* force buffer filling */
@@ -138,6 +153,190 @@ ctpl_input_stream_new_for_memory (const gchar    *data,
   return stream;
 }
 
+/**
+ * ctpl_input_stream_new_for_bytes:
+ * @bytes: A #GBytes holding the data for which create the stream
+ * @name: The name of the stream to identify it in error messages, or %NULL
+ * 
+ * Creates a new #CtplInputStream for the data of a #GBytes. This function adds
+ * a reference to @bytes.
+ * 
+ * Unlike other streams, this one reads directly from @bytes without copying
+ * its data, and the lexer can make data tokens reference @bytes rather than
+ * holding their own copy of the data.
+ * 
+ * Returns: A new #CtplInputStream for the given data
+ * 
+ * Since: 0.4
+ */
+CtplInputStream *
+ctpl_input_stream_new_for_bytes (GBytes      *bytes,
+                                 const gchar *name)
+{
+  CtplInputStream *self;
+  gsize            size;
+  
+  self = g_slice_alloc (sizeof *self);
+  self->ref_count = 1;
+  /* only for ctpl_input_stream_get_stream(), we never read from it */
+  self->stream = g_memory_input_stream_new_from_bytes (bytes);
+  self->source = g_bytes_ref (bytes);
+  self->source_file = NULL;
+  self->buffer = (gchar *) g_bytes_get_data (bytes, &size);
+  self->buf_size = size;
+  self->buf_pos = 0U;
+  self->name = g_strdup (name);
+  self->line = 1U;
+  self->pos = 0U;
+  
+  return self;
+}
+
+#ifdef G_OS_UNIX
+/* a mapped file. the file is not kept open, but its path and identity are
+ * remembered so it can be reopened to let the kernel copy its data */
+typedef struct _MappedSource MappedSource;
+struct _MappedSource
+{
+  GMappedFile    *file;
+  CtplSourceFile  info;
+};
+
+static void
+mapped_source_free (gpointer data)
+{
+  MappedSource *source = data;
+  
+  g_mapped_file_unref (source->file);
+  g_free (source->info.path);
+  g_slice_free1 (sizeof *source, source);
+}
+
+/* fills the identity of @file from @st */
+static void
+source_file_set_stat (CtplSourceFile    *file,
+                      const struct stat *st)
+{
+  file->device = (guint64) st->st_dev;
+  file->inode = (guint64) st->st_ino;
+  file->size = (goffset) st->st_size;
+  file->mtime = (gint64) st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  file->mtime_nsec = (gint32) st->st_mtim.tv_nsec;
+#else
+  file->mtime_nsec = 0;
+#endif
+}
+#endif
+
+/**
+ * ctpl_input_stream_new_for_mapped_path:
+ * @path: The path of a local regular file, in the GLib's filename encoding
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Creates a new #CtplInputStream reading a file mapped in memory, like
+ * ctpl_input_stream_new_for_bytes(). The data tokens of a template lexed or
+ * loaded from the stream reference the mapping rather than holding a copy of
+ * the data, and large ones can be copied by the kernel when rendered to a file
+ * descriptor.
+ * 
+ * The caller must guarantee that the file is neither modified nor truncated as
+ * long as the stream or a template created from it is alive: as with any
+ * memory-mapped file, reading data that was truncated away raises a %SIGBUS
+ * signal, and other changes would show in the output. If this can't be
+ * guaranteed, use ctpl_input_stream_new_for_path() instead.
+ * 
+ * Returns: A new #CtplInputStream on success, %NULL on error or if mapping
+ *          files is not supported (in which case the error is
+ *          %G_IO_ERROR_NOT_SUPPORTED).
+ * 
+ * Since: 0.4
+ */
+CtplInputStream *
+ctpl_input_stream_new_for_mapped_path (const gchar  *path,
+                                       GError      **error)
+{
+#ifdef G_OS_UNIX
+  CtplInputStream  *stream;
+  GMappedFile      *file = NULL;
+  MappedSource     *source;
+  GBytes           *bytes;
+  struct stat       st;
+  gint              fd;
+  
+  fd = open (path, O_RDONLY);
+  if (fd < 0) {
+    gint    errsv = errno;
+    gchar  *name = g_filename_display_name (path);
+    
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 _("Failed to open file '%s': %s"), name, g_strerror (errsv));
+    g_free (name);
+    
+    return NULL;
+  }
+  /* only map regular files, others may change size or not be mappable */
+  if (fstat (fd, &st) != 0 || ! S_ISREG (st.st_mode)) {
+    gchar *name = g_filename_display_name (path);
+    
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_REGULAR_FILE,
+                 _("File '%s' is not a regular file"), name);
+    g_free (name);
+  } else if ((file = g_mapped_file_new_from_fd (fd, FALSE, NULL)) == NULL) {
+    gchar *name = g_filename_display_name (path);
+    
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 _("Failed to map file '%s'"), name);
+    g_free (name);
+  }
+  /* the mapping stays valid without the file descriptor */
+  close (fd);
+  if (! file) {
+    return NULL;
+  }
+  source = g_slice_alloc (sizeof *source);
+  source->file = file;
+  source->info.path = g_strdup (path);
+  source_file_set_stat (&source->info, &st);
+  bytes = g_bytes_new_with_free_func (g_mapped_file_get_contents (file),
+                                      g_mapped_file_get_length (file),
+                                      mapped_source_free, source);
+  stream = ctpl_input_stream_new_for_bytes (bytes, NULL);
+  stream->source_file = &source->info;
+  stream->name = g_filename_display_basename (path);
+  g_bytes_unref (bytes);
+  
+  return stream;
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               _("Memory-mapped input files are not supported"));
+  
+  return NULL;
+#endif
+}
+
+/* tries to create a stream reading the whole of a local regular file in
+ * memory. this doesn't report errors, callers should fallback to a regular
+ * read on failure */
+static CtplInputStream *
+ctpl_input_stream_new_for_local_path (const gchar *path)
+{
+  CtplInputStream  *stream = NULL;
+  gchar            *data;
+  gsize             length;
+  
+  /* only read regular files at once, others may not end */
+  if (g_file_test (path, G_FILE_TEST_IS_REGULAR) &&
+      g_file_get_contents (path, &data, &length, NULL)) {
+    GBytes *bytes = g_bytes_new_take (data, length);
+    
+    stream = ctpl_input_stream_new_for_bytes (bytes, NULL);
+    g_bytes_unref (bytes);
+  }
+  
+  return stream;
+}
+
 /**
  * ctpl_input_stream_new_for_gfile:
  * @file: A #GFile to read
@@ -148,6 +347,12 @@ ctpl_input_stream_new_for_memory (const gchar    *data,
  * The errors this function can throw are those from the %G_IO_ERROR domain.
  * See ctpl_input_stream_new().
  * 
+ * Since version 0.4, local regular files are read at once in memory, see
+ * ctpl_input_stream_new_for_bytes(). The data of templates lexed from the
+ * stream then doesn't need to be copied, and the file can safely be modified
+ * afterwards. To avoid reading the file, see
+ * ctpl_input_stream_new_for_mapped_path().
+ * 
  * Returns: A new #CtplInputStream on success, %NULL on error.
  * 
  * Since: 0.2
@@ -156,21 +361,40 @@ CtplInputStream *
 ctpl_input_stream_new_for_gfile (GFile    *file,
                                  GError  **error)
 {
-  GFileInputStream *gfstream;
   CtplInputStream  *stream = NULL;
+  GInputStream     *gstream = NULL;
+  gchar            *path;
   
-  gfstream = g_file_read (file, NULL, error);
-  if (gfstream) {
+  path = g_file_get_path (file);
+  if (path) {
+    stream = ctpl_input_stream_new_for_local_path (path);
+    g_free (path);
+  }
+  if (! stream) {
+    gstream = G_INPUT_STREAM (g_file_read (file, NULL, error));
+  }
+  if (stream || gstream) {
     GFileInfo *finfo;
     
     finfo = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME,
                                G_FILE_QUERY_INFO_NONE, NULL, error);
-    if (finfo) {
-      stream = ctpl_input_stream_new (G_INPUT_STREAM (gfstream),
+    if (! finfo) {
+      if (stream) {
+        ctpl_input_stream_unref (stream);
+        stream = NULL;
+      }
+    } else if (stream) {
+      stream->name = g_strdup (g_file_info_get_display_name (finfo));
+    } else {
+      stream = ctpl_input_stream_new (gstream,
                                       g_file_info_get_display_name (finfo));
+    }
+    if (finfo) {
       g_object_unref (finfo);
     }
-    g_object_unref (gfstream);
+    if (gstream) {
+      g_object_unref (gstream);
+    }
   }
   
   return stream;
@@ -264,7 +488,11 @@ ctpl_input_stream_unref (CtplInputStream *stream)
     g_free (stream->name);
     stream->buf_pos = stream->buf_size;
     stream->buf_size = 0U;
-    g_free (stream->buffer);
+    if (stream->source) {
+      g_bytes_unref (stream->source);
+    } else {
+      g_free (stream->buffer);
+    }
     g_object_unref (stream->stream);
     g_slice_free1 (sizeof *stream, stream);
   }
@@ -335,6 +563,110 @@ ctpl_input_stream_get_line_position (const CtplInputStream *stream)
   return stream->pos;
 }
 
+/*
+ * ctpl_input_stream_get_source:
+ * @stream: A #CtplInputStream
+ * @offset: (out): Return location for the current read offset in the source
+ * @file: (out): Return location for the file the source maps, or %NULL if it
+ *        isn't a mapped file. It is owned by the source
+ * 
+ * Gets the #GBytes a stream created with ctpl_input_stream_new_for_bytes()
+ * reads from, and the current read position in it.
+ * 
+ * Returns: (transfer none): The source #GBytes of @stream, or %NULL if it
+ *          doesn't read from a #GBytes, in which case @offset and @file are not
+ *          set.
+ */
+GBytes *
+ctpl_input_stream_get_source (const CtplInputStream *stream,
+                              gsize                 *offset,
+                              const CtplSourceFile **file)
+{
+  if (stream->source) {
+    *file = stream->source_file;
+    /* at the end, the buffer is marked empty */
+    *offset = stream->buf_size > 0 ? stream->buf_pos
+                                   : g_bytes_get_size (stream->source);
+  }
+  
+  return stream->source;
+}
+
+/*
+ * ctpl_input_stream_new_region:
+ * @stream: A #CtplInputStream reading from a #GBytes
+ * @length: The length of the region
+ * 
+ * Creates a new #CtplInputStream reading the next @length bytes of @stream,
+ * which must read from a #GBytes (see ctpl_input_stream_get_source()).
+ * The new stream starts at the current position of @stream, including its
+ * line and line position so that the errors it reports are located as if
+ * @stream reported them. @stream itself is not moved.
+ * 
+ * The new stream and @stream can be read concurrently from different
+ * threads.
+ * 
+ * Returns: A new #CtplInputStream.
+ */
+CtplInputStream *
+ctpl_input_stream_new_region (const CtplInputStream *stream,
+                              gsize                  length)
+{
+  CtplInputStream *self;
+  
+  g_return_val_if_fail (stream->source != NULL, NULL);
+  
+  self = g_slice_alloc (sizeof *self);
+  self->ref_count = 1;
+  self->stream = g_memory_input_stream_new_from_bytes (stream->source);
+  self->source = g_bytes_ref (stream->source);
+  self->source_file = stream->source_file;
+  self->buffer = stream->buffer;
+  self->buf_pos = stream->buf_size > 0 ? stream->buf_pos : 0U;
+  self->buf_size = stream->buf_size > 0 ? MIN (stream->buf_pos + length,
+                                               stream->buf_size) : 0U;
+  self->name = g_strdup (stream->name);
+  self->line = stream->line;
+  self->pos = stream->pos;
+  
+  return self;
+}
+
+/*
+ * ctpl_source_file_check:
+ * @file: A #CtplSourceFile
+ * @fd: A file descriptor open for reading
+ * 
+ * Checks whether @fd is the file @file was mapped from and whether that file
+ * still is the same as when it was mapped, that is it wasn't replaced, resized
+ * nor modified since.
+ * 
+ * Returns: %TRUE if @fd can be read in place of the mapping of @file, %FALSE
+ *          otherwise.
+ */
+gboolean
+ctpl_source_file_check (const CtplSourceFile *file,
+                        gint                  fd)
+{
+#ifdef G_OS_UNIX
+  CtplSourceFile  current;
+  struct stat     st;
+  
+  if (fstat (fd, &st) != 0 || ! S_ISREG (st.st_mode)) {
+    return FALSE;
+  }
+  source_file_set_stat (&current, &st);
+  
+  return (current.device == file->device &&
+          current.inode == file->inode &&
+          current.size == file->size &&
+          current.mtime == file->mtime &&
+          current.mtime_nsec == file->mtime_nsec);
+#else
+  return FALSE;
+#endif
+}
+
 /**
  * ctpl_input_stream_set_error:
  * @stream: A #CtplInputStream
@@ -387,7 +719,13 @@ ensure_cache_filled (CtplInputStream *stream,
 {
   gboolean success = TRUE;
   
-  if (stream->buf_pos >= stream->buf_size) {
+  if (stream->source) {
+    /* the whole data is in the buffer, so we are at the end */
+    if (stream->buf_pos >= stream->buf_size) {
+      stream->buf_size = 0U;
+      stream->buf_pos = 0U;
+    }
+  } else if (stream->buf_pos >= stream->buf_size) {
     gssize read_size;
     
     read_size = g_input_stream_read (stream->stream, stream->buffer,
@@ -427,7 +765,9 @@ resize_cache (CtplInputStream *stream,
   
   g_return_val_if_fail (new_size > 0, FALSE);
   
-  if (new_size > stream->buf_size) {
+  if (stream->source) {
+    /* the buffer already holds the whole data, and isn't ours to resize */
+  } else if (new_size > stream->buf_size) {
     gssize read_size;
     gchar *new_buffer;
     
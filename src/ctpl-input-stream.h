@@ -51,10 +51,14 @@ CtplInputStream  *ctpl_input_stream_new_for_memory      (const gchar   *data,
                                                          gssize         length,
                                                          GDestroyNotify destroy,
                                                          const gchar   *name);
+CtplInputStream  *ctpl_input_stream_new_for_bytes       (GBytes        *bytes,
+                                                         const gchar   *name);
 CtplInputStream  *ctpl_input_stream_new_for_gfile       (GFile    *file,
                                                          GError  **error);
 CtplInputStream  *ctpl_input_stream_new_for_path        (const gchar   *path,
                                                          GError       **error);
+CtplInputStream  *ctpl_input_stream_new_for_mapped_path (const gchar   *path,
+                                                         GError       **error);
 CtplInputStream  *ctpl_input_stream_new_for_uri         (const gchar   *uri,
                                                          GError       **error);
 CtplInputStream  *ctpl_input_stream_ref                 (CtplInputStream *stream);
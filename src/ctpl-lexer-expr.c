@@ -104,6 +104,20 @@
  *     </listitem>
  *   </varlistentry>
  *   <varlistentry>
+ *     <term>Function calls</term>
+ *     <listitem>
+ *       <para>
+ *         A function name immediately followed by a parenthesized and
+ *         comma-separated list of expressions, like
+ *         <code>max(a, b + 1)</code>.
+ *         The function is looked up among the ones known to
+ *         <link linkend="ctpl-Functions">the function registry</link> when the
+ *         expression is evaluated, and its result may be used as any other
+ *         operand.
+ *       </para>
+ *     </listitem>
+ *   </varlistentry>
+ *   <varlistentry>
  *     <term>Parentheses</term>
  *     <listitem>
  *       <para>
@@ -132,6 +146,12 @@
  *     array[array[idx + 1]] * array[idx]
  *   </programlisting>
  * </example>
+ * <example>
+ *   <title>An expression with function calls</title>
+ *   <programlisting>
+ *     sum(array) / len(array)
+ *   </programlisting>
+ * </example>
  * Of course, the latter examples supposes that the environment contains the
  * variables @foo, @bar, @array and @idx, and that they contains appropriate
  * values for latter evaluation.
@@ -183,9 +203,54 @@ read_number (CtplInputStream *stream,
   return token;
 }
 
-/* Reads a symbol from @stream
+/* Reads the comma-separated arguments of a function call, from the opening
+ * parenthesis up to and including the closing one
+ * Returns: The list of the read arguments, or %NULL on error or if there were
+ *          no arguments -- check @error to know */
+static GSList *
+read_call_args (CtplInputStream *stream,
+                GError         **error)
+{
+  GSList   *args = NULL;
+  GError   *err = NULL;
+  gchar     c = ')';
+  
+  ctpl_input_stream_get_c (stream, NULL); /* eat the ( */
+  if (ctpl_input_stream_skip_blank (stream, &err) < 0) {
+    /* I/O error */
+  } else if (ctpl_input_stream_peek_c (stream, &err) == ')') {
+    ctpl_input_stream_get_c (stream, &err); /* no arguments */
+  } else if (! err) {
+    do {
+      CtplTokenExpr *arg;
+      
+      arg = ctpl_lexer_expr_lex_full (stream, FALSE, &err);
+      if (arg) {
+        args = g_slist_prepend (args, arg);
+        c = ctpl_input_stream_get_c (stream, &err);
+        if (! err && c != ',' && c != ')') {
+          ctpl_input_stream_set_error (stream, &err, CTPL_LEXER_EXPR_ERROR,
+                                       CTPL_LEXER_EXPR_ERROR_SYNTAX_ERROR,
+                                       _("Unexpected character '%c', expected "
+                                         "',' or ')'"), c);
+        }
+      }
+    } while (! err && c == ',');
+  }
+  if (err) {
+    g_slist_free_full (args, (GDestroyNotify) ctpl_token_expr_free);
+    args = NULL;
+    g_propagate_error (error, err);
+  }
+  
+  return g_slist_reverse (args);
+}
+
+/* Reads a symbol from @stream, or a function call if the symbol is immediately
+ * followed by an opening parenthesis
  * See ctpl_input_stream_read_symbol()
- * Returns: A new #CtplTokenExpr holding the symbol, or %NULL on error */
+ * Returns: A new #CtplTokenExpr holding the symbol or the call, or %NULL on
+ *          error */
 static CtplTokenExpr *
 read_symbol (CtplInputStream *stream,
              GError         **error)
@@ -195,12 +260,24 @@ read_symbol (CtplInputStream *stream,
   
   symbol = ctpl_input_stream_read_symbol (stream, error);
   if (symbol) {
-    if (*symbol) {
-      token = ctpl_token_expr_new_symbol (symbol, -1);
-    } else {
+    GError *err = NULL;
+    
+    if (! *symbol) {
       ctpl_input_stream_set_error (stream, error, CTPL_LEXER_EXPR_ERROR,
                                    CTPL_LEXER_EXPR_ERROR_SYNTAX_ERROR,
                                    _("No valid symbol"));
+    } else if (ctpl_input_stream_peek_c (stream, &err) == '(' && ! err) {
+      GSList *args;
+      
+      args = read_call_args (stream, &err);
+      if (! err) {
+        token = ctpl_token_expr_new_call (symbol, -1, args);
+      }
+    } else if (! err) {
+      token = ctpl_token_expr_new_symbol (symbol, -1);
+    }
+    if (err) {
+      g_propagate_error (error, err);
     }
   }
   g_free (symbol);
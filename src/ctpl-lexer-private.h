@@ -140,6 +140,10 @@ G_GNUC_INTERNAL
 CtplOperator    ctpl_operator_from_string   (const gchar *str,
                                              gssize       len,
                                              gsize       *operator_len);
+G_GNUC_INTERNAL
+gsize           ctpl_lexer_scan_unit        (const gchar *data,
+                                             gsize        i,
+                                             gsize        length);
 
 
 G_END_DECLS
@@ -20,12 +20,18 @@
 #include "ctpl-lexer.h"
 #include <glib.h>
 #include <string.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 #include "ctpl-i18n.h"
+#include "ctpl-escape.h"
 #include "ctpl-lexer-private.h"
 #include "ctpl-input-stream.h"
+#include "ctpl-input-stream-private.h"
 #include "ctpl-lexer-expr.h"
 #include "ctpl-token.h"
 #include "ctpl-token-private.h"
+#include "ctpl-threads-private.h"
 
 
 /**
@@ -57,9 +63,25 @@
  * }
  * </programlisting>
  * </example>
+ * 
+ * Large templates read from memory (e.g. with ctpl_lexer_lex_bytes() or
+ * ctpl_lexer_lex_path()) are lexed on several threads: a quick scan of the
+ * data finds the boundaries of the top-level statements, and independent
+ * regions made of whole top-level blocks are lexed concurrently. The resulting
+ * tree and the reported errors are the same as when lexing sequentially.
  */
 
 
+/* minimum size of the data to lex for it to be split in regions lexed in
+ * parallel */
+#define LEXER_PARALLEL_MIN_SIZE   (1U << 20)
+/* minimum size of a region lexed in parallel */
+#define LEXER_PARALLEL_MIN_REGION (64U << 10)
+/* number of regions per thread, so that threads finishing early can take over
+ * work from the others */
+#define LEXER_PARALLEL_REGIONS_PER_THREAD 4U
+
+
 /* statements constants */
 enum
 {
@@ -266,6 +288,41 @@ ctpl_lexer_read_token_tpl_for (CtplInputStream *stream,
   return token;
 }
 
+/* reads the end of a cache statement and its content (the "}...{end}" part of
+ * a "{cache}...{end}")
+ * Return a new token or %NULL on error */
+static CtplToken *
+ctpl_lexer_read_token_tpl_cache (CtplInputStream *stream,
+                                 LexerState      *state,
+                                 GError         **error)
+{
+  CtplToken *token = NULL;
+  
+  if (ctpl_lexer_read_stmt_end (stream, "cache", error)) {
+    GError     *err = NULL;
+    CtplToken  *children;
+    LexerState  substate = *state;
+    
+    substate.block_depth ++;
+    children = ctpl_lexer_lex_internal (stream, &substate, &err);
+    if (! err) {
+      if (state->block_depth != substate.block_depth) {
+        ctpl_input_stream_set_error (stream, &err, CTPL_LEXER_ERROR,
+                                     CTPL_LEXER_ERROR_SYNTAX_ERROR,
+                                     _("Unclosed 'cache' block"));
+        ctpl_token_free (children);
+      } else {
+        token = ctpl_token_new_cache (children);
+      }
+    }
+    if (err) {
+      g_propagate_error (error, err);
+    }
+  }
+  
+  return token;
+}
+
 /* reads an end block end (} of a {end} block)
  * Always returns %NULL to stop lexing pass or notify an error. */
 static CtplToken *
@@ -279,8 +336,8 @@ ctpl_lexer_read_token_tpl_end (CtplInputStream *stream,
       /* a non-opened block was closed, fail */
       ctpl_input_stream_set_error (stream, error, CTPL_LEXER_ERROR,
                                    CTPL_LEXER_ERROR_SYNTAX_ERROR,
-                                   _("Unmatched 'end' statement (needs a 'if' "
-                                     "or 'for' before)"));
+                                   _("Unmatched 'end' statement (needs an "
+                                     "'if', 'for' or 'cache' before)"));
     } else {
       state->last_statement_type_if = S_END;
     }
@@ -311,8 +368,55 @@ ctpl_lexer_read_token_tpl_else (CtplInputStream *stream,
   return NULL;
 }
 
+/* Reads the optional escape mode of an expression (the "|html" part of
+ * "{expr|html}"), setting @escape to %CTPL_ESCAPE_INHERIT if there is none */
+static gboolean
+ctpl_lexer_read_escape_mode (CtplInputStream  *stream,
+                             gint             *escape,
+                             GError          **error)
+{
+  gboolean success = FALSE;
+  
+  *escape = CTPL_ESCAPE_INHERIT;
+  if (ctpl_input_stream_skip_blank (stream, error) >= 0) {
+    GError *err = NULL;
+    gchar   c;
+    
+    c = ctpl_input_stream_peek_c (stream, &err);
+    if (err) {
+      /* I/O error */
+      g_propagate_error (error, err);
+    } else if (c != '|') {
+      /* no escape mode */
+      success = TRUE;
+    } else {
+      ctpl_input_stream_get_c (stream, NULL); /* skip the pipe */
+      if (ctpl_input_stream_skip_blank (stream, error) >= 0) {
+        gchar *name;
+        
+        name = ctpl_input_stream_read_symbol (stream, error);
+        if (name) {
+          CtplEscapeMode mode;
+          
+          if (! ctpl_escape_mode_from_string (name, &mode)) {
+            ctpl_input_stream_set_error (stream, error, CTPL_LEXER_ERROR,
+                                         CTPL_LEXER_ERROR_SYNTAX_ERROR,
+                                         _("Unknown escape mode '%s'"), name);
+          } else {
+            *escape = mode;
+            success = TRUE;
+          }
+          g_free (name);
+        }
+      }
+    }
+  }
+  
+  return success;
+}
+
 /* Reads an expression token (:BLANKCHARS:?:EXPRCHARS::BLANKCHARS:?}, without
- * the opening character) */
+ * the opening character), optionally followed by an escape mode */
 static CtplToken *
 ctpl_lexer_read_token_tpl_expr (CtplInputStream *stream,
                                 LexerState      *state,
@@ -320,12 +424,14 @@ ctpl_lexer_read_token_tpl_expr (CtplInputStream *stream,
 {
   CtplToken      *token = NULL;
   CtplTokenExpr  *expr;
+  gint            escape;
   
   (void)state; /* we don't use the state, silent compilers */
   expr = ctpl_lexer_expr_lex_full (stream, FALSE, error);
   if (expr) {
-    if (ctpl_lexer_read_stmt_end (stream, "expression", error)) {
-      token = ctpl_token_new_expr (expr);
+    if (ctpl_lexer_read_escape_mode (stream, &escape, error) &&
+        ctpl_lexer_read_stmt_end (stream, "expression", error)) {
+      token = ctpl_token_new_expr (expr, escape);
     } else {
       ctpl_token_expr_free (expr);
     }
@@ -359,9 +465,9 @@ ctpl_lexer_read_token_tpl (CtplInputStream *stream,
       gchar  *first_word;
       gsize   first_word_len;
       
-      /* the maximum length of an interesting word is 4 (else), plus one to be
-       * sure we get the end of the word */
-      first_word = ctpl_input_stream_peek_symbol_full (stream, 5,
+      /* the maximum length of an interesting word is 5 (cache), plus one to
+       * be sure we get the end of the word */
+      first_word = ctpl_input_stream_peek_symbol_full (stream, 6,
                                                        &first_word_len, error);
       if (first_word) {
         /* tries to handle @keyword, returns whether it has been handled.
@@ -378,6 +484,7 @@ ctpl_lexer_read_token_tpl (CtplInputStream *stream,
         } else if (HANDLE_KEYWORD ("for",   ctpl_lexer_read_token_tpl_for)) {
         } else if (HANDLE_KEYWORD ("end",   ctpl_lexer_read_token_tpl_end)) {
         } else if (HANDLE_KEYWORD ("else",  ctpl_lexer_read_token_tpl_else)) {
+        } else if (HANDLE_KEYWORD ("cache", ctpl_lexer_read_token_tpl_cache)) {
         } else {
           /* if nothing matched, it's an expression or nothing valid */
           token = ctpl_lexer_read_token_tpl_expr (stream, state, error);
@@ -394,6 +501,8 @@ ctpl_lexer_read_token_tpl (CtplInputStream *stream,
 }
 
 /* reads a data token
+ * If the stream reads from a #GBytes and the data has no escapes, the token
+ * references the stream's source rather than holding a copy of the data.
  * Returns: A new token on full success, %NULL otherwise (syntax error or empty
  *          read) */
 static CtplToken *
@@ -405,11 +514,18 @@ ctpl_lexer_read_token_data (CtplInputStream *stream,
   gchar c;
   gint        prev_c;
   gboolean    escaped = FALSE;
-  GString    *gstring;
+  GString    *gstring = NULL;
+  GBytes     *source;
+  gsize       start   = 0;
+  gsize       len     = 0;
+  const CtplSourceFile *file = NULL;
   GError     *err = NULL;
   
   (void)state; /* we don't use the state, silent compilers */
-  gstring = g_string_new ("");
+  source = ctpl_input_stream_get_source (stream, &start, &file);
+  if (! source) {
+    gstring = g_string_new ("");
+  }
   while (! err) {
     c = ctpl_input_stream_peek_c (stream, &err);
     if (err || ctpl_input_stream_eof_fast (stream) ||
@@ -417,7 +533,17 @@ ctpl_lexer_read_token_data (CtplInputStream *stream,
       break;
     } else {
       if (c != CTPL_ESCAPE_CHAR || escaped) {
-        g_string_append_c (gstring, c);
+        if (gstring) {
+          g_string_append_c (gstring, c);
+        } else {
+          len++;
+        }
+      } else if (! gstring) {
+        /* the data is no longer contiguous in the source, fallback to a
+         * copy */
+        gstring = g_string_new_len ((const gchar *) g_bytes_get_data (source,
+                                                                      NULL) +
+                                    start, (gssize) len);
       }
       prev_c = ctpl_input_stream_get_c (stream, &err);
       escaped = (prev_c == CTPL_ESCAPE_CHAR) ? ! escaped : FALSE;
@@ -437,12 +563,18 @@ ctpl_lexer_read_token_data (CtplInputStream *stream,
                                    _("Unexpected character '%c' inside data "
                                      "block"),
                                    c);
-    } else if (gstring->len > 0) {
+    } else if (gstring) {
       /* only create non-empty tokens */
-      token = ctpl_token_new_data (gstring->str, (gssize) gstring->len);
+      if (gstring->len > 0) {
+        token = ctpl_token_new_data (gstring->str, (gssize) gstring->len);
+      }
+    } else if (len > 0) {
+      token = ctpl_token_new_data_for_bytes (source, start, len, file);
     }
   }
-  g_string_free (gstring, TRUE);
+  if (gstring) {
+    g_string_free (gstring, TRUE);
+  }
   
   return token;
 }
@@ -518,6 +650,336 @@ ctpl_lexer_lex_internal (CtplInputStream *stream,
   return root;
 }
 
+/* finds the next character in @data from @i that has a meaning outside
+ * statements, or @length if there is none */
+static gsize
+ctpl_lexer_scan_data (const gchar *data,
+                      gsize        i,
+                      gsize        length)
+{
+#ifdef __SSE2__
+  const __m128i start = _mm_set1_epi8 (CTPL_START_CHAR);
+  const __m128i end   = _mm_set1_epi8 (CTPL_END_CHAR);
+  const __m128i esc   = _mm_set1_epi8 (CTPL_ESCAPE_CHAR);
+  
+  for (; i + 16 <= length; i += 16) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) &data[i]);
+    gint    mask;
+    
+    mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (v, start),
+                                                          _mm_cmpeq_epi8 (v, end)),
+                                            _mm_cmpeq_epi8 (v, esc)));
+    if (mask != 0) {
+      return i + (gsize) g_bit_nth_lsf ((gulong) mask, -1);
+    }
+  }
+#endif
+  for (; i < length; i++) {
+    if (data[i] == CTPL_START_CHAR || data[i] == CTPL_END_CHAR ||
+        data[i] == CTPL_ESCAPE_CHAR) {
+      break;
+    }
+  }
+  
+  return i;
+}
+
+/* skips the run of escape characters at @i, and the character they escape if
+ * any.
+ * Returns: The position after the escaped character */
+static gsize
+ctpl_lexer_skip_escapes (const gchar *data,
+                         gsize        i,
+                         gsize        length)
+{
+  gsize n;
+  
+  for (n = i; n < length && data[n] == CTPL_ESCAPE_CHAR; n++);
+  /* an odd number of escape characters escapes the next one */
+  return (n - i) % 2 != 0 ? MIN (n + 1, length) : n;
+}
+
+/* skips a statement starting at @i (after the opening character), updating
+ * @depth according to its keyword.
+ * Returns: The position after the statement, or 0 if it looks invalid */
+static gsize
+ctpl_lexer_scan_statement (const gchar *data,
+                           gsize        i,
+                           gsize        length,
+                           gint        *depth)
+{
+  gsize word;
+  
+  while (i < length && ctpl_is_blank (data[i])) {
+    i++;
+  }
+  for (word = i; i < length && ctpl_is_symbol (data[i]); i++);
+  if (i - word == 2 && strncmp (&data[word], "if", 2) == 0) {
+    (*depth)++;
+  } else if (i - word == 3 && strncmp (&data[word], "for", 3) == 0) {
+    (*depth)++;
+  } else if (i - word == 5 && strncmp (&data[word], "cache", 5) == 0) {
+    (*depth)++;
+  } else if (i - word == 3 && strncmp (&data[word], "end", 3) == 0) {
+    (*depth)--;
+  }
+  while (i < length) {
+    gchar c = data[i++];
+    
+    if (c == CTPL_END_CHAR) {
+      return i;
+    } else if (c == CTPL_START_CHAR) {
+      break;
+    } else if (c == CTPL_STRING_DELIMITER_CHAR) {
+      gboolean escaped = FALSE;
+      
+      for (; i < length && (escaped || data[i] != CTPL_STRING_DELIMITER_CHAR);
+           i++) {
+        escaped = (data[i] == CTPL_ESCAPE_CHAR) ? ! escaped : FALSE;
+      }
+      i++; /* closing delimiter */
+    }
+  }
+  
+  return 0;
+}
+
+/*
+ * ctpl_lexer_scan_regions:
+ * @data: The template data
+ * @length: The length of @data
+ * @region_size: The minimum size of a region
+ * @n_regions: (out): Return location for the number of regions
+ * 
+ * Splits template data in regions that can be lexed independently, that is
+ * that start at a top-level statement. The data is only scanned for the
+ * statement boundaries and the keywords opening and closing blocks, it is
+ * not validated.
+ * 
+ * Returns: The end offset of each region, to free with g_free(), or %NULL if
+ *          @data can't be split (because it is too small or invalid).
+ */
+static gsize *
+ctpl_lexer_scan_regions (const gchar *data,
+                         gsize        length,
+                         gsize        region_size,
+                         guint       *n_regions)
+{
+  GArray *ends;
+  gsize   start = 0;
+  gsize   i = 0;
+  gint    depth = 0;
+  
+  ends = g_array_new (FALSE, FALSE, sizeof (gsize));
+  while (depth >= 0 && (i = ctpl_lexer_scan_data (data, i, length)) < length) {
+    if (data[i] == CTPL_ESCAPE_CHAR) {
+      i = ctpl_lexer_skip_escapes (data, i, length);
+    } else if (data[i] == CTPL_END_CHAR) {
+      break;
+    } else {
+      if (depth == 0 && i - start >= region_size) {
+        g_array_append_val (ends, i);
+        start = i;
+      }
+      i = ctpl_lexer_scan_statement (data, i + 1, length, &depth);
+      if (i == 0) {
+        break;
+      }
+    }
+  }
+  if (i < length || depth != 0 || ends->len == 0) {
+    /* invalid or too small, leave it to the regular lexer */
+    g_array_free (ends, TRUE);
+    return NULL;
+  }
+  g_array_append_val (ends, length);
+  *n_regions = ends->len;
+  
+  return (gsize *) g_array_free (ends, FALSE);
+}
+
+/*
+ * ctpl_lexer_scan_unit:
+ * @data: The template data
+ * @i: The offset of the start of a top-level unit in @data
+ * @length: The length of @data
+ * 
+ * Finds the end of a top-level unit of a template, that is either a run of data
+ * up to the next statement, or a top-level statement together with the block
+ * it opens if any.
+ * Like ctpl_lexer_scan_regions(), the data is only scanned for the statement
+ * boundaries and the keywords opening and closing blocks, it is not validated.
+ * 
+ * Returns: The offset of the end of the unit, or 0 if it looks invalid.
+ */
+gsize
+ctpl_lexer_scan_unit (const gchar *data,
+                      gsize        i,
+                      gsize        length)
+{
+  gint depth = 0;
+  
+  if (i >= length) {
+    return 0;
+  }
+  if (data[i] != CTPL_START_CHAR) {
+    while ((i = ctpl_lexer_scan_data (data, i, length)) < length &&
+           data[i] == CTPL_ESCAPE_CHAR) {
+      i = ctpl_lexer_skip_escapes (data, i, length);
+    }
+    
+    return (i < length && data[i] == CTPL_END_CHAR) ? 0 : i;
+  }
+  while ((i = ctpl_lexer_scan_statement (data, i + 1, length, &depth)) > 0 &&
+         depth > 0) {
+    while ((i = ctpl_lexer_scan_data (data, i, length)) < length &&
+           data[i] == CTPL_ESCAPE_CHAR) {
+      i = ctpl_lexer_skip_escapes (data, i, length);
+    }
+    if (i >= length || data[i] == CTPL_END_CHAR) {
+      return 0;
+    }
+  }
+  
+  return depth == 0 ? i : 0;
+}
+
+
+typedef struct _LexerRegions LexerRegions;
+
+/* state of the lexing of regions in parallel */
+struct _LexerRegions
+{
+  CtplInputStream **streams;
+  CtplToken       **trees;
+  guint             n_regions;
+  gint              next_region;
+  gint              failed;
+};
+
+/* lexes regions until there are none left */
+static void
+ctpl_lexer_lex_regions (gpointer data)
+{
+  LexerRegions *regions = data;
+  gint          i;
+  
+  while ((i = g_atomic_int_add (&regions->next_region, 1)) <
+           (gint) regions->n_regions &&
+         ! g_atomic_int_get (&regions->failed)) {
+    LexerState  state = {0, S_NONE};
+    GError     *err = NULL;
+    
+    regions->trees[i] = ctpl_lexer_lex_internal (regions->streams[i], &state,
+                                                 &err);
+    if (err) {
+      g_error_free (err);
+      g_atomic_int_set (&regions->failed, TRUE);
+    }
+  }
+}
+
+/*
+ * ctpl_lexer_lex_parallel:
+ * @stream: A #CtplInputStream
+ * @tree: (out): Return location for the tree
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Lexes @stream by splitting it in regions lexed concurrently, if it reads
+ * from memory and is large enough for it to be worth it.
+ * If a region fails to lex, the whole data is lexed again sequentially so that
+ * the reported error is the one the sequential lexer would have reported.
+ * 
+ * Returns: %TRUE if @stream was lexed, in which case @tree and @error are set
+ *          like with ctpl_lexer_lex_internal(); %FALSE if @stream should be
+ *          lexed sequentially.
+ */
+static gboolean
+ctpl_lexer_lex_parallel (CtplInputStream  *stream,
+                         CtplToken       **tree,
+                         GError          **error)
+{
+  GBytes           *source;
+  const gchar      *data;
+  gsize             offset;
+  gsize             size;
+  const CtplSourceFile *file;
+  guint             n_threads;
+  gsize            *ends;
+  LexerRegions      regions;
+  CtplInputStream  *whole;
+  gsize             start = 0;
+  guint             i;
+  
+  source = ctpl_input_stream_get_source (stream, &offset, &file);
+  n_threads = ctpl_threads_get_max ();
+  if (! source || n_threads < 2) {
+    return FALSE;
+  }
+  data = g_bytes_get_data (source, &size);
+  if (size - offset < LEXER_PARALLEL_MIN_SIZE) {
+    return FALSE;
+  }
+  ends = ctpl_lexer_scan_regions (&data[offset], size - offset,
+                                  MAX ((size - offset) /
+                                       (n_threads *
+                                        LEXER_PARALLEL_REGIONS_PER_THREAD),
+                                       LEXER_PARALLEL_MIN_REGION),
+                                  &regions.n_regions);
+  if (! ends) {
+    return FALSE;
+  }
+  
+  whole = ctpl_input_stream_new_region (stream, size - offset);
+  regions.streams = g_new (CtplInputStream *, regions.n_regions);
+  regions.trees = g_new0 (CtplToken *, regions.n_regions);
+  for (i = 0; i < regions.n_regions; i++) {
+    regions.streams[i] = ctpl_input_stream_new_region (stream, ends[i] - start);
+    /* moves @stream to the start of the next region, counting lines */
+    ctpl_input_stream_skip (stream, ends[i] - start, NULL);
+    start = ends[i];
+  }
+  regions.next_region = 0;
+  regions.failed = FALSE;
+  ctpl_threads_run (MIN (n_threads, regions.n_regions), ctpl_lexer_lex_regions,
+                    &regions);
+  
+  *tree = NULL;
+  for (i = 0; i < regions.n_regions; i++) {
+    CtplToken *token = regions.trees[i];
+    
+    if (regions.failed) {
+      ctpl_token_free (token);
+    }
+    /* link the tokens one by one so the tree is exactly the one the
+     * sequential lexer creates */
+    while (! regions.failed && token) {
+      CtplToken *next = token->next;
+      
+      token->next = NULL;
+      token->last = NULL;
+      if (! *tree) {
+        *tree = token;
+      } else {
+        ctpl_token_append (*tree, token);
+      }
+      token = next;
+    }
+    ctpl_input_stream_unref (regions.streams[i]);
+  }
+  if (regions.failed) {
+    LexerState state = {0, S_NONE};
+    
+    *tree = ctpl_lexer_lex_internal (whole, &state, error);
+  }
+  ctpl_input_stream_unref (whole);
+  g_free (regions.trees);
+  g_free (regions.streams);
+  g_free (ends);
+  
+  return TRUE;
+}
+
 /**
  * ctpl_lexer_lex:
  * @stream: A #CtplInputStream holding the data to analyse
@@ -539,7 +1001,9 @@ ctpl_lexer_lex (CtplInputStream *stream,
   LexerState  lex_state = {0, S_NONE};
   GError     *err = NULL;
   
-  root = ctpl_lexer_lex_internal (stream, &lex_state, &err);
+  if (! ctpl_lexer_lex_parallel (stream, &root, &err)) {
+    root = ctpl_lexer_lex_internal (stream, &lex_state, &err);
+  }
   if (err) {
     g_propagate_error (error, err);
   } else if (! root) {
@@ -567,12 +1031,13 @@ CtplToken *
 ctpl_lexer_lex_string (const gchar *template,
                        GError     **error)
 {
-  CtplToken        *tree = NULL;
-  CtplInputStream  *stream;
+  CtplToken  *tree = NULL;
+  GBytes     *bytes;
   
-  stream = ctpl_input_stream_new_for_memory (template, -1, NULL, NULL);
-  tree = ctpl_lexer_lex (stream, error);
-  ctpl_input_stream_unref (stream);
+  /* copy the template once so the data tokens can reference it */
+  bytes = g_bytes_new (template, strlen (template));
+  tree = ctpl_lexer_lex_bytes (bytes, error);
+  g_bytes_unref (bytes);
   
   return tree;
 }
@@ -586,6 +1051,10 @@ ctpl_lexer_lex_string (const gchar *template,
  * Convenient function to lex a template from a file.
  * See ctpl_lexer_lex().
  * 
+ * Local files are read at once in memory, in which case the returned tree
+ * references that memory rather than copying its data (see
+ * ctpl_input_stream_new_for_gfile()).
+ * 
  * Errors can come from the %G_IO_ERROR domain if the file loading fails, or
  * from the %CTPL_LEXER_ERROR domain if the lexing fails.
  * 
@@ -606,3 +1075,33 @@ ctpl_lexer_lex_path (const gchar *path,
   
   return tree;
 }
+
+/**
+ * ctpl_lexer_lex_bytes:
+ * @bytes: A #GBytes holding the template data
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Convenient function to lex a template from a #GBytes.
+ * See ctpl_lexer_lex().
+ * 
+ * The data tokens of the returned tree reference @bytes instead of holding a
+ * copy of the data, so this is the cheapest way to lex a template already in
+ * memory.
+ * 
+ * Returns: A new #CtplToken tree or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+CtplToken *
+ctpl_lexer_lex_bytes (GBytes  *bytes,
+                      GError **error)
+{
+  CtplToken        *tree = NULL;
+  CtplInputStream  *stream;
+  
+  stream = ctpl_input_stream_new_for_bytes (bytes, NULL);
+  tree = ctpl_lexer_lex (stream, error);
+  ctpl_input_stream_unref (stream);
+  
+  return tree;
+}
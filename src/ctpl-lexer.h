@@ -61,6 +61,8 @@ CtplToken  *ctpl_lexer_lex_string   (const gchar *template,
                                      GError     **error);
 CtplToken  *ctpl_lexer_lex_path     (const gchar *path,
                                      GError     **error);
+CtplToken  *ctpl_lexer_lex_bytes    (GBytes  *bytes,
+                                     GError **error);
 
 
 G_END_DECLS
@@ -0,0 +1,64 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#ifndef H_CTPL_LRU_PRIVATE_H
+#define H_CTPL_LRU_PRIVATE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplLru CtplLru;
+
+/*
+ * CtplLru:
+ * 
+ * A list of cache entries ordered by last use, see ctpl_lru_init().
+ */
+struct _CtplLru
+{
+  /*< private >*/
+  GMutex  lock;
+  GQueue  queue;  /* most recently used first */
+};
+
+G_GNUC_INTERNAL
+void      ctpl_lru_init       (CtplLru  *lru);
+G_GNUC_INTERNAL
+void      ctpl_lru_clear      (CtplLru  *lru);
+G_GNUC_INTERNAL
+void      ctpl_lru_add        (CtplLru  *lru,
+                               GList    *link,
+                               gpointer  entry);
+G_GNUC_INTERNAL
+void      ctpl_lru_touch      (CtplLru  *lru,
+                               GList    *link);
+G_GNUC_INTERNAL
+void      ctpl_lru_remove     (CtplLru  *lru,
+                               GList    *link);
+G_GNUC_INTERNAL
+gpointer  ctpl_lru_get_oldest (CtplLru  *lru,
+                               gpointer  keep);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,156 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#include "ctpl-lru-private.h"
+#include <glib.h>
+
+
+/*
+ * SECTION: lru
+ * @short_description: Least recently used lists
+ * 
+ * A #CtplLru keeps the entries of a cache ordered by last use, so that the
+ * least recently used one can be evicted without looking at all of them.
+ * 
+ * The list doesn't allocate anything: each entry embeds the #GList link it is
+ * listed with. The list has its own lock so that entries can be touched while
+ * the cache is only locked for reading, but adding and removing entries
+ * requires the cache to be locked for writing, so that an entry is never
+ * removed while being touched.
+ * 
+ * Touching an entry never waits for the list's lock: if another thread holds
+ * it, the touch is skipped. Concurrent lookups thus don't serialize on the
+ * list, at the cost of an order that is only approximately the order of use.
+ */
+
+
+/*
+ * ctpl_lru_init:
+ * @lru: A #CtplLru
+ * 
+ * Initializes an empty #CtplLru.
+ */
+void
+ctpl_lru_init (CtplLru *lru)
+{
+  g_mutex_init (&lru->lock);
+  g_queue_init (&lru->queue);
+}
+
+/*
+ * ctpl_lru_clear:
+ * @lru: A #CtplLru
+ * 
+ * Frees the resources of a #CtplLru. The entries must have been removed
+ * already.
+ */
+void
+ctpl_lru_clear (CtplLru *lru)
+{
+  g_warn_if_fail (g_queue_is_empty (&lru->queue));
+  g_mutex_clear (&lru->lock);
+}
+
+/*
+ * ctpl_lru_add:
+ * @lru: A #CtplLru
+ * @link: The link of @entry, which must not be in a list
+ * @entry: The entry to add
+ * 
+ * Adds an entry to a #CtplLru as the most recently used one.
+ */
+void
+ctpl_lru_add (CtplLru  *lru,
+              GList    *link,
+              gpointer  entry)
+{
+  link->data = entry;
+  link->prev = NULL;
+  link->next = NULL;
+  g_mutex_lock (&lru->lock);
+  g_queue_push_head_link (&lru->queue, link);
+  g_mutex_unlock (&lru->lock);
+}
+
+/*
+ * ctpl_lru_touch:
+ * @lru: A #CtplLru
+ * @link: The link of an entry of @lru
+ * 
+ * Marks an entry of a #CtplLru as the most recently used one, unless the list
+ * is busy, in which case nothing is done.
+ */
+void
+ctpl_lru_touch (CtplLru *lru,
+                GList   *link)
+{
+  if (g_mutex_trylock (&lru->lock)) {
+    if (link != lru->queue.head) {
+      g_queue_unlink (&lru->queue, link);
+      g_queue_push_head_link (&lru->queue, link);
+    }
+    g_mutex_unlock (&lru->lock);
+  }
+}
+
+/*
+ * ctpl_lru_remove:
+ * @lru: A #CtplLru
+ * @link: The link of an entry of @lru
+ * 
+ * Removes an entry from a #CtplLru.
+ */
+void
+ctpl_lru_remove (CtplLru *lru,
+                 GList   *link)
+{
+  g_mutex_lock (&lru->lock);
+  g_queue_unlink (&lru->queue, link);
+  g_mutex_unlock (&lru->lock);
+}
+
+/*
+ * ctpl_lru_get_oldest:
+ * @lru: A #CtplLru
+ * @keep: (allow-none): An entry to skip, or %NULL
+ * 
+ * Gets the least recently used entry of a #CtplLru, other than @keep.
+ * 
+ * Returns: The entry, or %NULL if there is none.
+ */
+gpointer
+ctpl_lru_get_oldest (CtplLru  *lru,
+                     gpointer  keep)
+{
+  GList    *link;
+  gpointer  entry = NULL;
+  
+  g_mutex_lock (&lru->lock);
+  link = g_queue_peek_tail_link (&lru->queue);
+  if (link && link->data == keep) {
+    link = link->prev;
+  }
+  if (link) {
+    entry = link->data;
+  }
+  g_mutex_unlock (&lru->lock);
+  
+  return entry;
+}
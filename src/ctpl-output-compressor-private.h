@@ -0,0 +1,72 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef H_CTPL_OUTPUT_COMPRESSOR_PRIVATE_H
+#define H_CTPL_OUTPUT_COMPRESSOR_PRIVATE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include "ctpl-output-stream.h"
+
+G_BEGIN_DECLS
+
+
+/*
+ * CtplOutputCompressorFlush:
+ * @CTPL_OUTPUT_COMPRESSOR_CONTINUE: Only compress the data, the compressor may
+ *                                   keep some of it pending
+ * @CTPL_OUTPUT_COMPRESSOR_FLUSH: Write all pending data so that what was
+ *                                written so far can be decompressed
+ * @CTPL_OUTPUT_COMPRESSOR_FINISH: Write all pending data and end the
+ *                                 compressed stream
+ * 
+ * How a compressor should deal with pending data when writing.
+ */
+typedef enum _CtplOutputCompressorFlush
+{
+  CTPL_OUTPUT_COMPRESSOR_CONTINUE,
+  CTPL_OUTPUT_COMPRESSOR_FLUSH,
+  CTPL_OUTPUT_COMPRESSOR_FINISH
+} CtplOutputCompressorFlush;
+
+typedef struct _CtplOutputCompressor CtplOutputCompressor;
+
+
+G_GNUC_INTERNAL
+CtplOutputCompressor   *ctpl_output_compressor_new      (CtplOutputCompression  compression,
+                                                         gint                   level,
+                                                         GError               **error);
+G_GNUC_INTERNAL
+void                    ctpl_output_compressor_free     (CtplOutputCompressor *compressor);
+G_GNUC_INTERNAL
+CtplOutputCompression   ctpl_output_compressor_get_compression
+                                                        (const CtplOutputCompressor *compressor);
+G_GNUC_INTERNAL
+gboolean                ctpl_output_compressor_write    (CtplOutputCompressor       *compressor,
+                                                         GOutputStream              *stream,
+                                                         const gchar                *data,
+                                                         gsize                       length,
+                                                         CtplOutputCompressorFlush   flush,
+                                                         GCancellable               *cancellable,
+                                                         GError                    **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,302 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "ctpl-output-compressor-private.h"
+#include <glib.h>
+#include <gio/gio.h>
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+#include "ctpl-i18n.h"
+
+
+/*
+ * SECTION: output-compressor
+ * @short_description: Compression of output streams
+ * 
+ * Compresses the data written by a #CtplOutputStream before it reaches the
+ * underlying #GOutputStream. The compressor is fed the stream's whole buffers
+ * rather than each small write.
+ */
+
+/* size of the buffer receiving compressed data */
+#define OUTPUT_COMPRESSOR_BUF_SIZE 65536U
+
+struct _CtplOutputCompressor
+{
+  CtplOutputCompression   compression;
+  GConverter             *converter; /* gzip */
+#ifdef HAVE_ZSTD
+  ZSTD_CCtx              *zstd;
+#endif
+  gchar                  *buffer;
+  gsize                   buf_size;
+  gboolean                finished;
+};
+
+/*
+ * ctpl_output_compressor_new:
+ * @compression: The compression format
+ * @level: The compression level, or -1 for the format's default
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Creates a new compressor.
+ * 
+ * Returns: A new #CtplOutputCompressor, or %NULL if @compression is not
+ *          supported, in which case the error is %G_IO_ERROR_NOT_SUPPORTED.
+ */
+CtplOutputCompressor *
+ctpl_output_compressor_new (CtplOutputCompression  compression,
+                            gint                   level,
+                            GError               **error)
+{
+  CtplOutputCompressor *self;
+  
+  self = g_slice_alloc (sizeof *self);
+  self->compression = compression;
+  self->converter = NULL;
+#ifdef HAVE_ZSTD
+  self->zstd = NULL;
+#endif
+  self->buffer = NULL;
+  self->buf_size = OUTPUT_COMPRESSOR_BUF_SIZE;
+  self->finished = FALSE;
+  switch (compression) {
+    case CTPL_OUTPUT_COMPRESSION_GZIP:
+      self->converter = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP,
+                                                            level));
+      break;
+    
+#ifdef HAVE_ZSTD
+    case CTPL_OUTPUT_COMPRESSION_ZSTD:
+      self->zstd = ZSTD_createCCtx ();
+      ZSTD_CCtx_setParameter (self->zstd, ZSTD_c_compressionLevel,
+                              level < 0 ? 0 : level);
+      self->buf_size = MAX (self->buf_size, ZSTD_CStreamOutSize ());
+      break;
+#endif
+    
+    default:
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   _("Unsupported output compression"));
+      g_slice_free1 (sizeof *self, self);
+      return NULL;
+  }
+  self->buffer = g_malloc (self->buf_size);
+  
+  return self;
+}
+
+/*
+ * ctpl_output_compressor_free:
+ * @compressor: A #CtplOutputCompressor
+ * 
+ * Frees a #CtplOutputCompressor, dropping any data that was not written.
+ */
+void
+ctpl_output_compressor_free (CtplOutputCompressor *compressor)
+{
+  if (compressor->converter) {
+    g_object_unref (compressor->converter);
+  }
+#ifdef HAVE_ZSTD
+  if (compressor->zstd) {
+    ZSTD_freeCCtx (compressor->zstd);
+  }
+#endif
+  g_free (compressor->buffer);
+  g_slice_free1 (sizeof *compressor, compressor);
+}
+
+/*
+ * ctpl_output_compressor_get_compression:
+ * @compressor: A #CtplOutputCompressor
+ * 
+ * Returns: The compression format of @compressor.
+ */
+CtplOutputCompression
+ctpl_output_compressor_get_compression (const CtplOutputCompressor *compressor)
+{
+  return compressor->compression;
+}
+
+static gboolean
+ctpl_output_compressor_write_gzip (CtplOutputCompressor       *compressor,
+                                   GOutputStream              *stream,
+                                   const gchar                *data,
+                                   gsize                       length,
+                                   CtplOutputCompressorFlush   flush,
+                                   GCancellable               *cancellable,
+                                   GError                    **error)
+{
+  GConverterFlags flags = G_CONVERTER_NO_FLAGS;
+  gboolean        done  = FALSE;
+  
+  if (flush == CTPL_OUTPUT_COMPRESSOR_FINISH) {
+    flags = G_CONVERTER_INPUT_AT_END;
+  } else if (flush == CTPL_OUTPUT_COMPRESSOR_FLUSH) {
+    flags = G_CONVERTER_FLUSH;
+  }
+  while (! done) {
+    GConverterResult  result;
+    gsize             n_read    = 0;
+    gsize             n_written = 0;
+    GError           *err = NULL;
+    
+    result = g_converter_convert (compressor->converter, data, length,
+                                  compressor->buffer, compressor->buf_size,
+                                  flags, &n_read, &n_written, &err);
+    if (result == G_CONVERTER_ERROR) {
+      if (! g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+        g_propagate_error (error, err);
+        return FALSE;
+      }
+      /* the output buffer is too small to hold anything, grow it */
+      g_error_free (err);
+      compressor->buf_size *= 2;
+      compressor->buffer = g_realloc (compressor->buffer, compressor->buf_size);
+      continue;
+    }
+    data += n_read;
+    length -= n_read;
+    if (n_written > 0 &&
+        ! g_output_stream_write_all (stream, compressor->buffer, n_written,
+                                     NULL, cancellable, error)) {
+      return FALSE;
+    }
+    if (result == G_CONVERTER_CONVERTED) {
+      done = (flags == G_CONVERTER_NO_FLAGS && length == 0);
+    } else {
+      /* G_CONVERTER_FLUSHED or G_CONVERTER_FINISHED */
+      done = TRUE;
+    }
+  }
+  
+  return TRUE;
+}
+
+#ifdef HAVE_ZSTD
+static gboolean
+ctpl_output_compressor_write_zstd (CtplOutputCompressor       *compressor,
+                                   GOutputStream              *stream,
+                                   const gchar                *data,
+                                   gsize                       length,
+                                   CtplOutputCompressorFlush   flush,
+                                   GCancellable               *cancellable,
+                                   GError                    **error)
+{
+  ZSTD_inBuffer     input = { data, length, 0 };
+  ZSTD_EndDirective mode  = ZSTD_e_continue;
+  gboolean          done  = FALSE;
+  
+  if (flush == CTPL_OUTPUT_COMPRESSOR_FINISH) {
+    mode = ZSTD_e_end;
+  } else if (flush == CTPL_OUTPUT_COMPRESSOR_FLUSH) {
+    mode = ZSTD_e_flush;
+  }
+  while (! done) {
+    ZSTD_outBuffer  output = { compressor->buffer, compressor->buf_size, 0 };
+    gsize           remaining;
+    
+    remaining = ZSTD_compressStream2 (compressor->zstd, &output, &input, mode);
+    if (ZSTD_isError (remaining)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   _("Failed to compress output: %s"),
+                   ZSTD_getErrorName (remaining));
+      return FALSE;
+    }
+    if (output.pos > 0 &&
+        ! g_output_stream_write_all (stream, compressor->buffer, output.pos,
+                                     NULL, cancellable, error)) {
+      return FALSE;
+    }
+    if (mode == ZSTD_e_continue) {
+      done = (input.pos >= input.size);
+    } else {
+      done = (remaining == 0);
+    }
+  }
+  
+  return TRUE;
+}
+#endif
+
+/*
+ * ctpl_output_compressor_write:
+ * @compressor: A #CtplOutputCompressor
+ * @stream: The #GOutputStream to write the compressed data to
+ * @data: The data to compress
+ * @length: The length of @data
+ * @flush: How to deal with pending data
+ * @cancellable: (allow-none): A #GCancellable, or %NULL
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Compresses @data and writes the result to @stream. Once the compressor
+ * finished its stream (see %CTPL_OUTPUT_COMPRESSOR_FINISH), finishing it
+ * again does nothing and writing data to it fails with %G_IO_ERROR_CLOSED.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_output_compressor_write (CtplOutputCompressor       *compressor,
+                              GOutputStream              *stream,
+                              const gchar                *data,
+                              gsize                       length,
+                              CtplOutputCompressorFlush   flush,
+                              GCancellable               *cancellable,
+                              GError                    **error)
+{
+  gboolean rv = TRUE;
+  
+  if (compressor->finished) {
+    if (length > 0 || flush != CTPL_OUTPUT_COMPRESSOR_FINISH) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                   _("Stream is already closed"));
+      rv = FALSE;
+    }
+  } else if (length > 0 || flush != CTPL_OUTPUT_COMPRESSOR_CONTINUE) {
+    switch (compressor->compression) {
+      case CTPL_OUTPUT_COMPRESSION_GZIP:
+        rv = ctpl_output_compressor_write_gzip (compressor, stream, data,
+                                                length, flush, cancellable,
+                                                error);
+        break;
+      
+#ifdef HAVE_ZSTD
+      case CTPL_OUTPUT_COMPRESSION_ZSTD:
+        rv = ctpl_output_compressor_write_zstd (compressor, stream, data,
+                                                length, flush, cancellable,
+                                                error);
+        break;
+#endif
+      
+      default:
+        g_return_val_if_reached (FALSE);
+    }
+    if (rv && flush == CTPL_OUTPUT_COMPRESSOR_FINISH) {
+      compressor->finished = TRUE;
+    }
+  }
+  
+  return rv;
+}
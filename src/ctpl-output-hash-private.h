@@ -0,0 +1,48 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#ifndef H_CTPL_OUTPUT_HASH_PRIVATE_H
+#define H_CTPL_OUTPUT_HASH_PRIVATE_H
+
+#include <glib.h>
+#include "ctpl-output-stream.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplOutputHasher CtplOutputHasher;
+
+
+G_GNUC_INTERNAL
+CtplOutputHasher   *ctpl_output_hasher_new        (CtplOutputHash hashes);
+G_GNUC_INTERNAL
+void                ctpl_output_hasher_free       (CtplOutputHasher *hasher);
+G_GNUC_INTERNAL
+void                ctpl_output_hasher_update     (CtplOutputHasher *hasher,
+                                                   const gchar      *data,
+                                                   gsize             length);
+G_GNUC_INTERNAL
+gchar              *ctpl_output_hasher_get_string (const CtplOutputHasher *hasher,
+                                                   CtplOutputHash          hash);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,299 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "ctpl-output-hash-private.h"
+#include <glib.h>
+#include <string.h>
+
+
+/*
+ * SECTION: output-hash
+ * @short_description: Hashing of the output
+ * 
+ * Computes hashes of the data written to a #CtplOutputStream as it is
+ * written, see ctpl_output_stream_set_hashes().
+ * 
+ * The fast hash is XXH64 (from the xxHash family), implemented here with a
+ * 0 seed so it gives the same results as the reference implementation.
+ */
+
+
+#define XXH_PRIME64_1 G_GUINT64_CONSTANT (0x9E3779B185EBCA87)
+#define XXH_PRIME64_2 G_GUINT64_CONSTANT (0xC2B2AE3D27D4EB4F)
+#define XXH_PRIME64_3 G_GUINT64_CONSTANT (0x165667B19E3779F9)
+#define XXH_PRIME64_4 G_GUINT64_CONSTANT (0x85EBCA77C2B2AE63)
+#define XXH_PRIME64_5 G_GUINT64_CONSTANT (0x27D4EB2F165667C5)
+
+#define XXH_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+typedef struct _Xxh64State Xxh64State;
+
+/* state of a running XXH64 */
+struct _Xxh64State
+{
+  guint64 total_len;
+  guint64 v[4];
+  guchar  mem[32];  /* input not yet consumed */
+  gsize   mem_len;
+};
+
+struct _CtplOutputHasher
+{
+  CtplOutputHash  hashes;
+  Xxh64State      xxh64;
+  GChecksum      *sha256;
+};
+
+
+static inline guint64
+xxh_read64 (const guchar *p)
+{
+  guint64 v;
+  
+  memcpy (&v, p, sizeof v);
+  
+  return GUINT64_FROM_LE (v);
+}
+
+static inline guint32
+xxh_read32 (const guchar *p)
+{
+  guint32 v;
+  
+  memcpy (&v, p, sizeof v);
+  
+  return GUINT32_FROM_LE (v);
+}
+
+static inline guint64
+xxh64_round (guint64 acc,
+             guint64 input)
+{
+  acc += input * XXH_PRIME64_2;
+  acc = XXH_ROTL64 (acc, 31);
+  
+  return acc * XXH_PRIME64_1;
+}
+
+static inline guint64
+xxh64_merge_round (guint64 acc,
+                   guint64 val)
+{
+  acc ^= xxh64_round (0, val);
+  
+  return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static void
+xxh64_init (Xxh64State *state)
+{
+  state->total_len = 0;
+  state->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+  state->v[1] = XXH_PRIME64_2;
+  state->v[2] = 0;
+  state->v[3] = - XXH_PRIME64_1;
+  state->mem_len = 0;
+}
+
+/* consumes a 32 bytes stripe */
+static inline void
+xxh64_consume (Xxh64State    *state,
+               const guchar  *p)
+{
+  state->v[0] = xxh64_round (state->v[0], xxh_read64 (p));
+  state->v[1] = xxh64_round (state->v[1], xxh_read64 (p + 8));
+  state->v[2] = xxh64_round (state->v[2], xxh_read64 (p + 16));
+  state->v[3] = xxh64_round (state->v[3], xxh_read64 (p + 24));
+}
+
+static void
+xxh64_update (Xxh64State   *state,
+              const guchar *p,
+              gsize         length)
+{
+  const guchar *end = p + length;
+  
+  state->total_len += length;
+  if (state->mem_len + length < sizeof state->mem) {
+    memcpy (&state->mem[state->mem_len], p, length);
+    state->mem_len += length;
+    return;
+  }
+  if (state->mem_len > 0) {
+    gsize n = sizeof state->mem - state->mem_len;
+    
+    memcpy (&state->mem[state->mem_len], p, n);
+    xxh64_consume (state, state->mem);
+    p += n;
+    state->mem_len = 0;
+  }
+  for (; p + 32 <= end; p += 32) {
+    xxh64_consume (state, p);
+  }
+  if (p < end) {
+    state->mem_len = (gsize) (end - p);
+    memcpy (state->mem, p, state->mem_len);
+  }
+}
+
+/* gets the hash of the data so far, without altering @state */
+static guint64
+xxh64_digest (const Xxh64State *state)
+{
+  const guchar *p = state->mem;
+  const guchar *end = p + state->mem_len;
+  guint64       h;
+  
+  if (state->total_len >= 32) {
+    h = (XXH_ROTL64 (state->v[0], 1) + XXH_ROTL64 (state->v[1], 7) +
+         XXH_ROTL64 (state->v[2], 12) + XXH_ROTL64 (state->v[3], 18));
+    h = xxh64_merge_round (h, state->v[0]);
+    h = xxh64_merge_round (h, state->v[1]);
+    h = xxh64_merge_round (h, state->v[2]);
+    h = xxh64_merge_round (h, state->v[3]);
+  } else {
+    h = XXH_PRIME64_5;
+  }
+  h += state->total_len;
+  for (; p + 8 <= end; p += 8) {
+    h ^= xxh64_round (0, xxh_read64 (p));
+    h = XXH_ROTL64 (h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    h ^= (guint64) xxh_read32 (p) * XXH_PRIME64_1;
+    h = XXH_ROTL64 (h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= (guint64) *p * XXH_PRIME64_5;
+    h = XXH_ROTL64 (h, 11) * XXH_PRIME64_1;
+  }
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  
+  return h;
+}
+
+/*
+ * ctpl_output_hasher_new:
+ * @hashes: The hashes to compute
+ * 
+ * Creates a new #CtplOutputHasher computing @hashes.
+ * 
+ * Returns: A new #CtplOutputHasher, to be freed with ctpl_output_hasher_free().
+ */
+CtplOutputHasher *
+ctpl_output_hasher_new (CtplOutputHash hashes)
+{
+  CtplOutputHasher *hasher;
+  
+  hasher = g_slice_alloc (sizeof *hasher);
+  hasher->hashes = hashes;
+  xxh64_init (&hasher->xxh64);
+  hasher->sha256 = NULL;
+  if (hashes & CTPL_OUTPUT_HASH_SHA256) {
+    hasher->sha256 = g_checksum_new (G_CHECKSUM_SHA256);
+  }
+  
+  return hasher;
+}
+
+/*
+ * ctpl_output_hasher_free:
+ * @hasher: A #CtplOutputHasher
+ * 
+ * Frees a #CtplOutputHasher.
+ */
+void
+ctpl_output_hasher_free (CtplOutputHasher *hasher)
+{
+  if (hasher->sha256) {
+    g_checksum_free (hasher->sha256);
+  }
+  g_slice_free1 (sizeof *hasher, hasher);
+}
+
+/*
+ * ctpl_output_hasher_update:
+ * @hasher: A #CtplOutputHasher
+ * @data: Some data
+ * @length: The length of @data
+ * 
+ * Feeds more data to the hashes.
+ */
+void
+ctpl_output_hasher_update (CtplOutputHasher *hasher,
+                           const gchar      *data,
+                           gsize             length)
+{
+  if (hasher->hashes & CTPL_OUTPUT_HASH_XXH64) {
+    xxh64_update (&hasher->xxh64, (const guchar *) data, length);
+  }
+  if (hasher->sha256) {
+    /* GChecksum takes a gssize length */
+    while (length > 0) {
+      gsize n = MIN (length, G_MAXSSIZE);
+      
+      g_checksum_update (hasher->sha256, (const guchar *) data, (gssize) n);
+      data += n;
+      length -= n;
+    }
+  }
+}
+
+/*
+ * ctpl_output_hasher_get_string:
+ * @hasher: A #CtplOutputHasher
+ * @hash: A single #CtplOutputHash
+ * 
+ * Gets the current value of a hash, as a lowercase hexadecimal string.
+ * The hashes can still be updated afterwards.
+ * 
+ * Returns: A newly allocated string, or %NULL if @hasher doesn't compute
+ *          @hash.
+ */
+gchar *
+ctpl_output_hasher_get_string (const CtplOutputHasher *hasher,
+                               CtplOutputHash          hash)
+{
+  gchar *str = NULL;
+  
+  if (! (hasher->hashes & hash)) {
+    /* not computed */
+  } else if (hash == CTPL_OUTPUT_HASH_XXH64) {
+    str = g_strdup_printf ("%016" G_GINT64_MODIFIER "x",
+                           xxh64_digest (&hasher->xxh64));
+  } else if (hash == CTPL_OUTPUT_HASH_SHA256) {
+    /* getting the string closes the checksum, so use a copy */
+    GChecksum *copy = g_checksum_copy (hasher->sha256);
+    
+    str = g_strdup (g_checksum_get_string (copy));
+    g_checksum_free (copy);
+  }
+  
+  return str;
+}
@@ -0,0 +1,69 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef H_CTPL_OUTPUT_STREAM_PRIVATE_H
+#define H_CTPL_OUTPUT_STREAM_PRIVATE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include "ctpl-output-stream.h"
+#include "ctpl-input-stream-private.h"
+
+G_BEGIN_DECLS
+
+
+G_GNUC_INTERNAL
+CtplOutputStream   *ctpl_output_stream_new_for_gstring  (GString *string);
+G_GNUC_INTERNAL
+CtplOutputStream   *ctpl_output_stream_new_fragment     (CtplOutputStream *stream,
+                                                         GString          *string,
+                                                         gssize           *shared_written);
+G_GNUC_INTERNAL
+gboolean            ctpl_output_stream_write_static     (CtplOutputStream  *stream,
+                                                         const gchar       *data,
+                                                         gsize              length,
+                                                         GError           **error);
+G_GNUC_INTERNAL
+gboolean            ctpl_output_stream_write_file_range (CtplOutputStream      *stream,
+                                                         const gchar           *data,
+                                                         gsize                  length,
+                                                         const CtplSourceFile  *file,
+                                                         goffset                offset,
+                                                         GError               **error);
+G_GNUC_INTERNAL
+void                ctpl_output_stream_set_limits       (CtplOutputStream *stream,
+                                                         GCancellable     *cancellable,
+                                                         gint64            deadline,
+                                                         guint64           max_bytes);
+G_GNUC_INTERNAL
+gboolean            ctpl_output_stream_check_limits     (CtplOutputStream  *stream,
+                                                         GError           **error);
+G_GNUC_INTERNAL
+gboolean            ctpl_output_stream_account_data     (CtplOutputStream  *stream,
+                                                         const gchar       *data,
+                                                         gsize              length,
+                                                         GError           **error);
+G_GNUC_INTERNAL
+gboolean            ctpl_output_stream_flush_buffer     (CtplOutputStream  *stream,
+                                                         GError           **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -17,10 +17,46 @@
  * 
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+/* for copy_file_range() */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include "ctpl-output-stream.h"
+#include "ctpl-output-stream-private.h"
+#include "ctpl-output-compressor-private.h"
+#include "ctpl-output-hash-private.h"
+#include "ctpl-fragment-cache.h"
 #include <glib.h>
 #include <gio/gio.h>
 #include <string.h>
+#include "ctpl-i18n.h"
+#include "ctpl-parser.h"
+
+#if defined (HAVE_GIO_UNIX) && \
+    (defined (HAVE_COPY_FILE_RANGE) || \
+     (defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H)))
+# define USE_FD_RANGE 1
+# include <gio/gfiledescriptorbased.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/stat.h>
+# ifdef HAVE_SYS_SENDFILE_H
+#   include <sys/sendfile.h>
+# endif
+#endif
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+# define USE_MAPPED_FILE 1
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
 
 
 /**
@@ -30,26 +66,168 @@
  * 
  * The data output stream used by CTPL; built on top of #GOutputStream.
  * 
- * A #CtplOutputStream is created with ctpl_output_stream_new(). It uses a
- * #GObject<!-- -->-like refcounting, through ctpl_output_stream_ref() and
- * ctpl_output_stream_unref().
+ * A #CtplOutputStream is created with ctpl_output_stream_new() or
+ * ctpl_output_stream_new_sized(). It uses a #GObject<!-- -->-like refcounting,
+ * through ctpl_output_stream_ref() and ctpl_output_stream_unref().
+ * 
+ * A #CtplOutputStream is buffered: small writes are combined in a buffer, and
+ * the pending data is sent to the underlying #GOutputStream in as few calls as
+ * possible (using vectored writes when available). The buffer is flushed when
+ * it is full, when ctpl_output_stream_flush() is called, at the end of
+ * ctpl_parser_parse() and when the last reference to the stream is dropped.
+ * 
+ * This is a behaviour change from CTPL 0.3, where every write went straight
+ * to the underlying #GOutputStream. Code mixing writes to a #CtplOutputStream
+ * with direct writes to its #GOutputStream must call
+ * ctpl_output_stream_flush() before writing directly, or the data will be
+ * reordered. Write errors may also only be reported by the call that flushes
+ * the buffer rather than by the one that wrote the data, and the errors of the
+ * last flush made by ctpl_output_stream_unref() can't be reported at all (they
+ * are only logged with g_warning()); so flush or close the stream before
+ * dropping it. Use ctpl_output_stream_new_sized() with a size of 0 to get the
+ * former write-through behaviour.
+ * 
+ * A stream created with ctpl_output_stream_new_threaded() hands its filled
+ * buffers to a dedicated writer thread instead of writing them itself, so that
+ * rendering can go on while the underlying stream is busy.
+ * 
+ * A stream created with ctpl_output_stream_new_for_mapped_path() writes to a
+ * file mapped in memory rather than to a #GOutputStream. Such a stream should
+ * be closed with ctpl_output_stream_close() to check that the file was
+ * correctly written.
  * 
  * The errors that the functions in this module can throw comes from the
  * %G_IO_ERROR or %CTPL_IO_ERROR domains unless otherwise mentioned.
  */
 
+/* default size of the write-combining buffer */
+#define OUTPUT_STREAM_BUF_SIZE    8192U
+/* maximum number of spans gathered before flushing */
+#define OUTPUT_STREAM_MAX_SPANS   64U
+/* minimum size of a static write for it to be referenced rather than copied */
+#define OUTPUT_STREAM_MIN_SPAN    128U
+/* minimum size of a file range for it to be copied by the kernel */
+#define OUTPUT_STREAM_MIN_FD_RANGE  16384U
+/* bounds of the size by which a mapped output file grows */
+#define OUTPUT_MAP_MIN_GROW       (1U << 20)
+#define OUTPUT_MAP_MAX_GROW       (1U << 30)
+
+#if GLIB_CHECK_VERSION (2, 60, 0)
+typedef GOutputVector OutputSpan;
+#else
+typedef struct _OutputSpan OutputSpan;
+struct _OutputSpan
+{
+  gconstpointer buffer;
+  gsize         size;
+};
+#endif
+
+typedef struct _OutputChunk   OutputChunk;
+typedef struct _OutputWriter  OutputWriter;
+typedef struct _OutputMap     OutputMap;
+
+/* a buffer queued for the writer thread */
+struct _OutputChunk
+{
+  gchar  *data;
+  gsize   length;
+};
+
+/* state of the writer thread of a threaded stream */
+struct _OutputWriter
+{
+  GThread  *thread;
+  GMutex    lock;
+  GCond     cond;
+  GQueue    queue;        /* filled chunks waiting to be written */
+  GQueue    free_buffers; /* buffers available to the producer */
+  gboolean  busy;         /* whether the writer is writing a chunk */
+  gboolean  quit;
+  gint      failed;       /* atomic, whether @error is set */
+  GError   *error;
+};
+
+/* state of a memory-mapped output file */
+struct _OutputMap
+{
+  gint      fd;
+  gchar    *data;
+  gsize     size;   /* size of the file and of the mapping */
+  gsize     length; /* size of the data written */
+  gboolean  sync;
+};
 
 /**
  * CtplOutputStream:
  * 
  * An opaque object representing an output data stream.
  */
-/* It's actually a GOutputStream, the structure is just a wrapper */
 struct _CtplOutputStream
 {
-  GOutputStream parent;
+  /*< private >*/
+  gint            ref_count;
+  GOutputStream  *stream;
+  gint            fd;     /* file descriptor of @stream, or -1 */
+  GString        *string; /* when writing directly to memory */
+  OutputWriter   *writer;
+  OutputMap      *map;
+  CtplOutputCompressor *compressor;
+  CtplEscapeMode  escape; /* escape mode of the values */
+  CtplOutputHasher *hasher; /* hashes of the output, or %NULL */
+  guint           parallel_threshold; /* minimum loop size to render in
+                                       * parallel, or 0 */
+  CtplFragmentCache *fragment_cache;  /* cache of `cache` blocks, or %NULL */
+  /* limits of the current parsing */
+  GCancellable   *cancellable;
+  gint64          deadline;
+  guint64         written;
+  guint64         limit;
+  gssize         *shared_written; /* atomic, bytes written by the fragments
+                                   * sharing @shared_limit, or %NULL */
+  guint64         shared_limit;
+  /* write-combining buffer */
+  gchar          *buffer;
+  gsize           buf_size;
+  gsize           buf_len;
+  /* pending data, either pointing to @buffer or to static external data */
+  OutputSpan      spans[OUTPUT_STREAM_MAX_SPANS];
+  guint           n_spans;
 };
 
+/* allocates a new #CtplOutputStream with no output and default settings, for
+ * the constructors to complete */
+static CtplOutputStream *
+ctpl_output_stream_init (void)
+{
+  CtplOutputStream *self;
+  
+  self = g_slice_alloc (sizeof *self);
+  self->ref_count = 1;
+  self->stream = NULL;
+  self->fd = -1;
+  self->string = NULL;
+  self->writer = NULL;
+  self->map = NULL;
+  self->compressor = NULL;
+  self->buffer = NULL;
+  self->buf_size = 0U;
+  self->buf_len = 0U;
+  self->n_spans = 0U;
+  self->escape = CTPL_ESCAPE_NONE;
+  self->hasher = NULL;
+  self->parallel_threshold = 0;
+  self->fragment_cache = NULL;
+  self->cancellable = NULL;
+  self->deadline = 0;
+  self->written = 0;
+  self->limit = G_MAXUINT64;
+  self->shared_written = NULL;
+  self->shared_limit = G_MAXUINT64;
+  
+  return self;
+}
+
 /**
  * ctpl_output_stream_new:
  * @stream: A #GOutputStream
@@ -57,6 +235,13 @@ struct _CtplOutputStream
  * Creates a new #CtplOutputStream for a given #GOutputStream.
  * This function adds a reference to the #GOutputStream.
  * 
+ * This is the same as calling ctpl_output_stream_new_sized() with a reasonable
+ * default buffer size.
+ * 
+ * Since CTPL 0.4 the returned stream is buffered, see the
+ * <link linkend="ctpl-output-stream.description">description</link> for the
+ * consequences; before, it wrote directly to @stream.
+ * 
  * Returns: A new #CtplOutputStream.
  * 
  * Since: 0.2
@@ -64,7 +249,461 @@ struct _CtplOutputStream
 CtplOutputStream *
 ctpl_output_stream_new (GOutputStream *stream)
 {
-  return (CtplOutputStream *) g_object_ref (stream);
+  return ctpl_output_stream_new_sized (stream, OUTPUT_STREAM_BUF_SIZE);
+}
+
+/**
+ * ctpl_output_stream_new_sized:
+ * @stream: A #GOutputStream
+ * @buffer_size: The size of the write buffer, in bytes, or 0 to disable
+ *               buffering
+ * 
+ * Creates a new #CtplOutputStream for a given #GOutputStream, with a write
+ * buffer of @buffer_size bytes.
+ * This function adds a reference to the #GOutputStream.
+ * 
+ * Returns: A new #CtplOutputStream.
+ * 
+ * Since: 0.4
+ */
+CtplOutputStream *
+ctpl_output_stream_new_sized (GOutputStream *stream,
+                              gsize          buffer_size)
+{
+  CtplOutputStream *self;
+  
+  self = ctpl_output_stream_init ();
+  self->stream = g_object_ref (stream);
+#ifdef USE_FD_RANGE
+  if (G_IS_FILE_DESCRIPTOR_BASED (stream)) {
+    self->fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (stream));
+  }
+#endif
+  self->buf_size = buffer_size;
+  self->buffer = g_malloc (self->buf_size);
+  
+  return self;
+}
+
+/*
+ * ctpl_output_stream_new_for_gstring:
+ * @string: A #GString
+ * 
+ * Creates a new #CtplOutputStream that appends to @string.
+ * Such a stream doesn't have an underlying #GOutputStream nor a buffer: data is
+ * written directly to @string. @string must stay alive as long as the stream.
+ * 
+ * Returns: A new #CtplOutputStream.
+ */
+CtplOutputStream *
+ctpl_output_stream_new_for_gstring (GString *string)
+{
+  CtplOutputStream *self;
+  
+  self = ctpl_output_stream_init ();
+  self->string = string;
+  
+  return self;
+}
+
+/*
+ * ctpl_output_stream_new_fragment:
+ * @stream: A #CtplOutputStream
+ * @string: A #GString
+ * @shared_written: (allow-none): A counter initially set to 0 and shared by
+ *                  all the fragments of @stream rendered concurrently, or
+ *                  %NULL if the fragment is rendered alone
+ * 
+ * Creates a new #CtplOutputStream that appends to @string like
+ * ctpl_output_stream_new_for_gstring(), to render part of the output of
+ * @stream separately. The new stream has the escape mode, cancellable and
+ * deadline of @stream, and can write at most what is left of the byte budget
+ * of @stream. If @shared_written is not %NULL, this is what is left for all
+ * the fragments sharing the counter together rather than for each of them.
+ * It doesn't render loops in parallel, whatever the setting of @stream.
+ * 
+ * Returns: A new #CtplOutputStream.
+ */
+CtplOutputStream *
+ctpl_output_stream_new_fragment (CtplOutputStream *stream,
+                                 GString          *string,
+                                 gssize           *shared_written)
+{
+  CtplOutputStream *self;
+  
+  self = ctpl_output_stream_new_for_gstring (string);
+  self->escape = stream->escape;
+  self->cancellable = stream->cancellable;
+  self->deadline = stream->deadline;
+  if (stream->fragment_cache) {
+    self->fragment_cache = ctpl_fragment_cache_ref (stream->fragment_cache);
+  }
+  if (stream->limit != G_MAXUINT64) {
+    self->limit = stream->limit - stream->written;
+    if (shared_written) {
+      self->shared_written = shared_written;
+      self->shared_limit = self->limit;
+    }
+  }
+  
+  return self;
+}
+
+/* writes data to the underlying stream, compressing it if needed */
+static gboolean
+ctpl_output_stream_write_out (CtplOutputStream  *stream,
+                              const gchar       *data,
+                              gsize              length,
+                              GCancellable      *cancellable,
+                              GError           **error)
+{
+  if (stream->compressor) {
+    return ctpl_output_compressor_write (stream->compressor, stream->stream,
+                                         data, length,
+                                         CTPL_OUTPUT_COMPRESSOR_CONTINUE,
+                                         cancellable, error);
+  } else {
+    return g_output_stream_write_all (stream->stream, data, length, NULL,
+                                      cancellable, error);
+  }
+}
+
+/* body of the writer thread */
+static gpointer
+output_writer_thread (gpointer data)
+{
+  CtplOutputStream *stream = data;
+  OutputWriter     *writer = stream->writer;
+  
+  g_mutex_lock (&writer->lock);
+  while (! writer->quit || ! g_queue_is_empty (&writer->queue)) {
+    OutputChunk *chunk = g_queue_pop_head (&writer->queue);
+    
+    if (! chunk) {
+      g_cond_wait (&writer->cond, &writer->lock);
+    } else {
+      writer->busy = TRUE;
+      g_mutex_unlock (&writer->lock);
+      /* once failed, just recycle the buffers */
+      if (! g_atomic_int_get (&writer->failed)) {
+        GError *err = NULL;
+        
+        if (! ctpl_output_stream_write_out (stream, chunk->data,
+                                            chunk->length, NULL, &err)) {
+          writer->error = err;
+          g_atomic_int_set (&writer->failed, TRUE);
+        }
+      }
+      g_mutex_lock (&writer->lock);
+      g_queue_push_tail (&writer->free_buffers, chunk->data);
+      g_slice_free1 (sizeof *chunk, chunk);
+      writer->busy = FALSE;
+      g_cond_broadcast (&writer->cond);
+    }
+  }
+  g_mutex_unlock (&writer->lock);
+  
+  return NULL;
+}
+
+/**
+ * ctpl_output_stream_new_threaded:
+ * @stream: A #GOutputStream
+ * @buffer_size: The size of each write buffer, in bytes, or 0 for a reasonable
+ *               default
+ * @n_buffers: The maximum number of buffers, including the one being filled.
+ *             Values lower than 2 are treated as 2.
+ * 
+ * Creates a new #CtplOutputStream for a given #GOutputStream that writes to
+ * @stream from a dedicated thread.
+ * Filled buffers are queued for the writer thread while writing goes on in a
+ * new one. When all @n_buffers buffers are in use, writing blocks until the
+ * writer thread releases one, so the memory used never exceeds
+ * @buffer_size * @n_buffers bytes.
+ * 
+ * Errors from the writer thread are reported by the next call writing to or
+ * flushing the #CtplOutputStream, and every call after that.
+ * @stream must not be used directly while the #CtplOutputStream still has
+ * data to write, see ctpl_output_stream_flush().
+ * This function adds a reference to the #GOutputStream.
+ * 
+ * Returns: A new #CtplOutputStream.
+ * 
+ * Since: 0.4
+ */
+CtplOutputStream *
+ctpl_output_stream_new_threaded (GOutputStream *stream,
+                                 gsize          buffer_size,
+                                 guint          n_buffers)
+{
+  CtplOutputStream *self;
+  OutputWriter     *writer;
+  
+  if (buffer_size < 1) {
+    buffer_size = OUTPUT_STREAM_BUF_SIZE;
+  }
+  self = ctpl_output_stream_new_sized (stream, buffer_size);
+  self->fd = -1; /* only the writer thread writes to the stream */
+  writer = g_slice_alloc (sizeof *writer);
+  g_mutex_init (&writer->lock);
+  g_cond_init (&writer->cond);
+  g_queue_init (&writer->queue);
+  g_queue_init (&writer->free_buffers);
+  for (n_buffers = MAX (n_buffers, 2); n_buffers > 1; n_buffers--) {
+    g_queue_push_tail (&writer->free_buffers, g_malloc (buffer_size));
+  }
+  writer->busy = FALSE;
+  writer->quit = FALSE;
+  writer->failed = FALSE;
+  writer->error = NULL;
+  self->writer = writer;
+  writer->thread = g_thread_new ("CtplOutputStream writer",
+                                 output_writer_thread, self);
+  
+  return self;
+}
+
+/* reports the writer thread's error, if any */
+static gboolean
+output_writer_check (OutputWriter  *writer,
+                     GError       **error)
+{
+  if (G_UNLIKELY (g_atomic_int_get (&writer->failed))) {
+    if (error) {
+      *error = g_error_copy (writer->error);
+    }
+    return FALSE;
+  }
+  
+  return TRUE;
+}
+
+/* hands the filled write buffer to the writer thread and waits for a free one
+ * if none is available */
+static gboolean
+output_writer_push (CtplOutputStream  *stream,
+                    GError           **error)
+{
+  OutputWriter *writer = stream->writer;
+  
+  if (stream->buf_len > 0) {
+    OutputChunk *chunk;
+    
+    chunk = g_slice_alloc (sizeof *chunk);
+    chunk->data = stream->buffer;
+    chunk->length = stream->buf_len;
+    g_mutex_lock (&writer->lock);
+    g_queue_push_tail (&writer->queue, chunk);
+    g_cond_broadcast (&writer->cond);
+    while (g_queue_is_empty (&writer->free_buffers)) {
+      g_cond_wait (&writer->cond, &writer->lock);
+    }
+    stream->buffer = g_queue_pop_head (&writer->free_buffers);
+    stream->buf_len = 0U;
+    g_mutex_unlock (&writer->lock);
+  }
+  
+  return output_writer_check (writer, error);
+}
+
+/* waits until the writer thread wrote everything queued */
+static gboolean
+output_writer_drain (CtplOutputStream  *stream,
+                     GError           **error)
+{
+  OutputWriter *writer = stream->writer;
+  
+  g_mutex_lock (&writer->lock);
+  while (writer->busy || ! g_queue_is_empty (&writer->queue)) {
+    g_cond_wait (&writer->cond, &writer->lock);
+  }
+  g_mutex_unlock (&writer->lock);
+  
+  return output_writer_check (writer, error);
+}
+
+/* stops the writer thread and frees its resources */
+static void
+output_writer_free (OutputWriter *writer)
+{
+  gchar *buffer;
+  
+  g_mutex_lock (&writer->lock);
+  writer->quit = TRUE;
+  g_cond_broadcast (&writer->cond);
+  g_mutex_unlock (&writer->lock);
+  g_thread_join (writer->thread);
+  while ((buffer = g_queue_pop_head (&writer->free_buffers)) != NULL) {
+    g_free (buffer);
+  }
+  g_clear_error (&writer->error);
+  g_cond_clear (&writer->cond);
+  g_mutex_clear (&writer->lock);
+  g_slice_free1 (sizeof *writer, writer);
+}
+
+#ifdef USE_MAPPED_FILE
+/* sets @error from @errsv, the errno value of the failed operation, using
+ * @message that should contain a "%s" for the error's description */
+static void
+output_map_set_error (GError      **error,
+                      gint          errsv,
+                      const gchar  *message)
+{
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+               message, g_strerror (errsv));
+}
+
+/* makes sure there is room for @length more bytes in the mapping */
+static gboolean
+output_map_reserve (OutputMap  *map,
+                    gsize       length,
+                    GError    **error)
+{
+  gsize   size;
+  gchar  *data;
+  
+  if (map->data && map->length + length <= map->size) {
+    return TRUE;
+  }
+  /* grow in large steps to limit the number of remappings */
+  size = map->size + CLAMP (map->size, OUTPUT_MAP_MIN_GROW, OUTPUT_MAP_MAX_GROW);
+  size = MAX (size, map->length + length);
+  if (ftruncate (map->fd, (off_t) size) != 0) {
+    output_map_set_error (error, errno,
+                          _("Failed to resize output file: %s"));
+    return FALSE;
+  }
+  if (map->data) {
+    munmap (map->data, map->size);
+  }
+  data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+  if (data == MAP_FAILED) {
+    output_map_set_error (error, errno,
+                          _("Failed to map output file: %s"));
+    map->data = NULL;
+    map->size = 0;
+    return FALSE;
+  }
+  map->data = data;
+  map->size = size;
+  
+  return TRUE;
+}
+
+static gboolean
+output_map_write (OutputMap    *map,
+                  const gchar  *data,
+                  gsize         length,
+                  GError      **error)
+{
+  if (map->fd < 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                 _("Stream is already closed"));
+    return FALSE;
+  } else if (! output_map_reserve (map, length, error)) {
+    return FALSE;
+  }
+  memcpy (&map->data[map->length], data, length);
+  map->length += length;
+  
+  return TRUE;
+}
+
+/* unmaps the file, truncates it to the written data and closes it */
+static gboolean
+output_map_close (OutputMap  *map,
+                  GError    **error)
+{
+  gboolean rv = TRUE;
+  
+  if (map->fd >= 0) {
+    if (map->data) {
+      munmap (map->data, map->size);
+      map->data = NULL;
+    }
+    if (ftruncate (map->fd, (off_t) map->length) != 0) {
+      output_map_set_error (error, errno,
+                            _("Failed to resize output file: %s"));
+      rv = FALSE;
+    } else if (map->sync && fsync (map->fd) != 0) {
+      output_map_set_error (error, errno,
+                            _("Failed to synchronize output file: %s"));
+      rv = FALSE;
+    }
+    if (close (map->fd) != 0 && rv) {
+      output_map_set_error (error, errno,
+                            _("Failed to close output file: %s"));
+      rv = FALSE;
+    }
+    map->fd = -1;
+  }
+  
+  return rv;
+}
+#endif
+
+/**
+ * ctpl_output_stream_new_for_mapped_path:
+ * @path: The path of the file to write to, in the GLib's filename encoding
+ * @sync: Whether to synchronize the file to the disk (see fsync()) when
+ *        closing the stream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Creates a new #CtplOutputStream writing to a file mapped in memory, which
+ * avoids a system call per write and is interesting for very large outputs.
+ * The file is created if it doesn't exist and truncated otherwise. It is grown
+ * in large steps while writing, and truncated to the size of the written data
+ * by ctpl_output_stream_close().
+ * 
+ * Such a stream has no underlying #GOutputStream, so it can't be used with
+ * ctpl_parser_parse_async(). As with any memory-mapped file, running out of
+ * disk space while writing raises a %SIGBUS signal rather than an error.
+ * 
+ * Returns: A new #CtplOutputStream on success, %NULL on error or if mapping
+ *          files is not supported (in which case the error is
+ *          %G_IO_ERROR_NOT_SUPPORTED).
+ * 
+ * Since: 0.4
+ */
+CtplOutputStream *
+ctpl_output_stream_new_for_mapped_path (const gchar  *path,
+                                        gboolean      sync,
+                                        GError      **error)
+{
+#ifdef USE_MAPPED_FILE
+  CtplOutputStream *self;
+  OutputMap        *map;
+  gint              fd;
+  
+  fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    gint    errsv = errno;
+    gchar  *name = g_filename_display_name (path);
+    
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 _("Failed to open file '%s': %s"), name, g_strerror (errsv));
+    g_free (name);
+    
+    return NULL;
+  }
+  map = g_slice_alloc (sizeof *map);
+  map->fd = fd;
+  map->data = NULL;
+  map->size = 0;
+  map->length = 0;
+  map->sync = sync;
+  
+  self = ctpl_output_stream_init ();
+  self->map = map;
+  
+  return self;
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               _("Memory-mapped output files are not supported"));
+  
+  return NULL;
+#endif
 }
 
 /**
@@ -80,7 +719,9 @@ ctpl_output_stream_new (GOutputStream *stream)
 CtplOutputStream *
 ctpl_output_stream_ref (CtplOutputStream *stream)
 {
-  return g_object_ref (stream);
+  g_atomic_int_inc (&stream->ref_count);
+  
+  return stream;
 }
 
 /**
@@ -88,14 +729,61 @@ ctpl_output_stream_ref (CtplOutputStream *stream)
  * @stream: A #CtplOutputStream
  * 
  * Removes a reference from a #CtplOutputStream. When its reference count
- * reaches 0, the stream is destroyed.
+ * reaches 0, the pending data is flushed and the stream is destroyed.
+ * Errors occurring during that last flush cannot be reported and are only
+ * logged with g_warning(), so if you care about them, call
+ * ctpl_output_stream_flush() or ctpl_output_stream_close() beforehand.
+ * Since CTPL 0.4, dropping the last reference may thus write data to the
+ * underlying #GOutputStream, so it must be done before closing or reusing it.
  * 
  * Since: 0.2
  */
 void
 ctpl_output_stream_unref (CtplOutputStream *stream)
 {
-  g_object_unref (stream);
+  if (g_atomic_int_dec_and_test (&stream->ref_count)) {
+    GError *err = NULL;
+    
+    if (! ctpl_output_stream_flush_buffer (stream, &err) ||
+        (stream->writer && ! output_writer_drain (stream, &err))) {
+      g_warning ("Failed to flush output stream: %s", err->message);
+      g_error_free (err);
+    }
+    if (stream->writer) {
+      output_writer_free (stream->writer);
+    }
+    if (stream->compressor) {
+      /* end the compressed stream if it wasn't closed */
+      if (! ctpl_output_compressor_write (stream->compressor, stream->stream,
+                                          NULL, 0,
+                                          CTPL_OUTPUT_COMPRESSOR_FINISH,
+                                          NULL, &err)) {
+        g_warning ("Failed to flush output stream: %s", err->message);
+        g_clear_error (&err);
+      }
+      ctpl_output_compressor_free (stream->compressor);
+    }
+#ifdef USE_MAPPED_FILE
+    if (stream->map) {
+      if (! output_map_close (stream->map, &err)) {
+        g_warning ("Failed to close output stream: %s", err->message);
+        g_error_free (err);
+      }
+      g_slice_free1 (sizeof *stream->map, stream->map);
+    }
+#endif
+    if (stream->hasher) {
+      ctpl_output_hasher_free (stream->hasher);
+    }
+    if (stream->fragment_cache) {
+      ctpl_fragment_cache_unref (stream->fragment_cache);
+    }
+    g_free (stream->buffer);
+    if (stream->stream) {
+      g_object_unref (stream->stream);
+    }
+    g_slice_free1 (sizeof *stream, stream);
+  }
 }
 
 /**
@@ -104,14 +792,619 @@ ctpl_output_stream_unref (CtplOutputStream *stream)
  * 
  * Gets the underlying #GOutputStream associated with a #CtplOutputStream.
  * 
- * Returns: (transfer none): The underlying #GOutputStream of @stream.
+ * Note that the #CtplOutputStream might hold buffered data that was not yet
+ * written to the underlying stream, so you probably want to call
+ * ctpl_output_stream_flush() before writing to or closing the returned
+ * #GOutputStream.
+ * 
+ * Returns: (transfer none) (allow-none): The underlying #GOutputStream of
+ *          @stream, or %NULL if @stream writes to memory.
  * 
  * Since: 0.3
  */
 GOutputStream *
 ctpl_output_stream_get_stream (CtplOutputStream *stream)
 {
-  return &stream->parent;
+  return stream->stream;
+}
+
+/**
+ * ctpl_output_stream_set_compression:
+ * @stream: A #CtplOutputStream
+ * @compression: The compression format
+ * @level: The compression level, from 1 (fastest) to 9 for gzip and 22 for
+ *         Zstandard (best compression), or -1 for the format's default
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Sets whether and how a #CtplOutputStream compresses the data it writes to
+ * its underlying #GOutputStream. This must be called before anything is
+ * written to @stream.
+ * 
+ * The compressor is fed whole buffers rather than each write, so compression
+ * works best with the default buffer size or larger. For threaded streams
+ * (see ctpl_output_stream_new_threaded()), compression happens in the writer
+ * thread.
+ * ctpl_output_stream_flush() makes everything written so far decompressible,
+ * at a small cost on the compression ratio. The compressed data is ended when
+ * @stream is closed (see ctpl_output_stream_close()) or destroyed.
+ * 
+ * Compressed outputs are not supported by ctpl_parser_parse_async(), nor for
+ * streams without an underlying #GOutputStream.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise, in which case the error is
+ *          %G_IO_ERROR_NOT_SUPPORTED.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_output_stream_set_compression (CtplOutputStream      *stream,
+                                    CtplOutputCompression  compression,
+                                    gint                   level,
+                                    GError               **error)
+{
+  CtplOutputCompressor *compressor = NULL;
+  
+  g_return_val_if_fail (stream->written == 0, FALSE);
+  
+  if (compression != CTPL_OUTPUT_COMPRESSION_NONE) {
+    if (! stream->stream) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   _("Stream doesn't support compression"));
+      return FALSE;
+    }
+    compressor = ctpl_output_compressor_new (compression, level, error);
+    if (! compressor) {
+      return FALSE;
+    }
+  }
+  if (stream->compressor) {
+    ctpl_output_compressor_free (stream->compressor);
+  }
+  stream->compressor = compressor;
+  
+  return TRUE;
+}
+
+/**
+ * ctpl_output_stream_get_compression:
+ * @stream: A #CtplOutputStream
+ * 
+ * Gets the compression format of a #CtplOutputStream, see
+ * ctpl_output_stream_set_compression().
+ * 
+ * Returns: The compression format of @stream.
+ * 
+ * Since: 0.4
+ */
+CtplOutputCompression
+ctpl_output_stream_get_compression (CtplOutputStream *stream)
+{
+  return (stream->compressor
+          ? ctpl_output_compressor_get_compression (stream->compressor)
+          : CTPL_OUTPUT_COMPRESSION_NONE);
+}
+
+/*
+ * ctpl_output_stream_flush_buffer:
+ * @stream: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes all pending data of a #CtplOutputStream to its underlying stream,
+ * without flushing the underlying stream itself.
+ * For threaded streams, this only queues the pending data for writing.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_output_stream_flush_buffer (CtplOutputStream  *stream,
+                                 GError           **error)
+{
+  gboolean rv = TRUE;
+  
+  if (stream->writer) {
+    rv = (ctpl_output_stream_check_limits (stream, error) &&
+          output_writer_push (stream, error));
+  } else if (stream->n_spans > 0 && stream->compressor) {
+    guint i;
+    
+    rv = ctpl_output_stream_check_limits (stream, error);
+    for (i = 0; rv && i < stream->n_spans; i++) {
+      rv = ctpl_output_stream_write_out (stream, stream->spans[i].buffer,
+                                         stream->spans[i].size,
+                                         stream->cancellable, error);
+    }
+    stream->n_spans = 0U;
+    stream->buf_len = 0U;
+  } else if (stream->n_spans > 0) {
+#if GLIB_CHECK_VERSION (2, 60, 0)
+    rv = (ctpl_output_stream_check_limits (stream, error) &&
+          g_output_stream_writev_all (stream->stream, stream->spans,
+                                      stream->n_spans, NULL,
+                                      stream->cancellable, error));
+#else
+    guint i;
+    
+    rv = ctpl_output_stream_check_limits (stream, error);
+    for (i = 0; rv && i < stream->n_spans; i++) {
+      rv = g_output_stream_write_all (stream->stream, stream->spans[i].buffer,
+                                      stream->spans[i].size, NULL,
+                                      stream->cancellable, error);
+    }
+#endif
+    stream->n_spans = 0U;
+    stream->buf_len = 0U;
+  }
+  
+  return rv;
+}
+
+/*
+ * ctpl_output_stream_set_limits:
+ * @stream: A #CtplOutputStream
+ * @cancellable: (allow-none): A #GCancellable, or %NULL
+ * @deadline: The monotonic time (see g_get_monotonic_time()) after which
+ *            writing fails, or 0 for no deadline
+ * @max_bytes: The number of bytes that can still be written, or 0 for no limit
+ * 
+ * Sets the limits checked by ctpl_output_stream_check_limits() and when writing
+ * to and flushing a #CtplOutputStream.
+ * Exceeding the deadline or the byte budget is reported with respectively
+ * %CTPL_PARSER_ERROR_TIMED_OUT and %CTPL_PARSER_ERROR_OUTPUT_TOO_LARGE errors.
+ * Cancellation is reported with a %G_IO_ERROR_CANCELLED error.
+ */
+void
+ctpl_output_stream_set_limits (CtplOutputStream *stream,
+                               GCancellable     *cancellable,
+                               gint64            deadline,
+                               guint64           max_bytes)
+{
+  stream->cancellable = cancellable;
+  stream->deadline = deadline;
+  stream->limit = max_bytes > 0 ? stream->written + max_bytes : G_MAXUINT64;
+}
+
+/*
+ * ctpl_output_stream_check_limits:
+ * @stream: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Checks whether the operation writing to @stream was cancelled or exceeded
+ * its deadline (see ctpl_output_stream_set_limits()).
+ * 
+ * Returns: %TRUE if the operation can continue, %FALSE otherwise.
+ */
+gboolean
+ctpl_output_stream_check_limits (CtplOutputStream  *stream,
+                                 GError           **error)
+{
+  if (g_cancellable_set_error_if_cancelled (stream->cancellable, error)) {
+    return FALSE;
+  } else if (stream->deadline > 0 &&
+             g_get_monotonic_time () >= stream->deadline) {
+    g_set_error (error, CTPL_PARSER_ERROR, CTPL_PARSER_ERROR_TIMED_OUT,
+                 _("Parsing deadline exceeded"));
+    return FALSE;
+  }
+  
+  return TRUE;
+}
+
+/* accounts @length more bytes of @data, checking the byte budget and
+ * updating the hashes */
+static gboolean
+ctpl_output_stream_account (CtplOutputStream  *stream,
+                            const gchar       *data,
+                            gsize              length,
+                            GError           **error)
+{
+  if (G_UNLIKELY (length > stream->limit - stream->written) ||
+      (stream->shared_written &&
+       (guint64) g_atomic_pointer_add (stream->shared_written,
+                                       (gssize) length) + length >
+         stream->shared_limit)) {
+    g_set_error (error, CTPL_PARSER_ERROR, CTPL_PARSER_ERROR_OUTPUT_TOO_LARGE,
+                 _("Output exceeds the allowed size"));
+    return FALSE;
+  }
+  stream->written += length;
+  if (stream->hasher) {
+    ctpl_output_hasher_update (stream->hasher, data, length);
+  }
+  
+  return TRUE;
+}
+
+/* adds a span, flushing the pending ones if there is no room left */
+static gboolean
+ctpl_output_stream_add_span (CtplOutputStream  *stream,
+                             gconstpointer      data,
+                             gsize              length,
+                             GError           **error)
+{
+  gboolean rv = TRUE;
+  
+  if (stream->n_spans >= OUTPUT_STREAM_MAX_SPANS) {
+    rv = ctpl_output_stream_flush_buffer (stream, error);
+  }
+  if (rv) {
+    stream->spans[stream->n_spans].buffer = data;
+    stream->spans[stream->n_spans].size = length;
+    stream->n_spans++;
+  }
+  
+  return rv;
+}
+
+/* copies data to the write buffer, which must have enough room for it */
+static gboolean
+ctpl_output_stream_append_buffer (CtplOutputStream  *stream,
+                                  const gchar       *data,
+                                  gsize              length,
+                                  GError           **error)
+{
+  gchar    *dest = &stream->buffer[stream->buf_len];
+  gboolean  rv = TRUE;
+  
+  if (stream->n_spans > 0 &&
+      (const gchar *) stream->spans[stream->n_spans - 1].buffer +
+        stream->spans[stream->n_spans - 1].size == dest) {
+    /* the last span ends at the buffer's end, just extend it */
+    stream->spans[stream->n_spans - 1].size += length;
+  } else {
+    rv = ctpl_output_stream_add_span (stream, dest, length, error);
+    if (rv) {
+      /* adding the span may have flushed the buffer */
+      dest = &stream->buffer[stream->buf_len];
+      stream->spans[stream->n_spans - 1].buffer = dest;
+    }
+  }
+  if (rv) {
+    memcpy (dest, data, length);
+    stream->buf_len += length;
+  }
+  
+  return rv;
+}
+
+/*
+ * ctpl_output_stream_write_static:
+ * @stream: A #CtplOutputStream
+ * @data: The data to write
+ * @length: Length of @data in bytes
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes data to a #CtplOutputStream like ctpl_output_stream_write(), but
+ * the stream may keep a reference to @data rather than copying it, so @data
+ * must remain valid and unchanged until the next flush.
+ * This is used to write the data tokens of a tree, which outlive the parsing.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_output_stream_write_static (CtplOutputStream  *stream,
+                                 const gchar       *data,
+                                 gsize              length,
+                                 GError           **error)
+{
+  if (length < OUTPUT_STREAM_MIN_SPAN || stream->string || stream->writer ||
+      stream->map) {
+    return ctpl_output_stream_write (stream, data, (gssize) length, error);
+  } else {
+    return (ctpl_output_stream_account (stream, data, length, error) &&
+            ctpl_output_stream_add_span (stream, data, length, error));
+  }
+}
+
+#ifdef USE_FD_RANGE
+/* copies up to @length bytes from @in_fd at @offset to @out_fd, in the kernel.
+ * Returns: the number of bytes copied, which can be less than @length if the
+ *          kernel doesn't support copying between these file descriptors */
+static gsize
+copy_fd_range (gint     out_fd,
+               gint     in_fd,
+               goffset  offset,
+               gsize    length)
+{
+  gsize     done = 0;
+  gboolean  use_copy_range = TRUE;
+  
+  while (done < length) {
+    gssize n = -1;
+    
+#ifdef HAVE_COPY_FILE_RANGE
+    if (use_copy_range) {
+      loff_t off = (loff_t) (offset + (goffset) done);
+      
+      n = copy_file_range (in_fd, &off, out_fd, NULL, length - done, 0);
+      /* only works between regular files, and not on all systems */
+      use_copy_range = (n >= 0 || errno == EINTR);
+    }
+#else
+    use_copy_range = FALSE;
+#endif
+#if defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H)
+    if (! use_copy_range) {
+      off_t off = (off_t) (offset + (goffset) done);
+      
+      n = sendfile (out_fd, in_fd, &off, length - done);
+    }
+#endif
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      break;
+    }
+    done += (gsize) n;
+  }
+  
+  return done;
+}
+#endif
+
+/*
+ * ctpl_output_stream_write_file_range:
+ * @stream: A #CtplOutputStream
+ * @data: The data to write
+ * @length: Length of @data in bytes
+ * @file: The file containing @data, or %NULL
+ * @offset: The offset of @data in @file
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes static data to a #CtplOutputStream like
+ * ctpl_output_stream_write_static(), but if @data is large enough and the
+ * stream writes to a file descriptor, the data is copied by the kernel from
+ * @file (using copy_file_range() or sendfile()) rather than written from
+ * @data. The file is only opened for the time of the copy, and @data is
+ * written instead if the file changed since it was mapped, so that the output
+ * always matches what was accounted and hashed.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_output_stream_write_file_range (CtplOutputStream      *stream,
+                                     const gchar           *data,
+                                     gsize                  length,
+                                     const CtplSourceFile  *file,
+                                     goffset                offset,
+                                     GError               **error)
+{
+#ifdef USE_FD_RANGE
+  gint fd;
+  
+  if (file && stream->fd >= 0 && ! stream->compressor &&
+      length >= OUTPUT_STREAM_MIN_FD_RANGE &&
+      (fd = open (file->path, O_RDONLY)) >= 0) {
+    gsize done = 0;
+    
+    /* pending data goes first */
+    if (! ctpl_output_stream_account (stream, data, length, error) ||
+        ! ctpl_output_stream_flush_buffer (stream, error)) {
+      close (fd);
+      return FALSE;
+    }
+    /* only copy from the very file that was mapped */
+    if (ctpl_source_file_check (file, fd)) {
+      done = copy_fd_range (stream->fd, fd, offset, length);
+      if (done == 0) {
+        /* not supported for this output, don't try again */
+        stream->fd = -1;
+      }
+    }
+    close (fd);
+    
+    return (done >= length ||
+            g_output_stream_write_all (stream->stream, data + done,
+                                       length - done, NULL,
+                                       stream->cancellable, error));
+  }
+#endif
+  
+  return ctpl_output_stream_write_static (stream, data, length, error);
+}
+
+/**
+ * ctpl_output_stream_set_escape_mode:
+ * @stream: A #CtplOutputStream
+ * @mode: A #CtplEscapeMode
+ * 
+ * Sets how the values of the expressions rendered to a #CtplOutputStream are
+ * escaped.
+ * This only applies to expressions that don't specify their own escape mode,
+ * and never to the raw data of the template nor to data written with
+ * ctpl_output_stream_write().
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_output_stream_set_escape_mode (CtplOutputStream *stream,
+                                    CtplEscapeMode    mode)
+{
+  stream->escape = mode;
+}
+
+/**
+ * ctpl_output_stream_get_escape_mode:
+ * @stream: A #CtplOutputStream
+ * 
+ * Gets the escape mode of a #CtplOutputStream, see
+ * ctpl_output_stream_set_escape_mode().
+ * 
+ * Returns: The escape mode of @stream.
+ * 
+ * Since: 0.4
+ */
+CtplEscapeMode
+ctpl_output_stream_get_escape_mode (CtplOutputStream *stream)
+{
+  return stream->escape;
+}
+
+/**
+ * ctpl_output_stream_set_parallel_threshold:
+ * @stream: A #CtplOutputStream
+ * @threshold: The minimum number of iterations of a loop for it to be rendered
+ *             in parallel, or 0 to never render loops in parallel
+ * 
+ * Sets whether ctpl_parser_parse() renders the iterations of large `for` loops
+ * to @stream on several threads.
+ * The iterations of such loops are split in chunks rendered concurrently to
+ * separate buffers, which are then written to @stream in order, so the output
+ * is the same as when rendering sequentially.
+ * Loops rendered in parallel don't nest: the loops inside the iterations of a
+ * loop rendered in parallel are rendered sequentially by the thread rendering
+ * the enclosing iteration. A loop nested in a loop below the threshold can
+ * still be rendered in parallel though, if it is large enough itself.
+ * 
+ * While a loop is rendered in parallel, the environment is only read from
+ * several threads, so it must not be modified concurrently.
+ * 
+ * This doesn't apply to ctpl_parser_parse_async() nor #CtplRenderIter.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_output_stream_set_parallel_threshold (CtplOutputStream *stream,
+                                           guint             threshold)
+{
+  stream->parallel_threshold = threshold;
+}
+
+/**
+ * ctpl_output_stream_get_parallel_threshold:
+ * @stream: A #CtplOutputStream
+ * 
+ * Gets the minimum size of the loops rendered in parallel to a
+ * #CtplOutputStream, see ctpl_output_stream_set_parallel_threshold().
+ * 
+ * Returns: The threshold, or 0 if loops are never rendered in parallel.
+ * 
+ * Since: 0.4
+ */
+guint
+ctpl_output_stream_get_parallel_threshold (CtplOutputStream *stream)
+{
+  return stream->parallel_threshold;
+}
+
+/**
+ * ctpl_output_stream_set_fragment_cache:
+ * @stream: A #CtplOutputStream
+ * @cache: (allow-none): A #CtplFragmentCache, or %NULL
+ * 
+ * Sets the #CtplFragmentCache in which ctpl_parser_parse() looks up and
+ * stores the output of the <code>cache</code> blocks rendered to @stream.
+ * Without a cache, these blocks are rendered like their content.
+ * This function adds a reference to @cache.
+ * 
+ * This doesn't apply to #CtplRenderIter.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_output_stream_set_fragment_cache (CtplOutputStream  *stream,
+                                       CtplFragmentCache *cache)
+{
+  if (cache) {
+    ctpl_fragment_cache_ref (cache);
+  }
+  if (stream->fragment_cache) {
+    ctpl_fragment_cache_unref (stream->fragment_cache);
+  }
+  stream->fragment_cache = cache;
+}
+
+/**
+ * ctpl_output_stream_get_fragment_cache:
+ * @stream: A #CtplOutputStream
+ * 
+ * Gets the #CtplFragmentCache of a #CtplOutputStream, see
+ * ctpl_output_stream_set_fragment_cache().
+ * 
+ * Returns: (transfer none): The cache, or %NULL if there is none.
+ * 
+ * Since: 0.4
+ */
+CtplFragmentCache *
+ctpl_output_stream_get_fragment_cache (CtplOutputStream *stream)
+{
+  return stream->fragment_cache;
+}
+
+/**
+ * ctpl_output_stream_set_hashes:
+ * @stream: A #CtplOutputStream
+ * @hashes: The hashes to compute, or %CTPL_OUTPUT_HASH_NONE to stop computing
+ *          hashes
+ * 
+ * Sets which hashes a #CtplOutputStream computes on the data written to it.
+ * The hashes are computed as the data is written, so that for example an
+ * HTTP ETag or a checksum for a cache can be obtained right after rendering
+ * without reading the output again.
+ * 
+ * The hashes cover everything written after this call, before compression if
+ * any (see ctpl_output_stream_set_compression()); calling it again restarts
+ * them. Get their values with ctpl_output_stream_get_hash().
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_output_stream_set_hashes (CtplOutputStream *stream,
+                               CtplOutputHash    hashes)
+{
+  if (stream->hasher) {
+    ctpl_output_hasher_free (stream->hasher);
+    stream->hasher = NULL;
+  }
+  if (hashes != CTPL_OUTPUT_HASH_NONE) {
+    stream->hasher = ctpl_output_hasher_new (hashes);
+  }
+}
+
+/**
+ * ctpl_output_stream_get_hash:
+ * @stream: A #CtplOutputStream
+ * @hash: A single #CtplOutputHash
+ * 
+ * Gets the value of a hash computed by a #CtplOutputStream on the data written
+ * to it so far, see ctpl_output_stream_set_hashes().
+ * The stream can still be written to afterwards, and the hash keeps being
+ * computed.
+ * 
+ * Returns: A newly allocated string holding the hash in lowercase
+ *          hexadecimal, or %NULL if @stream doesn't compute @hash. Free with
+ *          g_free().
+ * 
+ * Since: 0.4
+ */
+gchar *
+ctpl_output_stream_get_hash (CtplOutputStream *stream,
+                             CtplOutputHash    hash)
+{
+  return stream->hasher ? ctpl_output_hasher_get_string (stream->hasher, hash)
+                        : NULL;
+}
+
+/*
+ * ctpl_output_stream_account_data:
+ * @stream: A #CtplOutputStream
+ * @data: Some data
+ * @length: The length of @data
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Accounts data written to the underlying stream of a #CtplOutputStream
+ * directly rather than through @stream: checks it fits in the byte budget of
+ * @stream (see ctpl_output_stream_set_limits()), adds it to the written bytes
+ * and updates the hashes.
+ * 
+ * Returns: %TRUE if @data can be written, %FALSE if it exceeds the budget.
+ */
+gboolean
+ctpl_output_stream_account_data (CtplOutputStream  *stream,
+                                 const gchar       *data,
+                                 gsize              length,
+                                 GError           **error)
+{
+  return ctpl_output_stream_account (stream, data, length, error);
 }
 
 /**
@@ -133,12 +1426,46 @@ ctpl_output_stream_write (CtplOutputStream  *stream,
                           gssize             length,
                           GError           **error)
 {
-  gsize len;
+  gboolean  rv = TRUE;
+  gsize     len;
   
   len = (length < 0) ? strlen (data) : (gsize)length;
+  if (! ctpl_output_stream_account (stream, data, len, error)) {
+    rv = FALSE;
+  } else if (stream->string) {
+    g_string_append_len (stream->string, data, (gssize) len);
+#ifdef USE_MAPPED_FILE
+  } else if (stream->map) {
+    rv = output_map_write (stream->map, data, len, error);
+#endif
+  } else if (stream->writer) {
+    /* the writer thread only deals with copies */
+    rv = output_writer_check (stream->writer, error);
+    while (rv && len > 0) {
+      gsize n = MIN (len, stream->buf_size - stream->buf_len);
+      
+      memcpy (&stream->buffer[stream->buf_len], data, n);
+      stream->buf_len += n;
+      data += n;
+      len -= n;
+      if (stream->buf_len >= stream->buf_size) {
+        rv = output_writer_push (stream, error);
+      }
+    }
+  } else if (len > stream->buf_size / 2) {
+    /* too big to be worth copying: write it together with pending data */
+    rv = (ctpl_output_stream_add_span (stream, data, len, error) &&
+          ctpl_output_stream_flush_buffer (stream, error));
+  } else if (len > 0) {
+    if (stream->buf_len + len > stream->buf_size) {
+      rv = ctpl_output_stream_flush_buffer (stream, error);
+    }
+    if (rv) {
+      rv = ctpl_output_stream_append_buffer (stream, data, len, error);
+    }
+  }
   
-  return g_output_stream_write (G_OUTPUT_STREAM (stream), data, len, NULL,
-                                error) == (gssize)len;
+  return rv;
 }
 
 #undef ctpl_output_stream_put_c
@@ -161,3 +1488,76 @@ ctpl_output_stream_put_c (CtplOutputStream  *stream,
 {
   return ctpl_output_stream_write (stream, &c, 1, error);
 }
+
+/**
+ * ctpl_output_stream_flush:
+ * @stream: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes all data buffered in a #CtplOutputStream to the underlying
+ * #GOutputStream, and then flushes it (see g_output_stream_flush()).
+ * For streams created with ctpl_output_stream_new_threaded(), this waits for
+ * the writer thread to write all queued data.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_output_stream_flush (CtplOutputStream  *stream,
+                          GError           **error)
+{
+  return (ctpl_output_stream_flush_buffer (stream, error) &&
+          (! stream->writer || output_writer_drain (stream, error)) &&
+          (! stream->compressor ||
+           ctpl_output_compressor_write (stream->compressor, stream->stream,
+                                         NULL, 0, CTPL_OUTPUT_COMPRESSOR_FLUSH,
+                                         stream->cancellable, error)) &&
+          (! stream->stream ||
+           g_output_stream_flush (stream->stream, NULL, error)));
+}
+
+/**
+ * ctpl_output_stream_close:
+ * @stream: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Flushes a #CtplOutputStream (see ctpl_output_stream_flush()) and closes the
+ * underlying #GOutputStream (see g_output_stream_close()).
+ * If the stream compresses its output, this also ends the compressed data.
+ * For streams created with ctpl_output_stream_new_for_mapped_path(), this
+ * truncates the file to the size of the written data and closes it, and
+ * synchronizes it to the disk if requested.
+ * 
+ * No data can be written to @stream after it was closed. Note that the stream
+ * still needs to be unref'd with ctpl_output_stream_unref().
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_output_stream_close (CtplOutputStream  *stream,
+                          GError           **error)
+{
+  gboolean rv;
+  
+  rv = (ctpl_output_stream_flush_buffer (stream, error) &&
+        (! stream->writer || output_writer_drain (stream, error)) &&
+        (! stream->compressor ||
+         ctpl_output_compressor_write (stream->compressor, stream->stream,
+                                       NULL, 0, CTPL_OUTPUT_COMPRESSOR_FINISH,
+                                       stream->cancellable, error)));
+  /* close even if flushing failed, but only report the first error */
+#ifdef USE_MAPPED_FILE
+  if (stream->map && ! output_map_close (stream->map, rv ? error : NULL)) {
+    rv = FALSE;
+  }
+#endif
+  if (stream->stream &&
+      ! g_output_stream_close (stream->stream, NULL, rv ? error : NULL)) {
+    rv = FALSE;
+  }
+  
+  return rv;
+}
@@ -26,16 +26,93 @@
 
 #include <glib.h>
 #include <gio/gio.h>
+#include "ctpl-escape.h"
+#include "ctpl-fragment-cache.h"
 
 G_BEGIN_DECLS
 
 
 typedef struct _CtplOutputStream CtplOutputStream;
 
+/**
+ * CtplOutputCompression:
+ * @CTPL_OUTPUT_COMPRESSION_NONE: No compression
+ * @CTPL_OUTPUT_COMPRESSION_GZIP: gzip compression
+ * @CTPL_OUTPUT_COMPRESSION_ZSTD: Zstandard compression, only available if CTPL
+ *                                was built with libzstd
+ * 
+ * Compression formats of the output of a #CtplOutputStream, see
+ * ctpl_output_stream_set_compression().
+ * 
+ * Since: 0.4
+ */
+typedef enum _CtplOutputCompression
+{
+  CTPL_OUTPUT_COMPRESSION_NONE,
+  CTPL_OUTPUT_COMPRESSION_GZIP,
+  CTPL_OUTPUT_COMPRESSION_ZSTD
+} CtplOutputCompression;
+
+/**
+ * CtplOutputHash:
+ * @CTPL_OUTPUT_HASH_NONE: No hash
+ * @CTPL_OUTPUT_HASH_XXH64: The XXH64 non-cryptographic hash, fast enough to be
+ *                          computed on any output
+ * @CTPL_OUTPUT_HASH_SHA256: The SHA-256 cryptographic hash
+ * 
+ * Hashes a #CtplOutputStream can compute on the data written to it, see
+ * ctpl_output_stream_set_hashes(). The values can be combined.
+ * 
+ * Since: 0.4
+ */
+typedef enum _CtplOutputHash
+{
+  CTPL_OUTPUT_HASH_NONE   = 0,
+  CTPL_OUTPUT_HASH_XXH64  = 1 << 0,
+  CTPL_OUTPUT_HASH_SHA256 = 1 << 1
+} CtplOutputHash;
+
 CtplOutputStream *ctpl_output_stream_new            (GOutputStream *stream);
+CtplOutputStream *ctpl_output_stream_new_sized      (GOutputStream *stream,
+                                                     gsize          buffer_size);
+CtplOutputStream *ctpl_output_stream_new_threaded   (GOutputStream *stream,
+                                                     gsize          buffer_size,
+                                                     guint          n_buffers);
+CtplOutputStream *ctpl_output_stream_new_for_mapped_path
+                                                    (const gchar   *path,
+                                                     gboolean       sync,
+                                                     GError       **error);
 CtplOutputStream *ctpl_output_stream_ref            (CtplOutputStream *stream);
 void              ctpl_output_stream_unref          (CtplOutputStream *stream);
 GOutputStream    *ctpl_output_stream_get_stream     (CtplOutputStream *stream);
+gboolean          ctpl_output_stream_set_compression
+                                                    (CtplOutputStream      *stream,
+                                                     CtplOutputCompression  compression,
+                                                     gint                   level,
+                                                     GError               **error);
+CtplOutputCompression
+                  ctpl_output_stream_get_compression
+                                                    (CtplOutputStream *stream);
+void              ctpl_output_stream_set_escape_mode
+                                                    (CtplOutputStream *stream,
+                                                     CtplEscapeMode    mode);
+CtplEscapeMode    ctpl_output_stream_get_escape_mode
+                                                    (CtplOutputStream *stream);
+void              ctpl_output_stream_set_parallel_threshold
+                                                    (CtplOutputStream *stream,
+                                                     guint             threshold);
+guint             ctpl_output_stream_get_parallel_threshold
+                                                    (CtplOutputStream *stream);
+void              ctpl_output_stream_set_fragment_cache
+                                                    (CtplOutputStream  *stream,
+                                                     CtplFragmentCache *cache);
+CtplFragmentCache *
+                  ctpl_output_stream_get_fragment_cache
+                                                    (CtplOutputStream *stream);
+void              ctpl_output_stream_set_hashes     (CtplOutputStream *stream,
+                                                     CtplOutputHash    hashes);
+gchar            *ctpl_output_stream_get_hash       (CtplOutputStream *stream,
+                                                     CtplOutputHash    hash);
 gboolean          ctpl_output_stream_write          (CtplOutputStream  *stream,
                                                      const gchar       *data,
                                                      gssize             length,
@@ -43,6 +120,10 @@ gboolean          ctpl_output_stream_write          (CtplOutputStream  *stream,
 gboolean          ctpl_output_stream_put_c          (CtplOutputStream  *stream,
                                                      gchar              c,
                                                      GError           **error);
+gboolean          ctpl_output_stream_flush          (CtplOutputStream  *stream,
+                                                     GError           **error);
+gboolean          ctpl_output_stream_close          (CtplOutputStream  *stream,
+                                                     GError           **error);
 
 #if defined (__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
 static inline gboolean
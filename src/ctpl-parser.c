@@ -19,12 +19,24 @@
 
 #include "ctpl-parser.h"
 #include <glib.h>
+#include <gio/gio.h>
 #include <string.h>
 #include "ctpl-i18n.h"
+#include "ctpl-escape.h"
+#include "ctpl-escape-private.h"
+#include "ctpl-environ.h"
+#include "ctpl-environ-private.h"
 #include "ctpl-eval.h"
+#include "ctpl-eval-private.h"
+#include "ctpl-fragment-cache.h"
+#include "ctpl-fragment-cache-private.h"
 #include "ctpl-token.h"
 #include "ctpl-token-private.h"
 #include "ctpl-output-stream.h"
+#include "ctpl-output-stream-private.h"
+#include "ctpl-parser-private.h"
+#include "ctpl-render-iter.h"
+#include "ctpl-threads-private.h"
 
 
 /**
@@ -34,9 +46,27 @@
  * 
  * Parses a #CtplToken tree against a #CtplEnviron.
  * 
- * To parse a token tree, use ctpl_parser_parse().
+ * To parse a token tree, use ctpl_parser_parse(). To get the output in memory,
+ * ctpl_parser_parse_to_string() and ctpl_parser_parse_to_gstring() are faster
+ * than parsing to a #GMemoryOutputStream.
+ * To parse without blocking on the output, use ctpl_parser_parse_async().
+ * To render the same template for many records, use ctpl_parser_parse_batch().
+ * 
+ * The output of <code>cache</code> blocks is reused from the
+ * #CtplFragmentCache of the output if it has one, see
+ * ctpl_output_stream_set_fragment_cache().
  */
 
+/* size of the chunks rendered between asynchronous writes */
+#define PARSE_ASYNC_CHUNK_SIZE  16384U
+/* minimum number of iterations in a chunk of a loop rendered in parallel */
+#define PARALLEL_LOOP_MIN_CHUNK 16U
+/* number of chunks per thread of a loop rendered in parallel, so that threads
+ * finishing early can take over work from the others */
+#define PARALLEL_LOOP_CHUNKS_PER_THREAD 4U
+/* number of records a thread takes at once when rendering a batch */
+#define PARSE_BATCH_CHUNK_SIZE  16U
+
 /* The only useful thing is to be able to push or pop variables/constants :
  * 
  * A loop :
@@ -92,13 +122,263 @@ ctpl_parser_error_quark (void)
 }
 
 
+static gboolean   ctpl_parser_parse_tree    (const CtplToken   *tree,
+                                            CtplEnviron       *env,
+                                            CtplOutputStream  *output,
+                                            GError           **error);
+
+
 /* "parses" a data token */
 static gboolean
-ctpl_parser_parse_token_data (const gchar      *data,
-                              CtplOutputStream *output,
-                              GError          **error)
+ctpl_parser_parse_token_data (const CtplTokenData *data,
+                              CtplOutputStream    *output,
+                              GError             **error)
+{
+  /* the data lives as long as the tree, which outlives the parsing */
+  if (data->source_file) {
+    const gchar *base = g_bytes_get_data (data->source, NULL);
+    
+    return ctpl_output_stream_write_file_range (output, data->data,
+                                                data->length,
+                                                data->source_file,
+                                                data->data - base, error);
+  } else {
+    return ctpl_output_stream_write_static (output, data->data, data->length,
+                                            error);
+  }
+}
+
+/**
+ * ctpl_parser_check_loop_array:
+ * @value: The value a <code>for</code> statement iterates over
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Checks whether @value can be iterated over by a <code>for</code> statement,
+ * reporting the same error than parsing such a statement would otherwise.
+ * 
+ * This is mostly useful to code rendering templates without a token tree, like
+ * the code written by ctpl_codegen_emit_c().
+ * 
+ * Returns: %TRUE if @value can be iterated over, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_parser_check_loop_array (const CtplValue *value,
+                              GError         **error)
+{
+  gboolean rv = TRUE;
+  
+  if (! CTPL_VALUE_HOLDS_ARRAY (value)) {
+    gchar *array_name;
+    
+    array_name = ctpl_value_to_string (value);
+    g_set_error (error, CTPL_PARSER_ERROR, CTPL_PARSER_ERROR_INCOMPATIBLE_SYMBOL,
+                 _("Cannot iterate over value '%s'"),
+                 array_name);
+    g_free (array_name);
+    rv = FALSE;
+  }
+  
+  return rv;
+}
+
+/*
+ * ctpl_parser_eval_loop_array:
+ * @token: A #CtplTokenFor
+ * @env: A #CtplEnviron
+ * @value: An initialized #CtplValue to fill with the array to iterate over
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Evaluates the array expression of a `for` token and checks it can be
+ * iterated over.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_parser_eval_loop_array (const CtplTokenFor  *token,
+                             CtplEnviron         *env,
+                             CtplValue           *value,
+                             GError             **error)
 {
-  return ctpl_output_stream_write (output, data, -1, error);
+  return (ctpl_eval_value (token->array, env, value, error) &&
+          ctpl_parser_check_loop_array (value, error));
+}
+
+/* renders @n_items iterations of a `for` loop starting at @items */
+static gboolean
+ctpl_parser_parse_loop_items (const CtplTokenFor  *token,
+                              const GSList        *items,
+                              guint                n_items,
+                              CtplEnviron         *env,
+                              CtplOutputStream    *output,
+                              GError             **error)
+{
+  gboolean rv = TRUE;
+  
+  for (; rv && items && n_items > 0; items = items->next, n_items--) {
+    if (! ctpl_output_stream_check_limits (output, error)) {
+      rv = FALSE;
+      break;
+    }
+    ctpl_environ_push (env, token->iter, items->data);
+    rv = ctpl_parser_parse_tree (token->children, env, output, error);
+    ctpl_environ_pop (env, token->iter, NULL);
+  }
+  
+  return rv;
+}
+
+
+typedef struct _ParallelChunk ParallelChunk;
+typedef struct _ParallelLoop  ParallelLoop;
+
+/* a range of iterations of a loop rendered in parallel */
+struct _ParallelChunk
+{
+  const GSList *items;
+  guint         n_items;
+  GString      *output;
+  gboolean      rv;
+  GError       *error;
+};
+
+/* state of a loop rendered in parallel */
+struct _ParallelLoop
+{
+  const CtplTokenFor *token;
+  CtplEnviron        *env;
+  CtplOutputStream   *output;
+  ParallelChunk      *chunks;
+  guint               n_chunks;
+  gint                next_chunk;   /* next chunk to render */
+  gint                first_failed; /* first chunk that failed */
+  gssize              written;      /* bytes written by all the chunks, for
+                                     * them to share the byte budget */
+};
+
+/* renders chunks of @loop until there are none left */
+static void
+parallel_loop_run (gpointer data)
+{
+  ParallelLoop *loop = data;
+  CtplEnviron  *env = ctpl_environ_new_child (loop->env);
+  gint          i;
+  
+  while ((i = g_atomic_int_add (&loop->next_chunk, 1)) < (gint) loop->n_chunks) {
+    ParallelChunk    *chunk = &loop->chunks[i];
+    CtplOutputStream *output;
+    gint              failed;
+    
+    if (i > g_atomic_int_get (&loop->first_failed)) {
+      /* this chunk would never be written */
+      chunk->rv = FALSE;
+      continue;
+    }
+    chunk->output = g_string_new (NULL);
+    output = ctpl_output_stream_new_fragment (loop->output, chunk->output,
+                                              &loop->written);
+    chunk->rv = ctpl_parser_parse_loop_items (loop->token, chunk->items,
+                                              chunk->n_items, env, output,
+                                              &chunk->error);
+    ctpl_output_stream_unref (output);
+    if (! chunk->rv) {
+      do {
+        failed = g_atomic_int_get (&loop->first_failed);
+      } while (i < failed &&
+               ! g_atomic_int_compare_and_exchange (&loop->first_failed,
+                                                    failed, i));
+    }
+  }
+  ctpl_environ_unref (env);
+}
+
+/*
+ * ctpl_parser_parse_loop_parallel:
+ * @token: A #CtplTokenFor
+ * @items: The items to iterate over
+ * @n_items: The number of items in @items
+ * @env: A #CtplEnviron
+ * @output: A #CtplOutputStream
+ * @n_threads: The number of threads to use
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Renders a `for` loop on several threads.
+ * The iterations are split in more chunks than there are threads, that the
+ * threads take in order as they finish the previous ones, so the work is
+ * balanced even if some iterations are much longer to render than others.
+ * Each chunk is rendered to its own buffer with its own scope for the
+ * iterator, and the buffers are then written to @output in order.
+ * 
+ * As the chunks are written in order and the one in which an error occurred is
+ * written up to the error, the output is the same as if the loop was rendered
+ * sequentially.
+ * The chunks share what is left of the byte budget of @output, so that together
+ * they never render much more than it allows. Exceeding it is still reported
+ * as with a sequential rendering, but the output written before the error may
+ * be shorter.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+static gboolean
+ctpl_parser_parse_loop_parallel (const CtplTokenFor  *token,
+                                 const GSList        *items,
+                                 guint                n_items,
+                                 CtplEnviron         *env,
+                                 CtplOutputStream    *output,
+                                 guint                n_threads,
+                                 GError             **error)
+{
+  ParallelLoop  loop;
+  guint         chunk_size;
+  guint         i;
+  gboolean      rv = TRUE;
+  
+  loop.token = token;
+  loop.env = env;
+  loop.output = output;
+  loop.n_chunks = MIN (n_threads * PARALLEL_LOOP_CHUNKS_PER_THREAD,
+                       MAX (n_items / PARALLEL_LOOP_MIN_CHUNK, 1));
+  chunk_size = (n_items + loop.n_chunks - 1) / loop.n_chunks;
+  loop.n_chunks = (n_items + chunk_size - 1) / chunk_size;
+  loop.chunks = g_new (ParallelChunk, loop.n_chunks);
+  for (i = 0; i < loop.n_chunks; i++) {
+    guint n;
+    
+    loop.chunks[i].items = items;
+    loop.chunks[i].n_items = MIN (chunk_size, n_items - i * chunk_size);
+    loop.chunks[i].output = NULL;
+    loop.chunks[i].rv = FALSE;
+    loop.chunks[i].error = NULL;
+    for (n = 0; n < loop.chunks[i].n_items; n++) {
+      items = items->next;
+    }
+  }
+  loop.next_chunk = 0;
+  loop.first_failed = G_MAXINT;
+  loop.written = 0;
+  ctpl_threads_run (MIN (n_threads, loop.n_chunks), parallel_loop_run, &loop);
+  
+  for (i = 0; i < loop.n_chunks; i++) {
+    ParallelChunk *chunk = &loop.chunks[i];
+    
+    if (rv && chunk->output) {
+      rv = ctpl_output_stream_write (output, chunk->output->str,
+                                     (gssize) chunk->output->len, error);
+    }
+    if (rv && ! chunk->rv) {
+      g_propagate_error (error, chunk->error);
+      chunk->error = NULL;
+      rv = FALSE;
+    }
+    if (chunk->output) {
+      g_string_free (chunk->output, TRUE);
+    }
+    g_clear_error (&chunk->error);
+  }
+  g_free (loop.chunks);
+  
+  return rv;
 }
 
 /* Tries to parse a `for` token */
@@ -108,31 +388,31 @@ ctpl_parser_parse_token_for (const CtplTokenFor  *token,
                              CtplOutputStream    *output,
                              GError             **error)
 {
-  /* we can safely assume token holds array here */
   CtplValue value;
   gboolean  rv = FALSE;
   
   ctpl_value_init (&value);
-  if (ctpl_eval_value (token->array, env, &value, error)) {
-    if (! CTPL_VALUE_HOLDS_ARRAY (&value)) {
-      gchar *array_name;
-      
-      array_name = ctpl_value_to_string (&value);
-      g_set_error (error, CTPL_PARSER_ERROR, CTPL_PARSER_ERROR_INCOMPATIBLE_SYMBOL,
-                   _("Cannot iterate over value '%s'"),
-                   array_name);
-      g_free (array_name);
-    } else {
-      const GSList *array_items;
-      
-      rv = TRUE;
-      array_items = ctpl_value_get_array (&value);
-      for (; rv && array_items; array_items = array_items->next) {
-        ctpl_environ_push (env, token->iter, array_items->data);
-        rv = ctpl_parser_parse (token->children, env, output, error);
-        ctpl_environ_pop (env, token->iter, NULL);
+  if (ctpl_parser_eval_loop_array (token, env, &value, error)) {
+    const GSList *array_items;
+    guint         threshold;
+    guint         n_items = G_MAXUINT;
+    guint         n_threads = 1;
+    
+    array_items = ctpl_value_get_array (&value);
+    threshold = ctpl_output_stream_get_parallel_threshold (output);
+    if (threshold > 0) {
+      n_items = g_slist_length ((GSList *) array_items);
+      if (n_items >= threshold) {
+        n_threads = ctpl_threads_get_max ();
       }
     }
+    if (n_threads > 1) {
+      rv = ctpl_parser_parse_loop_parallel (token, array_items, n_items, env,
+                                            output, n_threads, error);
+    } else {
+      rv = ctpl_parser_parse_loop_items (token, array_items, n_items, env,
+                                         output, error);
+    }
   }
   ctpl_value_free_value (&value);
   
@@ -150,44 +430,270 @@ ctpl_parser_parse_token_if (const CtplTokenIf  *token,
   gboolean  eval;
   
   if (ctpl_eval_bool (token->condition, env, &eval, error)) {
-    rv = ctpl_parser_parse (eval ? token->if_children
-                                 : token->else_children,
-                            env, output, error);
+    rv = ctpl_parser_parse_tree (eval ? token->if_children
+                                      : token->else_children,
+                                 env, output, error);
   }
   
   return rv;
 }
 
-/* Tries to parse an expression (a variable, a complete expression, ...). */
+/* appends to @key a description of @value that is different for any
+ * different value */
+static void
+ctpl_parser_append_cache_value (GString         *key,
+                                const CtplValue *value)
+{
+  switch (ctpl_value_get_held_type (value)) {
+    case CTPL_VTYPE_INT:
+      g_string_append_printf (key, "i%ld;", ctpl_value_get_int (value));
+      break;
+    
+    case CTPL_VTYPE_FLOAT:
+      /* the hexadecimal form is exact */
+      g_string_append_printf (key, "f%a;", ctpl_value_get_float (value));
+      break;
+    
+    case CTPL_VTYPE_STRING: {
+      const gchar *string = ctpl_value_get_string (value);
+      
+      g_string_append_printf (key, "s%" G_GSIZE_FORMAT ":", strlen (string));
+      g_string_append (key, string);
+      break;
+    }
+    
+    case CTPL_VTYPE_ARRAY: {
+      const GSList *item;
+      
+      g_string_append (key, "a[");
+      for (item = ctpl_value_get_array (value); item; item = item->next) {
+        ctpl_parser_append_cache_value (key, item->data);
+      }
+      g_string_append_c (key, ']');
+      break;
+    }
+  }
+}
+
+/* builds the key of the output of a `cache` token in a #CtplFragmentCache,
+ * from the values of the symbols it depends on */
+static gchar *
+ctpl_parser_get_cache_key (const CtplTokenCache *token,
+                           CtplEnviron          *env,
+                           CtplEscapeMode        escape)
+{
+  GString  *key;
+  gsize     i;
+  
+  key = g_string_new (NULL);
+  g_string_append_printf (key, "%" G_GSIZE_FORMAT ":%d:", token->id, escape);
+  for (i = 0; token->symbols[i]; i++) {
+    const CtplValue *value;
+    
+    value = ctpl_environ_lookup (env, token->symbols[i]);
+    if (! value) {
+      g_string_append_c (key, '-');
+    } else {
+      ctpl_parser_append_cache_value (key, value);
+    }
+  }
+  
+  return g_string_free (key, FALSE);
+}
+
+/* Tries to parse a `cache` token, reusing its output from the fragment cache of
+ * @output if possible */
 static gboolean
-ctpl_parser_parse_token_expr (CtplTokenExpr    *expr,
-                              CtplEnviron      *env,
-                              CtplOutputStream *output,
-                              GError          **error)
+ctpl_parser_parse_token_cache (const CtplTokenCache  *token,
+                               CtplEnviron           *env,
+                               CtplOutputStream      *output,
+                               GError               **error)
 {
-  CtplValue eval_value;
-  gboolean  rv = FALSE;
+  CtplFragmentCache  *cache;
+  gboolean            rv = FALSE;
   
-  ctpl_value_init (&eval_value);
-  if (ctpl_eval_value (expr, env, &eval_value, error)) {
+  cache = ctpl_output_stream_get_fragment_cache (output);
+  if (! cache) {
+    rv = ctpl_parser_parse_tree (token->children, env, output, error);
+  } else {
+    gchar  *key;
+    GBytes *data;
+    
+    key = ctpl_parser_get_cache_key (token, env,
+                                     ctpl_output_stream_get_escape_mode (output));
+    data = ctpl_fragment_cache_lookup (cache, key);
+    if (! data) {
+      GString          *string = g_string_new (NULL);
+      CtplOutputStream *fragment;
+      gsize             length;
+      
+      fragment = ctpl_output_stream_new_fragment (output, string, NULL);
+      rv = ctpl_parser_parse_tree (token->children, env, fragment, error);
+      ctpl_output_stream_unref (fragment);
+      length = string->len;
+      data = g_bytes_new_take (g_string_free (string, FALSE), length);
+      if (rv) {
+        ctpl_fragment_cache_store (cache, key, data);
+      } else {
+        /* write what was rendered before the error, like without cache */
+        ctpl_output_stream_write (output, g_bytes_get_data (data, NULL),
+                                  (gssize) length, NULL);
+        g_bytes_unref (data);
+        data = NULL;
+      }
+    }
+    if (data) {
+      gsize         length;
+      const gchar  *bytes = g_bytes_get_data (data, &length);
+      
+      rv = ctpl_output_stream_write (output, bytes, (gssize) length, error);
+      g_bytes_unref (data);
+    }
+    g_free (key);
+  }
+  
+  return rv;
+}
+
+/* writes escaped data to a CtplOutputStream, for ctpl_escape_write() */
+static gboolean
+ctpl_parser_write_escaped (gpointer      output,
+                           const gchar  *data,
+                           gsize         length,
+                           GError      **error)
+{
+  return ctpl_output_stream_write (output, data, (gssize) length, error);
+}
+
+typedef struct _ParseExprData ParseExprData;
+
+struct _ParseExprData
+{
+  CtplOutputStream *output;
+  CtplEscapeMode    escape;
+};
+
+/* writes a piece of the value of an expression, for ctpl_eval_write() */
+static gboolean
+ctpl_parser_write_piece (gpointer      user_data,
+                         const gchar  *data,
+                         gsize         length,
+                         GError      **error)
+{
+  ParseExprData *expr_data = user_data;
+  
+  return ctpl_escape_write (expr_data->escape, data, length,
+                            ctpl_parser_write_escaped, expr_data->output,
+                            error);
+}
+
+/**
+ * ctpl_parser_write_value:
+ * @value: A #CtplValue
+ * @escape: The #CtplEscapeMode to write @value with
+ * @output: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes the string form of @value to @output escaped with @escape, like it is
+ * done when parsing an expression.
+ * 
+ * This is mostly useful to code rendering templates without a token tree, like
+ * the code written by ctpl_codegen_emit_c().
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_parser_write_value (const CtplValue   *value,
+                         CtplEscapeMode     escape,
+                         CtplOutputStream  *output,
+                         GError           **error)
+{
+  gboolean rv = FALSE;
+  
+  /* shell quoting applies to the value as a whole, it can't be written in
+   * pieces */
+  if (escape != CTPL_ESCAPE_SHELL) {
+    ParseExprData data;
+    
+    data.output = output;
+    data.escape = escape;
+    rv = ctpl_eval_write_value (value, 1, ctpl_parser_write_piece, &data,
+                                error);
+  } else {
     gchar *strval;
     
-    strval = ctpl_value_to_string (&eval_value);
+    strval = ctpl_value_to_string (value);
     if (! strval) {
       g_set_error (error, CTPL_PARSER_ERROR, CTPL_PARSER_ERROR_FAILED,
                    _("Cannot convert expression to a printable format"));
     } else {
-      rv = ctpl_output_stream_write (output, strval, -1, error);
+      rv = ctpl_escape_write (escape, strval, strlen (strval),
+                              ctpl_parser_write_escaped, output, error);
     }
     g_free (strval);
   }
-  ctpl_value_free_value (&eval_value);
   
   return rv;
 }
 
-/* Tries to parse a token by dispatching calls to specific parsers. */
-static gboolean
+/*
+ * ctpl_parser_parse_token_expr:
+ * @expr: A #CtplTokenExpr
+ * @escape: The #CtplEscapeMode of the expression, or %CTPL_ESCAPE_INHERIT to
+ *          use the one of @output
+ * @env: A #CtplEnviron
+ * @output: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Tries to parse an expression (a variable, a complete expression, ...).
+ * The value is written to @output as it is computed, see ctpl_eval_write().
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+ctpl_parser_parse_token_expr (CtplTokenExpr    *expr,
+                              gint              escape,
+                              CtplEnviron      *env,
+                              CtplOutputStream *output,
+                              GError          **error)
+{
+  ParseExprData data;
+  gboolean      rv = FALSE;
+  
+  data.output = output;
+  data.escape = (escape == CTPL_ESCAPE_INHERIT
+                 ? ctpl_output_stream_get_escape_mode (output)
+                 : (CtplEscapeMode) escape);
+  if (data.escape != CTPL_ESCAPE_SHELL) {
+    rv = ctpl_eval_write (expr, env, ctpl_parser_write_piece, &data, error);
+  } else {
+    CtplValue eval_value;
+    
+    ctpl_value_init (&eval_value);
+    if (ctpl_eval_value (expr, env, &eval_value, error)) {
+      rv = ctpl_parser_write_value (&eval_value, data.escape, output, error);
+    }
+    ctpl_value_free_value (&eval_value);
+  }
+  
+  return rv;
+}
+
+/*
+ * ctpl_parser_parse_token:
+ * @token: A #CtplToken
+ * @env: A #CtplEnviron
+ * @output: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Tries to parse a token by dispatching calls to specific parsers. The tokens
+ * following @token are not parsed, and @output is not flushed.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
 ctpl_parser_parse_token (const CtplToken   *token,
                          CtplEnviron       *env,
                          CtplOutputStream  *output,
@@ -209,7 +715,13 @@ ctpl_parser_parse_token (const CtplToken   *token,
       break;
     
     case CTPL_TOKEN_TYPE_EXPR:
-      rv = ctpl_parser_parse_token_expr (token->token.t_expr, env, output, error);
+      rv = ctpl_parser_parse_token_expr (token->token.t_expr, token->escape,
+                                         env, output, error);
+      break;
+    
+    case CTPL_TOKEN_TYPE_CACHE:
+      rv = ctpl_parser_parse_token_cache (token->token.t_cache, env, output,
+                                          error);
       break;
     
     default:
@@ -220,6 +732,22 @@ ctpl_parser_parse_token (const CtplToken   *token,
   return rv;
 }
 
+/* parses a token list, without flushing the output */
+static gboolean
+ctpl_parser_parse_tree (const CtplToken   *tree,
+                        CtplEnviron       *env,
+                        CtplOutputStream  *output,
+                        GError           **error)
+{
+  gboolean rv = TRUE;
+  
+  for (; rv && tree; tree = tree->next) {
+    rv = ctpl_parser_parse_token (tree, env, output, error);
+  }
+  
+  return rv;
+}
+
 /**
  * ctpl_parser_parse:
  * @tree: A #CtplToken from which start parsing
@@ -229,6 +757,9 @@ ctpl_parser_parse_token (const CtplToken   *token,
  * 
  * Parses a token tree against an environment and outputs the result to @output.
  * 
+ * The data buffered in @output is written to the underlying #GOutputStream
+ * before this function returns, even on failure.
+ * 
  * Returns: %TRUE on success, %FALSE otherwise, in which case @error shall be
  *          set to the error that occurred.
  */
@@ -238,11 +769,467 @@ ctpl_parser_parse (const CtplToken   *tree,
                    CtplOutputStream  *output,
                    GError           **error)
 {
-  gboolean rv = TRUE;
+  gboolean rv;
   
-  for (; rv && tree; tree = tree->next) {
-    rv = ctpl_parser_parse_token (tree, env, output, error);
+  rv = ctpl_parser_parse_tree (tree, env, output, error);
+  /* the output may reference data from @tree, so it has to be flushed before
+   * the caller gets a chance to free it */
+  if (rv) {
+    rv = ctpl_output_stream_flush_buffer (output, error);
+  } else {
+    ctpl_output_stream_flush_buffer (output, NULL);
   }
   
   return rv;
 }
+
+/**
+ * ctpl_parser_parse_full:
+ * @tree: A #CtplToken from which start parsing
+ * @env: A #CtplEnviron representing the parsing environment
+ * @output: A #CtplInputStream in which write parsing output
+ * @cancellable: (allow-none): A #GCancellable, or %NULL
+ * @deadline: The monotonic time (see g_get_monotonic_time()) at which to abort
+ *            the parsing, or 0 for no deadline
+ * @max_output: The maximum number of bytes to output, or 0 for no limit
+ * @error: Location where return a #GError or %NULL to ignore errors
+ * 
+ * Parses a token tree like ctpl_parser_parse(), but gives up if @cancellable
+ * is cancelled, if @deadline is reached or if the output would exceed
+ * @max_output bytes.
+ * These conditions are checked at each loop iteration and each time the output
+ * is flushed, so that even templates producing huge outputs are stopped
+ * promptly.
+ * 
+ * Cancellation is reported with a %G_IO_ERROR_CANCELLED error, reaching the
+ * deadline with %CTPL_PARSER_ERROR_TIMED_OUT and exceeding the output size with
+ * %CTPL_PARSER_ERROR_OUTPUT_TOO_LARGE.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise, in which case @error shall be
+ *          set to the error that occurred.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_parser_parse_full (const CtplToken   *tree,
+                        CtplEnviron       *env,
+                        CtplOutputStream  *output,
+                        GCancellable      *cancellable,
+                        gint64             deadline,
+                        guint64            max_output,
+                        GError           **error)
+{
+  gboolean rv;
+  
+  ctpl_output_stream_set_limits (output, cancellable, deadline, max_output);
+  rv = ctpl_parser_parse (tree, env, output, error);
+  ctpl_output_stream_set_limits (output, NULL, 0, 0);
+  
+  return rv;
+}
+
+/**
+ * ctpl_parser_parse_to_gstring:
+ * @tree: A #CtplToken from which start parsing
+ * @env: A #CtplEnviron representing the parsing environment
+ * @string: A #GString to which append the parsing output
+ * @error: Location where return a #GError or %NULL to ignore errors
+ * 
+ * Parses a token tree against an environment like ctpl_parser_parse(), but
+ * appends the output to a #GString.
+ * The output is written directly to @string, which is grown beforehand
+ * according to the size of the previous outputs of @tree.
+ * 
+ * On failure, @string contains the output generated before the error.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise, in which case @error shall be
+ *          set to the error that occurred.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_parser_parse_to_gstring (const CtplToken  *tree,
+                              CtplEnviron      *env,
+                              GString          *string,
+                              GError          **error)
+{
+  CtplOutputStream *output;
+  gsize             start = string->len;
+  gboolean          rv;
+  
+  if (tree) {
+    gint hint = g_atomic_int_get (&tree->size_hint);
+    
+    if (hint > 0 && string->allocated_len <= start + (gsize) hint) {
+      /* there is no API to reserve space, but growing never shrinks */
+      g_string_set_size (string, start + (gsize) hint);
+      g_string_truncate (string, start);
+    }
+  }
+  output = ctpl_output_stream_new_for_gstring (string);
+  rv = ctpl_parser_parse (tree, env, output, error);
+  ctpl_output_stream_unref (output);
+  if (rv && tree) {
+    /* the tree is shared and only the hint is updated, so cast away constness
+     * is not a problem */
+    g_atomic_int_set (&((CtplToken *) tree)->size_hint,
+                      (gint) MIN (string->len - start, G_MAXINT));
+  }
+  
+  return rv;
+}
+
+/**
+ * ctpl_parser_parse_to_string:
+ * @tree: A #CtplToken from which start parsing
+ * @env: A #CtplEnviron representing the parsing environment
+ * @length: (out) (allow-none): Return location for the length of the output,
+ *                              or %NULL
+ * @error: Location where return a #GError or %NULL to ignore errors
+ * 
+ * Parses a token tree against an environment like ctpl_parser_parse(), but
+ * returns the output as a newly allocated string.
+ * See ctpl_parser_parse_to_gstring().
+ * 
+ * Returns: A newly allocated 0-terminated string holding the output, that
+ *          should be freed with g_free(); or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+gchar *
+ctpl_parser_parse_to_string (const CtplToken  *tree,
+                             CtplEnviron      *env,
+                             gsize            *length,
+                             GError          **error)
+{
+  GString *string;
+  gchar   *output = NULL;
+  
+  string = g_string_sized_new (0);
+  if (! ctpl_parser_parse_to_gstring (tree, env, string, error)) {
+    g_string_free (string, TRUE);
+  } else {
+    if (length) {
+      *length = string->len;
+    }
+    output = g_string_free (string, FALSE);
+  }
+  
+  return output;
+}
+
+
+typedef struct _ParseBatch ParseBatch;
+
+/* state of a batch rendering */
+struct _ParseBatch
+{
+  const CtplToken          *tree;
+  CtplEnviron              *env;
+  gint                      n_records;
+  CtplParserBatchRecordFunc record_func;
+  CtplParserBatchOutputFunc output_func;
+  gpointer                  user_data;
+  gint                      next_record;
+  gint                      n_failed;
+};
+
+/* renders records of a batch until there are none left, reusing the same
+ * output buffer and stream for all of them */
+static void
+parse_batch_run (gpointer data)
+{
+  ParseBatch       *batch = data;
+  GString          *string;
+  CtplOutputStream *output;
+  gint              i;
+  gint              hint = 0;
+  
+  if (batch->tree) {
+    hint = g_atomic_int_get (&batch->tree->size_hint);
+  }
+  string = g_string_sized_new ((gsize) MAX (hint, 0));
+  output = ctpl_output_stream_new_for_gstring (string);
+  while ((i = g_atomic_int_add (&batch->next_record,
+                                PARSE_BATCH_CHUNK_SIZE)) < batch->n_records) {
+    gint end = (gint) MIN ((guint) i + PARSE_BATCH_CHUNK_SIZE,
+                           (guint) batch->n_records);
+    
+    for (; i < end; i++) {
+      CtplEnviron  *env;
+      GError       *err = NULL;
+      
+      g_string_truncate (string, 0);
+      env = ctpl_environ_new_child (batch->env);
+      if (! batch->record_func ||
+          batch->record_func ((guint) i, env, batch->user_data, &err)) {
+        ctpl_parser_parse (batch->tree, env, output, &err);
+      }
+      batch->output_func ((guint) i, string->str, string->len, err,
+                          batch->user_data);
+      if (err) {
+        g_atomic_int_inc (&batch->n_failed);
+        g_error_free (err);
+      }
+      ctpl_environ_unref (env);
+    }
+  }
+  ctpl_output_stream_unref (output);
+  g_string_free (string, TRUE);
+}
+
+/**
+ * ctpl_parser_parse_batch:
+ * @tree: A #CtplToken from which start parsing
+ * @env: A #CtplEnviron holding the symbols common to all the records
+ * @n_records: The number of records to render
+ * @record_func: (allow-none): A function adding the symbols of a record to its
+ *                             environment, or %NULL
+ * @output_func: A function receiving the output of each record
+ * @user_data: User data to pass to @record_func and @output_func
+ * 
+ * Renders @tree once for each of @n_records records, as with
+ * ctpl_parser_parse_to_string() but without the setup cost of each call.
+ * 
+ * Each record is rendered against its own #CtplEnviron, which is initially
+ * empty and falls back to @env for the symbols it doesn't hold. @record_func is
+ * called to add the symbols of the record to that environment. It can add them
+ * one by one with ctpl_environ_push() or merge an existing environment with
+ * ctpl_environ_merge().
+ * 
+ * The records are distributed over several threads, each rendering to a buffer
+ * it reuses for all its records, so @record_func and @output_func are called
+ * concurrently and the records are not rendered in order. @env should not be
+ * modified during the call.
+ * 
+ * An error rendering a record doesn't stop the batch: @output_func receives it
+ * along with the output generated before it, and the next records are still
+ * rendered.
+ * 
+ * Returns: The number of records that failed to render.
+ * 
+ * Since: 0.4
+ */
+guint
+ctpl_parser_parse_batch (const CtplToken           *tree,
+                         CtplEnviron               *env,
+                         guint                      n_records,
+                         CtplParserBatchRecordFunc  record_func,
+                         CtplParserBatchOutputFunc  output_func,
+                         gpointer                   user_data)
+{
+  ParseBatch  batch;
+  guint       n_chunks;
+  
+  g_return_val_if_fail (env != NULL, n_records);
+  g_return_val_if_fail (output_func != NULL, n_records);
+  g_return_val_if_fail (n_records <= G_MAXINT - PARSE_BATCH_CHUNK_SIZE,
+                        n_records);
+  
+  batch.tree = tree;
+  batch.env = env;
+  batch.n_records = (gint) n_records;
+  batch.record_func = record_func;
+  batch.output_func = output_func;
+  batch.user_data = user_data;
+  batch.next_record = 0;
+  batch.n_failed = 0;
+  n_chunks = (n_records + PARSE_BATCH_CHUNK_SIZE - 1) / PARSE_BATCH_CHUNK_SIZE;
+  ctpl_threads_run (MIN (ctpl_threads_get_max (), n_chunks), parse_batch_run,
+                    &batch);
+  
+  return (guint) batch.n_failed;
+}
+
+
+typedef struct _ParseAsyncData ParseAsyncData;
+
+/* state of an asynchronous parsing */
+struct _ParseAsyncData
+{
+  CtplRenderIter   *iter;
+  CtplOutputStream *output;
+  gchar            *buffer;
+  gsize             length;   /* length of the data in @buffer */
+  gsize             written;  /* how much of @buffer was written */
+};
+
+static void
+parse_async_data_free (gpointer ptr)
+{
+  ParseAsyncData *data = ptr;
+  
+  ctpl_render_iter_free (data->iter);
+  ctpl_output_stream_unref (data->output);
+  g_free (data->buffer);
+  g_slice_free1 (sizeof *data, data);
+}
+
+static void   parse_async_write_next  (GTask *task);
+
+static void
+parse_async_write_cb (GObject      *object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+  GTask          *task = user_data;
+  ParseAsyncData *data = g_task_get_task_data (task);
+  GError         *err = NULL;
+  gssize          n;
+  
+  n = g_output_stream_write_finish (G_OUTPUT_STREAM (object), result, &err);
+  if (n < 0) {
+    g_task_return_error (task, err);
+    g_object_unref (task);
+  } else {
+    data->written += (gsize) n;
+    parse_async_write_next (task);
+  }
+}
+
+/* renders the next chunk if the current one was written, and writes it */
+static void
+parse_async_write_next (GTask *task)
+{
+  ParseAsyncData *data = g_task_get_task_data (task);
+  
+  if (data->written >= data->length) {
+    GError *err = NULL;
+    gssize  n;
+    
+    if (g_task_return_error_if_cancelled (task)) {
+      g_object_unref (task);
+      return;
+    }
+    if (! ctpl_output_stream_check_limits (data->output, &err)) {
+      n = -1;
+    } else {
+      n = ctpl_render_iter_next (data->iter, data->buffer,
+                                 PARSE_ASYNC_CHUNK_SIZE, &err);
+      if (n > 0 &&
+          ! ctpl_output_stream_account_data (data->output, data->buffer,
+                                             (gsize) n, &err)) {
+        n = -1;
+      }
+    }
+    if (n <= 0) {
+      if (n < 0) {
+        g_task_return_error (task, err);
+      } else {
+        g_task_return_boolean (task, TRUE);
+      }
+      g_object_unref (task);
+      return;
+    }
+    data->length = (gsize) n;
+    data->written = 0;
+  }
+  g_output_stream_write_async (ctpl_output_stream_get_stream (data->output),
+                               &data->buffer[data->written],
+                               data->length - data->written,
+                               g_task_get_priority (task),
+                               g_task_get_cancellable (task),
+                               parse_async_write_cb, task);
+}
+
+/**
+ * ctpl_parser_parse_async:
+ * @tree: A #CtplToken from which start parsing
+ * @env: A #CtplEnviron representing the parsing environment
+ * @output: A #CtplOutputStream in which write parsing output
+ * @io_priority: The I/O priority of the request
+ * @cancellable: (allow-none): A #GCancellable, or %NULL
+ * @callback: A #GAsyncReadyCallback to call when the parsing is finished
+ * @user_data: Data to pass to @callback
+ * 
+ * Asynchronously parses a token tree against an environment and outputs the
+ * result to @output.
+ * The output is rendered in chunks with a #CtplRenderIter, and each chunk is
+ * written with g_output_stream_write_async(): rendering is suspended while the
+ * underlying stream is not ready and resumed from the thread-default main
+ * context, so a single thread can serve many parsings at once.
+ * 
+ * Any data already buffered in @output is flushed synchronously before the
+ * asynchronous parsing starts. @tree must stay valid and neither @env nor
+ * @output may be used until the operation finishes.
+ * 
+ * Each chunk is accounted in @output like with ctpl_parser_parse(): it is
+ * added to the hashes of @output, and the parsing stops before rendering a
+ * chunk if the limits set on @output are exceeded. However, the fragment cache
+ * of @output (see ctpl_output_stream_set_fragment_cache()) is not used: the
+ * <code>cache</code> blocks are always rendered like their content, and loops
+ * are never rendered in parallel.
+ * 
+ * @output must have an underlying #GOutputStream and must not compress its
+ * output, otherwise the operation fails with %G_IO_ERROR_NOT_SUPPORTED.
+ * 
+ * When the operation is finished, @callback is called. You can then call
+ * ctpl_parser_parse_finish() to get the result of the operation.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_parser_parse_async (const CtplToken     *tree,
+                         CtplEnviron         *env,
+                         CtplOutputStream    *output,
+                         gint                 io_priority,
+                         GCancellable        *cancellable,
+                         GAsyncReadyCallback  callback,
+                         gpointer             user_data)
+{
+  GTask  *task;
+  GError *err = NULL;
+  
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ctpl_parser_parse_async);
+  g_task_set_priority (task, io_priority);
+  if (ctpl_output_stream_get_stream (output) == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             _("Outputs without an underlying stream cannot "
+                               "be written asynchronously"));
+    g_object_unref (task);
+  } else if (ctpl_output_stream_get_compression (output) !=
+             CTPL_OUTPUT_COMPRESSION_NONE) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             _("Compressed outputs cannot be written "
+                               "asynchronously"));
+    g_object_unref (task);
+  } else if (! ctpl_output_stream_flush (output, &err)) {
+    g_task_return_error (task, err);
+    g_object_unref (task);
+  } else {
+    ParseAsyncData *data;
+    
+    data = g_slice_alloc (sizeof *data);
+    data->iter = ctpl_render_iter_new (tree, env);
+    ctpl_render_iter_set_escape_mode (data->iter,
+                                      ctpl_output_stream_get_escape_mode (output));
+    data->output = ctpl_output_stream_ref (output);
+    data->buffer = g_malloc (PARSE_ASYNC_CHUNK_SIZE);
+    data->length = 0;
+    data->written = 0;
+    g_task_set_task_data (task, data, parse_async_data_free);
+    parse_async_write_next (task);
+  }
+}
+
+/**
+ * ctpl_parser_parse_finish:
+ * @result: A #GAsyncResult
+ * @error: Location where return a #GError or %NULL to ignore errors
+ * 
+ * Finishes an operation started with ctpl_parser_parse_async().
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise, in which case @error shall be
+ *          set to the error that occurred.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_parser_parse_finish (GAsyncResult  *result,
+                          GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+  
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
@@ -25,9 +25,12 @@
 #define H_CTPL_PARSER_H
 
 #include <glib.h>
+#include <gio/gio.h>
 #include "ctpl-token.h"
 #include "ctpl-environ.h"
 #include "ctpl-output-stream.h"
+#include "ctpl-escape.h"
+#include "ctpl-value.h"
 
 G_BEGIN_DECLS
 
@@ -47,6 +50,10 @@ G_BEGIN_DECLS
  *                                      environment.
  * @CTPL_PARSER_ERROR_FAILED: An error occurred without any precision on what
  *                            failed.
+ * @CTPL_PARSER_ERROR_TIMED_OUT: The parsing did not finish before its deadline
+ *                               (Since: 0.4)
+ * @CTPL_PARSER_ERROR_OUTPUT_TOO_LARGE: The output exceeded the allowed size
+ *                                      (Since: 0.4)
  * 
  * Error codes that parsing functions can throw, from the %CTPL_PARSER_ERROR
  * domain.
@@ -55,15 +62,92 @@ typedef enum _CtplParserError
 {
   CTPL_PARSER_ERROR_INCOMPATIBLE_SYMBOL,
   CTPL_PARSER_ERROR_SYMBOL_NOT_FOUND,
-  CTPL_PARSER_ERROR_FAILED
+  CTPL_PARSER_ERROR_FAILED,
+  CTPL_PARSER_ERROR_TIMED_OUT,
+  CTPL_PARSER_ERROR_OUTPUT_TOO_LARGE
 } CtplParserError;
 
+/**
+ * CtplParserBatchRecordFunc:
+ * @index: The index of the record
+ * @env: The environment of the record, to which add its symbols
+ * @user_data: User data passed to ctpl_parser_parse_batch()
+ * @error: Return location for errors
+ * 
+ * User function for ctpl_parser_parse_batch() adding the symbols of the record
+ * at @index to @env.
+ * 
+ * Returns: %TRUE on success, %FALSE if the record can't be rendered, in which
+ *          case @error should be set.
+ * 
+ * Since: 0.4
+ */
+typedef gboolean  (*CtplParserBatchRecordFunc)  (guint         index,
+                                                 CtplEnviron  *env,
+                                                 gpointer      user_data,
+                                                 GError      **error);
+/**
+ * CtplParserBatchOutputFunc:
+ * @index: The index of the record
+ * @data: The output of the record
+ * @length: The length of @data
+ * @error: (allow-none): The error that occurred rendering the record, or %NULL
+ * @user_data: User data passed to ctpl_parser_parse_batch()
+ * 
+ * User function for ctpl_parser_parse_batch() receiving the output of the
+ * record at @index. @data is only valid until the function returns.
+ * If @error is set, @data is the output generated before the error occurred.
+ * 
+ * Since: 0.4
+ */
+typedef void      (*CtplParserBatchOutputFunc)  (guint         index,
+                                                 const gchar  *data,
+                                                 gsize         length,
+                                                 const GError *error,
+                                                 gpointer      user_data);
+
 
-GQuark    ctpl_parser_error_quark   (void) G_GNUC_CONST;
-gboolean  ctpl_parser_parse         (const CtplToken   *tree,
-                                     CtplEnviron       *env,
-                                     CtplOutputStream  *output,
-                                     GError           **error);
+GQuark    ctpl_parser_error_quark       (void) G_GNUC_CONST;
+gboolean  ctpl_parser_parse             (const CtplToken   *tree,
+                                         CtplEnviron       *env,
+                                         CtplOutputStream  *output,
+                                         GError           **error);
+gboolean  ctpl_parser_parse_full        (const CtplToken   *tree,
+                                         CtplEnviron       *env,
+                                         CtplOutputStream  *output,
+                                         GCancellable      *cancellable,
+                                         gint64             deadline,
+                                         guint64            max_output,
+                                         GError           **error);
+gboolean  ctpl_parser_parse_to_gstring  (const CtplToken   *tree,
+                                         CtplEnviron       *env,
+                                         GString           *string,
+                                         GError           **error);
+gchar    *ctpl_parser_parse_to_string   (const CtplToken   *tree,
+                                         CtplEnviron       *env,
+                                         gsize             *length,
+                                         GError           **error);
+guint     ctpl_parser_parse_batch       (const CtplToken           *tree,
+                                         CtplEnviron               *env,
+                                         guint                      n_records,
+                                         CtplParserBatchRecordFunc  record_func,
+                                         CtplParserBatchOutputFunc  output_func,
+                                         gpointer                   user_data);
+void      ctpl_parser_parse_async       (const CtplToken     *tree,
+                                         CtplEnviron         *env,
+                                         CtplOutputStream    *output,
+                                         gint                 io_priority,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data);
+gboolean  ctpl_parser_parse_finish      (GAsyncResult  *result,
+                                         GError       **error);
+gboolean  ctpl_parser_write_value       (const CtplValue   *value,
+                                         CtplEscapeMode     escape,
+                                         CtplOutputStream  *output,
+                                         GError           **error);
+gboolean  ctpl_parser_check_loop_array  (const CtplValue *value,
+                                         GError         **error);
 
 
 G_END_DECLS
@@ -0,0 +1,369 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "ctpl-render-iter.h"
+#include <glib.h>
+#include <string.h>
+#include "ctpl-environ.h"
+#include "ctpl-eval.h"
+#include "ctpl-output-stream.h"
+#include "ctpl-output-stream-private.h"
+#include "ctpl-parser-private.h"
+#include "ctpl-token-private.h"
+#include "ctpl-value.h"
+
+
+/**
+ * SECTION: render-iter
+ * @short_description: Pull-based rendering
+ * @include: ctpl/ctpl.h
+ * 
+ * A #CtplRenderIter renders a token tree piece by piece into buffers provided
+ * by the caller, unlike ctpl_parser_parse() that pushes the whole output to a
+ * stream at once.
+ * The iterator keeps track of where it is in the tree, so rendering can be
+ * suspended at any point and resumed by the next call to
+ * ctpl_render_iter_next(), without using threads nor buffering the whole
+ * output.
+ * 
+ * A #CtplRenderIter is created with ctpl_render_iter_new() and freed with
+ * ctpl_render_iter_free().
+ * 
+ * |[
+ * CtplRenderIter *iter;
+ * gchar           buf[4096];
+ * gssize          n;
+ * 
+ * iter = ctpl_render_iter_new (tree, env);
+ * while ((n = ctpl_render_iter_next (iter, buf, sizeof buf, &error)) > 0) {
+ *   /<!-- -->* send the @n bytes in @buf somewhere *<!-- -->/
+ * }
+ * if (n < 0) {
+ *   /<!-- -->* handle the error *<!-- -->/
+ * }
+ * ctpl_render_iter_free (iter);
+ * ]|
+ * 
+ * The errors this module can throw are the same as ctpl_parser_parse() ones.
+ */
+
+
+typedef struct _RenderFrame RenderFrame;
+
+/* a list of tokens being rendered, possibly the body of a loop */
+struct _RenderFrame
+{
+  const CtplToken    *token;  /* next token to render in the list */
+  const CtplTokenFor *loop;   /* the loop this is the body of, or %NULL */
+  CtplValue           array;  /* the array @loop iterates over */
+  const GSList       *item;   /* the current item of @array */
+};
+
+/**
+ * CtplRenderIter:
+ * 
+ * An opaque object holding the state of a pull-based rendering.
+ */
+struct _CtplRenderIter
+{
+  /*< private >*/
+  CtplEnviron      *env;
+  GArray           *frames;
+  /* output of the current token not yet given to the caller */
+  const gchar      *pending;
+  gsize             pending_len;
+  /* storage for the output of expressions */
+  GString          *scratch;
+  CtplOutputStream *scratch_stream;
+  /* error to report on next call, if the previous one returned some data */
+  GError           *error;
+};
+
+
+/* pushes a new frame rendering @token */
+static RenderFrame *
+render_iter_push_frame (CtplRenderIter  *iter,
+                        const CtplToken *token)
+{
+  RenderFrame *frame;
+  
+  g_array_set_size (iter->frames, iter->frames->len + 1);
+  frame = &g_array_index (iter->frames, RenderFrame, iter->frames->len - 1);
+  frame->token = token;
+  frame->loop = NULL;
+  ctpl_value_init (&frame->array);
+  frame->item = NULL;
+  
+  return frame;
+}
+
+/* pops the topmost frame, restoring the environment if it was a loop body */
+static void
+render_iter_pop_frame (CtplRenderIter *iter)
+{
+  RenderFrame *frame;
+  
+  frame = &g_array_index (iter->frames, RenderFrame, iter->frames->len - 1);
+  if (frame->loop && frame->item) {
+    ctpl_environ_pop (iter->env, frame->loop->iter, NULL);
+  }
+  ctpl_value_free_value (&frame->array);
+  g_array_set_size (iter->frames, iter->frames->len - 1);
+}
+
+/* starts rendering a `for` token */
+static gboolean
+render_iter_enter_for (CtplRenderIter      *iter,
+                       const CtplTokenFor  *token,
+                       GError             **error)
+{
+  CtplValue value;
+  gboolean  rv;
+  
+  ctpl_value_init (&value);
+  rv = ctpl_parser_eval_loop_array (token, iter->env, &value, error);
+  if (rv && ctpl_value_get_array (&value)) {
+    RenderFrame *frame;
+    
+    frame = render_iter_push_frame (iter, token->children);
+    frame->loop = token;
+    /* steal the value, it is freed with the frame */
+    frame->array = value;
+    ctpl_value_init (&value);
+    frame->item = ctpl_value_get_array (&frame->array);
+    ctpl_environ_push (iter->env, token->iter, frame->item->data);
+  }
+  ctpl_value_free_value (&value);
+  
+  return rv;
+}
+
+/* renders the next token producing output into the pending buffer.
+ * Returns %FALSE on error; on success @iter->pending is %NULL at the end of
+ * the rendering. */
+static gboolean
+render_iter_advance (CtplRenderIter  *iter,
+                     GError         **error)
+{
+  gboolean rv = TRUE;
+  
+  iter->pending = NULL;
+  iter->pending_len = 0;
+  while (rv && ! iter->pending && iter->frames->len > 0) {
+    RenderFrame      *frame;
+    const CtplToken  *token;
+    
+    frame = &g_array_index (iter->frames, RenderFrame, iter->frames->len - 1);
+    token = frame->token;
+    if (! token) {
+      if (frame->loop && frame->item->next) {
+        /* next iteration */
+        ctpl_environ_pop (iter->env, frame->loop->iter, NULL);
+        frame->item = frame->item->next;
+        ctpl_environ_push (iter->env, frame->loop->iter, frame->item->data);
+        frame->token = frame->loop->children;
+      } else {
+        render_iter_pop_frame (iter);
+      }
+      continue;
+    }
+    
+    frame->token = token->next;
+    switch (token->type) {
+      case CTPL_TOKEN_TYPE_DATA:
+        iter->pending = token->token.t_data->data;
+        iter->pending_len = token->token.t_data->length;
+        break;
+      
+      case CTPL_TOKEN_TYPE_EXPR:
+        g_string_truncate (iter->scratch, 0);
+        rv = ctpl_parser_parse_token_expr (token->token.t_expr, token->escape,
+                                           iter->env, iter->scratch_stream,
+                                           error);
+        iter->pending = iter->scratch->str;
+        iter->pending_len = iter->scratch->len;
+        break;
+      
+      case CTPL_TOKEN_TYPE_IF: {
+        gboolean eval;
+        
+        rv = ctpl_eval_bool (token->token.t_if->condition, iter->env, &eval,
+                             error);
+        if (rv) {
+          render_iter_push_frame (iter, eval ? token->token.t_if->if_children
+                                             : token->token.t_if->else_children);
+        }
+        break;
+      }
+      
+      case CTPL_TOKEN_TYPE_FOR:
+        rv = render_iter_enter_for (iter, token->token.t_for, error);
+        break;
+      
+      case CTPL_TOKEN_TYPE_CACHE:
+        /* there is no fragment cache here, render the content */
+        render_iter_push_frame (iter, token->token.t_cache->children);
+        break;
+      
+      default:
+        g_critical ("Invalid/unknown token type %d", token->type);
+        g_assert_not_reached ();
+    }
+  }
+  if (! rv) {
+    iter->pending = NULL;
+    iter->pending_len = 0;
+  }
+  
+  return rv;
+}
+
+/**
+ * ctpl_render_iter_new:
+ * @tree: A #CtplToken from which start rendering
+ * @env: A #CtplEnviron representing the rendering environment
+ * 
+ * Creates a new #CtplRenderIter to render @tree against @env.
+ * @tree must stay valid as long as the iterator is used, and @env is modified
+ * during the rendering just as with ctpl_parser_parse(), so it must not be
+ * used for anything else until the iterator is freed.
+ * This function adds a reference to @env.
+ * 
+ * Returns: A new #CtplRenderIter, to be freed with ctpl_render_iter_free().
+ * 
+ * Since: 0.4
+ */
+CtplRenderIter *
+ctpl_render_iter_new (const CtplToken *tree,
+                      CtplEnviron     *env)
+{
+  CtplRenderIter *iter;
+  
+  iter = g_slice_alloc (sizeof *iter);
+  iter->env = ctpl_environ_ref (env);
+  iter->frames = g_array_new (FALSE, FALSE, sizeof (RenderFrame));
+  iter->pending = NULL;
+  iter->pending_len = 0;
+  iter->scratch = g_string_new (NULL);
+  iter->scratch_stream = ctpl_output_stream_new_for_gstring (iter->scratch);
+  iter->error = NULL;
+  render_iter_push_frame (iter, tree);
+  
+  return iter;
+}
+
+/**
+ * ctpl_render_iter_free:
+ * @iter: A #CtplRenderIter
+ * 
+ * Frees a #CtplRenderIter. If the rendering was not finished, the environment
+ * is restored to the state it had before it started.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_render_iter_free (CtplRenderIter *iter)
+{
+  while (iter->frames->len > 0) {
+    render_iter_pop_frame (iter);
+  }
+  g_array_free (iter->frames, TRUE);
+  ctpl_output_stream_unref (iter->scratch_stream);
+  g_string_free (iter->scratch, TRUE);
+  g_clear_error (&iter->error);
+  ctpl_environ_unref (iter->env);
+  g_slice_free1 (sizeof *iter, iter);
+}
+
+/**
+ * ctpl_render_iter_set_escape_mode:
+ * @iter: A #CtplRenderIter
+ * @mode: A #CtplEscapeMode
+ * 
+ * Sets how @iter escapes the values of the expressions that don't specify
+ * their own escape mode, like ctpl_output_stream_set_escape_mode() does for
+ * ctpl_parser_parse().
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_render_iter_set_escape_mode (CtplRenderIter *iter,
+                                  CtplEscapeMode  mode)
+{
+  ctpl_output_stream_set_escape_mode (iter->scratch_stream, mode);
+}
+
+/**
+ * ctpl_render_iter_next:
+ * @iter: A #CtplRenderIter
+ * @buffer: A buffer to fill with the output
+ * @size: The size of @buffer
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Renders the next @size bytes of output into @buffer.
+ * @buffer is always filled completely unless the end of the output is reached.
+ * 
+ * If an error occurs after some output was already written to @buffer, this
+ * output is returned and the error is reported by the next call.
+ * Once an error has been reported, the iterator cannot be used anymore and
+ * should be freed.
+ * 
+ * Returns: The number of bytes written to @buffer, 0 at the end of the output
+ *          (if @size is not 0), or -1 on error.
+ * 
+ * Since: 0.4
+ */
+gssize
+ctpl_render_iter_next (CtplRenderIter  *iter,
+                       gchar           *buffer,
+                       gsize            size,
+                       GError         **error)
+{
+  gsize written = 0;
+  
+  g_return_val_if_fail (size <= G_MAXSSIZE, -1);
+  
+  if (iter->error) {
+    g_propagate_error (error, iter->error);
+    iter->error = NULL;
+    return -1;
+  }
+  
+  while (written < size) {
+    if (iter->pending_len > 0) {
+      gsize n = MIN (iter->pending_len, size - written);
+      
+      memcpy (&buffer[written], iter->pending, n);
+      written += n;
+      iter->pending += n;
+      iter->pending_len -= n;
+    } else if (! render_iter_advance (iter, &iter->error)) {
+      if (written == 0) {
+        g_propagate_error (error, iter->error);
+        iter->error = NULL;
+        return -1;
+      }
+      break;
+    } else if (! iter->pending) {
+      /* the end */
+      break;
+    }
+  }
+  
+  return (gssize) written;
+}
@@ -0,0 +1,51 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_RENDER_ITER_H
+#define H_CTPL_RENDER_ITER_H
+
+#include <glib.h>
+#include "ctpl-token.h"
+#include "ctpl-environ.h"
+#include "ctpl-escape.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplRenderIter CtplRenderIter;
+
+CtplRenderIter   *ctpl_render_iter_new      (const CtplToken *tree,
+                                             CtplEnviron     *env);
+void              ctpl_render_iter_free     (CtplRenderIter *iter);
+void              ctpl_render_iter_set_escape_mode
+                                            (CtplRenderIter *iter,
+                                             CtplEscapeMode  mode);
+gssize            ctpl_render_iter_next     (CtplRenderIter  *iter,
+                                             gchar           *buffer,
+                                             gsize            size,
+                                             GError         **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
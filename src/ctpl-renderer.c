@@ -0,0 +1,330 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#include "ctpl-renderer.h"
+#include <glib.h>
+#include <gio/gio.h>
+#include "ctpl-environ.h"
+#include "ctpl-environ-private.h"
+#include "ctpl-output-stream.h"
+#include "ctpl-output-stream-private.h"
+#include "ctpl-parser.h"
+#include "ctpl-token.h"
+#include "ctpl-token-private.h"
+
+
+/**
+ * SECTION: renderer
+ * @short_description: Thread pool render service
+ * @include: ctpl/ctpl.h
+ * 
+ * A #CtplRenderer renders token trees on a pool of worker threads, so that
+ * renders can be submitted from any thread without each application building
+ * its own threading around ctpl_parser_parse().
+ * 
+ * A #CtplRenderer is created with ctpl_renderer_new() and freed with
+ * ctpl_renderer_free(). Renders are submitted with
+ * ctpl_renderer_render_async(), and their output is retrieved with
+ * ctpl_renderer_render_finish() from the callback, which is called in the
+ * thread-default main context of the thread that submitted the render.
+ * 
+ * Each render happens in its own environment falling back to the one it was
+ * given, so the same #CtplEnviron can be used by several concurrent renders as
+ * long as nobody modifies it. The workers reuse their output buffers from one
+ * render to the next, and renders with a higher priority are started first.
+ * 
+ * The errors this module can throw are the same as ctpl_parser_parse() ones,
+ * plus %G_IO_ERROR_CANCELLED if a render is cancelled.
+ */
+
+
+/**
+ * CtplRenderer:
+ * 
+ * An opaque object rendering token trees on a pool of threads.
+ */
+struct _CtplRenderer
+{
+  /*< private >*/
+  GThreadPool  *pool;
+  /* the scratch state of idle workers */
+  GAsyncQueue  *scratches;
+  gint          next_seq;
+};
+
+typedef struct _RendererScratch RendererScratch;
+
+/* state a worker reuses from one render to the next */
+struct _RendererScratch
+{
+  GString          *string;
+  CtplOutputStream *output;
+};
+
+typedef struct _RendererJob RendererJob;
+
+/* a submitted render */
+struct _RendererJob
+{
+  const CtplToken  *tree;
+  CtplEnviron      *env;
+  gint              seq;  /* submission order, for equal priorities */
+};
+
+
+static void
+renderer_scratch_free (gpointer data)
+{
+  RendererScratch *scratch = data;
+  
+  ctpl_output_stream_unref (scratch->output);
+  g_string_free (scratch->string, TRUE);
+  g_slice_free1 (sizeof *scratch, scratch);
+}
+
+static void
+renderer_job_free (gpointer data)
+{
+  RendererJob *job = data;
+  
+  ctpl_environ_unref (job->env);
+  g_slice_free1 (sizeof *job, job);
+}
+
+static void
+renderer_string_free (gpointer data)
+{
+  g_string_free (data, TRUE);
+}
+
+/* orders tasks by priority, then by submission order */
+static gint
+renderer_compare_tasks (gconstpointer a,
+                        gconstpointer b,
+                        gpointer      user_data)
+{
+  GTask        *task_a = (GTask *) a;
+  GTask        *task_b = (GTask *) b;
+  RendererJob  *job_a = g_task_get_task_data (task_a);
+  RendererJob  *job_b = g_task_get_task_data (task_b);
+  gint          priority_a = g_task_get_priority (task_a);
+  gint          priority_b = g_task_get_priority (task_b);
+  
+  if (priority_a != priority_b) {
+    return priority_a < priority_b ? -1 : 1;
+  }
+  
+  return job_a->seq < job_b->seq ? -1 : (job_a->seq > job_b->seq ? 1 : 0);
+}
+
+/* renders a task, in a worker thread */
+static void
+renderer_worker (gpointer data,
+                 gpointer user_data)
+{
+  GTask            *task = data;
+  CtplRenderer     *renderer = user_data;
+  RendererJob      *job = g_task_get_task_data (task);
+  RendererScratch  *scratch;
+  CtplEnviron      *env;
+  GError           *err = NULL;
+  
+  if (g_task_return_error_if_cancelled (task)) {
+    g_object_unref (task);
+    return;
+  }
+  
+  scratch = g_async_queue_try_pop (renderer->scratches);
+  if (! scratch) {
+    scratch = g_slice_alloc (sizeof *scratch);
+    scratch->string = g_string_sized_new (0);
+    scratch->output = ctpl_output_stream_new_for_gstring (scratch->string);
+  }
+  g_string_truncate (scratch->string, 0);
+  if (job->tree) {
+    gint hint = g_atomic_int_get (&job->tree->size_hint);
+    
+    if (hint > 0 && scratch->string->allocated_len <= (gsize) hint) {
+      g_string_set_size (scratch->string, (gsize) hint);
+      g_string_truncate (scratch->string, 0);
+    }
+  }
+  /* the environment given by the user is left untouched */
+  env = ctpl_environ_new_child (job->env);
+  if (! ctpl_parser_parse_full (job->tree, env, scratch->output,
+                                g_task_get_cancellable (task), 0, 0, &err)) {
+    g_task_return_error (task, err);
+  } else {
+    if (job->tree) {
+      g_atomic_int_set (&((CtplToken *) job->tree)->size_hint,
+                        (gint) MIN (scratch->string->len, G_MAXINT));
+    }
+    g_task_return_pointer (task, g_string_new_len (scratch->string->str,
+                                                   (gssize) scratch->string->len),
+                           renderer_string_free);
+  }
+  ctpl_environ_unref (env);
+  g_async_queue_push (renderer->scratches, scratch);
+  g_object_unref (task);
+}
+
+/**
+ * ctpl_renderer_new:
+ * @n_workers: The number of worker threads, or 0 to use one per processor
+ * 
+ * Creates a new #CtplRenderer rendering on @n_workers threads.
+ * 
+ * Returns: A new #CtplRenderer, to free with ctpl_renderer_free().
+ * 
+ * Since: 0.4
+ */
+CtplRenderer *
+ctpl_renderer_new (guint n_workers)
+{
+  CtplRenderer *self;
+  
+  if (n_workers == 0) {
+    n_workers = g_get_num_processors ();
+  }
+  
+  self = g_slice_alloc (sizeof *self);
+  self->pool = g_thread_pool_new (renderer_worker, self, (gint) n_workers,
+                                  FALSE, NULL);
+  g_thread_pool_set_sort_function (self->pool, renderer_compare_tasks, NULL);
+  self->scratches = g_async_queue_new_full (renderer_scratch_free);
+  self->next_seq = 0;
+  
+  return self;
+}
+
+/**
+ * ctpl_renderer_free:
+ * @renderer: A #CtplRenderer
+ * 
+ * Frees a #CtplRenderer. The renders that were submitted are completed before
+ * this function returns, although their callbacks are only called when the
+ * main context of the thread that submitted them runs.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_renderer_free (CtplRenderer *renderer)
+{
+  g_thread_pool_free (renderer->pool, FALSE, TRUE);
+  g_async_queue_unref (renderer->scratches);
+  g_slice_free1 (sizeof *renderer, renderer);
+}
+
+/**
+ * ctpl_renderer_get_n_workers:
+ * @renderer: A #CtplRenderer
+ * 
+ * Gets the number of worker threads of a #CtplRenderer.
+ * 
+ * Returns: The maximum number of renders @renderer runs at the same time.
+ * 
+ * Since: 0.4
+ */
+guint
+ctpl_renderer_get_n_workers (CtplRenderer *renderer)
+{
+  return (guint) g_thread_pool_get_max_threads (renderer->pool);
+}
+
+/**
+ * ctpl_renderer_render_async:
+ * @renderer: A #CtplRenderer
+ * @tree: A #CtplToken from which start parsing
+ * @env: A #CtplEnviron representing the parsing environment
+ * @io_priority: The priority of the render, lower values are started first
+ * @cancellable: (allow-none): A #GCancellable, or %NULL
+ * @callback: A #GAsyncReadyCallback to call when the render is done
+ * @user_data: User data to pass to @callback
+ * 
+ * Submits the rendering of @tree against @env to the workers of @renderer.
+ * This function can be called from any thread. When the render is done,
+ * @callback is called in the thread-default main context of the calling
+ * thread, and should call ctpl_renderer_render_finish() to get the output.
+ * 
+ * @tree must stay alive until @callback is called. @env is referenced by the
+ * render and is not modified by it, but it should not be modified by anyone
+ * else before @callback is called.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_renderer_render_async (CtplRenderer        *renderer,
+                            const CtplToken     *tree,
+                            CtplEnviron         *env,
+                            gint                 io_priority,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  GTask        *task;
+  RendererJob  *job;
+  
+  job = g_slice_alloc (sizeof *job);
+  job->tree = tree;
+  job->env = ctpl_environ_ref (env);
+  job->seq = g_atomic_int_add (&renderer->next_seq, 1);
+  
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ctpl_renderer_render_async);
+  g_task_set_priority (task, io_priority);
+  g_task_set_task_data (task, job, renderer_job_free);
+  g_thread_pool_push (renderer->pool, task, NULL);
+}
+
+/**
+ * ctpl_renderer_render_finish:
+ * @renderer: A #CtplRenderer
+ * @result: The #GAsyncResult passed to the callback
+ * @length: (out) (allow-none): Return location for the length of the output,
+ *                              or %NULL
+ * @error: Location where return a #GError or %NULL to ignore errors
+ * 
+ * Finishes a render started with ctpl_renderer_render_async().
+ * 
+ * Returns: A newly allocated 0-terminated string holding the output, that
+ *          should be freed with g_free(); or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+gchar *
+ctpl_renderer_render_finish (CtplRenderer  *renderer,
+                             GAsyncResult  *result,
+                             gsize         *length,
+                             GError       **error)
+{
+  GString *string;
+  
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+  
+  string = g_task_propagate_pointer (G_TASK (result), error);
+  if (! string) {
+    return NULL;
+  }
+  if (length) {
+    *length = string->len;
+  }
+  
+  return g_string_free (string, FALSE);
+}
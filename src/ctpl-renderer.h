@@ -0,0 +1,55 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_RENDERER_H
+#define H_CTPL_RENDERER_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include "ctpl-token.h"
+#include "ctpl-environ.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplRenderer CtplRenderer;
+
+CtplRenderer     *ctpl_renderer_new           (guint n_workers);
+void              ctpl_renderer_free          (CtplRenderer *renderer);
+guint             ctpl_renderer_get_n_workers (CtplRenderer *renderer);
+void              ctpl_renderer_render_async  (CtplRenderer        *renderer,
+                                               const CtplToken     *tree,
+                                               CtplEnviron         *env,
+                                               gint                 io_priority,
+                                               GCancellable        *cancellable,
+                                               GAsyncReadyCallback  callback,
+                                               gpointer             user_data);
+gchar            *ctpl_renderer_render_finish (CtplRenderer  *renderer,
+                                               GAsyncResult  *result,
+                                               gsize         *length,
+                                               GError       **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
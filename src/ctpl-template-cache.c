@@ -0,0 +1,609 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "ctpl-template-cache.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <errno.h>
+#include "ctpl-input-stream.h"
+#include "ctpl-lru-private.h"
+#include "ctpl-template.h"
+
+
+/**
+ * SECTION: template-cache
+ * @short_description: Compiled template cache
+ * @include: ctpl/ctpl.h
+ * 
+ * A #CtplTemplateCache keeps the token trees of the templates it loaded, so
+ * that a template used over and over again is only read and lexed once.
+ * Both text and compiled templates are supported (see ctpl_template_load()).
+ * 
+ * Templates are looked up by file with ctpl_template_cache_lookup_path() or
+ * ctpl_template_cache_lookup_file(), which load the template the first time and
+ * then return the cached #CtplTemplate for as long as the file doesn't change.
+ * A #CtplTemplate is reference counted, so a template that is reloaded or
+ * evicted from the cache stays valid for those still using it.
+ * 
+ * By default, each lookup checks the modification time, inode and size of the
+ * file to detect changes. With ctpl_template_cache_set_use_monitors(), the
+ * cache rather uses #GFileMonitor<!-- -->s and lookups don't touch the file
+ * system at all.
+ * 
+ * A cache can be limited to a memory budget, approximated by the size of the
+ * template sources. When it is exceeded, the least recently used templates are
+ * evicted.
+ * 
+ * A #CtplTemplateCache can be used from several threads at the same time.
+ * Lookups only take a shared lock and never wait for each other: recording
+ * which template was used last is skipped when another thread is recording
+ * it, which only makes eviction approximate. Only loading a template needs
+ * exclusive access, and only for the time it takes to store it.
+ * 
+ * |[
+ * CtplTemplate *tmpl;
+ * 
+ * tmpl = ctpl_template_cache_lookup_path (cache, "page.tpl", &error);
+ * if (tmpl) {
+ *   ctpl_parser_parse (ctpl_template_get_tree (tmpl), env, output, &error);
+ *   ctpl_template_unref (tmpl);
+ * }
+ * ]|
+ */
+
+
+typedef struct _CacheStamp CacheStamp;
+
+/* what identifies a version of a template file */
+struct _CacheStamp
+{
+  gint64  mtime;
+  gint32  mtime_nsec; /* so that rewrites within a second are seen */
+  guint64 inode;
+  goffset size;
+};
+
+typedef struct _CacheEntry CacheEntry;
+
+/* a cached template */
+struct _CacheEntry
+{
+  CtplTemplateCache *cache;
+  const gchar  *key;        /* owned by the hash table */
+  GFile        *file;
+  gchar        *path;       /* local path of @file, or %NULL */
+  CtplTemplate *tmpl;
+  CacheStamp    stamp;      /* stamp of the file @tmpl was loaded from */
+  GList         lru_link;
+  /* set when the monitor reports a change, owned by the monitor's handler if
+   * any */
+  gint         *stale;
+  GFileMonitor *monitor;
+  gulong        monitor_handler;
+};
+
+/**
+ * CtplTemplateCache:
+ * 
+ * An opaque reference counted object caching compiled templates.
+ */
+struct _CtplTemplateCache
+{
+  /*< private >*/
+  gint        ref_count;
+  GRWLock     lock;
+  GHashTable *entries;  /* path or URI -> CacheEntry */
+  CtplLru     lru;
+  gsize       max_size;
+  gsize       size;
+  gboolean    use_monitors;
+};
+
+
+/* gets the current stamp of @file, whose local path is @path if not %NULL */
+static gboolean
+cache_get_stamp (GFile        *file,
+                 const gchar  *path,
+                 CacheStamp   *stamp,
+                 GError      **error)
+{
+  gboolean rv = FALSE;
+  
+  if (path) {
+    GStatBuf st;
+    
+    if (g_stat (path, &st) != 0) {
+      gint errnum = errno;
+      
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errnum),
+                   "%s: %s", path, g_strerror (errnum));
+    } else {
+      stamp->mtime = (gint64) st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+      stamp->mtime_nsec = (gint32) st.st_mtim.tv_nsec;
+#else
+      stamp->mtime_nsec = 0;
+#endif
+      stamp->inode = (guint64) st.st_ino;
+      stamp->size = (goffset) st.st_size;
+      rv = TRUE;
+    }
+  } else {
+    GFileInfo *info;
+    
+    info = g_file_query_info (file,
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC","
+                              G_FILE_ATTRIBUTE_UNIX_INODE","
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                              G_FILE_QUERY_INFO_NONE, NULL, error);
+    if (info) {
+      stamp->mtime = (gint64) g_file_info_get_attribute_uint64 (info,
+                                G_FILE_ATTRIBUTE_TIME_MODIFIED);
+      stamp->mtime_nsec = (gint32) g_file_info_get_attribute_uint32 (info,
+                                G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC) * 1000;
+      stamp->inode = g_file_info_get_attribute_uint64 (info,
+                                                       G_FILE_ATTRIBUTE_UNIX_INODE);
+      stamp->size = g_file_info_get_size (info);
+      g_object_unref (info);
+      rv = TRUE;
+    }
+  }
+  
+  return rv;
+}
+
+static gboolean
+cache_stamp_equal (const CacheStamp *a,
+                   const CacheStamp *b)
+{
+  return (a->mtime == b->mtime && a->mtime_nsec == b->mtime_nsec &&
+          a->inode == b->inode && a->size == b->size);
+}
+
+static void
+cache_monitor_changed (GFileMonitor      *monitor,
+                       GFile             *file,
+                       GFile             *other_file,
+                       GFileMonitorEvent  event,
+                       gpointer           user_data)
+{
+  gint *stale = user_data;
+  
+  g_atomic_int_set (stale, TRUE);
+}
+
+static void
+cache_stale_free (gpointer  data,
+                  GClosure *closure)
+{
+  g_free (data);
+}
+
+/* creates a new entry for @key, and adds it to @cache. Must be called with the
+ * lock held for writing. */
+static CacheEntry *
+cache_entry_new (CtplTemplateCache *cache,
+                 const gchar       *key,
+                 GFile             *file,
+                 const gchar       *path)
+{
+  CacheEntry *entry;
+  
+  entry = g_slice_alloc (sizeof *entry);
+  entry->cache = cache;
+  entry->key = g_strdup (key);
+  entry->file = g_object_ref (file);
+  entry->path = g_strdup (path);
+  entry->tmpl = NULL;
+  entry->stale = g_new0 (gint, 1);
+  entry->monitor = NULL;
+  entry->monitor_handler = 0;
+  if (cache->use_monitors) {
+    entry->monitor = g_file_monitor_file (entry->file, G_FILE_MONITOR_NONE,
+                                          NULL, NULL);
+    if (entry->monitor) {
+      /* the handler owns the flag, so it stays valid while it runs even if
+       * the entry is freed meanwhile */
+      entry->monitor_handler = g_signal_connect_data (entry->monitor, "changed",
+                                                      G_CALLBACK (cache_monitor_changed),
+                                                      entry->stale,
+                                                      cache_stale_free,
+                                                      0);
+    }
+  }
+  g_hash_table_insert (cache->entries, (gchar *) entry->key, entry);
+  ctpl_lru_add (&cache->lru, &entry->lru_link, entry);
+  
+  return entry;
+}
+
+static void
+cache_entry_free (gpointer data)
+{
+  CacheEntry *entry = data;
+  
+  ctpl_lru_remove (&entry->cache->lru, &entry->lru_link);
+  if (entry->monitor) {
+    g_signal_handler_disconnect (entry->monitor, entry->monitor_handler);
+    g_file_monitor_cancel (entry->monitor);
+    g_object_unref (entry->monitor);
+  } else {
+    g_free (entry->stale);
+  }
+  if (entry->tmpl) {
+    ctpl_template_unref (entry->tmpl);
+  }
+  g_free (entry->path);
+  g_object_unref (entry->file);
+  g_slice_free1 (sizeof *entry, entry);
+}
+
+/* evicts the least recently used entries but @keep until the cache fits its
+ * budget. Must be called with the lock held for writing. */
+static void
+cache_evict (CtplTemplateCache *cache,
+             CacheEntry        *keep)
+{
+  CacheEntry *lru;
+  
+  while (cache->max_size > 0 && cache->size > cache->max_size &&
+         (lru = ctpl_lru_get_oldest (&cache->lru, keep)) != NULL) {
+    cache->size -= (gsize) lru->stamp.size;
+    g_hash_table_remove (cache->entries, lru->key);
+  }
+}
+
+/* loads the template for @key, and stores it in the cache */
+static CtplTemplate *
+cache_load (CtplTemplateCache  *cache,
+            const gchar        *key,
+            GFile              *file,
+            const gchar        *path,
+            GError            **error)
+{
+  CtplTemplate *tmpl = NULL;
+  CacheStamp    stamp;
+  
+  /* stamp before reading, so that a change while loading is seen next time */
+  if (cache_get_stamp (file, path, &stamp, error)) {
+    CtplInputStream *stream;
+    
+    if (path) {
+      stream = ctpl_input_stream_new_for_path (path, error);
+    } else {
+      stream = ctpl_input_stream_new_for_gfile (file, error);
+    }
+    if (stream) {
+      tmpl = ctpl_template_load (stream, error);
+      ctpl_input_stream_unref (stream);
+    }
+    if (tmpl) {
+      CacheEntry   *entry;
+      CtplTemplate *old = NULL;
+      
+      g_rw_lock_writer_lock (&cache->lock);
+      entry = g_hash_table_lookup (cache->entries, key);
+      if (entry) {
+        old = entry->tmpl;
+        cache->size -= (gsize) entry->stamp.size;
+      } else {
+        entry = cache_entry_new (cache, key, file, path);
+      }
+      entry->tmpl = ctpl_template_ref (tmpl);
+      entry->stamp = stamp;
+      ctpl_lru_touch (&cache->lru, &entry->lru_link);
+      cache->size += (gsize) stamp.size;
+      cache_evict (cache, entry);
+      g_rw_lock_writer_unlock (&cache->lock);
+      
+      /* the old template may still be used, it will be freed by its last
+       * user */
+      if (old) {
+        ctpl_template_unref (old);
+      }
+    }
+  }
+  
+  return tmpl;
+}
+
+/* marks the entry for @key as stale, if it is monitored */
+static void
+cache_set_stale (CtplTemplateCache *cache,
+                 const gchar       *key)
+{
+  CacheEntry *entry;
+  
+  g_rw_lock_reader_lock (&cache->lock);
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry && entry->monitor) {
+    g_atomic_int_set (entry->stale, TRUE);
+  }
+  g_rw_lock_reader_unlock (&cache->lock);
+}
+
+/* looks up the template for @key, loading it if needed */
+static CtplTemplate *
+cache_lookup (CtplTemplateCache  *cache,
+              const gchar        *key,
+              GFile              *file,
+              const gchar        *path,
+              GError            **error)
+{
+  CtplTemplate *tmpl = NULL;
+  CacheEntry   *entry;
+  CacheStamp    stamp;
+  gboolean      check_stamp = FALSE;
+  gboolean      stale = FALSE;
+  
+  g_rw_lock_reader_lock (&cache->lock);
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry) {
+    ctpl_lru_touch (&cache->lru, &entry->lru_link);
+    if (! entry->monitor) {
+      tmpl = ctpl_template_ref (entry->tmpl);
+      stamp = entry->stamp;
+      check_stamp = TRUE;
+    } else if (g_atomic_int_compare_and_exchange (entry->stale, TRUE, FALSE)) {
+      /* the file changed, and changes after this point will mark the entry
+       * stale again */
+      stale = TRUE;
+    } else {
+      tmpl = ctpl_template_ref (entry->tmpl);
+    }
+  }
+  g_rw_lock_reader_unlock (&cache->lock);
+  
+  if (check_stamp) {
+    CacheStamp current;
+    
+    if (! cache_get_stamp (file, path, &current, NULL) ||
+        ! cache_stamp_equal (&current, &stamp)) {
+      ctpl_template_unref (tmpl);
+      tmpl = NULL;
+    }
+  }
+  if (! tmpl) {
+    GFile *load_file = file ? g_object_ref (file) : g_file_new_for_path (path);
+    
+    tmpl = cache_load (cache, key, load_file, path, error);
+    g_object_unref (load_file);
+    if (! tmpl && stale) {
+      /* reload again next time rather than returning the outdated template,
+       * so the error keeps being reported until the file is fixed */
+      cache_set_stale (cache, key);
+    }
+  }
+  
+  return tmpl;
+}
+
+/**
+ * ctpl_template_cache_new:
+ * @max_size: The memory budget of the cache, or 0 for no limit
+ * 
+ * Creates a new #CtplTemplateCache. If @max_size is not 0, the least recently
+ * used templates are evicted when the total size of the cached templates'
+ * sources exceeds it.
+ * 
+ * Returns: A new #CtplTemplateCache.
+ * 
+ * Since: 0.4
+ */
+CtplTemplateCache *
+ctpl_template_cache_new (gsize max_size)
+{
+  CtplTemplateCache *self;
+  
+  self = g_slice_alloc (sizeof *self);
+  self->ref_count = 1;
+  g_rw_lock_init (&self->lock);
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         cache_entry_free);
+  ctpl_lru_init (&self->lru);
+  self->max_size = max_size;
+  self->size = 0;
+  self->use_monitors = FALSE;
+  
+  return self;
+}
+
+/**
+ * ctpl_template_cache_ref:
+ * @cache: A #CtplTemplateCache
+ * 
+ * Adds a reference to a #CtplTemplateCache.
+ * 
+ * Returns: The cache
+ * 
+ * Since: 0.4
+ */
+CtplTemplateCache *
+ctpl_template_cache_ref (CtplTemplateCache *cache)
+{
+  g_atomic_int_inc (&cache->ref_count);
+  
+  return cache;
+}
+
+/**
+ * ctpl_template_cache_unref:
+ * @cache: A #CtplTemplateCache
+ * 
+ * Removes a reference from a #CtplTemplateCache. If the reference count drops
+ * to 0, frees the cache. The templates obtained from it stay valid until they
+ * are unreferenced.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_template_cache_unref (CtplTemplateCache *cache)
+{
+  if (g_atomic_int_dec_and_test (&cache->ref_count)) {
+    g_hash_table_destroy (cache->entries);
+    ctpl_lru_clear (&cache->lru);
+    g_rw_lock_clear (&cache->lock);
+    g_slice_free1 (sizeof *cache, cache);
+  }
+}
+
+/**
+ * ctpl_template_cache_set_use_monitors:
+ * @cache: A #CtplTemplateCache
+ * @use_monitors: Whether to use file monitors to detect changes
+ * 
+ * Sets whether templates loaded from now on by @cache are monitored with a
+ * #GFileMonitor to detect their changes, rather than checking the file at each
+ * lookup. Monitors report changes through the thread-default main context of
+ * the thread that loaded the template, so it has to be running.
+ * If a template can't be monitored, it is checked at each lookup.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_template_cache_set_use_monitors (CtplTemplateCache *cache,
+                                      gboolean           use_monitors)
+{
+  g_rw_lock_writer_lock (&cache->lock);
+  cache->use_monitors = use_monitors;
+  g_rw_lock_writer_unlock (&cache->lock);
+}
+
+/**
+ * ctpl_template_cache_get_size:
+ * @cache: A #CtplTemplateCache
+ * 
+ * Gets the total size of the sources of the templates in @cache, which is what
+ * its memory budget limits.
+ * 
+ * Returns: The size of the cached templates.
+ * 
+ * Since: 0.4
+ */
+gsize
+ctpl_template_cache_get_size (CtplTemplateCache *cache)
+{
+  gsize size;
+  
+  g_rw_lock_reader_lock (&cache->lock);
+  size = cache->size;
+  g_rw_lock_reader_unlock (&cache->lock);
+  
+  return size;
+}
+
+/**
+ * ctpl_template_cache_lookup_file:
+ * @cache: A #CtplTemplateCache
+ * @file: The #GFile holding the template
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Gets the template held in @file, loading it if it is not in @cache or if
+ * @file changed since it was loaded.
+ * 
+ * Errors can come from the %G_IO_ERROR domain if the file loading fails, or
+ * from the %CTPL_LEXER_ERROR domain if the lexing fails.
+ * 
+ * Returns: A new reference to the #CtplTemplate, to release with
+ *          ctpl_template_unref(); or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+CtplTemplate *
+ctpl_template_cache_lookup_file (CtplTemplateCache  *cache,
+                                 GFile              *file,
+                                 GError            **error)
+{
+  CtplTemplate *tmpl;
+  gchar        *path;
+  
+  path = g_file_get_path (file);
+  if (path) {
+    tmpl = cache_lookup (cache, path, NULL, path, error);
+  } else {
+    gchar *uri = g_file_get_uri (file);
+    
+    tmpl = cache_lookup (cache, uri, file, NULL, error);
+    g_free (uri);
+  }
+  g_free (path);
+  
+  return tmpl;
+}
+
+/**
+ * ctpl_template_cache_lookup_path:
+ * @cache: A #CtplTemplateCache
+ * @path: The path of the file holding the template, in the GLib's filename
+ *        encoding
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Gets the template held in the file at @path, like
+ * ctpl_template_cache_lookup_file(). Templates are identified by their path as
+ * given, so the same file should always be referred to by the same path.
+ * 
+ * Returns: A new reference to the #CtplTemplate, to release with
+ *          ctpl_template_unref(); or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+CtplTemplate *
+ctpl_template_cache_lookup_path (CtplTemplateCache  *cache,
+                                 const gchar        *path,
+                                 GError            **error)
+{
+  return cache_lookup (cache, path, NULL, path, error);
+}
+
+/**
+ * ctpl_template_cache_invalidate:
+ * @cache: A #CtplTemplateCache
+ * @file: A #GFile
+ * 
+ * Removes the template held in @file from @cache, if any, so that it is
+ * loaded again on next lookup.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_template_cache_invalidate (CtplTemplateCache *cache,
+                                GFile             *file)
+{
+  gchar      *key;
+  CacheEntry *entry;
+  
+  key = g_file_get_path (file);
+  if (! key) {
+    key = g_file_get_uri (file);
+  }
+  g_rw_lock_writer_lock (&cache->lock);
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry) {
+    cache->size -= (gsize) entry->stamp.size;
+    g_hash_table_remove (cache->entries, key);
+  }
+  g_rw_lock_writer_unlock (&cache->lock);
+  g_free (key);
+}
@@ -0,0 +1,55 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_TEMPLATE_CACHE_H
+#define H_CTPL_TEMPLATE_CACHE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include "ctpl-template.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct _CtplTemplateCache CtplTemplateCache;
+
+CtplTemplateCache  *ctpl_template_cache_new            (gsize max_size);
+CtplTemplateCache  *ctpl_template_cache_ref            (CtplTemplateCache *cache);
+void                ctpl_template_cache_unref          (CtplTemplateCache *cache);
+void                ctpl_template_cache_set_use_monitors
+                                                       (CtplTemplateCache *cache,
+                                                        gboolean           use_monitors);
+gsize               ctpl_template_cache_get_size       (CtplTemplateCache *cache);
+CtplTemplate       *ctpl_template_cache_lookup_file    (CtplTemplateCache  *cache,
+                                                        GFile              *file,
+                                                        GError            **error);
+CtplTemplate       *ctpl_template_cache_lookup_path    (CtplTemplateCache  *cache,
+                                                        const gchar        *path,
+                                                        GError            **error);
+void                ctpl_template_cache_invalidate     (CtplTemplateCache *cache,
+                                                        GFile             *file);
+
+
+G_END_DECLS
+
+#endif /* guard */
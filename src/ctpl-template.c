@@ -0,0 +1,854 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#include "ctpl-template.h"
+#include <glib.h>
+#include <string.h>
+#include "ctpl-i18n.h"
+#include "ctpl-input-stream.h"
+#include "ctpl-input-stream-private.h"
+#include "ctpl-lexer.h"
+#include "ctpl-output-stream.h"
+#include "ctpl-token.h"
+#include "ctpl-token-private.h"
+#include "ctpl-value.h"
+
+
+/**
+ * SECTION: template
+ * @short_description: Compiled templates
+ * @include: ctpl/ctpl.h
+ * 
+ * A #CtplTemplate holds a compiled template, that is a token tree, with a
+ * reference count so it can be shared.
+ * 
+ * Templates can be saved in a compact binary form with ctpl_template_save(),
+ * that is much faster to load than lexing the template again.
+ * ctpl_template_load() and ctpl_template_load_path() load both compiled and
+ * text templates, so that compiled ones can be used transparently.
+ * When a compiled template is read from a local file, the file is read at once
+ * in memory and the data of the template is used in place rather than copied.
+ * Loading it from a stream created with ctpl_input_stream_new_for_mapped_path()
+ * avoids reading the file at all.
+ * 
+ * The compiled form is versioned: it can be loaded on any platform by any
+ * version of CTPL that supports its version, and is otherwise rejected with
+ * %CTPL_TEMPLATE_ERROR_UNSUPPORTED_VERSION.
+ */
+
+/* The compiled form is:
+ * 
+ *   header: TEMPLATE_MAGIC, then the format version as u32
+ *   tokens: for each token, its tag as u8 and its content, then TAG_END
+ *     TAG_DATA:  u32 length, the data
+ *     TAG_EXPR:  u8 escape mode + 1, expr
+ *     TAG_FOR:   string iterator, expr array, tokens children
+ *     TAG_IF:    expr condition, tokens if children, tokens else children
+ *     TAG_CACHE: tokens children (the symbols they depend on are found again
+ *                when loading)
+ *   expr: u8 type, then
+ *     operator:  u8 operator, expr left operand, expr right operand
+ *     value:     value
+ *     symbol:    string
+ *     call:      string name, u32 number of arguments, the exprs of the
+ *                arguments
+ *   and u32 number of indexes, the exprs of the indexes
+ *   value: u8 type, then
+ *     int:       i64
+ *     float:     IEEE 754 double as u64
+ *     string:    string
+ *     array:     u32 length, the values
+ *   string: u32 length, the bytes
+ * 
+ * All integers are little endian. */
+#define TEMPLATE_MAGIC      "\x89" "CTPL\r\n\x1a"
+#define TEMPLATE_MAGIC_LEN  8
+#define TEMPLATE_VERSION    3
+/* oldest format version that can be loaded: version 1 had no TAG_CACHE, and
+ * versions before 3 had no call expressions */
+#define TEMPLATE_MIN_VERSION 1
+/* maximum nesting of the compiled form, not to overflow the stack loading a
+ * corrupted file */
+#define TEMPLATE_MAX_DEPTH  4096
+
+enum {
+  TAG_END,
+  TAG_DATA,
+  TAG_EXPR,
+  TAG_FOR,
+  TAG_IF,
+  TAG_CACHE
+};
+
+
+/**
+ * CtplTemplate:
+ * 
+ * An opaque reference counted object holding a compiled template.
+ */
+struct _CtplTemplate
+{
+  /*< private >*/
+  gint        ref_count;
+  CtplToken  *tree;
+};
+
+
+/*<standard>*/
+GQuark
+ctpl_template_error_quark (void)
+{
+  static GQuark error_quark = 0;
+  
+  if (G_UNLIKELY (error_quark == 0)) {
+    error_quark = g_quark_from_static_string ("CtplTemplate");
+  }
+  
+  return error_quark;
+}
+
+/**
+ * ctpl_template_new:
+ * @tree: (transfer full) (allow-none): A token tree
+ * 
+ * Creates a new #CtplTemplate holding @tree.
+ * 
+ * Returns: A new #CtplTemplate, owning @tree.
+ * 
+ * Since: 0.4
+ */
+CtplTemplate *
+ctpl_template_new (CtplToken *tree)
+{
+  CtplTemplate *self;
+  
+  self = g_slice_alloc (sizeof *self);
+  self->ref_count = 1;
+  self->tree = tree;
+  
+  return self;
+}
+
+/**
+ * ctpl_template_ref:
+ * @tmpl: A #CtplTemplate
+ * 
+ * Adds a reference to a #CtplTemplate.
+ * 
+ * Returns: The template
+ * 
+ * Since: 0.4
+ */
+CtplTemplate *
+ctpl_template_ref (CtplTemplate *tmpl)
+{
+  g_atomic_int_inc (&tmpl->ref_count);
+  
+  return tmpl;
+}
+
+/**
+ * ctpl_template_unref:
+ * @tmpl: A #CtplTemplate
+ * 
+ * Removes a reference from a #CtplTemplate. If the reference count drops to 0,
+ * frees the template and its token tree.
+ * 
+ * Since: 0.4
+ */
+void
+ctpl_template_unref (CtplTemplate *tmpl)
+{
+  if (g_atomic_int_dec_and_test (&tmpl->ref_count)) {
+    ctpl_token_free (tmpl->tree);
+    g_slice_free1 (sizeof *tmpl, tmpl);
+  }
+}
+
+/**
+ * ctpl_template_get_tree:
+ * @tmpl: A #CtplTemplate
+ * 
+ * Gets the token tree of a #CtplTemplate, to render it with ctpl_parser_parse()
+ * for example. The tree belongs to @tmpl and is only valid as long as @tmpl is.
+ * 
+ * Returns: The token tree of @tmpl, which may be %NULL for an empty template.
+ * 
+ * Since: 0.4
+ */
+const CtplToken *
+ctpl_template_get_tree (const CtplTemplate *tmpl)
+{
+  return tmpl->tree;
+}
+
+
+static void
+save_u8 (GString *out,
+         guint8   v)
+{
+  g_string_append_c (out, (gchar) v);
+}
+
+static void
+save_u32 (GString *out,
+          guint32  v)
+{
+  v = GUINT32_TO_LE (v);
+  g_string_append_len (out, (const gchar *) &v, sizeof v);
+}
+
+static void
+save_u64 (GString *out,
+          guint64  v)
+{
+  v = GUINT64_TO_LE (v);
+  g_string_append_len (out, (const gchar *) &v, sizeof v);
+}
+
+static void
+save_string (GString     *out,
+             const gchar *str,
+             gsize        length)
+{
+  save_u32 (out, (guint32) length);
+  g_string_append_len (out, str, (gssize) length);
+}
+
+static void
+save_value (GString         *out,
+            const CtplValue *value)
+{
+  save_u8 (out, (guint8) ctpl_value_get_held_type (value));
+  switch (ctpl_value_get_held_type (value)) {
+    case CTPL_VTYPE_INT:
+      save_u64 (out, (guint64) (gint64) ctpl_value_get_int (value));
+      break;
+    
+    case CTPL_VTYPE_FLOAT: {
+      gdouble v = ctpl_value_get_float (value);
+      guint64 bits;
+      
+      memcpy (&bits, &v, sizeof bits);
+      save_u64 (out, bits);
+      break;
+    }
+    
+    case CTPL_VTYPE_STRING: {
+      const gchar *str = ctpl_value_get_string (value);
+      
+      save_string (out, str, strlen (str));
+      break;
+    }
+    
+    case CTPL_VTYPE_ARRAY: {
+      const GSList *item;
+      
+      save_u32 (out, (guint32) ctpl_value_array_length (value));
+      for (item = ctpl_value_get_array (value); item; item = item->next) {
+        save_value (out, item->data);
+      }
+      break;
+    }
+  }
+}
+
+static void
+save_expr (GString             *out,
+           const CtplTokenExpr *expr)
+{
+  const GSList *index;
+  
+  save_u8 (out, (guint8) expr->type);
+  switch (expr->type) {
+    case CTPL_TOKEN_EXPR_TYPE_OPERATOR:
+      save_u8 (out, (guint8) expr->token.t_operator->operator);
+      save_expr (out, expr->token.t_operator->loperand);
+      save_expr (out, expr->token.t_operator->roperand);
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_VALUE:
+      save_value (out, &expr->token.t_value);
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_SYMBOL:
+      save_string (out, expr->token.t_symbol, strlen (expr->token.t_symbol));
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_CALL: {
+      const GSList *arg;
+      
+      save_string (out, expr->token.t_call->name,
+                   strlen (expr->token.t_call->name));
+      save_u32 (out, expr->token.t_call->n_args);
+      for (arg = expr->token.t_call->args; arg; arg = arg->next) {
+        save_expr (out, arg->data);
+      }
+      break;
+    }
+  }
+  save_u32 (out, g_slist_length (expr->indexes));
+  for (index = expr->indexes; index; index = index->next) {
+    save_expr (out, index->data);
+  }
+}
+
+static void
+save_tokens (GString         *out,
+             const CtplToken *token)
+{
+  for (; token; token = token->next) {
+    switch (ctpl_token_get_type (token)) {
+      case CTPL_TOKEN_TYPE_DATA:
+        save_u8 (out, TAG_DATA);
+        save_string (out, token->token.t_data->data,
+                     token->token.t_data->length);
+        break;
+      
+      case CTPL_TOKEN_TYPE_EXPR:
+        save_u8 (out, TAG_EXPR);
+        save_u8 (out, (guint8) (token->escape + 1));
+        save_expr (out, token->token.t_expr);
+        break;
+      
+      case CTPL_TOKEN_TYPE_FOR:
+        save_u8 (out, TAG_FOR);
+        save_string (out, token->token.t_for->iter,
+                     strlen (token->token.t_for->iter));
+        save_expr (out, token->token.t_for->array);
+        save_tokens (out, token->token.t_for->children);
+        break;
+      
+      case CTPL_TOKEN_TYPE_IF:
+        save_u8 (out, TAG_IF);
+        save_expr (out, token->token.t_if->condition);
+        save_tokens (out, token->token.t_if->if_children);
+        save_tokens (out, token->token.t_if->else_children);
+        break;
+      
+      case CTPL_TOKEN_TYPE_CACHE:
+        save_u8 (out, TAG_CACHE);
+        save_tokens (out, token->token.t_cache->children);
+        break;
+    }
+  }
+  save_u8 (out, TAG_END);
+}
+
+/**
+ * ctpl_template_save:
+ * @tmpl: A #CtplTemplate
+ * @output: A #CtplOutputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Writes the compiled form of @tmpl to @output, so that it can later be loaded
+ * with ctpl_template_load() without lexing it again.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ * 
+ * Since: 0.4
+ */
+gboolean
+ctpl_template_save (const CtplTemplate  *tmpl,
+                    CtplOutputStream    *output,
+                    GError             **error)
+{
+  GString  *out;
+  gboolean  rv;
+  
+  out = g_string_new_len (TEMPLATE_MAGIC, TEMPLATE_MAGIC_LEN);
+  save_u32 (out, TEMPLATE_VERSION);
+  save_tokens (out, tmpl->tree);
+  rv = ctpl_output_stream_write (output, out->str, out->len, error);
+  g_string_free (out, TRUE);
+  
+  return rv;
+}
+
+
+typedef struct _TemplateLoader TemplateLoader;
+
+/* state of the loading of a compiled template */
+struct _TemplateLoader
+{
+  GBytes       *bytes;
+  const guchar *data;
+  gsize         size;
+  gsize         pos;
+  const CtplSourceFile *file; /* the file @bytes maps, or %NULL */
+  guint         depth;
+};
+
+static const guchar *
+load_data (TemplateLoader *loader,
+           gsize           length)
+{
+  const guchar *data = NULL;
+  
+  if (length <= loader->size - loader->pos) {
+    data = &loader->data[loader->pos];
+    loader->pos += length;
+  }
+  
+  return data;
+}
+
+static gboolean
+load_u8 (TemplateLoader *loader,
+         guint8         *v)
+{
+  const guchar *data = load_data (loader, sizeof *v);
+  
+  if (data) {
+    *v = *data;
+  }
+  
+  return data != NULL;
+}
+
+static gboolean
+load_u32 (TemplateLoader *loader,
+          guint32        *v)
+{
+  const guchar *data = load_data (loader, sizeof *v);
+  
+  if (data) {
+    memcpy (v, data, sizeof *v);
+    *v = GUINT32_FROM_LE (*v);
+  }
+  
+  return data != NULL;
+}
+
+static gboolean
+load_u64 (TemplateLoader *loader,
+          guint64        *v)
+{
+  const guchar *data = load_data (loader, sizeof *v);
+  
+  if (data) {
+    memcpy (v, data, sizeof *v);
+    *v = GUINT64_FROM_LE (*v);
+  }
+  
+  return data != NULL;
+}
+
+static const gchar *
+load_string (TemplateLoader *loader,
+             gsize          *length)
+{
+  guint32 len;
+  
+  if (! load_u32 (loader, &len)) {
+    return NULL;
+  }
+  *length = len;
+  
+  return (const gchar *) load_data (loader, len);
+}
+
+static gboolean
+load_value (TemplateLoader *loader,
+            CtplValue      *value)
+{
+  gboolean  rv = FALSE;
+  guint8    type;
+  
+  if (loader->depth++ >= TEMPLATE_MAX_DEPTH || ! load_u8 (loader, &type)) {
+    /* fail */
+  } else if (type == CTPL_VTYPE_INT) {
+    guint64 v;
+    
+    if ((rv = load_u64 (loader, &v))) {
+      ctpl_value_set_int (value, (glong) (gint64) v);
+    }
+  } else if (type == CTPL_VTYPE_FLOAT) {
+    guint64 bits;
+    gdouble v;
+    
+    if ((rv = load_u64 (loader, &bits))) {
+      memcpy (&v, &bits, sizeof v);
+      ctpl_value_set_float (value, v);
+    }
+  } else if (type == CTPL_VTYPE_STRING) {
+    const gchar  *str;
+    gsize         length;
+    
+    if ((rv = (str = load_string (loader, &length)) != NULL)) {
+      ctpl_value_take_string (value, g_strndup (str, length));
+    }
+  } else if (type == CTPL_VTYPE_ARRAY) {
+    guint32 length;
+    
+    if ((rv = load_u32 (loader, &length))) {
+      guint32 i;
+      
+      ctpl_value_set_array (value, CTPL_VTYPE_INT, 0, NULL);
+      for (i = 0; rv && i < length; i++) {
+        CtplValue item;
+        
+        ctpl_value_init (&item);
+        if ((rv = load_value (loader, &item))) {
+          ctpl_value_array_append (value, &item);
+        }
+        ctpl_value_free_value (&item);
+      }
+    }
+  }
+  loader->depth--;
+  
+  return rv;
+}
+
+static CtplTokenExpr *
+load_expr (TemplateLoader *loader)
+{
+  CtplTokenExpr  *expr = NULL;
+  guint8          type;
+  guint32         n_indexes;
+  
+  if (loader->depth++ >= TEMPLATE_MAX_DEPTH || ! load_u8 (loader, &type)) {
+    /* fail */
+  } else if (type == CTPL_TOKEN_EXPR_TYPE_OPERATOR) {
+    guint8          operator;
+    CtplTokenExpr  *loperand = NULL;
+    CtplTokenExpr  *roperand = NULL;
+    
+    if (load_u8 (loader, &operator) && operator < CTPL_OPERATOR_NONE &&
+        (loperand = load_expr (loader)) != NULL &&
+        (roperand = load_expr (loader)) != NULL) {
+      expr = ctpl_token_expr_new_operator (operator, loperand, roperand);
+    } else if (loperand) {
+      ctpl_token_expr_free (loperand);
+    }
+  } else if (type == CTPL_TOKEN_EXPR_TYPE_VALUE) {
+    CtplValue value;
+    
+    ctpl_value_init (&value);
+    if (load_value (loader, &value)) {
+      expr = ctpl_token_expr_new_value (&value);
+    }
+    ctpl_value_free_value (&value);
+  } else if (type == CTPL_TOKEN_EXPR_TYPE_SYMBOL) {
+    const gchar  *symbol;
+    gsize         length;
+    
+    if ((symbol = load_string (loader, &length)) != NULL) {
+      expr = ctpl_token_expr_new_symbol (symbol, (gssize) length);
+    }
+  } else if (type == CTPL_TOKEN_EXPR_TYPE_CALL) {
+    const gchar  *name;
+    gsize         length;
+    guint32       n_args;
+    
+    if ((name = load_string (loader, &length)) != NULL &&
+        load_u32 (loader, &n_args)) {
+      GSList   *args = NULL;
+      guint32   i;
+      
+      for (i = 0; i < n_args; i++) {
+        CtplTokenExpr *arg = load_expr (loader);
+        
+        if (! arg) {
+          break;
+        }
+        args = g_slist_prepend (args, arg);
+      }
+      if (i < n_args) {
+        g_slist_free_full (args, (GDestroyNotify) ctpl_token_expr_free);
+      } else {
+        expr = ctpl_token_expr_new_call (name, (gssize) length,
+                                         g_slist_reverse (args));
+      }
+    }
+  }
+  if (expr) {
+    if (! load_u32 (loader, &n_indexes)) {
+      ctpl_token_expr_free (expr);
+      expr = NULL;
+    } else {
+      guint32 i;
+      
+      for (i = 0; expr && i < n_indexes; i++) {
+        CtplTokenExpr *index = load_expr (loader);
+        
+        if (! index) {
+          ctpl_token_expr_free (expr);
+          expr = NULL;
+        } else {
+          expr->indexes = g_slist_prepend (expr->indexes, index);
+        }
+      }
+      if (expr) {
+        expr->indexes = g_slist_reverse (expr->indexes);
+      }
+    }
+  }
+  loader->depth--;
+  
+  return expr;
+}
+
+static gboolean
+load_tokens (TemplateLoader  *loader,
+             CtplToken      **tree)
+{
+  gboolean  ended = FALSE;
+  guint8    tag;
+  
+  *tree = NULL;
+  if (loader->depth++ >= TEMPLATE_MAX_DEPTH) {
+    loader->depth--;
+    return FALSE;
+  }
+  while (! ended && load_u8 (loader, &tag)) {
+    CtplToken      *token = NULL;
+    CtplTokenExpr  *expr = NULL;
+    CtplToken      *children = NULL;
+    CtplToken      *else_children = NULL;
+    
+    if (tag == TAG_END) {
+      ended = TRUE;
+      continue;
+    } else if (tag == TAG_DATA) {
+      const gchar  *data;
+      gsize         length;
+      
+      if ((data = load_string (loader, &length)) != NULL) {
+        /* the data is used in place */
+        token = ctpl_token_new_data_for_bytes (loader->bytes,
+                                               (gsize) ((const guchar *) data -
+                                                        loader->data),
+                                               length, loader->file);
+      }
+    } else if (tag == TAG_EXPR) {
+      guint8 escape;
+      
+      if (load_u8 (loader, &escape) &&
+          escape <= CTPL_ESCAPE_SHELL + 1 &&
+          (expr = load_expr (loader)) != NULL) {
+        token = ctpl_token_new_expr (expr, (gint) escape - 1);
+      }
+    } else if (tag == TAG_FOR) {
+      const gchar  *iter;
+      gsize         length;
+      
+      if ((iter = load_string (loader, &length)) != NULL &&
+          (expr = load_expr (loader)) != NULL) {
+        if (load_tokens (loader, &children)) {
+          gchar *iterator = g_strndup (iter, length);
+          
+          token = ctpl_token_new_for (expr, iterator, children);
+          g_free (iterator);
+        } else {
+          ctpl_token_expr_free (expr);
+        }
+      }
+    } else if (tag == TAG_IF) {
+      if ((expr = load_expr (loader)) != NULL) {
+        if (load_tokens (loader, &children) &&
+            load_tokens (loader, &else_children)) {
+          token = ctpl_token_new_if (expr, children, else_children);
+        } else {
+          ctpl_token_free (children);
+          ctpl_token_expr_free (expr);
+        }
+      }
+    } else if (tag == TAG_CACHE) {
+      if (load_tokens (loader, &children)) {
+        token = ctpl_token_new_cache (children);
+      }
+    }
+    
+    if (! token) {
+      break;
+    } else if (! *tree) {
+      *tree = token;
+    } else {
+      ctpl_token_append (*tree, token);
+    }
+  }
+  if (! ended) {
+    ctpl_token_free (*tree);
+    *tree = NULL;
+  }
+  loader->depth--;
+  
+  return ended;
+}
+
+/* loads a compiled template from @bytes, starting at @offset */
+static CtplTemplate *
+template_load_compiled (GBytes                *bytes,
+                        gsize                  offset,
+                        const CtplSourceFile  *file,
+                        GError               **error)
+{
+  CtplTemplate   *tmpl = NULL;
+  TemplateLoader  loader;
+  CtplToken      *tree = NULL;
+  guint32         version;
+  
+  loader.bytes = bytes;
+  loader.data = g_bytes_get_data (bytes, &loader.size);
+  loader.pos = offset + TEMPLATE_MAGIC_LEN;
+  loader.file = file;
+  loader.depth = 0;
+  
+  if (! load_u32 (&loader, &version)) {
+    /* handled below */
+  } else if (version < TEMPLATE_MIN_VERSION || version > TEMPLATE_VERSION) {
+    g_set_error (error, CTPL_TEMPLATE_ERROR,
+                 CTPL_TEMPLATE_ERROR_UNSUPPORTED_VERSION,
+                 _("Unsupported compiled template version %u"), version);
+    return NULL;
+  } else if (load_tokens (&loader, &tree) && loader.pos == loader.size) {
+    tmpl = ctpl_template_new (tree);
+  } else {
+    ctpl_token_free (tree);
+  }
+  if (! tmpl) {
+    g_set_error (error, CTPL_TEMPLATE_ERROR, CTPL_TEMPLATE_ERROR_INVALID,
+                 _("Invalid compiled template data at offset %"
+                   G_GSIZE_FORMAT), loader.pos - offset);
+  }
+  
+  return tmpl;
+}
+
+/* reads the rest of @stream in a new #GBytes */
+static GBytes *
+template_read_all (CtplInputStream  *stream,
+                   GError          **error)
+{
+  GByteArray *array;
+  guint8      buf[4096];
+  gssize      n_read;
+  
+  array = g_byte_array_new ();
+  while ((n_read = ctpl_input_stream_read (stream, buf, sizeof buf,
+                                           error)) > 0) {
+    g_byte_array_append (array, buf, (guint) n_read);
+  }
+  if (n_read < 0) {
+    g_byte_array_unref (array);
+    return NULL;
+  }
+  
+  return g_byte_array_free_to_bytes (array);
+}
+
+/**
+ * ctpl_template_load:
+ * @stream: A #CtplInputStream
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Loads a template from @stream, either compiled (see ctpl_template_save()) or
+ * as text, in which case it is lexed with ctpl_lexer_lex().
+ * 
+ * When @stream reads from memory (see ctpl_input_stream_new_for_bytes() and
+ * ctpl_input_stream_new_for_mapped_path()), or from a local file, which is
+ * then read at once, the data of a compiled template is not copied.
+ * 
+ * Errors can come from the %CTPL_TEMPLATE_ERROR domain for an invalid compiled
+ * template, from the %CTPL_LEXER_ERROR domain for an invalid text template, or
+ * from the %G_IO_ERROR domain if reading fails.
+ * 
+ * Returns: A new #CtplTemplate, or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+CtplTemplate *
+ctpl_template_load (CtplInputStream  *stream,
+                    GError          **error)
+{
+  CtplTemplate *tmpl = NULL;
+  GBytes       *source;
+  gsize         offset = 0;
+  const CtplSourceFile *file = NULL;
+  gchar         magic[TEMPLATE_MAGIC_LEN];
+  gssize        n;
+  
+  source = ctpl_input_stream_get_source (stream, &offset, &file);
+  if (source) {
+    gsize         size;
+    const gchar  *data = g_bytes_get_data (source, &size);
+    
+    if (size - offset >= TEMPLATE_MAGIC_LEN &&
+        memcmp (&data[offset], TEMPLATE_MAGIC, TEMPLATE_MAGIC_LEN) == 0) {
+      tmpl = template_load_compiled (source, offset, file, error);
+      /* consume the stream like lexing would */
+      ctpl_input_stream_skip (stream, size - offset, NULL);
+      return tmpl;
+    }
+  } else if ((n = ctpl_input_stream_peek (stream, magic, sizeof magic,
+                                          error)) < 0) {
+    return NULL;
+  } else if (n == TEMPLATE_MAGIC_LEN &&
+             memcmp (magic, TEMPLATE_MAGIC, TEMPLATE_MAGIC_LEN) == 0) {
+    GBytes *bytes = template_read_all (stream, error);
+    
+    if (bytes) {
+      tmpl = template_load_compiled (bytes, 0, NULL, error);
+      g_bytes_unref (bytes);
+    }
+    return tmpl;
+  }
+  
+  {
+    CtplToken *tree = ctpl_lexer_lex (stream, error);
+    
+    if (tree) {
+      tmpl = ctpl_template_new (tree);
+    }
+  }
+  
+  return tmpl;
+}
+
+/**
+ * ctpl_template_load_path:
+ * @path: The path of the file from which load the template, in the GLib's
+ *        filename encoding
+ * @error: Return location for errors, or %NULL to ignore them
+ * 
+ * Convenient function to load a template from a file.
+ * See ctpl_template_load().
+ * 
+ * Returns: A new #CtplTemplate, or %NULL on error.
+ * 
+ * Since: 0.4
+ */
+CtplTemplate *
+ctpl_template_load_path (const gchar *path,
+                         GError     **error)
+{
+  CtplTemplate     *tmpl = NULL;
+  CtplInputStream  *stream;
+  
+  stream = ctpl_input_stream_new_for_path (path, error);
+  if (stream) {
+    tmpl = ctpl_template_load (stream, error);
+    ctpl_input_stream_unref (stream);
+  }
+  
+  return tmpl;
+}
@@ -0,0 +1,80 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#if ! defined (H_CTPL_H_INSIDE) && ! defined (CTPL_COMPILATION)
+# error "Only <ctpl/ctpl.h> can be included directly."
+#endif
+
+#ifndef H_CTPL_TEMPLATE_H
+#define H_CTPL_TEMPLATE_H
+
+#include <glib.h>
+#include "ctpl-token.h"
+#include "ctpl-input-stream.h"
+#include "ctpl-output-stream.h"
+
+G_BEGIN_DECLS
+
+
+/**
+ * CTPL_TEMPLATE_ERROR:
+ * 
+ * Error domain of CtplTemplate.
+ * 
+ * Since: 0.4
+ */
+#define CTPL_TEMPLATE_ERROR  (ctpl_template_error_quark ())
+
+/**
+ * CtplTemplateError:
+ * @CTPL_TEMPLATE_ERROR_INVALID: The compiled template is truncated or corrupted
+ * @CTPL_TEMPLATE_ERROR_UNSUPPORTED_VERSION: The compiled template was written
+ *                                           by an incompatible version of CTPL
+ * 
+ * Error codes that loading a compiled template can throw, from the
+ * %CTPL_TEMPLATE_ERROR domain.
+ * 
+ * Since: 0.4
+ */
+typedef enum _CtplTemplateError
+{
+  CTPL_TEMPLATE_ERROR_INVALID,
+  CTPL_TEMPLATE_ERROR_UNSUPPORTED_VERSION
+} CtplTemplateError;
+
+typedef struct _CtplTemplate CtplTemplate;
+
+
+GQuark              ctpl_template_error_quark  (void) G_GNUC_CONST;
+CtplTemplate       *ctpl_template_new          (CtplToken *tree);
+CtplTemplate       *ctpl_template_ref          (CtplTemplate *tmpl);
+void                ctpl_template_unref        (CtplTemplate *tmpl);
+const CtplToken    *ctpl_template_get_tree     (const CtplTemplate *tmpl);
+CtplTemplate       *ctpl_template_load         (CtplInputStream  *stream,
+                                                GError          **error);
+CtplTemplate       *ctpl_template_load_path    (const gchar  *path,
+                                                GError      **error);
+gboolean            ctpl_template_save         (const CtplTemplate  *tmpl,
+                                                CtplOutputStream    *output,
+                                                GError             **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
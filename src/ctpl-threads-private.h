@@ -0,0 +1,47 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#ifndef H_CTPL_THREADS_PRIVATE_H
+#define H_CTPL_THREADS_PRIVATE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+/*
+ * CtplThreadsFunc:
+ * @data: The data passed to ctpl_threads_run()
+ * 
+ * A function run concurrently by several threads with ctpl_threads_run().
+ */
+typedef void (*CtplThreadsFunc) (gpointer data);
+
+G_GNUC_INTERNAL
+guint     ctpl_threads_get_max  (void);
+G_GNUC_INTERNAL
+void      ctpl_threads_run      (guint            n_threads,
+                                 CtplThreadsFunc  func,
+                                 gpointer         data);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,144 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#include "ctpl-threads-private.h"
+#include <glib.h>
+
+
+/*
+ * SECTION: threads
+ * @short_description: Shared worker threads
+ * 
+ * A pool of threads shared by the parts of the library that split their work
+ * among several threads, like rendering loops in parallel.
+ * 
+ * The work is not split in tasks: each thread runs the same function, which
+ * takes pieces of the work from a shared state until there are none left, so
+ * the threads finishing early take over work from the others.
+ * The calling thread takes part in the work, so progress is made even when
+ * the pool is busy.
+ */
+
+
+typedef struct _ThreadsJob ThreadsJob;
+
+/* a function being run on several threads */
+struct _ThreadsJob
+{
+  CtplThreadsFunc func;
+  gpointer        data;
+  /* pool threads still running @func */
+  GMutex          mutex;
+  GCond           cond;
+  guint           n_pending;
+};
+
+/* body of the pool threads */
+static void
+ctpl_threads_worker (gpointer data,
+                     gpointer user_data)
+{
+  ThreadsJob *job = data;
+  
+  job->func (job->data);
+  g_mutex_lock (&job->mutex);
+  if (--job->n_pending == 0) {
+    g_cond_signal (&job->cond);
+  }
+  g_mutex_unlock (&job->mutex);
+}
+
+/* gets the shared pool, or %NULL if there is a single processor */
+static GThreadPool *
+ctpl_threads_get_pool (void)
+{
+  static gsize pool = 0;
+  
+  if (g_once_init_enter (&pool)) {
+    GThreadPool  *new_pool = NULL;
+    guint         n_threads = g_get_num_processors ();
+    
+    /* the calling thread takes part in the work */
+    if (n_threads > 1) {
+      new_pool = g_thread_pool_new (ctpl_threads_worker, NULL,
+                                    (gint) n_threads - 1, FALSE, NULL);
+    }
+    g_once_init_leave (&pool, (gsize) new_pool + 1);
+  }
+  
+  return (GThreadPool *) (pool - 1);
+}
+
+/*
+ * ctpl_threads_get_max:
+ * 
+ * Gets the number of threads that can work concurrently with
+ * ctpl_threads_run(), including the calling thread.
+ * 
+ * Returns: The maximum number of threads, 1 if work can't be split.
+ */
+guint
+ctpl_threads_get_max (void)
+{
+  GThreadPool *pool = ctpl_threads_get_pool ();
+  
+  return pool ? (guint) g_thread_pool_get_max_threads (pool) + 1 : 1;
+}
+
+/*
+ * ctpl_threads_run:
+ * @n_threads: The number of threads to run @func on, including the calling
+ *             thread
+ * @func: The function to run
+ * @data: Data to pass to @func
+ * 
+ * Runs @func on @n_threads threads concurrently, and waits for all of them to
+ * return. @n_threads is clamped to ctpl_threads_get_max().
+ */
+void
+ctpl_threads_run (guint           n_threads,
+                  CtplThreadsFunc func,
+                  gpointer        data)
+{
+  GThreadPool  *pool = ctpl_threads_get_pool ();
+  ThreadsJob    job;
+  guint         n_workers;
+  guint         i;
+  
+  n_workers = MIN (n_threads, ctpl_threads_get_max ());
+  n_workers = n_workers > 0 ? n_workers - 1 : 0;
+  job.func = func;
+  job.data = data;
+  g_mutex_init (&job.mutex);
+  g_cond_init (&job.cond);
+  job.n_pending = n_workers;
+  
+  for (i = 0; i < n_workers; i++) {
+    g_thread_pool_push (pool, &job, NULL);
+  }
+  func (data);
+  g_mutex_lock (&job.mutex);
+  while (job.n_pending > 0) {
+    g_cond_wait (&job.cond, &job.mutex);
+  }
+  g_mutex_unlock (&job.mutex);
+  g_cond_clear (&job.cond);
+  g_mutex_clear (&job.mutex);
+}
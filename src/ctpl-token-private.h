@@ -23,6 +23,8 @@
 #include <glib.h>
 #include "ctpl-value.h"
 #include "ctpl-token.h"
+#include "ctpl-escape.h"
+#include "ctpl-input-stream-private.h"
 
 G_BEGIN_DECLS
 
@@ -36,64 +38,25 @@ G_BEGIN_DECLS
  * Represents a CTPL language token.
  * 
  * A #CtplToken is created with ctpl_token_new_data(), ctpl_token_new_expr(),
- * ctpl_token_new_for() or ctpl_token_new_if(), and freed with
- * ctpl_token_free().
+ * ctpl_token_new_for(), ctpl_token_new_if() or ctpl_token_new_cache(), and
+ * freed with ctpl_token_free().
  * You can append or prepend tokens to others with ctpl_token_append() and
  * ctpl_token_prepend().
  * To dump a #CtplToken, use ctpl_token_dump().
  * 
  * A #CtplTokenExpr is created with ctpl_token_expr_new_operator(), 
- * ctpl_token_expr_new_value() or ctpl_token_expr_new_symbol(), and freed with
- * ctpl_token_expr_free().
+ * ctpl_token_expr_new_value(), ctpl_token_expr_new_symbol() or
+ * ctpl_token_expr_new_call(), and freed with ctpl_token_expr_free().
  * To dump a #CtplTokenExpr, use ctpl_token_expr_dump().
  */
 
-/*
- * CtplOperator:
- * @CTPL_OPERATOR_AND:    Boolean AND operator
- * @CTPL_OPERATOR_DIV:    Division operator
- * @CTPL_OPERATOR_EQUAL:  Equality test operator
- * @CTPL_OPERATOR_INFEQ:  @CTPL_OPERATOR_INF || @CTPL_OPERATOR_EQUAL
- * @CTPL_OPERATOR_INF:    Inferiority test operator
- * @CTPL_OPERATOR_MINUS:  Subtraction operator
- * @CTPL_OPERATOR_MODULO: Modulo operator
- * @CTPL_OPERATOR_MUL:    Multiplication operator
- * @CTPL_OPERATOR_NEQ:    Non-equality test operator (! @CTPL_OPERATOR_EQUAL)
- * @CTPL_OPERATOR_OR:     Boolean OR operator
- * @CTPL_OPERATOR_PLUS:   Addition operator
- * @CTPL_OPERATOR_SUPEQ:  @CTPL_OPERATOR_SUP || @CTPL_OPERATOR_EQUAL
- * @CTPL_OPERATOR_SUP:    Superiority test operator
- * @CTPL_OPERATOR_NONE:   Not an operator, denoting no operator
- * 
- * Operators constants.
- * 
- * See also ctpl_operator_to_string() and ctpl_operator_from_string().
- */
-/* keep order as needed by operators_array in lexer-expr.c */
-typedef enum {
-  CTPL_OPERATOR_AND,
-  CTPL_OPERATOR_DIV,
-  CTPL_OPERATOR_EQUAL,
-  CTPL_OPERATOR_INFEQ,
-  CTPL_OPERATOR_INF,
-  CTPL_OPERATOR_MINUS,
-  CTPL_OPERATOR_MODULO,
-  CTPL_OPERATOR_MUL,
-  CTPL_OPERATOR_NEQ,
-  CTPL_OPERATOR_OR,
-  CTPL_OPERATOR_PLUS,
-  CTPL_OPERATOR_SUPEQ,
-  CTPL_OPERATOR_SUP,
-  /* must be last */
-  CTPL_OPERATOR_NONE
-} CtplOperator;
-
 /*
  * CtplTokenType:
  * @CTPL_TOKEN_TYPE_DATA: Data flow, not an language token
  * @CTPL_TOKEN_TYPE_FOR: A loop through an array of values
  * @CTPL_TOKEN_TYPE_IF: A conditional branching
  * @CTPL_TOKEN_TYPE_EXPR: An expression
+ * @CTPL_TOKEN_TYPE_CACHE: A block whose output can be cached
  * 
  * Possible types of a token.
  */
@@ -102,7 +65,8 @@ typedef enum _CtplTokenType
   CTPL_TOKEN_TYPE_DATA,
   CTPL_TOKEN_TYPE_FOR,
   CTPL_TOKEN_TYPE_IF,
-  CTPL_TOKEN_TYPE_EXPR
+  CTPL_TOKEN_TYPE_EXPR,
+  CTPL_TOKEN_TYPE_CACHE
 } CtplTokenType;
 
 /*
@@ -111,6 +75,7 @@ typedef enum _CtplTokenType
  *            (<link linkend="CtplOperator"><code>CTPL_OPERATOR_*</code></link>)
  * @CTPL_TOKEN_EXPR_TYPE_VALUE:     An inline value value
  * @CTPL_TOKEN_EXPR_TYPE_SYMBOL:    A symbol (a name to be found in the environ)
+ * @CTPL_TOKEN_EXPR_TYPE_CALL:      A function call (see ctpl_function_call())
  * 
  * Possibles types of an expression token.
  */
@@ -118,12 +83,44 @@ typedef enum _CtplTokenExprType
 {
   CTPL_TOKEN_EXPR_TYPE_OPERATOR,
   CTPL_TOKEN_EXPR_TYPE_VALUE,
-  CTPL_TOKEN_EXPR_TYPE_SYMBOL
+  CTPL_TOKEN_EXPR_TYPE_SYMBOL,
+  CTPL_TOKEN_EXPR_TYPE_CALL
 } CtplTokenExprType;
 
+/*
+ * CTPL_ESCAPE_INHERIT:
+ * 
+ * Escape mode of expression tokens that don't specify one, and use the one of
+ * the output instead.
+ */
+#define CTPL_ESCAPE_INHERIT (-1)
+
+typedef struct _CtplTokenData         CtplTokenData;
 typedef struct _CtplTokenFor          CtplTokenFor;
 typedef struct _CtplTokenIf           CtplTokenIf;
+typedef struct _CtplTokenCache        CtplTokenCache;
 typedef struct _CtplTokenExprOperator CtplTokenExprOperator;
+typedef struct _CtplTokenExprCall     CtplTokenExprCall;
+
+/*
+ * CtplTokenData:
+ * @data: The data, not 0-terminated
+ * @length: The length of @data
+ * @source: The buffer @data points into, or %NULL if @data is owned by the
+ *          token
+ * @source_file: The file @source maps, or %NULL. It is owned by @source
+ * 
+ * Holds the data of a data token.
+ * When the template was read from a #GBytes, data tokens without escapes
+ * reference a span of it rather than holding their own copy.
+ */
+struct _CtplTokenData
+{
+  const gchar    *data;
+  gsize           length;
+  GBytes         *source;
+  const CtplSourceFile *source_file;
+};
 
 /*
  * CtplTokenFor:
@@ -155,6 +152,22 @@ struct _CtplTokenIf
   CtplToken      *else_children;
 };
 
+/*
+ * CtplTokenCache:
+ * @id: A number identifying the block among all the ones created
+ * @symbols: (array zero-terminated=1): The symbols the output of the block
+ *           depends on
+ * @children: Tree whose output is cached
+ * 
+ * Holds information about a <code>cache</code> statement.
+ */
+struct _CtplTokenCache
+{
+  gsize           id;
+  gchar         **symbols;
+  CtplToken      *children;
+};
+
 /*
  * CtplTokenExprOperator:
  * @operator: The operator
@@ -170,11 +183,27 @@ struct _CtplTokenExprOperator
   CtplTokenExpr  *roperand;
 };
 
+/*
+ * CtplTokenExprCall:
+ * @name: The name of the function to call
+ * @args: (element-type CtplTokenExpr): The arguments of the call, in order
+ * @n_args: The length of @args
+ * 
+ * Represents a function call token in an expression.
+ */
+struct _CtplTokenExprCall
+{
+  gchar          *name;
+  GSList         *args;
+  guint           n_args;
+};
+
 /*
  * CtplTokenExprValue:
  * @t_operator: The value of an operator token
  * @t_value: The value of an inline value token
  * @t_symbol: The name of a symbol token
+ * @t_call: The value of a function call token
  * 
  * Represents the possible values of an expression token (see #CtplTokenExpr).
  */
@@ -183,6 +212,7 @@ union _CtplTokenExprValue
   CtplTokenExprOperator  *t_operator;
   CtplValue               t_value;
   gchar                  *t_symbol;
+  CtplTokenExprCall      *t_call;
 };
 typedef union _CtplTokenExprValue CtplTokenExprValue;
 
@@ -208,21 +238,27 @@ struct _CtplTokenExpr
  * @t_expr: The value of an expression token
  * @t_for: The value of a for token
  * @t_if: The value of an if token
+ * @t_cache: The value of a cache token
  * 
  * Represents the possible values of a token (see #CtplToken).
  */
 union _CtplTokenValue
 {
-  gchar          *t_data;
+  CtplTokenData  *t_data;
   CtplTokenExpr  *t_expr;
   CtplTokenFor   *t_for;
   CtplTokenIf    *t_if;
+  CtplTokenCache *t_cache;
 };
 typedef union _CtplTokenValue CtplTokenValue;
 
 /*
  * CtplToken:
  * @type: Type of the token
+ * @size_hint: Size of the output of the last render to memory of the tree
+ *             starting at this token, used to preallocate the next ones
+ * @escape: For expression tokens, the #CtplEscapeMode of the value, or
+ *          %CTPL_ESCAPE_INHERIT
  * @token: Union holding the corresponding token (according to @type)
  * @next: Next token
  * @last: Last token
@@ -232,6 +268,8 @@ typedef union _CtplTokenValue CtplTokenValue;
 struct _CtplToken
 {
   CtplTokenType   type;
+  gint            size_hint; /* atomic */
+  gint            escape;
   CtplTokenValue  token;
   CtplToken      *next;
   CtplToken      *last;
@@ -242,7 +280,13 @@ G_GNUC_INTERNAL
 CtplToken    *ctpl_token_new_data           (const gchar *data,
                                              gssize       len);
 G_GNUC_INTERNAL
-CtplToken    *ctpl_token_new_expr           (CtplTokenExpr *expr);
+CtplToken    *ctpl_token_new_data_for_bytes (GBytes               *bytes,
+                                             gsize                 offset,
+                                             gsize                 length,
+                                             const CtplSourceFile *file);
+G_GNUC_INTERNAL
+CtplToken    *ctpl_token_new_expr           (CtplTokenExpr *expr,
+                                             gint           escape);
 G_GNUC_INTERNAL
 CtplToken    *ctpl_token_new_for            (CtplTokenExpr *array,
                                              const gchar   *iterator,
@@ -252,6 +296,8 @@ CtplToken    *ctpl_token_new_if             (CtplTokenExpr *condition,
                                              CtplToken     *if_children,
                                              CtplToken     *else_children);
 G_GNUC_INTERNAL
+CtplToken    *ctpl_token_new_cache          (CtplToken *children);
+G_GNUC_INTERNAL
 CtplTokenExpr *ctpl_token_expr_new_operator (CtplOperator    operator,
                                              CtplTokenExpr  *loperand,
                                              CtplTokenExpr  *roperand);
@@ -260,6 +306,10 @@ CtplTokenExpr *ctpl_token_expr_new_value    (const CtplValue *value);
 G_GNUC_INTERNAL
 CtplTokenExpr *ctpl_token_expr_new_symbol   (const gchar *symbol,
                                              gssize       len);
+G_GNUC_INTERNAL
+CtplTokenExpr *ctpl_token_expr_new_call     (const gchar *name,
+                                             gssize       len,
+                                             GSList      *args);
 /* ctpl_token_free(): see token.h */
 G_GNUC_INTERNAL
 void          ctpl_token_expr_free_full     (CtplTokenExpr *token,
@@ -272,6 +322,8 @@ G_GNUC_INTERNAL
 void          ctpl_token_prepend            (CtplToken *token,
                                              CtplToken *brother);
 G_GNUC_INTERNAL
+gchar       **ctpl_token_get_symbols        (const CtplToken *token);
+G_GNUC_INTERNAL
 void          ctpl_token_dump               (const CtplToken *token);
 G_GNUC_INTERNAL
 void          ctpl_token_expr_dump          (const CtplTokenExpr *token);
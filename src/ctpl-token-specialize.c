@@ -0,0 +1,505 @@
+/* 
+ * 
+ * Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+#include "ctpl-token.h"
+#include "ctpl-token-private.h"
+#include <string.h>
+#include <glib.h>
+#include "ctpl-environ.h"
+#include "ctpl-environ-private.h"
+#include "ctpl-eval.h"
+#include "ctpl-output-stream.h"
+#include "ctpl-output-stream-private.h"
+#include "ctpl-parser-private.h"
+#include "ctpl-value.h"
+
+
+typedef struct _SpecializeBinding SpecializeBinding;
+
+/* the iterator of a loop enclosing the tokens being specialized */
+struct _SpecializeBinding
+{
+  const gchar  *iter;
+  gboolean      is_static;  /* whether the loop is unrolled, and its iterator
+                             * pushed on the environment */
+};
+
+typedef struct _Specializer Specializer;
+
+/* state of a specialization */
+struct _Specializer
+{
+  CtplEnviron *env;       /* the static environment and unrolled iterators */
+  GSList      *bindings;  /* (element-type SpecializeBinding) innermost
+                           * first */
+};
+
+typedef struct _Residual Residual;
+
+/* a residual tree being built */
+struct _Residual
+{
+  CtplToken        *root;
+  /* pending data, merged until a token that is not data is added */
+  const CtplToken  *data_token; /* the only pending data, if it is a token */
+  GString          *data;
+};
+
+
+/* looks up the value of @symbol if it is static */
+static const CtplValue *
+specializer_lookup (Specializer  *spec,
+                    const gchar  *symbol)
+{
+  const GSList *item;
+  
+  for (item = spec->bindings; item; item = item->next) {
+    const SpecializeBinding *binding = item->data;
+    
+    if (strcmp (binding->iter, symbol) == 0) {
+      if (! binding->is_static) {
+        return NULL;
+      }
+      break;
+    }
+  }
+  
+  return ctpl_environ_lookup (spec->env, symbol);
+}
+
+/* checks whether @expr only depends on static symbols */
+static gboolean
+specializer_expr_is_static (Specializer         *spec,
+                            const CtplTokenExpr *expr)
+{
+  gboolean      rv = TRUE;
+  const GSList *item;
+  
+  if (! expr) {
+    return TRUE;
+  }
+  switch (expr->type) {
+    case CTPL_TOKEN_EXPR_TYPE_OPERATOR:
+      rv = (specializer_expr_is_static (spec, expr->token.t_operator->loperand) &&
+            specializer_expr_is_static (spec, expr->token.t_operator->roperand));
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_SYMBOL:
+      rv = specializer_lookup (spec, expr->token.t_symbol) != NULL;
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_CALL:
+      /* functions only depend on their arguments */
+      for (item = expr->token.t_call->args; rv && item; item = item->next) {
+        rv = specializer_expr_is_static (spec, item->data);
+      }
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_VALUE:
+      break;
+  }
+  for (item = expr->indexes; rv && item; item = item->next) {
+    rv = specializer_expr_is_static (spec, item->data);
+  }
+  
+  return rv;
+}
+
+/* evaluates @expr if it only depends on static symbols, filling @value.
+ * Returns: whether @value was filled */
+static gboolean
+specializer_eval_static (Specializer         *spec,
+                         const CtplTokenExpr *expr,
+                         CtplValue           *value)
+{
+  return (specializer_expr_is_static (spec, expr) &&
+          ctpl_eval_value (expr, spec->env, value, NULL));
+}
+
+/* creates a copy of @expr in which the static parts are replaced by their
+ * values. The parts that fail to evaluate are kept for the error to be
+ * reported when rendering */
+static CtplTokenExpr *
+specializer_expr (Specializer         *spec,
+                  const CtplTokenExpr *expr)
+{
+  CtplTokenExpr  *result = NULL;
+  CtplValue       value;
+  const GSList   *item;
+  
+  if (! expr) {
+    return NULL;
+  }
+  ctpl_value_init (&value);
+  if (specializer_eval_static (spec, expr, &value)) {
+    result = ctpl_token_expr_new_value (&value);
+  } else {
+    switch (expr->type) {
+      case CTPL_TOKEN_EXPR_TYPE_OPERATOR: {
+        const CtplTokenExprOperator *op = expr->token.t_operator;
+        
+        result = ctpl_token_expr_new_operator (op->operator,
+                                               specializer_expr (spec,
+                                                                 op->loperand),
+                                               specializer_expr (spec,
+                                                                 op->roperand));
+        break;
+      }
+      
+      case CTPL_TOKEN_EXPR_TYPE_SYMBOL: {
+        const CtplValue *symbol_value;
+        
+        symbol_value = specializer_lookup (spec, expr->token.t_symbol);
+        if (symbol_value) {
+          result = ctpl_token_expr_new_value (symbol_value);
+        } else {
+          result = ctpl_token_expr_new_symbol (expr->token.t_symbol, -1);
+        }
+        break;
+      }
+      
+      case CTPL_TOKEN_EXPR_TYPE_CALL: {
+        GSList *args = NULL;
+        
+        for (item = expr->token.t_call->args; item; item = item->next) {
+          args = g_slist_prepend (args, specializer_expr (spec, item->data));
+        }
+        result = ctpl_token_expr_new_call (expr->token.t_call->name, -1,
+                                           g_slist_reverse (args));
+        break;
+      }
+      
+      case CTPL_TOKEN_EXPR_TYPE_VALUE:
+        result = ctpl_token_expr_new_value (&expr->token.t_value);
+        break;
+    }
+    for (item = expr->indexes; item; item = item->next) {
+      result->indexes = g_slist_prepend (result->indexes,
+                                         specializer_expr (spec, item->data));
+    }
+    result->indexes = g_slist_reverse (result->indexes);
+  }
+  ctpl_value_free_value (&value);
+  
+  return result;
+}
+
+/* appends @token to the residual tree */
+static void
+residual_append (Residual  *residual,
+                 CtplToken *token)
+{
+  if (! residual->root) {
+    residual->root = token;
+  } else {
+    ctpl_token_append (residual->root, token);
+  }
+}
+
+/* appends the pending data as a single data token */
+static void
+residual_flush_data (Residual *residual)
+{
+  if (residual->data_token) {
+    const CtplTokenData *data = residual->data_token->token.t_data;
+    
+    if (data->source) {
+      const gchar *base = g_bytes_get_data (data->source, NULL);
+      
+      residual_append (residual,
+                       ctpl_token_new_data_for_bytes (data->source,
+                                                      (gsize) (data->data - base),
+                                                      data->length,
+                                                      data->source_file));
+    } else {
+      residual_append (residual,
+                       ctpl_token_new_data (data->data,
+                                            (gssize) data->length));
+    }
+    residual->data_token = NULL;
+  } else if (residual->data->len > 0) {
+    residual_append (residual,
+                     ctpl_token_new_data (residual->data->str,
+                                          (gssize) residual->data->len));
+    g_string_truncate (residual->data, 0);
+  }
+}
+
+/* adds data to the residual tree, from @token if it is not %NULL */
+static void
+residual_add_data (Residual        *residual,
+                   const CtplToken *token,
+                   const gchar     *data,
+                   gsize            length)
+{
+  if (token && ! residual->data_token && residual->data->len == 0) {
+    /* keep the token as is if it is not merged with other data, so that it
+     * still references its source */
+    residual->data_token = token;
+  } else {
+    if (residual->data_token) {
+      const CtplTokenData *pending = residual->data_token->token.t_data;
+      
+      g_string_append_len (residual->data, pending->data,
+                           (gssize) pending->length);
+      residual->data_token = NULL;
+    }
+    g_string_append_len (residual->data, data, (gssize) length);
+  }
+}
+
+/* adds a token that is not data to the residual tree */
+static void
+residual_add (Residual  *residual,
+              CtplToken *token)
+{
+  residual_flush_data (residual);
+  residual_append (residual, token);
+}
+
+/* adds the tokens of @tree to the residual tree, merging its data with the
+ * surrounding one. This takes ownership of @tree */
+static void
+residual_splice (Residual  *residual,
+                 CtplToken *tree)
+{
+  while (tree) {
+    CtplToken *next = tree->next;
+    
+    tree->next = NULL;
+    tree->last = NULL;
+    if (ctpl_token_get_type (tree) == CTPL_TOKEN_TYPE_DATA) {
+      residual_add_data (residual, NULL, tree->token.t_data->data,
+                         tree->token.t_data->length);
+      ctpl_token_free (tree);
+    } else {
+      residual_add (residual, tree);
+    }
+    tree = next;
+  }
+}
+
+static CtplToken *specializer_tree (Specializer     *spec,
+                                    const CtplToken *tree);
+
+/* specializes an expression token */
+static void
+specializer_token_expr (Specializer     *spec,
+                        const CtplToken *token,
+                        Residual        *residual)
+{
+  gboolean done = FALSE;
+  
+  if (token->escape != CTPL_ESCAPE_INHERIT) {
+    /* the output doesn't matter, so the value can be written as data */
+    if (specializer_expr_is_static (spec, token->token.t_expr)) {
+      GString          *string = g_string_new (NULL);
+      CtplOutputStream *output = ctpl_output_stream_new_for_gstring (string);
+      
+      if (ctpl_parser_parse_token_expr (token->token.t_expr, token->escape,
+                                        spec->env, output, NULL)) {
+        residual_add_data (residual, NULL, string->str, string->len);
+        done = TRUE;
+      }
+      ctpl_output_stream_unref (output);
+      g_string_free (string, TRUE);
+    }
+  }
+  if (! done) {
+    residual_add (residual,
+                  ctpl_token_new_expr (specializer_expr (spec,
+                                                         token->token.t_expr),
+                                       token->escape));
+  }
+}
+
+/* specializes a `for` token, unrolling it if the array is static */
+static void
+specializer_token_for (Specializer        *spec,
+                       const CtplTokenFor *token,
+                       Residual           *residual)
+{
+  SpecializeBinding binding;
+  GSList            link;
+  CtplValue         value;
+  
+  ctpl_value_init (&value);
+  /* the array expression is not in the scope of the iterator, so it is checked
+   * before binding it */
+  binding.iter = token->iter;
+  binding.is_static = (specializer_eval_static (spec, token->array, &value) &&
+                       CTPL_VALUE_HOLDS_ARRAY (&value));
+  link.data = &binding;
+  link.next = spec->bindings;
+  spec->bindings = &link;
+  
+  if (binding.is_static) {
+    const GSList *item;
+    
+    for (item = ctpl_value_get_array (&value); item; item = item->next) {
+      CtplToken *children;
+      
+      ctpl_environ_push (spec->env, token->iter, item->data);
+      children = specializer_tree (spec, token->children);
+      ctpl_environ_pop (spec->env, token->iter, NULL);
+      residual_splice (residual, children);
+    }
+  } else {
+    CtplTokenExpr *array;
+    
+    spec->bindings = link.next;
+    array = specializer_expr (spec, token->array);
+    spec->bindings = &link;
+    residual_add (residual,
+                  ctpl_token_new_for (array, token->iter,
+                                      specializer_tree (spec,
+                                                        token->children)));
+  }
+  ctpl_value_free_value (&value);
+  
+  spec->bindings = link.next;
+}
+
+/* specializes an `if` token, keeping only the taken branch if the condition is
+ * static */
+static void
+specializer_token_if (Specializer       *spec,
+                      const CtplTokenIf *token,
+                      Residual          *residual)
+{
+  gboolean eval;
+  
+  if (specializer_expr_is_static (spec, token->condition) &&
+      ctpl_eval_bool (token->condition, spec->env, &eval, NULL)) {
+    residual_splice (residual,
+                     specializer_tree (spec, eval ? token->if_children
+                                                  : token->else_children));
+  } else {
+    residual_add (residual,
+                  ctpl_token_new_if (specializer_expr (spec, token->condition),
+                                     specializer_tree (spec,
+                                                       token->if_children),
+                                     specializer_tree (spec,
+                                                       token->else_children)));
+  }
+}
+
+/* specializes a `cache` token. The new block only depends on the dynamic
+ * symbols, and isn't kept at all if its content became data */
+static void
+specializer_token_cache (Specializer          *spec,
+                         const CtplTokenCache *token,
+                         Residual             *residual)
+{
+  CtplToken *children;
+  
+  children = specializer_tree (spec, token->children);
+  if (! children || (! children->next &&
+                     ctpl_token_get_type (children) == CTPL_TOKEN_TYPE_DATA)) {
+    residual_splice (residual, children);
+  } else {
+    residual_add (residual, ctpl_token_new_cache (children));
+  }
+}
+
+/* specializes the token list @tree.
+ * Returns: the residual tree */
+static CtplToken *
+specializer_tree (Specializer     *spec,
+                  const CtplToken *tree)
+{
+  Residual residual;
+  
+  residual.root = NULL;
+  residual.data_token = NULL;
+  residual.data = g_string_new (NULL);
+  for (; tree; tree = tree->next) {
+    switch (ctpl_token_get_type (tree)) {
+      case CTPL_TOKEN_TYPE_DATA:
+        residual_add_data (&residual, tree, tree->token.t_data->data,
+                           tree->token.t_data->length);
+        break;
+      
+      case CTPL_TOKEN_TYPE_EXPR:
+        specializer_token_expr (spec, tree, &residual);
+        break;
+      
+      case CTPL_TOKEN_TYPE_FOR:
+        specializer_token_for (spec, tree->token.t_for, &residual);
+        break;
+      
+      case CTPL_TOKEN_TYPE_IF:
+        specializer_token_if (spec, tree->token.t_if, &residual);
+        break;
+      
+      case CTPL_TOKEN_TYPE_CACHE:
+        specializer_token_cache (spec, tree->token.t_cache, &residual);
+        break;
+    }
+  }
+  residual_flush_data (&residual);
+  g_string_free (residual.data, TRUE);
+  
+  return residual.root;
+}
+
+/**
+ * ctpl_token_specialize:
+ * @tree: A #CtplToken tree
+ * @static_env: A #CtplEnviron holding the symbols whose values never change
+ * 
+ * Partially evaluates @tree against @static_env, producing a residual tree
+ * that only depends on the other symbols.
+ * Expressions only referencing symbols of @static_env are replaced by their
+ * values, <code>if</code> statements with such conditions are replaced by the
+ * taken branch, and <code>for</code> loops over such arrays are unrolled.
+ * Data resulting from these is merged with the surrounding one, so a tree only
+ * depending on @static_env becomes a single data token.
+ * Function calls are considered to only depend on their arguments (see
+ * ctpl_function_register()).
+ * 
+ * Rendering the residual tree with an environ holding the symbols of
+ * @static_env and some others gives the same output as rendering @tree, as
+ * long as the values of the symbols of @static_env don't change.
+ * Parts that fail to evaluate are kept in the residual tree, so the errors
+ * are reported when rendering it.
+ * 
+ * Returns: The residual tree, that should be freed with ctpl_token_free() when
+ *          no longer needed. It is %NULL if it doesn't output anything.
+ * 
+ * Since: 0.4
+ */
+CtplToken *
+ctpl_token_specialize (const CtplToken *tree,
+                       CtplEnviron     *static_env)
+{
+  Specializer spec;
+  CtplToken  *residual;
+  
+  g_return_val_if_fail (static_env != NULL, NULL);
+  
+  /* unrolled iterators are pushed to a child not to modify @static_env */
+  spec.env = ctpl_environ_new_child (static_env);
+  spec.bindings = NULL;
+  residual = specializer_tree (&spec, tree);
+  ctpl_environ_unref (spec.env);
+  
+  return residual;
+}
@@ -53,6 +53,8 @@ token_new (void)
   
   token = g_slice_alloc (sizeof *token);
   if (token) {
+    token->size_hint = 0;
+    token->escape = CTPL_ESCAPE_INHERIT;
     token->next = NULL;
     token->last = NULL;
   }
@@ -78,8 +80,61 @@ ctpl_token_new_data (const char *data,
   
   token = token_new ();
   if (token) {
+    gsize           length = GET_LEN (data, len);
+    CtplTokenData  *tdata;
+    gchar          *copy;
+    
+    /* allocate the copy together with the structure */
+    tdata = g_malloc (sizeof *tdata + length + 1);
+    copy = (gchar *) (tdata + 1);
+    memcpy (copy, data, length);
+    copy[length] = 0;
+    tdata->data = copy;
+    tdata->length = length;
+    tdata->source = NULL;
+    tdata->source_file = NULL;
     token->type = CTPL_TOKEN_TYPE_DATA;
-    token->token.t_data = g_strndup (data, GET_LEN (data, len));
+    token->token.t_data = tdata;
+  }
+  
+  return token;
+}
+
+/*
+ * ctpl_token_new_data_for_bytes:
+ * @bytes: A #GBytes holding the data
+ * @offset: Offset of the data in @bytes
+ * @length: Length of the data
+ * @file: The file @bytes maps, or %NULL. It must remain valid as long as
+ *        @bytes is alive
+ * 
+ * Creates a new token holding raw data referencing a span of @bytes rather
+ * than a copy of it. This adds a reference to @bytes.
+ * 
+ * Returns: A new #CtplToken that should be freed with ctpl_token_free() when no
+ *          longer needed.
+ */
+CtplToken *
+ctpl_token_new_data_for_bytes (GBytes               *bytes,
+                               gsize                 offset,
+                               gsize                 length,
+                               const CtplSourceFile *file)
+{
+  CtplToken *token;
+  
+  g_return_val_if_fail (offset + length <= g_bytes_get_size (bytes), NULL);
+  
+  token = token_new ();
+  if (token) {
+    CtplTokenData *tdata;
+    
+    tdata = g_slice_alloc (sizeof *tdata);
+    tdata->data = (const gchar *) g_bytes_get_data (bytes, NULL) + offset;
+    tdata->length = length;
+    tdata->source = g_bytes_ref (bytes);
+    tdata->source_file = file;
+    token->type = CTPL_TOKEN_TYPE_DATA;
+    token->token.t_data = tdata;
   }
   
   return token;
@@ -88,6 +143,8 @@ ctpl_token_new_data (const char *data,
 /*
  * ctpl_token_new_expr:
  * @expr: The expression
+ * @escape: The #CtplEscapeMode of the expression's value, or
+ *          %CTPL_ESCAPE_INHERIT to use the output's one
  * 
  * Creates a new token holding an expression.
  * Such tokens are used to represent any expression that will be simply
@@ -98,13 +155,15 @@ ctpl_token_new_data (const char *data,
  *          longer needed.
  */
 CtplToken *
-ctpl_token_new_expr (CtplTokenExpr *expr)
+ctpl_token_new_expr (CtplTokenExpr *expr,
+                     gint           escape)
 {
   CtplToken  *token;
   
   token = token_new ();
   if (token) {
     token->type = CTPL_TOKEN_TYPE_EXPR;
+    token->escape = escape;
     token->token.t_expr = expr;
   }
   
@@ -175,6 +234,175 @@ ctpl_token_new_if (CtplTokenExpr *condition,
   return token;
 }
 
+/* adds @symbol to @symbols if it isn't already there nor in @bound */
+static void
+token_add_symbol (const gchar  *symbol,
+                  const GSList *bound,
+                  GPtrArray    *symbols)
+{
+  guint i;
+  
+  for (; bound; bound = bound->next) {
+    if (strcmp (bound->data, symbol) == 0) {
+      return;
+    }
+  }
+  for (i = 0; i < symbols->len; i++) {
+    if (strcmp (g_ptr_array_index (symbols, i), symbol) == 0) {
+      return;
+    }
+  }
+  g_ptr_array_add (symbols, g_strdup (symbol));
+}
+
+/* adds the symbols @expr references to @symbols, but those in @bound */
+static void
+token_expr_collect_symbols (const CtplTokenExpr *expr,
+                            const GSList        *bound,
+                            GPtrArray           *symbols)
+{
+  const GSList *item;
+  
+  if (! expr) {
+    return;
+  }
+  switch (expr->type) {
+    case CTPL_TOKEN_EXPR_TYPE_OPERATOR:
+      token_expr_collect_symbols (expr->token.t_operator->loperand, bound,
+                                  symbols);
+      token_expr_collect_symbols (expr->token.t_operator->roperand, bound,
+                                  symbols);
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_SYMBOL:
+      token_add_symbol (expr->token.t_symbol, bound, symbols);
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_CALL:
+      for (item = expr->token.t_call->args; item; item = item->next) {
+        token_expr_collect_symbols (item->data, bound, symbols);
+      }
+      break;
+    
+    case CTPL_TOKEN_EXPR_TYPE_VALUE:
+      break;
+  }
+  for (item = expr->indexes; item; item = item->next) {
+    token_expr_collect_symbols (item->data, bound, symbols);
+  }
+}
+
+static void token_collect_symbols (const CtplToken *tree,
+                                   const GSList    *bound,
+                                   GPtrArray       *symbols);
+
+/* adds the symbols @token references to @symbols, but those in @bound, which
+ * are the iterators of the loops enclosing @token. The tokens following
+ * @token are ignored */
+static void
+token_collect_symbols_1 (const CtplToken *token,
+                         const GSList    *bound,
+                         GPtrArray       *symbols)
+{
+  switch (token->type) {
+    case CTPL_TOKEN_TYPE_DATA:
+      break;
+    
+    case CTPL_TOKEN_TYPE_EXPR:
+      token_expr_collect_symbols (token->token.t_expr, bound, symbols);
+      break;
+    
+    case CTPL_TOKEN_TYPE_FOR: {
+      GSList iter;
+      
+      token_expr_collect_symbols (token->token.t_for->array, bound, symbols);
+      iter.data = token->token.t_for->iter;
+      iter.next = (GSList *) bound;
+      token_collect_symbols (token->token.t_for->children, &iter, symbols);
+      break;
+    }
+    
+    case CTPL_TOKEN_TYPE_IF:
+      token_expr_collect_symbols (token->token.t_if->condition, bound,
+                                  symbols);
+      token_collect_symbols (token->token.t_if->if_children, bound, symbols);
+      token_collect_symbols (token->token.t_if->else_children, bound,
+                             symbols);
+      break;
+    
+    case CTPL_TOKEN_TYPE_CACHE:
+      token_collect_symbols (token->token.t_cache->children, bound, symbols);
+      break;
+  }
+}
+
+/* adds the symbols @tree references to @symbols, but those in @bound, which
+ * are the iterators of the loops enclosing @tree */
+static void
+token_collect_symbols (const CtplToken *tree,
+                       const GSList    *bound,
+                       GPtrArray       *symbols)
+{
+  for (; tree; tree = tree->next) {
+    token_collect_symbols_1 (tree, bound, symbols);
+  }
+}
+
+/*
+ * ctpl_token_get_symbols:
+ * @token: A #CtplToken
+ * 
+ * Gets the symbols the output of @token depends on, not including the tokens
+ * following it nor the iterators of the loops it contains.
+ * 
+ * Returns: (array zero-terminated=1) (transfer full): A %NULL-terminated array
+ *          of symbol names, that should be freed with g_strfreev().
+ */
+gchar **
+ctpl_token_get_symbols (const CtplToken *token)
+{
+  GPtrArray *symbols = g_ptr_array_new ();
+  
+  token_collect_symbols_1 (token, NULL, symbols);
+  g_ptr_array_add (symbols, NULL);
+  
+  return (gchar **) g_ptr_array_free (symbols, FALSE);
+}
+
+/*
+ * ctpl_token_new_cache:
+ * @children: Sub-tree whose output can be cached
+ * 
+ * Creates a new token holding a cache statement.
+ * The symbols the output of @children depends on are collected from it, so it
+ * must not be modified afterwards.
+ * 
+ * Returns: A new #CtplToken that should be freed with ctpl_token_free() when no
+ *          longer needed.
+ */
+CtplToken *
+ctpl_token_new_cache (CtplToken *children)
+{
+  static gsize  next_id = 0;
+  CtplToken    *token;
+  
+  token = token_new ();
+  if (token) {
+    GPtrArray *symbols = g_ptr_array_new ();
+    
+    token_collect_symbols (children, NULL, symbols);
+    g_ptr_array_add (symbols, NULL);
+    token->type = CTPL_TOKEN_TYPE_CACHE;
+    token->token.t_cache = g_slice_alloc (sizeof *token->token.t_cache);
+    token->token.t_cache->id = (gsize) g_atomic_pointer_add (&next_id, 1);
+    token->token.t_cache->symbols = (gchar **) g_ptr_array_free (symbols,
+                                                                 FALSE);
+    token->token.t_cache->children = children;
+  }
+  
+  return token;
+}
+
 /* allocates a #CtplTokenExpr */
 static CtplTokenExpr *
 ctpl_token_expr_new (void)
@@ -269,6 +497,37 @@ ctpl_token_expr_new_symbol (const char *symbol,
   return token;
 }
 
+/*
+ * ctpl_token_expr_new_call:
+ * @name: String holding the name of the function to call
+ * @len: Length to read from @name or -1 to read the whole string.
+ * @args: (element-type CtplTokenExpr) (transfer full): The arguments of the
+ *        call
+ * 
+ * Creates a new #CtplTokenExpr holding a function call.
+ * 
+ * Returns: A new #CtplTokenExpr that should be freed with
+ *          ctpl_token_expr_free() when no longer needed.
+ */
+CtplTokenExpr *
+ctpl_token_expr_new_call (const gchar *name,
+                          gssize       len,
+                          GSList      *args)
+{
+  CtplTokenExpr *token;
+  
+  token = ctpl_token_expr_new ();
+  if (token) {
+    token->type                 = CTPL_TOKEN_EXPR_TYPE_CALL;
+    token->token.t_call         = g_slice_alloc (sizeof *token->token.t_call);
+    token->token.t_call->name   = g_strndup (name, GET_LEN (name, len));
+    token->token.t_call->args   = args;
+    token->token.t_call->n_args = g_slist_length (args);
+  }
+  
+  return token;
+}
+
 
 /*
  * ctpl_token_expr_free_full:
@@ -296,6 +555,14 @@ ctpl_token_expr_free_full (CtplTokenExpr *token,
         g_free (token->token.t_symbol);
         break;
       
+      case CTPL_TOKEN_EXPR_TYPE_CALL:
+        /* like indexes, arguments are always owned by the call */
+        g_slist_free_full (token->token.t_call->args,
+                           (GDestroyNotify) ctpl_token_expr_free);
+        g_free (token->token.t_call->name);
+        g_slice_free1 (sizeof *token->token.t_call, token->token.t_call);
+        break;
+      
       case CTPL_TOKEN_EXPR_TYPE_VALUE:
         ctpl_value_free_value (&token->token.t_value);
         break;
@@ -337,7 +604,12 @@ ctpl_token_free (CtplToken *token)
     
     switch (token->type) {
       case CTPL_TOKEN_TYPE_DATA:
-        g_free (token->token.t_data);
+        if (token->token.t_data->source) {
+          g_bytes_unref (token->token.t_data->source);
+          g_slice_free1 (sizeof *token->token.t_data, token->token.t_data);
+        } else {
+          g_free (token->token.t_data);
+        }
         break;
       
       case CTPL_TOKEN_TYPE_EXPR:
@@ -361,6 +633,12 @@ ctpl_token_free (CtplToken *token)
         
         g_slice_free1 (sizeof *token->token.t_if, token->token.t_if);
         break;
+      
+      case CTPL_TOKEN_TYPE_CACHE:
+        g_strfreev (token->token.t_cache->symbols);
+        ctpl_token_free (token->token.t_cache->children);
+        g_slice_free1 (sizeof *token->token.t_cache, token->token.t_cache);
+        break;
     }
     next = token->next;
     g_slice_free1 (sizeof *token, token);
@@ -451,6 +729,17 @@ ctpl_token_expr_dump_internal (const CtplTokenExpr *expr)
       case CTPL_TOKEN_EXPR_TYPE_SYMBOL:
         g_print ("%s", expr->token.t_symbol);
         break;
+      
+      case CTPL_TOKEN_EXPR_TYPE_CALL: {
+        const GSList *arg;
+        
+        g_print ("%s", expr->token.t_call->name);
+        for (arg = expr->token.t_call->args; arg; arg = arg->next) {
+          g_print (arg == expr->token.t_call->args ? " " : ", ");
+          ctpl_token_expr_dump_internal (arg->data);
+        }
+        break;
+      }
     }
   }
   g_print (")");
@@ -471,12 +760,16 @@ ctpl_token_dump_internal (const CtplToken *token,
   } else {
     switch (token->type) {
       case CTPL_TOKEN_TYPE_DATA:
-        g_print ("data: '%s'\n", token->token.t_data);
+        g_print ("data: '%.*s'\n", (gint) token->token.t_data->length,
+                 token->token.t_data->data);
         break;
       
       case CTPL_TOKEN_TYPE_EXPR:
         g_print ("expr: ");
         ctpl_token_expr_dump_internal (token->token.t_expr);
+        if (token->escape != CTPL_ESCAPE_INHERIT) {
+          g_print (" | %s", ctpl_escape_mode_to_string (token->escape));
+        }
         g_print ("\n");
         break;
       
@@ -507,6 +800,19 @@ ctpl_token_dump_internal (const CtplToken *token,
                                     TRUE, depth + 1);
         }
         break;
+      
+      case CTPL_TOKEN_TYPE_CACHE: {
+        gchar *symbols;
+        
+        symbols = g_strjoinv (", ", token->token.t_cache->symbols);
+        g_print ("cache: depends on '%s'\n", symbols);
+        g_free (symbols);
+        if (token->token.t_cache->children) {
+          ctpl_token_dump_internal (token->token.t_cache->children,
+                                    TRUE, depth + 1);
+        }
+        break;
+      }
     }
     if (chain && token->next) {
       ctpl_token_dump_internal (token->next, chain, depth);
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include <locale.h>
 #include <unistd.h> /* for STDOUT_FILENO */
 #include <glib.h>
@@ -50,6 +51,16 @@ static gchar       *OPT_output_file   = NULL;
 static gboolean     OPT_verbose       = FALSE;
 static gboolean     OPT_print_version = FALSE;
 static gchar       *OPT_encoding      = NULL;
+static gboolean     OPT_mmap_output   = FALSE;
+static gboolean     OPT_sync_output   = FALSE;
+static gchar       *OPT_compress      = NULL;
+static gchar       *OPT_escape        = NULL;
+static gint         OPT_parallel      = 0;
+static gboolean     OPT_compile       = FALSE;
+static gchar       *OPT_emit_c        = NULL;
+
+static CtplOutputCompression  output_compression = CTPL_OUTPUT_COMPRESSION_NONE;
+static CtplEscapeMode         output_escape      = CTPL_ESCAPE_NONE;
 
 static GOptionEntry option_entries[] = {
   { "output", 'o', 0, G_OPTION_ARG_FILENAME, &OPT_output_file,
@@ -67,6 +78,24 @@ static GOptionEntry option_entries[] = {
     N_("Print the version information and exit."), NULL },
   { "encoding", 0, 0, G_OPTION_ARG_STRING, &OPT_encoding,
     N_("Specify the encoding of the input and output files."), N_("ENCODING") },
+  { "mmap", 0, 0, G_OPTION_ARG_NONE, &OPT_mmap_output,
+    N_("Write the output file through a memory mapping."), NULL },
+  { "sync", 0, 0, G_OPTION_ARG_NONE, &OPT_sync_output,
+    N_("Synchronize the memory-mapped output file to disk when done."), NULL },
+  { "compress", 0, 0, G_OPTION_ARG_STRING, &OPT_compress,
+    N_("Compress the output with FORMAT, either gzip or zstd."), N_("FORMAT") },
+  { "escape", 0, 0, G_OPTION_ARG_STRING, &OPT_escape,
+    N_("Escape the values of expressions with MODE, one of none, html, url, "
+       "json or shell."), N_("MODE") },
+  { "parallel-loops", 0, 0, G_OPTION_ARG_INT, &OPT_parallel,
+    N_("Render loops of at least N iterations on several threads."),
+    N_("N") },
+  { "compile", 0, 0, G_OPTION_ARG_NONE, &OPT_compile,
+    N_("Write the compiled form of the input template instead of rendering "
+       "it."), NULL },
+  { "emit-c", 0, 0, G_OPTION_ARG_STRING, &OPT_emit_c,
+    N_("Write a C function named NAME rendering the input template instead of "
+       "rendering it."), N_("NAME") },
   { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &OPT_input_files,
     N_("Input files"), N_("INPUTFILE[...]") },
   { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
@@ -152,7 +181,26 @@ parse_options (gint    *argc,
     } else if (OPT_input_files == NULL) {
       g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
                    _("Missing input file(s)"));
+    } else if ((OPT_compile || OPT_emit_c) && OPT_input_files[1] != NULL) {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Only one template can be compiled at a time"));
+    } else if (OPT_compile && OPT_emit_c) {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Options --compile and --emit-c cannot be used together"));
+    } else if (OPT_compress && strcmp (OPT_compress, "gzip") != 0 &&
+               strcmp (OPT_compress, "zstd") != 0) {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Unknown compression format '%s'"), OPT_compress);
+    } else if (OPT_escape &&
+               ! ctpl_escape_mode_from_string (OPT_escape, &output_escape)) {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Unknown escape mode '%s'"), OPT_escape);
     } else {
+      if (OPT_compress) {
+        output_compression = (strcmp (OPT_compress, "gzip") == 0
+                              ? CTPL_OUTPUT_COMPRESSION_GZIP
+                              : CTPL_OUTPUT_COMPRESSION_ZSTD);
+      }
       if (! OPT_encoding) {
         const gchar *local_charset;
         
@@ -161,7 +209,19 @@ parse_options (gint    *argc,
         g_get_charset (&local_charset);
         OPT_encoding = g_strdup (local_charset);
       }
-      success = TRUE;
+      if (output_compression == CTPL_OUTPUT_COMPRESSION_ZSTD &&
+          encoding_needs_conversion (OPT_encoding)) {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     _("Zstandard compression cannot be used together with "
+                       "an encoding conversion"));
+      } else if ((OPT_compile || OPT_emit_c) &&
+                 encoding_needs_conversion (OPT_encoding)) {
+        g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     _("Templates cannot be compiled together with an "
+                       "encoding conversion"));
+      } else {
+        success = TRUE;
+      }
     }
   }
   g_option_context_free (context);
@@ -169,6 +229,21 @@ parse_options (gint    *argc,
   return success;
 }
 
+/* wraps @stream in a GConverterInputStream for @converter, taking ownership of
+ * both */
+static GInputStream *
+wrap_input_stream (GInputStream *stream,
+                   GConverter   *converter)
+{
+  GInputStream *wrapped;
+  
+  wrapped = g_converter_input_stream_new (stream, converter);
+  g_object_unref (stream);
+  g_object_unref (converter);
+  
+  return wrapped;
+}
+
 /* Creates a CtplInputStream from a command-line argument */
 static CtplInputStream *
 open_input_stream (const gchar *arg,
@@ -177,14 +252,31 @@ open_input_stream (const gchar *arg,
   GFile            *file;
   CtplInputStream  *stream = NULL;
   GInputStream     *gstream = NULL;
-  GFileInputStream *gfstream;
+  gboolean          gzipped;
   
   file = g_file_new_for_commandline_arg (arg);
-  gfstream = g_file_read (file, NULL, error);
-  if (gfstream) {
-    gstream = G_INPUT_STREAM (gfstream);
+  gzipped = g_str_has_suffix (arg, ".gz");
+  if (! gzipped && ! encoding_needs_conversion (OPT_encoding)) {
+    gchar *path = g_file_get_path (file);
     
-    if (encoding_needs_conversion (OPT_encoding)) {
+    /* maps local regular files, which allows to send their data without
+     * copying, and reads the others */
+    if (path) {
+      stream = ctpl_input_stream_new_for_mapped_path (path, NULL);
+      g_free (path);
+    }
+    if (! stream) {
+      stream = ctpl_input_stream_new_for_gfile (file, error);
+    }
+  } else {
+    gstream = G_INPUT_STREAM (g_file_read (file, NULL, error));
+    if (gstream && gzipped) {
+      GZlibDecompressor *decompressor;
+      
+      decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+      gstream = wrap_input_stream (gstream, G_CONVERTER (decompressor));
+    }
+    if (gstream && encoding_needs_conversion (OPT_encoding)) {
       GCharsetConverter *converter;
       
       converter = g_charset_converter_new ("utf8", OPT_encoding, error);
@@ -192,13 +284,7 @@ open_input_stream (const gchar *arg,
         g_object_unref (gstream);
         gstream = NULL;
       } else {
-        GInputStream *gcstream;
-        
-        gcstream = g_converter_input_stream_new (G_INPUT_STREAM (gstream),
-                                                 G_CONVERTER (converter));
-        g_object_unref (gstream);
-        gstream = gcstream;
-        g_object_unref (converter);
+        gstream = wrap_input_stream (gstream, G_CONVERTER (converter));
       }
     }
   }
@@ -291,14 +377,65 @@ parse_template (const gchar      *filename,
   
   stream = open_input_stream (filename, error);
   if (stream) {
-    CtplToken *tree;
+    CtplTemplate *tmpl;
+    
+    /* compiled templates are loaded transparently */
+    tmpl = ctpl_template_load (stream, error);
+    ctpl_input_stream_unref (stream);
+    if (tmpl) {
+      rv = ctpl_parser_parse (ctpl_template_get_tree (tmpl), env, output,
+                              error);
+      ctpl_template_unref (tmpl);
+    }
+  }
+  
+  return rv;
+}
+
+/* writes the compiled form of a template from a file */
+static gboolean
+compile_template (const gchar      *filename,
+                  CtplOutputStream *output,
+                  GError          **error)
+{
+  gboolean          rv = FALSE;
+  CtplInputStream  *stream;
+  
+  stream = open_input_stream (filename, error);
+  if (stream) {
+    CtplTemplate *tmpl;
     
-    tree = ctpl_lexer_lex (stream, error);
+    tmpl = ctpl_template_load (stream, error);
     ctpl_input_stream_unref (stream);
-    if (tree) {
-      rv = ctpl_parser_parse (tree, env, output, error);
+    if (tmpl) {
+      rv = ctpl_template_save (tmpl, output, error);
+      ctpl_template_unref (tmpl);
+    }
+  }
+  
+  return rv;
+}
+
+/* writes a C function rendering a template from a file */
+static gboolean
+emit_c_template (const gchar      *filename,
+                 CtplOutputStream *output,
+                 GError          **error)
+{
+  gboolean          rv = FALSE;
+  CtplInputStream  *stream;
+  
+  stream = open_input_stream (filename, error);
+  if (stream) {
+    CtplTemplate *tmpl;
+    
+    tmpl = ctpl_template_load (stream, error);
+    ctpl_input_stream_unref (stream);
+    if (tmpl) {
+      rv = ctpl_codegen_emit_c (ctpl_template_get_tree (tmpl), OPT_emit_c,
+                                output, error);
+      ctpl_template_unref (tmpl);
     }
-    ctpl_token_free (tree);
   }
   
   return rv;
@@ -317,12 +454,30 @@ parse_templates (CtplEnviron       *env,
     for (i = 0; success && OPT_input_files[i] != NULL; i++) {
       GError *err = NULL;
       
-      printv (_("Parsing template '%s'...\n"), OPT_input_files[i]);
-      if (! parse_template (OPT_input_files[i], output, env, &err)) {
-        printerr (_("Failed to parse template '%s': %s\n"),
-                  OPT_input_files[i], err->message);
-        g_error_free (err);
-        success = FALSE;
+      if (OPT_compile) {
+        printv (_("Compiling template '%s'...\n"), OPT_input_files[i]);
+        if (! compile_template (OPT_input_files[i], output, &err)) {
+          printerr (_("Failed to compile template '%s': %s\n"),
+                    OPT_input_files[i], err->message);
+          g_error_free (err);
+          success = FALSE;
+        }
+      } else if (OPT_emit_c) {
+        printv (_("Writing C code of template '%s'...\n"), OPT_input_files[i]);
+        if (! emit_c_template (OPT_input_files[i], output, &err)) {
+          printerr (_("Failed to write C code of template '%s': %s\n"),
+                    OPT_input_files[i], err->message);
+          g_error_free (err);
+          success = FALSE;
+        }
+      } else {
+        printv (_("Parsing template '%s'...\n"), OPT_input_files[i]);
+        if (! parse_template (OPT_input_files[i], output, env, &err)) {
+          printerr (_("Failed to parse template '%s': %s\n"),
+                    OPT_input_files[i], err->message);
+          g_error_free (err);
+          success = FALSE;
+        }
       }
     }
   }
@@ -340,15 +495,37 @@ get_output_stream (void)
     GFile              *file;
     GError             *err = NULL;
     GFileOutputStream  *gfostream;
+    gchar              *path = NULL;
     
     file = g_file_new_for_commandline_arg (OPT_output_file);
-    gfostream = g_file_replace (file, NULL, FALSE, 0, NULL, &err);
-    if (! gfostream) {
-      printerr (_("Failed to open output: %s\n"), err->message);
-      g_error_free (err);
+    if (OPT_mmap_output) {
+      path = g_file_get_path (file);
+      if (! path || encoding_needs_conversion (OPT_encoding) ||
+          output_compression != CTPL_OUTPUT_COMPRESSION_NONE) {
+        printv (_("Cannot map output '%s', writing it normally\n"),
+                OPT_output_file);
+        g_free (path);
+        path = NULL;
+      }
+    }
+    if (path) {
+      stream = ctpl_output_stream_new_for_mapped_path (path, OPT_sync_output,
+                                                       &err);
+      if (! stream) {
+        printerr (_("Failed to open output: %s\n"), err->message);
+        g_error_free (err);
+      }
     } else {
-      gostream = G_OUTPUT_STREAM (gfostream);
+      gfostream = g_file_replace (file, NULL, FALSE, 0, NULL, &err);
+      if (! gfostream) {
+        printerr (_("Failed to open output: %s\n"), err->message);
+        g_error_free (err);
+      } else {
+        gostream = G_OUTPUT_STREAM (gfostream);
+      }
     }
+    g_free (path);
+    g_object_unref (file);
   } else {
 #ifdef G_OS_WIN32
     HANDLE handle;
@@ -359,9 +536,24 @@ get_output_stream (void)
 #endif
   }
   if (gostream) {
-    if (encoding_needs_conversion (OPT_encoding)) {
+    gboolean  converting = encoding_needs_conversion (OPT_encoding);
+    GError   *err = NULL;
+    
+    if (converting && output_compression == CTPL_OUTPUT_COMPRESSION_GZIP) {
+      GZlibCompressor *compressor;
+      GOutputStream   *gzostream;
+      
+      /* the encoding conversion has to happen before compression, so we
+       * can't let the CtplOutputStream compress */
+      compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+      gzostream = g_converter_output_stream_new (gostream,
+                                                 G_CONVERTER (compressor));
+      g_object_unref (gostream);
+      gostream = gzostream;
+      g_object_unref (compressor);
+    }
+    if (converting) {
       GCharsetConverter *converter;
-      GError            *err = NULL;
       
       converter = g_charset_converter_new (OPT_encoding, "utf8", &err);
       if (! converter) {
@@ -379,6 +571,14 @@ get_output_stream (void)
     }
     stream = ctpl_output_stream_new (gostream);
     g_object_unref (gostream);
+    if (! converting &&
+        ! ctpl_output_stream_set_compression (stream, output_compression, -1,
+                                              &err)) {
+      printerr (_("Failed to setup output compression: %s\n"), err->message);
+      g_error_free (err);
+      ctpl_output_stream_unref (stream);
+      stream = NULL;
+    }
   }
   
   return stream;
@@ -431,9 +631,17 @@ int main (int     argc,
       CtplOutputStream *ostream = get_output_stream ();
       
       if (ostream) {
+        ctpl_output_stream_set_escape_mode (ostream, output_escape);
+        ctpl_output_stream_set_parallel_threshold (ostream,
+                                                   (guint) MAX (OPT_parallel, 0));
         if (parse_templates (env, ostream)) {
           err = 0;
         }
+        if (! ctpl_output_stream_close (ostream, &error)) {
+          printerr (_("Failed to close output: %s\n"), error->message);
+          g_clear_error (&error);
+          err = 1;
+        }
         ctpl_output_stream_unref (ostream);
       }
       ctpl_environ_unref (env);
@@ -22,11 +22,21 @@
 
 #define H_CTPL_H_INSIDE
 
+#include "ctpl-codegen.h"
 #include "ctpl-environ.h"
 #include "ctpl-eval.h"
+#include "ctpl-function.h"
 #include "ctpl-lexer-expr.h"
 #include "ctpl-lexer.h"
+#include "ctpl-incremental-lexer.h"
 #include "ctpl-parser.h"
+#include "ctpl-escape.h"
+#include "ctpl-render-iter.h"
+#include "ctpl-incremental-render.h"
+#include "ctpl-renderer.h"
+#include "ctpl-template.h"
+#include "ctpl-template-cache.h"
+#include "ctpl-fragment-cache.h"
 #include "ctpl-io.h"
 #include "ctpl-input-stream.h"
 #include "ctpl-output-stream.h"
@@ -0,0 +1,90 @@
+/* Checks for ctpl_parser_parse_batch() */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "../src/ctpl.h"
+
+
+/* adds the symbols of a batch record, failing for record 500 */
+static gboolean
+batch_record (guint         index,
+              CtplEnviron  *env,
+              gpointer      user_data,
+              GError      **error)
+{
+  if (index == 500) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "no record %u", index);
+    return FALSE;
+  }
+  ctpl_environ_push_int (env, "n", index);
+  
+  return TRUE;
+}
+
+/* stores the output of a batch record, marking failures with a "!" */
+static void
+batch_output (guint         index,
+              const gchar  *data,
+              gsize         length,
+              const GError *error,
+              gpointer      user_data)
+{
+  gchar **outputs = user_data;
+  
+  g_assert (outputs[index] == NULL);
+  outputs[index] = g_strdup_printf ("%s%.*s", error ? "!" : "", (gint) length,
+                                    data);
+}
+
+/* checks rendering a batch of records, some of which fail */
+static void
+check_batch (void)
+{
+  const gchar  *template = "{prefix}{n}{if n == 700}{missing}{end}.";
+  CtplEnviron  *env;
+  CtplToken    *tree;
+  gchar       **outputs;
+  guint         n_records = 1000;
+  guint         i;
+  
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "prefix = \"#\";", NULL));
+  tree = ctpl_lexer_lex_string (template, NULL);
+  g_assert (tree != NULL);
+  outputs = g_new0 (gchar *, n_records + 1);
+  g_assert_cmpuint (ctpl_parser_parse_batch (tree, env, n_records, batch_record,
+                                             batch_output, outputs), ==, 2);
+  for (i = 0; i < n_records; i++) {
+    gchar *expected;
+    
+    if (i == 500) {
+      expected = g_strdup ("!");
+    } else if (i == 700) {
+      expected = g_strdup ("!#700");
+    } else {
+      expected = g_strdup_printf ("#%u.", i);
+    }
+    g_assert_cmpstr (outputs[i], ==, expected);
+    g_free (expected);
+  }
+  /* records don't leak into the common environment */
+  g_assert (ctpl_environ_lookup (env, "n") == NULL);
+  
+  g_strfreev (outputs);
+  ctpl_token_free (tree);
+  ctpl_environ_unref (env);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_batch ();
+  
+  return 0;
+}
@@ -0,0 +1,101 @@
+/* Checks for ctpl_codegen_emit_c() */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "../src/ctpl.h"
+
+
+/* gets the data written so far to a GMemoryOutputStream */
+static gchar *
+get_memory_data (GOutputStream *ostream)
+{
+  GMemoryOutputStream *mstream = G_MEMORY_OUTPUT_STREAM (ostream);
+  gsize                size = g_memory_output_stream_get_data_size (mstream);
+  
+  return size > 0 ? g_strndup (g_memory_output_stream_get_data (mstream), size)
+                  : g_strdup ("");
+}
+
+/* checks writing templates as C code */
+static void
+check_codegen (void)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  CtplToken        *tree;
+  CtplEnviron      *env;
+  CtplValue         lvalue;
+  CtplValue         rvalue;
+  CtplValue         value;
+  GError           *err = NULL;
+  gchar            *code;
+  
+  /* the helpers the generated code calls */
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "items = [1, 2, 3];", NULL));
+  ctpl_value_init (&lvalue);
+  ctpl_value_init (&rvalue);
+  ctpl_value_init (&value);
+  g_assert (ctpl_eval_lookup (env, "items", &lvalue, NULL));
+  ctpl_value_set_int (&rvalue, 1);
+  g_assert (ctpl_eval_index_value (&lvalue, &rvalue, NULL));
+  g_assert_cmpint (ctpl_value_get_int (&lvalue), ==, 2);
+  ctpl_value_set_float (&rvalue, 0.5);
+  g_assert (ctpl_eval_operator_values (CTPL_OPERATOR_PLUS, &lvalue, &rvalue,
+                                       &value, NULL));
+  g_assert_cmpfloat (ctpl_value_get_float (&value), ==, 2.5);
+  g_assert (ctpl_eval_operator_values (CTPL_OPERATOR_INFEQ, &lvalue, &rvalue,
+                                       &value, NULL));
+  g_assert (! ctpl_eval_bool_value (&value));
+  g_assert (! ctpl_eval_index_value (&lvalue, &rvalue, &err));
+  g_assert_error (err, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND);
+  g_clear_error (&err);
+  g_assert (! ctpl_eval_lookup (env, "missing", &value, &err));
+  g_assert_error (err, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND);
+  g_clear_error (&err);
+  g_assert (! ctpl_parser_check_loop_array (&value, &err));
+  g_assert_error (err, CTPL_PARSER_ERROR,
+                  CTPL_PARSER_ERROR_INCOMPATIBLE_SYMBOL);
+  g_clear_error (&err);
+  ctpl_value_free_value (&value);
+  ctpl_value_free_value (&rvalue);
+  ctpl_value_free_value (&lvalue);
+  ctpl_environ_unref (env);
+  
+  /* the output of the generated code is checked by tests.sh */
+  tree = ctpl_lexer_lex_string ("{for i in items}[{i|html}]{end}"
+                                "{if items[1] > 1}\"yes\"{end}", NULL);
+  g_assert (tree != NULL);
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (ostream);
+  g_assert (ctpl_codegen_emit_c (tree, "render_items", stream, NULL));
+  g_assert (! ctpl_codegen_emit_c (tree, "2render", stream, &err));
+  g_assert_error (err, CTPL_CODEGEN_ERROR, CTPL_CODEGEN_ERROR_INVALID_NAME);
+  g_clear_error (&err);
+  g_assert (ctpl_output_stream_flush (stream, NULL));
+  code = get_memory_data (ostream);
+  g_assert (strstr (code, "gboolean\nrender_items (CtplEnviron") != NULL);
+  g_assert (strstr (code, "ctpl_eval_lookup (env, \"items\"") != NULL);
+  g_assert (strstr (code, "CTPL_ESCAPE_HTML") != NULL);
+  g_assert (strstr (code, "\"\\\"yes\\\"\"") != NULL);
+  g_assert (strstr (code, "2render") == NULL);
+  g_free (code);
+  ctpl_output_stream_unref (stream);
+  g_object_unref (ostream);
+  ctpl_token_free (tree);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_codegen ();
+  
+  return 0;
+}
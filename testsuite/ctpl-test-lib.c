@@ -11,6 +11,155 @@
 #include "ctpl-test-lib.h"
 
 
+/* renders @tree with @iter_size bytes chunks using CtplRenderIter */
+static gchar *
+render_with_iter (const CtplToken  *tree,
+                  CtplEnviron      *env,
+                  gsize             iter_size)
+{
+  CtplRenderIter *iter;
+  GString        *string;
+  gchar          *buf;
+  gssize          n;
+  
+  string = g_string_new (NULL);
+  buf = g_malloc (iter_size);
+  iter = ctpl_render_iter_new (tree, env);
+  while ((n = ctpl_render_iter_next (iter, buf, iter_size, NULL)) > 0) {
+    g_string_append_len (string, buf, n);
+  }
+  ctpl_render_iter_free (iter);
+  g_free (buf);
+  
+  return g_string_free (string, n < 0);
+}
+
+static void
+parse_async_ready (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  gboolean *done = user_data;
+  
+  done[0] = TRUE;
+  done[1] = ctpl_parser_parse_finish (result, NULL);
+}
+
+/* renders @tree using ctpl_parser_parse_async() */
+static gchar *
+render_async (const CtplToken  *tree,
+              CtplEnviron      *env)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  GMainContext     *context;
+  gboolean          done[2] = { FALSE, FALSE };
+  gchar            *output = NULL;
+  
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (ostream);
+  context = g_main_context_default ();
+  ctpl_parser_parse_async (tree, env, stream, G_PRIORITY_DEFAULT, NULL,
+                           parse_async_ready, done);
+  while (! done[0]) {
+    g_main_context_iteration (context, TRUE);
+  }
+  if (done[1]) {
+    GMemoryOutputStream *mstream = G_MEMORY_OUTPUT_STREAM (ostream);
+    
+    output = g_strndup (g_memory_output_stream_get_data (mstream),
+                        g_memory_output_stream_get_data_size (mstream));
+  }
+  ctpl_output_stream_unref (stream);
+  g_object_unref (ostream);
+  
+  return output;
+}
+
+/* renders @tree rendering all loops in parallel */
+static gchar *
+render_parallel (const CtplToken  *tree,
+                 CtplEnviron      *env)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  gchar            *output = NULL;
+  
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (ostream);
+  ctpl_output_stream_set_parallel_threshold (stream, 1);
+  if (ctpl_parser_parse (tree, env, stream, NULL)) {
+    GMemoryOutputStream *mstream = G_MEMORY_OUTPUT_STREAM (ostream);
+    
+    output = g_strndup (g_memory_output_stream_get_data (mstream),
+                        g_memory_output_stream_get_data_size (mstream));
+  }
+  ctpl_output_stream_unref (stream);
+  g_object_unref (ostream);
+  
+  return output;
+}
+
+/* checks the other ways of rendering @tree give @output, or fail if @output
+ * is %NULL */
+static void
+check_alternate_outputs (const CtplToken *tree,
+                         CtplEnviron     *env,
+                         const gchar     *output)
+{
+  const gsize iter_sizes[] = { 1, 7, 4096 };
+  guint       i;
+  
+  /* check the direct-to-memory output matches, twice to also check the one
+   * using the size hint from the previous render */
+  for (i = 0; i < 2; i++) {
+    gchar  *str_output;
+    gsize   str_length = 0;
+    
+    str_output = ctpl_parser_parse_to_string (tree, env, &str_length, NULL);
+    if (g_strcmp0 (str_output, output) != 0 ||
+        (output && str_length != strlen (output))) {
+      g_error ("Output to string differs from output to stream: "
+               "\"%s\" vs \"%s\"", str_output, output);
+    }
+    g_free (str_output);
+  }
+  /* and the pull-based one */
+  for (i = 0; i < G_N_ELEMENTS (iter_sizes); i++) {
+    gchar *iter_output;
+    
+    iter_output = render_with_iter (tree, env, iter_sizes[i]);
+    if (g_strcmp0 (iter_output, output) != 0) {
+      g_error ("Output of a %" G_GSIZE_FORMAT " bytes render iterator differs "
+               "from output to stream: \"%s\" vs \"%s\"",
+               iter_sizes[i], iter_output, output);
+    }
+    g_free (iter_output);
+  }
+  /* and the asynchronous one */
+  {
+    gchar *async_output;
+    
+    async_output = render_async (tree, env);
+    if (g_strcmp0 (async_output, output) != 0) {
+      g_error ("Output of asynchronous parsing differs from output to stream: "
+               "\"%s\" vs \"%s\"", async_output, output);
+    }
+    g_free (async_output);
+  }
+  /* and the one rendering loops in parallel */
+  {
+    gchar *parallel_output;
+    
+    parallel_output = render_parallel (tree, env);
+    if (g_strcmp0 (parallel_output, output) != 0) {
+      g_error ("Output of parallel loops differs from output to stream: "
+               "\"%s\" vs \"%s\"", parallel_output, output);
+    }
+    g_free (parallel_output);
+  }
+}
+
 /* parses a string with CTPL, returns the output, or %NULL on failure */
 gchar *
 ctpltest_parse_string (const gchar  *string,
@@ -45,7 +194,8 @@ ctpltest_parse_string (const gchar  *string,
         memcpy (output, p, size);
         output[size] = 0;
       }
-      g_object_unref (stream);
+      check_alternate_outputs (tree, env, output);
+      ctpl_output_stream_unref (stream);
       g_object_unref (ostream);
       ctpl_token_free (tree);
     }
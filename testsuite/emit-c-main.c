@@ -0,0 +1,58 @@
+
+/* Renders the function written by `ctpl --emit-c=ctpl_test_render` to stdout,
+ * with the environment read from the file given as argument.
+ * This is used by tests.sh to check the generated code renders templates like
+ * the parser does. */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <stdio.h>
+
+#include <ctpl/ctpl.h>
+
+
+gboolean  ctpl_test_render  (CtplEnviron       *env,
+                             CtplOutputStream  *output,
+                             GError           **error);
+
+
+int
+main (int     argc,
+      char  **argv)
+{
+  CtplEnviron      *env;
+  GOutputStream    *gostream;
+  CtplOutputStream *output;
+  GError           *err = NULL;
+  gboolean          success;
+  
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  if (argc != 2) {
+    fprintf (stderr, "USAGE: %s ENVIRONFILE\n", argv[0]);
+    return 2;
+  }
+  
+  env = ctpl_environ_new ();
+  gostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  output = ctpl_output_stream_new (gostream);
+  success = (ctpl_environ_add_from_path (env, argv[1], &err) &&
+             ctpl_test_render (env, output, &err) &&
+             ctpl_output_stream_flush (output, &err));
+  if (success) {
+    GMemoryOutputStream *mostream = G_MEMORY_OUTPUT_STREAM (gostream);
+    
+    fwrite (g_memory_output_stream_get_data (mostream), 1,
+            g_memory_output_stream_get_data_size (mostream), stdout);
+  } else {
+    fprintf (stderr, "%s\n", err->message);
+    g_error_free (err);
+  }
+  ctpl_output_stream_unref (output);
+  g_object_unref (gostream);
+  ctpl_environ_unref (env);
+  
+  return success ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/* Checks for CtplFragmentCache */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "../src/ctpl.h"
+
+
+/* gets the data written so far to a GMemoryOutputStream */
+static gchar *
+get_memory_data (GOutputStream *ostream)
+{
+  GMemoryOutputStream *mstream = G_MEMORY_OUTPUT_STREAM (ostream);
+  gsize                size = g_memory_output_stream_get_data_size (mstream);
+  
+  return size > 0 ? g_strndup (g_memory_output_stream_get_data (mstream), size)
+                  : g_strdup ("");
+}
+
+/* renders @tree to a string through an output using @cache */
+static gchar *
+render_cached (const CtplToken   *tree,
+               CtplEnviron       *env,
+               CtplFragmentCache *cache,
+               CtplEscapeMode     escape,
+               gboolean           success)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  gchar            *data;
+  
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (ostream);
+  ctpl_output_stream_set_fragment_cache (stream, cache);
+  ctpl_output_stream_set_escape_mode (stream, escape);
+  g_assert (ctpl_parser_parse (tree, env, stream, NULL) == success);
+  ctpl_output_stream_unref (stream);
+  data = get_memory_data (ostream);
+  g_object_unref (ostream);
+  
+  return data;
+}
+
+/* checks that the output of cache blocks is reused for the same values of the
+ * symbols they depend on, and only for them */
+static void
+check_fragment_cache (void)
+{
+  CtplFragmentCache  *cache;
+  CtplToken          *tree;
+  CtplToken          *failing;
+  CtplEnviron        *env;
+  gchar              *data;
+  
+  tree = ctpl_lexer_lex_string ("{cache}<{title}>{for i in items}[{i}]{end}"
+                                "{end} {n}", NULL);
+  g_assert (tree != NULL);
+  failing = ctpl_lexer_lex_string ("{cache}a{missing}{end}", NULL);
+  g_assert (failing != NULL);
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "title = \"t\"; n = 1; i = 0;"
+                                               "items = [1, 2];", NULL));
+  
+  /* without a cache, blocks are rendered like their content */
+  data = render_cached (tree, env, NULL, CTPL_ESCAPE_NONE, TRUE);
+  g_assert_cmpstr (data, ==, "<t>[1][2] 1");
+  g_free (data);
+  
+  cache = ctpl_fragment_cache_new (0);
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_NONE, TRUE);
+  g_assert_cmpstr (data, ==, "<t>[1][2] 1");
+  g_free (data);
+  g_assert_cmpuint (ctpl_fragment_cache_get_hits (cache), ==, 0);
+  g_assert_cmpuint (ctpl_fragment_cache_get_misses (cache), ==, 1);
+  /* neither a symbol outside the block nor a shadowed one is a dependency */
+  ctpl_environ_push_int (env, "n", 2);
+  ctpl_environ_push_int (env, "i", 7);
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_NONE, TRUE);
+  g_assert_cmpstr (data, ==, "<t>[1][2] 2");
+  g_free (data);
+  g_assert_cmpuint (ctpl_fragment_cache_get_hits (cache), ==, 1);
+  /* a dependency or the escape mode changes the output */
+  ctpl_environ_push_string (env, "title", "&");
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_NONE, TRUE);
+  g_assert_cmpstr (data, ==, "<&>[1][2] 2");
+  g_free (data);
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_HTML, TRUE);
+  g_assert_cmpstr (data, ==, "<&amp;>[1][2] 2");
+  g_free (data);
+  g_assert_cmpuint (ctpl_fragment_cache_get_misses (cache), ==, 3);
+  ctpl_environ_pop (env, "title", NULL);
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_NONE, TRUE);
+  g_assert_cmpstr (data, ==, "<t>[1][2] 2");
+  g_free (data);
+  g_assert_cmpuint (ctpl_fragment_cache_get_hits (cache), ==, 2);
+  
+  /* failed blocks are written up to the error, but not stored */
+  data = render_cached (failing, env, cache, CTPL_ESCAPE_NONE, FALSE);
+  g_assert_cmpstr (data, ==, "a");
+  g_free (data);
+  data = render_cached (failing, env, cache, CTPL_ESCAPE_NONE, FALSE);
+  g_free (data);
+  g_assert_cmpuint (ctpl_fragment_cache_get_misses (cache), ==, 5);
+  
+  ctpl_fragment_cache_clear (cache);
+  g_assert_cmpuint (ctpl_fragment_cache_get_size (cache), ==, 0);
+  ctpl_fragment_cache_unref (cache);
+  
+  /* the least recently used outputs are evicted to fit in the budget */
+  cache = ctpl_fragment_cache_new (80);
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_NONE, TRUE);
+  g_free (data);
+  ctpl_environ_push_string (env, "title", "u");
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_NONE, TRUE);
+  g_free (data);
+  ctpl_environ_pop (env, "title", NULL);
+  data = render_cached (tree, env, cache, CTPL_ESCAPE_NONE, TRUE);
+  g_assert_cmpstr (data, ==, "<t>[1][2] 2");
+  g_free (data);
+  g_assert_cmpuint (ctpl_fragment_cache_get_misses (cache), ==, 3);
+  g_assert_cmpuint (ctpl_fragment_cache_get_size (cache), >, 0);
+  g_assert_cmpuint (ctpl_fragment_cache_get_size (cache), <=, 80);
+  ctpl_fragment_cache_unref (cache);
+  
+  ctpl_environ_unref (env);
+  ctpl_token_free (failing);
+  ctpl_token_free (tree);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_fragment_cache ();
+  
+  return 0;
+}
@@ -0,0 +1,121 @@
+/* Checks for CtplFunction */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "../src/ctpl.h"
+
+
+/* scale(n): multiplies an integer by the factor @user_data points to */
+static gboolean
+scale_function (const CtplValue  *args,
+                guint             n_args,
+                CtplValue        *result,
+                gpointer          user_data,
+                GError          **error)
+{
+  const gint *factor = user_data;
+  
+  if (n_args != 1 || ! CTPL_VALUE_HOLDS_INT (&args[0])) {
+    g_set_error (error, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND,
+                 "scale() takes an integer");
+    return FALSE;
+  }
+  ctpl_value_set_int (result, ctpl_value_get_int (&args[0]) * *factor);
+  
+  return TRUE;
+}
+
+static void
+reset_factor (gpointer data)
+{
+  *(gint *) data = 0;
+}
+
+/* checks calling registered functions from templates */
+static void
+check_functions (void)
+{
+  CtplEnviron  *env;
+  CtplEnviron  *empty_env;
+  CtplToken    *tree;
+  CtplToken    *residual;
+  CtplValue     args[2];
+  CtplValue     value;
+  GError       *err = NULL;
+  gchar        *data;
+  gint          factor = 3;
+  
+  /* builtins called directly */
+  ctpl_value_init (&args[0]);
+  ctpl_value_init (&args[1]);
+  ctpl_value_init (&value);
+  ctpl_value_set_string (&args[0], "a-b-c");
+  ctpl_value_set_string (&args[1], "b-");
+  g_assert (ctpl_function_call ("contains", args, 2, &value, NULL));
+  g_assert_cmpint (ctpl_value_get_int (&value), ==, 1);
+  g_assert (ctpl_function_call ("len", args, 1, &value, NULL));
+  g_assert_cmpint (ctpl_value_get_int (&value), ==, 5);
+  g_assert (! ctpl_function_call ("len", args, 2, &value, &err));
+  g_assert_error (err, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND);
+  g_clear_error (&err);
+  ctpl_value_set_int (&args[1], 2);
+  g_assert (! ctpl_function_call ("max", args, 2, &value, &err));
+  g_assert_error (err, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_INVALID_OPERAND);
+  g_clear_error (&err);
+  ctpl_value_set_float (&args[0], 1.5);
+  g_assert (ctpl_function_call ("max", args, 2, &value, NULL));
+  g_assert_cmpint (ctpl_value_get_int (&value), ==, 2);
+  g_assert (ctpl_function_call ("sum", args, 2, &value, NULL));
+  g_assert_cmpfloat (ctpl_value_get_float (&value), ==, 3.5);
+  ctpl_value_free_value (&value);
+  ctpl_value_free_value (&args[1]);
+  ctpl_value_free_value (&args[0]);
+  
+  /* registered functions, and calls in templates */
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "items = [4, 1, 3];"
+                                               "name = \"ctpl\";", NULL));
+  empty_env = ctpl_environ_new ();
+  ctpl_function_register ("scale", scale_function, &factor, reset_factor);
+  tree = ctpl_lexer_lex_string ("{scale(max(items)) + len(name)}|"
+                                "{join(items, \"+\")}", NULL);
+  g_assert (tree != NULL);
+  data = ctpl_parser_parse_to_string (tree, env, NULL, NULL);
+  g_assert_cmpstr (data, ==, "16|4+1+3");
+  g_free (data);
+  /* calls on static values are evaluated ahead */
+  residual = ctpl_token_specialize (tree, env);
+  data = ctpl_parser_parse_to_string (residual, empty_env, NULL, NULL);
+  g_assert_cmpstr (data, ==, "16|4+1+3");
+  g_free (data);
+  ctpl_token_free (residual);
+  
+  g_assert (ctpl_function_unregister ("scale"));
+  g_assert_cmpint (factor, ==, 0);
+  g_assert (! ctpl_function_unregister ("scale"));
+  g_assert (ctpl_parser_parse_to_string (tree, env, NULL, &err) == NULL);
+  g_assert_error (err, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_FUNCTION_NOT_FOUND);
+  g_clear_error (&err);
+  ctpl_token_free (tree);
+  
+  /* syntax errors */
+  g_assert (ctpl_lexer_lex_string ("{len(items}", NULL) == NULL);
+  g_assert (ctpl_lexer_lex_string ("{join(items,)}", NULL) == NULL);
+  
+  ctpl_environ_unref (empty_env);
+  ctpl_environ_unref (env);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_functions ();
+  
+  return 0;
+}
@@ -0,0 +1,106 @@
+/* Checks for CtplIncrementalLexer */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "../src/ctpl.h"
+
+
+/* checks that the tree of @lexer renders like a tree lexed from its whole
+ * template */
+static void
+check_incremental_lexer_tree (CtplIncrementalLexer *lexer,
+                              CtplEnviron          *env)
+{
+  CtplToken  *tree;
+  gchar      *expected;
+  gchar      *data;
+  
+  tree = ctpl_lexer_lex_string (ctpl_incremental_lexer_get_template (lexer,
+                                                                     NULL),
+                                NULL);
+  g_assert (tree != NULL);
+  expected = ctpl_parser_parse_to_string (tree, env, NULL, NULL);
+  g_assert (expected != NULL);
+  data = ctpl_parser_parse_to_string (ctpl_incremental_lexer_get_tree (lexer),
+                                      env, NULL, NULL);
+  g_assert_cmpstr (data, ==, expected);
+  g_free (data);
+  g_free (expected);
+  ctpl_token_free (tree);
+}
+
+/* checks lexing edited templates incrementally */
+static void
+check_incremental_lexer (void)
+{
+  CtplIncrementalLexer *lexer;
+  CtplEnviron          *env;
+  gchar                *data;
+  gsize                 length;
+  GError               *err = NULL;
+  
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "x = 1; y = 2; c = 1;"
+                                               "items = [3, 4];", NULL));
+  lexer = ctpl_incremental_lexer_new ();
+  g_assert (ctpl_incremental_lexer_get_tree (lexer) == NULL);
+  g_assert (ctpl_incremental_lexer_set_template (lexer,
+                                                 "a{x}b{if c}[{x}]{else}-{end}"
+                                                 "c{for i in items}{i},{end}",
+                                                 -1, NULL));
+  check_incremental_lexer_tree (lexer, env);
+  
+  /* data inserted before a statement is merged with the preceding one */
+  g_assert (ctpl_incremental_lexer_edit (lexer, 1, 0, "\\{", -1, NULL));
+  g_assert_cmpstr (ctpl_incremental_lexer_get_template (lexer, NULL), ==,
+                   "a\\{{x}b{if c}[{x}]{else}-{end}c{for i in items}{i},{end}");
+  check_incremental_lexer_tree (lexer, env);
+  /* edits inside a block or a statement */
+  g_assert (ctpl_incremental_lexer_edit (lexer, 4, 1, "y", -1, NULL));
+  g_assert (ctpl_incremental_lexer_edit (lexer, 13, 1, "- {y}", -1, NULL));
+  check_incremental_lexer_tree (lexer, env);
+  data = ctpl_parser_parse_to_string (ctpl_incremental_lexer_get_tree (lexer),
+                                      env, NULL, NULL);
+  g_assert_cmpstr (data, ==, "a{2b- 21]c3,4,");
+  g_free (data);
+  
+  /* opening a block fails until it is closed, leaving the tree as is */
+  g_assert (! ctpl_incremental_lexer_edit (lexer, 1, 0, "{if x}", -1, &err));
+  g_assert_error (err, CTPL_LEXER_ERROR, CTPL_LEXER_ERROR_SYNTAX_ERROR);
+  g_clear_error (&err);
+  data = ctpl_parser_parse_to_string (ctpl_incremental_lexer_get_tree (lexer),
+                                      env, NULL, NULL);
+  g_assert_cmpstr (data, ==, "a{2b- 21]c3,4,");
+  g_free (data);
+  g_assert (ctpl_incremental_lexer_edit (lexer, 12, 0, "{end}", -1, NULL));
+  check_incremental_lexer_tree (lexer, env);
+  /* removing whole units, and then everything */
+  g_assert (ctpl_incremental_lexer_edit (lexer, 0, 1, "", 0, NULL));
+  check_incremental_lexer_tree (lexer, env);
+  g_assert (ctpl_incremental_lexer_edit (lexer, 0, 16, NULL, 0, NULL));
+  g_assert_cmpstr (ctpl_incremental_lexer_get_template (lexer, NULL), ==,
+                   "b{if c}- {y}{x}]{else}-{end}c{for i in items}{i},{end}");
+  check_incremental_lexer_tree (lexer, env);
+  ctpl_incremental_lexer_get_template (lexer, &length);
+  g_assert (ctpl_incremental_lexer_edit (lexer, 0, length, "", 0, NULL));
+  g_assert (ctpl_incremental_lexer_get_tree (lexer) == NULL);
+  g_assert (ctpl_incremental_lexer_edit (lexer, 0, 0, "{x}", -1, NULL));
+  check_incremental_lexer_tree (lexer, env);
+  
+  ctpl_incremental_lexer_free (lexer);
+  ctpl_environ_unref (env);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_incremental_lexer ();
+  
+  return 0;
+}
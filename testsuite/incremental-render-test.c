@@ -0,0 +1,98 @@
+/* Checks for CtplIncrementalRender */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "../src/ctpl.h"
+
+
+/* checks that incremental rendering only renders what changed */
+static void
+check_incremental_render (void)
+{
+  CtplIncrementalRender  *render;
+  CtplToken              *tree;
+  CtplEnviron            *env;
+  const gchar            *output;
+  gsize                   length;
+  guint64                 version;
+  gchar                 **changes;
+  GError                 *err = NULL;
+  
+  tree = ctpl_lexer_lex_string ("<{title}>{for i in items}[{i}]{end}({load})",
+                                NULL);
+  g_assert (tree != NULL);
+  env = ctpl_environ_new ();
+  g_assert_cmpuint (ctpl_environ_get_version (env), ==, 0);
+  g_assert (ctpl_environ_add_from_string (env, "title = \"t\"; load = 1;"
+                                               "items = [1, 2];", NULL));
+  version = ctpl_environ_get_version (env);
+  g_assert_cmpuint (version, ==, 3);
+  g_assert_cmpuint (ctpl_environ_get_symbol_version (env, "load"), >, 0);
+  g_assert_cmpuint (ctpl_environ_get_symbol_version (env, "none"), ==, 0);
+  
+  render = ctpl_incremental_render_new (tree, env);
+  output = ctpl_incremental_render_update (render, &length, NULL);
+  g_assert_cmpstr (output, ==, "<t>[1][2](1)");
+  g_assert_cmpuint (length, ==, strlen (output));
+  g_assert_cmpuint (ctpl_incremental_render_get_n_rendered (render), ==, 7);
+  /* the loop iterator isn't a change */
+  output = ctpl_incremental_render_update (render, NULL, NULL);
+  g_assert_cmpstr (output, ==, "<t>[1][2](1)");
+  g_assert_cmpuint (ctpl_incremental_render_get_n_rendered (render), ==, 0);
+  
+  version = ctpl_environ_get_version (env);
+  ctpl_environ_push_int (env, "load", 42);
+  changes = ctpl_environ_get_changes (env, version);
+  g_assert_cmpuint (g_strv_length (changes), ==, 1);
+  g_assert_cmpstr (changes[0], ==, "load");
+  g_strfreev (changes);
+  output = ctpl_incremental_render_update (render, NULL, NULL);
+  g_assert_cmpstr (output, ==, "<t>[1][2](42)");
+  g_assert_cmpuint (ctpl_incremental_render_get_n_rendered (render), ==, 1);
+  /* outputs of different sizes move the following ones */
+  ctpl_environ_push_string (env, "title", "longer");
+  ctpl_environ_push_int (env, "load", 7);
+  output = ctpl_incremental_render_update (render, NULL, NULL);
+  g_assert_cmpstr (output, ==, "<longer>[1][2](7)");
+  g_assert_cmpuint (ctpl_incremental_render_get_n_rendered (render), ==, 2);
+  ctpl_environ_pop (env, "title", NULL);
+  output = ctpl_incremental_render_update (render, NULL, NULL);
+  g_assert_cmpstr (output, ==, "<t>[1][2](7)");
+  g_assert_cmpuint (ctpl_incremental_render_get_n_rendered (render), ==, 1);
+  
+  /* changing the escape mode renders everything again */
+  ctpl_environ_push_string (env, "title", "&");
+  ctpl_incremental_render_set_escape_mode (render, CTPL_ESCAPE_HTML);
+  output = ctpl_incremental_render_update (render, NULL, NULL);
+  g_assert_cmpstr (output, ==, "<&amp;>[1][2](7)");
+  g_assert_cmpuint (ctpl_incremental_render_get_n_rendered (render), ==, 7);
+  
+  /* failed tokens are rendered again on next update */
+  while (ctpl_environ_pop (env, "load", NULL));
+  g_assert (ctpl_incremental_render_update (render, &length, &err) == NULL);
+  g_assert_error (err, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND);
+  g_clear_error (&err);
+  ctpl_environ_push_int (env, "load", 3);
+  output = ctpl_incremental_render_update (render, NULL, NULL);
+  g_assert_cmpstr (output, ==, "<&amp;>[1][2](3)");
+  g_assert_cmpuint (ctpl_incremental_render_get_n_rendered (render), ==, 1);
+  
+  ctpl_incremental_render_free (render);
+  ctpl_environ_unref (env);
+  ctpl_token_free (tree);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_incremental_render ();
+  
+  return 0;
+}
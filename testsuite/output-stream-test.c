@@ -0,0 +1,723 @@
+/* Checks for CtplOutputStream */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../src/ctpl.h"
+
+
+/* gets the data written so far to a GMemoryOutputStream */
+static gchar *
+get_memory_data (GOutputStream *ostream)
+{
+  GMemoryOutputStream *mstream = G_MEMORY_OUTPUT_STREAM (ostream);
+  gsize                size = g_memory_output_stream_get_data_size (mstream);
+  
+  return size > 0 ? g_strndup (g_memory_output_stream_get_data (mstream), size)
+                  : g_strdup ("");
+}
+
+/* writes chunks of various sizes through a buffer of @buffer_size bytes, and
+ * checks that the output is the same as the input.  If @n_buffers is not 0,
+ * uses a threaded stream with that many buffers. */
+static void
+check_writes (gsize buffer_size,
+              guint n_buffers)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  GString          *expected;
+  gchar            *data;
+  gsize             i;
+  
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  if (n_buffers > 0) {
+    stream = ctpl_output_stream_new_threaded (ostream, buffer_size, n_buffers);
+  } else {
+    stream = ctpl_output_stream_new_sized (ostream, buffer_size);
+  }
+  expected = g_string_new (NULL);
+  for (i = 0; i < 2000; i++) {
+    gchar  *chunk;
+    
+    chunk = g_strnfill (i * 7 % 301, (gchar) ('a' + i % 26));
+    g_assert (ctpl_output_stream_write (stream, chunk, -1, NULL));
+    g_assert (ctpl_output_stream_put_c (stream, '\n', NULL));
+    g_string_append (expected, chunk);
+    g_string_append_c (expected, '\n');
+    g_free (chunk);
+  }
+  g_assert (ctpl_output_stream_flush (stream, NULL));
+  data = get_memory_data (ostream);
+  g_assert_cmpstr (data, ==, expected->str);
+  g_free (data);
+  g_string_free (expected, TRUE);
+  ctpl_output_stream_unref (stream);
+  g_object_unref (ostream);
+}
+
+/* checks that data is buffered until flushed, and flushed on last unref */
+static void
+check_buffering (void)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  gchar            *data;
+  
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new_sized (ostream, 64);
+  g_assert (ctpl_output_stream_write (stream, "hello", -1, NULL));
+  data = get_memory_data (ostream);
+  g_assert_cmpstr (data, ==, "");
+  g_free (data);
+  g_assert (ctpl_output_stream_flush (stream, NULL));
+  data = get_memory_data (ostream);
+  g_assert_cmpstr (data, ==, "hello");
+  g_free (data);
+  g_assert (ctpl_output_stream_write (stream, " world", -1, NULL));
+  ctpl_output_stream_unref (stream);
+  data = get_memory_data (ostream);
+  g_assert_cmpstr (data, ==, "hello world");
+  g_free (data);
+  g_object_unref (ostream);
+}
+
+/* checks that errors from the writer thread are reported */
+static void
+check_threaded_error (void)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  GError           *err = NULL;
+  gboolean          success = TRUE;
+  guint             i;
+  
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  g_output_stream_close (ostream, NULL, NULL);
+  stream = ctpl_output_stream_new_threaded (ostream, 16, 2);
+  for (i = 0; success && i < 1000; i++) {
+    success = ctpl_output_stream_write (stream, "some data", -1, &err);
+  }
+  if (success) {
+    success = ctpl_output_stream_flush (stream, &err);
+  }
+  g_assert (! success);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_CLOSED);
+  g_clear_error (&err);
+  /* the error sticks */
+  g_assert (! ctpl_output_stream_write (stream, "more", -1, NULL));
+  ctpl_output_stream_unref (stream);
+  g_object_unref (ostream);
+}
+
+/* checks that ctpl_parser_parse_full() honours its limits */
+static void
+check_limits (void)
+{
+  const gchar      *template = "{for i in items}{for j in items}"
+                                 "some text {i * j}\n"
+                               "{end}{end}";
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  CtplEnviron      *env;
+  CtplToken        *tree;
+  GCancellable     *cancellable;
+  GError           *err = NULL;
+  gchar            *data;
+  gsize             size;
+  
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "items = [1, 2, 3, 4, 5, 6, 7, "
+                                                        "8, 9, 10, 11, 12];",
+                                          NULL));
+  tree = ctpl_lexer_lex_string (template, NULL);
+  g_assert (tree != NULL);
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (ostream);
+  
+  /* no limits */
+  g_assert (ctpl_parser_parse_full (tree, env, stream, NULL, 0, 0, NULL));
+  size = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (ostream));
+  /* output budget: the output is not written past the limit */
+  g_assert (! ctpl_parser_parse_full (tree, env, stream, NULL, 0, 100, &err));
+  g_assert_error (err, CTPL_PARSER_ERROR, CTPL_PARSER_ERROR_OUTPUT_TOO_LARGE);
+  g_clear_error (&err);
+  g_assert_cmpuint (g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (ostream)),
+                    <=, size + 100);
+  /* deadline */
+  g_assert (! ctpl_parser_parse_full (tree, env, stream, NULL,
+                                      g_get_monotonic_time (), 0, &err));
+  g_assert_error (err, CTPL_PARSER_ERROR, CTPL_PARSER_ERROR_TIMED_OUT);
+  g_clear_error (&err);
+  /* cancellation */
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  g_assert (! ctpl_parser_parse_full (tree, env, stream, cancellable, 0, 0,
+                                      &err));
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&err);
+  g_object_unref (cancellable);
+  /* and the stream is usable again afterwards */
+  g_assert (ctpl_output_stream_write (stream, "end", -1, NULL));
+  g_assert (ctpl_output_stream_flush (stream, NULL));
+  data = get_memory_data (ostream);
+  g_assert (g_str_has_suffix (data, "end"));
+  data[size] = 0;
+  g_assert (g_str_has_suffix (data, "some text 144\n"));
+  g_free (data);
+  
+  ctpl_output_stream_unref (stream);
+  g_object_unref (ostream);
+  ctpl_token_free (tree);
+  ctpl_environ_unref (env);
+}
+
+/* renders @template to a string, rendering loops of at least @threshold
+ * iterations in parallel */
+static gchar *
+render_loops (const gchar  *template,
+              CtplEnviron  *env,
+              guint         threshold,
+              GError      **error)
+{
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  CtplToken        *tree;
+  gchar            *data;
+  
+  tree = ctpl_lexer_lex_string (template, NULL);
+  g_assert (tree != NULL);
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (ostream);
+  ctpl_output_stream_set_parallel_threshold (stream, threshold);
+  g_assert_cmpuint (ctpl_output_stream_get_parallel_threshold (stream), ==,
+                    threshold);
+  ctpl_parser_parse (tree, env, stream, error);
+  data = get_memory_data (ostream);
+  ctpl_output_stream_unref (stream);
+  g_object_unref (ostream);
+  ctpl_token_free (tree);
+  
+  return data;
+}
+
+/* checks that rendering loops in parallel gives the same output as rendering
+ * them sequentially, also when an error occurs in the middle of the loop */
+static void
+check_parallel_loops (void)
+{
+  const gchar  *template = "{for i in items}<{i}:{for j in small}"
+                             "{i * j},{end}>\n"
+                           "{end}end\n";
+  const gchar  *failing = "{for i in items}{i}\n{if i == 1234}{i + small}{end}"
+                          "{end}";
+  CtplEnviron  *env;
+  GString      *items;
+  gchar        *sequential;
+  gchar        *parallel;
+  GError       *err = NULL;
+  guint         i;
+  
+  items = g_string_new ("items = [");
+  for (i = 0; i < 5000; i++) {
+    g_string_append_printf (items, "%s%u", i > 0 ? ", " : "", i);
+  }
+  g_string_append (items, "]; small = [1, 2, 3];");
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, items->str, NULL));
+  
+  sequential = render_loops (template, env, 0, NULL);
+  parallel = render_loops (template, env, 1, NULL);
+  g_assert (g_str_has_suffix (sequential, "<4999:4999,9998,14997,>\nend\n"));
+  g_assert_cmpstr (sequential, ==, parallel);
+  g_free (parallel);
+  /* loops below the threshold are rendered sequentially */
+  parallel = render_loops (template, env, 10000, NULL);
+  g_assert_cmpstr (sequential, ==, parallel);
+  g_free (parallel);
+  g_free (sequential);
+  
+  /* the output stops at the same place on error */
+  sequential = render_loops (failing, env, 0, &err);
+  g_assert (err != NULL);
+  g_clear_error (&err);
+  parallel = render_loops (failing, env, 1, &err);
+  g_assert (err != NULL);
+  g_clear_error (&err);
+  g_assert (g_str_has_suffix (sequential, "\n1234\n"));
+  g_assert_cmpstr (sequential, ==, parallel);
+  g_free (parallel);
+  g_free (sequential);
+  
+  /* the environment is left untouched */
+  g_assert (ctpl_environ_lookup (env, "i") == NULL);
+  g_assert (ctpl_environ_lookup (env, "j") == NULL);
+  
+  g_string_free (items, TRUE);
+  ctpl_environ_unref (env);
+}
+
+/* lexes @template either from a #GBytes, which may be split and lexed in
+ * parallel, or from a plain stream which is always lexed sequentially, and
+ * renders the result */
+static gchar *
+lex_and_render (const gchar  *template,
+                gboolean      bytes,
+                CtplEnviron  *env,
+                GError      **error)
+{
+  CtplToken *tree;
+  gchar     *data = NULL;
+  
+  if (bytes) {
+    GBytes *b = g_bytes_new_static (template, strlen (template));
+    
+    tree = ctpl_lexer_lex_bytes (b, error);
+    g_bytes_unref (b);
+  } else {
+    CtplInputStream *stream;
+    
+    stream = ctpl_input_stream_new_for_memory (template, -1, NULL, NULL);
+    tree = ctpl_lexer_lex (stream, error);
+    ctpl_input_stream_unref (stream);
+  }
+  if (tree) {
+    data = ctpl_parser_parse_to_string (tree, env, NULL, error);
+    ctpl_token_free (tree);
+  }
+  
+  return data;
+}
+
+/* checks that lexing a large template in parallel gives the same tree and the
+ * same errors as lexing it sequentially */
+static void
+check_parallel_lexing (void)
+{
+  CtplEnviron  *env;
+  GString      *template;
+  gchar        *sequential;
+  gchar        *parallel;
+  GError       *err1 = NULL;
+  GError       *err2 = NULL;
+  guint         i;
+  
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "items = [1, 2]; s = \"}{\";",
+                                          NULL));
+  template = g_string_new (NULL);
+  for (i = 0; template->len < (3U << 20); i++) {
+    g_string_append_printf (template,
+                            "line %u \\\\{s}\\\\\\{\\\\\\}\n"
+                            "{for i in items}{if i == 2}[{i} \"{s}\"]"
+                            "{else}{\"}{\" + i}{end}{end}\n", i);
+  }
+  sequential = lex_and_render (template->str, FALSE, env, NULL);
+  parallel = lex_and_render (template->str, TRUE, env, NULL);
+  g_assert (sequential != NULL);
+  g_assert (g_str_has_prefix (sequential, "line 0 \\}{\\{\\}\n}{1[2 \"}{\"]\n"));
+  g_assert_cmpstr (sequential, ==, parallel);
+  g_free (parallel);
+  g_free (sequential);
+  
+  /* an error near the end is reported at the same location */
+  g_string_append (template, "{for i items}{i}{end}\n");
+  g_string_append (template, template->str);
+  g_assert (lex_and_render (template->str, FALSE, env, &err1) == NULL);
+  g_assert (lex_and_render (template->str, TRUE, env, &err2) == NULL);
+  g_assert_cmpstr (err1->message, ==, err2->message);
+  g_error_free (err1);
+  g_error_free (err2);
+  
+  g_string_free (template, TRUE);
+  ctpl_environ_unref (env);
+}
+
+/* checks that data tokens lexed from a #GBytes reference it, unless the data
+ * contains escapes in which case they hold a copy */
+static void
+check_span_tokens (void)
+{
+  gchar             template[] = "abc{x}d\\{e";
+  GBytes           *bytes;
+  CtplInputStream  *stream;
+  CtplToken        *tree;
+  CtplEnviron      *env;
+  gchar            *output;
+  
+  bytes = g_bytes_new_static (template, sizeof template - 1);
+  stream = ctpl_input_stream_new_for_bytes (bytes, NULL);
+  tree = ctpl_lexer_lex (stream, NULL);
+  g_assert (tree != NULL);
+  ctpl_input_stream_unref (stream);
+  g_bytes_unref (bytes);
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "x = 1;", NULL));
+  
+  /* changes to the source only show in the tokens referencing it */
+  template[0] = 'A';
+  template[6] = 'D';
+  output = ctpl_parser_parse_to_string (tree, env, NULL, NULL);
+  g_assert_cmpstr (output, ==, "Abc1d{e");
+  g_free (output);
+  
+  ctpl_environ_unref (env);
+  ctpl_token_free (tree);
+}
+
+/* renders @tree to the file at @path, and gets the file's contents */
+static gchar *
+render_to_path (const CtplToken *tree,
+                CtplEnviron     *env,
+                const gchar     *path)
+{
+  GFile            *file;
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  gchar            *data;
+  
+  file = g_file_new_for_path (path);
+  ostream = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE,
+                                             G_FILE_CREATE_NONE, NULL, NULL));
+  g_assert (ostream != NULL);
+  stream = ctpl_output_stream_new (ostream);
+  g_assert (ctpl_parser_parse (tree, env, stream, NULL));
+  ctpl_output_stream_unref (stream);
+  g_assert (g_output_stream_close (ostream, NULL, NULL));
+  g_object_unref (ostream);
+  g_object_unref (file);
+  g_assert (g_file_get_contents (path, &data, NULL, NULL));
+  
+  return data;
+}
+
+/* checks that rendering a mapped template to a file gives the same output as
+ * rendering it to memory, whether or not the data is copied by the kernel */
+static void
+check_file_output (void)
+{
+  gchar            *tpl_path;
+  gchar            *out_path;
+  gchar            *template;
+  gchar            *expected;
+  gchar            *data;
+  gint              fd;
+  CtplToken        *tree;
+  CtplEnviron      *env;
+  GFile            *file;
+  GOutputStream    *ostream;
+  CtplOutputStream *stream;
+  CtplInputStream  *instream;
+  CtplInputStream  *instreams[2048];
+  GError           *err = NULL;
+  guint             i;
+  
+  fd = g_file_open_tmp ("ctpl-XXXXXX.tpl", &tpl_path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  fd = g_file_open_tmp ("ctpl-XXXXXX.out", &out_path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  
+  data = g_strnfill (100000, 'x');
+  template = g_strconcat (data, "{a}", data, "\\{", data, "{a}", NULL);
+  g_free (data);
+  g_assert (g_file_set_contents (tpl_path, template, -1, NULL));
+  
+  tree = ctpl_lexer_lex_path (tpl_path, NULL);
+  g_assert (tree != NULL);
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "a = 42;", NULL));
+  expected = ctpl_parser_parse_to_string (tree, env, NULL, NULL);
+  g_assert (expected != NULL);
+  
+  file = g_file_new_for_path (out_path);
+  ostream = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE,
+                                             G_FILE_CREATE_NONE, NULL, NULL));
+  g_assert (ostream != NULL);
+  stream = ctpl_output_stream_new (ostream);
+  g_assert (ctpl_parser_parse (tree, env, stream, NULL));
+  ctpl_output_stream_unref (stream);
+  g_assert (g_output_stream_close (ostream, NULL, NULL));
+  g_object_unref (ostream);
+  g_object_unref (file);
+  
+  g_assert (g_file_get_contents (out_path, &data, NULL, NULL));
+  g_assert_cmpstr (data, ==, expected);
+  g_free (data);
+  
+  /* the tree doesn't depend on the file, which can be truncated in place */
+  fd = open (tpl_path, O_WRONLY | O_TRUNC);
+  g_assert (fd >= 0);
+  g_assert (write (fd, "short", 5) == 5);
+  close (fd);
+  data = ctpl_parser_parse_to_string (tree, env, NULL, NULL);
+  g_assert_cmpstr (data, ==, expected);
+  g_free (data);
+  ctpl_token_free (tree);
+  
+  /* a file mapped on request is used in place */
+  g_assert (g_file_set_contents (tpl_path, template, -1, NULL));
+  instream = ctpl_input_stream_new_for_mapped_path (tpl_path, &err);
+  if (! instream) {
+    g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+    g_clear_error (&err);
+  } else {
+    tree = ctpl_lexer_lex (instream, NULL);
+    g_assert (tree != NULL);
+    ctpl_input_stream_unref (instream);
+    data = render_to_path (tree, env, out_path);
+    g_assert_cmpstr (data, ==, expected);
+    g_free (data);
+    
+    /* a file replaced after mapping is not copied from in place of the
+     * mapping */
+    g_free (template);
+    data = g_strnfill (100000, 'y');
+    template = g_strconcat (data, "{a}", data, "\\{", data, "{a}", NULL);
+    g_free (data);
+    g_assert (g_file_set_contents (tpl_path, template, -1, NULL));
+    data = render_to_path (tree, env, out_path);
+    g_assert_cmpstr (data, ==, expected);
+    g_free (data);
+    ctpl_token_free (tree);
+    
+    /* mapped files are not kept open, so there can be more of them than the
+     * usual limit of open files */
+    for (i = 0; i < G_N_ELEMENTS (instreams); i++) {
+      instreams[i] = ctpl_input_stream_new_for_mapped_path (tpl_path, NULL);
+      g_assert (instreams[i] != NULL);
+    }
+    for (i = 0; i < G_N_ELEMENTS (instreams); i++) {
+      ctpl_input_stream_unref (instreams[i]);
+    }
+  }
+  
+  g_free (template);
+  g_free (expected);
+  ctpl_environ_unref (env);
+  g_unlink (tpl_path);
+  g_unlink (out_path);
+  g_free (tpl_path);
+  g_free (out_path);
+}
+
+/* gets the error of an asynchronous parsing that must fail */
+static void
+parse_async_ready (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  GError **err = user_data;
+  
+  g_assert (! ctpl_parser_parse_finish (result, err));
+  g_assert (*err != NULL);
+}
+
+/* checks writing to a memory-mapped file */
+static void
+check_mapped_output (void)
+{
+  gchar            *path;
+  gchar            *data;
+  gsize             length;
+  GString          *expected;
+  CtplOutputStream *stream;
+  CtplToken        *tree;
+  CtplEnviron      *env;
+  GError           *err = NULL;
+  gint              fd;
+  gsize             i;
+  
+  fd = g_file_open_tmp ("ctpl-XXXXXX.out", &path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  stream = ctpl_output_stream_new_for_mapped_path (path, TRUE, &err);
+  if (! stream) {
+    g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+    g_error_free (err);
+  } else {
+    expected = g_string_new (NULL);
+    /* enough to grow the file a few times */
+    for (i = 0; i < 5000; i++) {
+      gchar *chunk = g_strnfill (i % 1021, (gchar) ('a' + i % 26));
+      
+      g_assert (ctpl_output_stream_write (stream, chunk, -1, NULL));
+      g_string_append (expected, chunk);
+      g_free (chunk);
+    }
+    g_assert (ctpl_output_stream_get_stream (stream) == NULL);
+    /* there is no stream to write to asynchronously */
+    tree = ctpl_lexer_lex_string ("data", NULL);
+    env = ctpl_environ_new ();
+    ctpl_parser_parse_async (tree, env, stream, G_PRIORITY_DEFAULT, NULL,
+                             parse_async_ready, &err);
+    while (! err) {
+      g_main_context_iteration (NULL, TRUE);
+    }
+    g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+    g_clear_error (&err);
+    ctpl_environ_unref (env);
+    ctpl_token_free (tree);
+    g_assert (ctpl_output_stream_close (stream, NULL));
+    g_assert (! ctpl_output_stream_write (stream, "x", 1, &err));
+    g_assert_error (err, G_IO_ERROR, G_IO_ERROR_CLOSED);
+    g_clear_error (&err);
+    ctpl_output_stream_unref (stream);
+    
+    g_assert (g_file_get_contents (path, &data, &length, NULL));
+    g_assert_cmpuint (length, ==, expected->len);
+    g_assert (memcmp (data, expected->str, length) == 0);
+    g_free (data);
+    g_string_free (expected, TRUE);
+  }
+  g_unlink (path);
+  g_free (path);
+}
+
+/* checks compressing the output, by decompressing it back */
+static void
+check_compression (void)
+{
+  GOutputStream      *mstream;
+  CtplOutputStream   *stream;
+  GConverter         *decompressor;
+  GString            *expected;
+  gchar               out[4096];
+  const gchar        *in;
+  gsize               in_length;
+  gsize               bytes_read;
+  gsize               bytes_written;
+  GString            *result;
+  GConverterResult    res;
+  gsize               i;
+  
+  mstream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (mstream);
+  g_assert (ctpl_output_stream_set_compression (stream,
+                                                CTPL_OUTPUT_COMPRESSION_GZIP,
+                                                -1, NULL));
+  g_assert_cmpint (ctpl_output_stream_get_compression (stream), ==,
+                   CTPL_OUTPUT_COMPRESSION_GZIP);
+  expected = g_string_new (NULL);
+  for (i = 0; i < 2000; i++) {
+    gchar *chunk = g_strdup_printf ("line %" G_GSIZE_FORMAT "\n", i);
+    
+    g_assert (ctpl_output_stream_write (stream, chunk, -1, NULL));
+    g_string_append (expected, chunk);
+    g_free (chunk);
+  }
+  g_assert (ctpl_output_stream_close (stream, NULL));
+  ctpl_output_stream_unref (stream);
+  
+  in = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (mstream));
+  in_length = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (mstream));
+  g_assert_cmpuint (in_length, <, expected->len);
+  decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+  result = g_string_new (NULL);
+  do {
+    res = g_converter_convert (decompressor, in, in_length, out, sizeof out,
+                               G_CONVERTER_INPUT_AT_END, &bytes_read,
+                               &bytes_written, NULL);
+    g_assert (res != G_CONVERTER_ERROR);
+    g_string_append_len (result, out, (gssize) bytes_written);
+    in += bytes_read;
+    in_length -= bytes_read;
+  } while (res != G_CONVERTER_FINISHED);
+  g_assert_cmpuint (result->len, ==, expected->len);
+  g_assert_cmpstr (result->str, ==, expected->str);
+  
+  g_string_free (result, TRUE);
+  g_string_free (expected, TRUE);
+  g_object_unref (decompressor);
+  g_object_unref (mstream);
+}
+
+/* checks the hashes computed on the output against known values */
+static void
+check_hashes (void)
+{
+  GOutputStream      *mstream;
+  CtplOutputStream   *stream;
+  gchar              *hash;
+  gchar              *sha256;
+  GString            *expected;
+  gsize               i;
+  
+  mstream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (mstream);
+  g_assert (ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_XXH64) == NULL);
+  ctpl_output_stream_set_hashes (stream, CTPL_OUTPUT_HASH_XXH64);
+  hash = ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_XXH64);
+  g_assert_cmpstr (hash, ==, "ef46db3751d8e999");
+  g_free (hash);
+  g_assert (ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_SHA256) == NULL);
+  g_assert (ctpl_output_stream_write (stream, "abc", -1, NULL));
+  hash = ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_XXH64);
+  g_assert_cmpstr (hash, ==, "44bc2cf5ad770999");
+  g_free (hash);
+  
+  /* restarts the hashes, and covers inputs of more than one stripe */
+  ctpl_output_stream_set_hashes (stream, (CTPL_OUTPUT_HASH_XXH64 |
+                                          CTPL_OUTPUT_HASH_SHA256));
+  expected = g_string_new (NULL);
+  for (i = 0; i < 200; i++) {
+    gchar *chunk = g_strdup_printf ("line %" G_GSIZE_FORMAT "\n", i);
+    
+    g_assert (ctpl_output_stream_write (stream, chunk, -1, NULL));
+    g_string_append (expected, chunk);
+    g_free (chunk);
+    if (i == 100) {
+      /* getting a hash doesn't change it */
+      g_free (ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_XXH64));
+      g_free (ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_SHA256));
+    }
+  }
+  hash = ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_XXH64);
+  g_assert_cmpstr (hash, ==, "61c5447c033024b4");
+  g_free (hash);
+  hash = ctpl_output_stream_get_hash (stream, CTPL_OUTPUT_HASH_SHA256);
+  sha256 = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                        (const guchar *) expected->str,
+                                        expected->len);
+  g_assert_cmpstr (hash, ==, sha256);
+  g_free (sha256);
+  g_free (hash);
+  
+  ctpl_output_stream_unref (stream);
+  g_string_free (expected, TRUE);
+  g_object_unref (mstream);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_writes (0, 0);
+  check_writes (1, 0);
+  check_writes (64, 0);
+  check_writes (8192, 0);
+  check_writes (1, 2);
+  check_writes (64, 4);
+  check_writes (0, 8);
+  check_buffering ();
+  check_threaded_error ();
+  check_limits ();
+  check_parallel_loops ();
+  check_parallel_lexing ();
+  check_span_tokens ();
+  check_file_output ();
+  check_mapped_output ();
+  check_compression ();
+  check_hashes ();
+  
+  return 0;
+}
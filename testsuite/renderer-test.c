@@ -0,0 +1,105 @@
+/* Checks for CtplRenderer */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "../src/ctpl.h"
+
+
+typedef struct _RendererResult RendererResult;
+
+struct _RendererResult
+{
+  CtplRenderer *renderer;
+  guint        *n_pending;
+  gchar        *output;
+  GError       *error;
+};
+
+/* stores the result of a render */
+static void
+renderer_done (GObject      *object,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+  RendererResult *r = user_data;
+  
+  r->output = ctpl_renderer_render_finish (r->renderer, result, NULL,
+                                           &r->error);
+  (*r->n_pending)--;
+}
+
+/* checks rendering concurrently with a CtplRenderer */
+static void
+check_renderer (void)
+{
+  CtplRenderer   *renderer;
+  CtplEnviron    *env;
+  CtplToken      *tree;
+  CtplToken      *failing;
+  GCancellable   *cancellable;
+  RendererResult  results[22];
+  guint           n_pending = G_N_ELEMENTS (results);
+  guint           i;
+  
+  renderer = ctpl_renderer_new (3);
+  g_assert_cmpuint (ctpl_renderer_get_n_workers (renderer), ==, 3);
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "items = [1, 2, 3]; x = \"!\";",
+                                          NULL));
+  tree = ctpl_lexer_lex_string ("{for i in items}{i}{end}{x}", NULL);
+  failing = ctpl_lexer_lex_string ("{for i in items}{i}{end}{missing}", NULL);
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  
+  for (i = 0; i < G_N_ELEMENTS (results); i++) {
+    results[i].renderer = renderer;
+    results[i].n_pending = &n_pending;
+    results[i].output = NULL;
+    results[i].error = NULL;
+    ctpl_renderer_render_async (renderer, i == 5 ? failing : tree, env,
+                                G_PRIORITY_DEFAULT, i == 7 ? cancellable : NULL,
+                                renderer_done, &results[i]);
+  }
+  while (n_pending > 0) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+  
+  for (i = 0; i < G_N_ELEMENTS (results); i++) {
+    if (i == 5) {
+      g_assert_error (results[i].error, CTPL_EVAL_ERROR,
+                      CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND);
+      g_assert (results[i].output == NULL);
+      g_clear_error (&results[i].error);
+    } else if (i == 7) {
+      g_assert_error (results[i].error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+      g_assert (results[i].output == NULL);
+      g_clear_error (&results[i].error);
+    } else {
+      g_assert_no_error (results[i].error);
+      g_assert_cmpstr (results[i].output, ==, "123!");
+      g_free (results[i].output);
+    }
+  }
+  /* renders don't modify the environment they are given */
+  g_assert (ctpl_environ_lookup (env, "i") == NULL);
+  
+  ctpl_renderer_free (renderer);
+  g_object_unref (cancellable);
+  ctpl_token_free (failing);
+  ctpl_token_free (tree);
+  ctpl_environ_unref (env);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_renderer ();
+  
+  return 0;
+}
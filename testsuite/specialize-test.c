@@ -0,0 +1,96 @@
+/* Checks for ctpl_token_specialize() */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "../src/ctpl.h"
+
+
+/* checks that a specialized tree renders like the original one */
+static void
+check_specialize (void)
+{
+  CtplToken    *tree;
+  CtplToken    *residual;
+  CtplEnviron  *static_env;
+  CtplEnviron  *env;
+  gchar        *expected;
+  gchar        *data;
+  GError       *err = NULL;
+  
+  tree = ctpl_lexer_lex_string ("{if flag}<{site|html}>{else}no{end}"
+                                "{for m in menu}[{m}]{end}"
+                                "{for u in users}({u}{site}{if u == site}!{end})"
+                                "{end}{for site in menu}{site}{end}"
+                                "{cache}{site}{user}{end}{cache}{site}{end}",
+                                NULL);
+  g_assert (tree != NULL);
+  static_env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (static_env,
+                                          "site = \"&\"; flag = 1;"
+                                          "menu = [\"a\", \"b\"];", NULL));
+  residual = ctpl_token_specialize (tree, static_env);
+  g_assert (residual != NULL);
+  
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env,
+                                          "site = \"&\"; flag = 1;"
+                                          "menu = [\"a\", \"b\"];"
+                                          "users = [\"x\", \"&\"];"
+                                          "user = \"y\";", NULL));
+  expected = ctpl_parser_parse_to_string (tree, env, NULL, NULL);
+  g_assert_cmpstr (expected, ==, "<&amp;>[a][b](x&)(&&!)ab&y&");
+  data = ctpl_parser_parse_to_string (residual, env, NULL, NULL);
+  g_assert_cmpstr (data, ==, expected);
+  g_free (data);
+  g_free (expected);
+  ctpl_environ_unref (env);
+  
+  /* the residual tree doesn't need the static symbols anymore, but still
+   * needs the others */
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "users = []; user = 1;", NULL));
+  data = ctpl_parser_parse_to_string (residual, env, NULL, NULL);
+  g_assert_cmpstr (data, ==, "<&amp;>[a][b]ab&1&");
+  g_free (data);
+  ctpl_environ_unref (env);
+  env = ctpl_environ_new ();
+  g_assert (ctpl_parser_parse_to_string (residual, env, NULL, &err) == NULL);
+  g_assert_error (err, CTPL_EVAL_ERROR, CTPL_EVAL_ERROR_SYMBOL_NOT_FOUND);
+  g_clear_error (&err);
+  ctpl_environ_unref (env);
+  ctpl_token_free (residual);
+  
+  /* the array of a loop is not in the scope of its iterator */
+  ctpl_token_free (tree);
+  tree = ctpl_lexer_lex_string ("{for menu in menu}{menu}{end}", NULL);
+  residual = ctpl_token_specialize (tree, static_env);
+  g_assert (residual != NULL);
+  env = ctpl_environ_new ();
+  data = ctpl_parser_parse_to_string (residual, env, NULL, NULL);
+  g_assert_cmpstr (data, ==, "ab");
+  g_free (data);
+  ctpl_environ_unref (env);
+  ctpl_token_free (residual);
+  
+  /* a fully static tree doesn't output anything if it is empty */
+  ctpl_token_free (tree);
+  tree = ctpl_lexer_lex_string ("{if flag}{else}no{end}", NULL);
+  g_assert (ctpl_token_specialize (tree, static_env) == NULL);
+  
+  ctpl_environ_unref (static_env);
+  ctpl_token_free (tree);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_specialize ();
+  
+  return 0;
+}
@@ -0,0 +1,134 @@
+/* Checks for CtplTemplateCache */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../src/ctpl.h"
+
+
+/* renders a cached template */
+static gchar *
+render_template (CtplTemplate *tmpl,
+                 CtplEnviron  *env)
+{
+  return ctpl_parser_parse_to_string (ctpl_template_get_tree (tmpl), env, NULL,
+                                      NULL);
+}
+
+/* checks that the template cache reloads changed files and honours its
+ * budget */
+static void
+check_template_cache (void)
+{
+  CtplTemplateCache  *cache;
+  CtplTemplate       *t1;
+  CtplTemplate       *t2;
+  CtplTemplate       *t3;
+  CtplEnviron        *env;
+  GFile              *file;
+  GError             *err = NULL;
+  gchar              *path_a;
+  gchar              *path_b;
+  gchar              *missing;
+  gchar              *data;
+  gint                fd;
+  
+  fd = g_file_open_tmp ("ctpl-XXXXXX.tpl", &path_a, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  fd = g_file_open_tmp ("ctpl-XXXXXX.tpl", &path_b, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  missing = g_strconcat (path_a, ".missing", NULL);
+  g_assert (g_file_set_contents (path_a, "a{x}", -1, NULL));
+  g_assert (g_file_set_contents (path_b, "b{x}!", -1, NULL));
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "x = 1;", NULL));
+  
+  cache = ctpl_template_cache_new (0);
+  t1 = ctpl_template_cache_lookup_path (cache, path_a, NULL);
+  g_assert (t1 != NULL);
+  t2 = ctpl_template_cache_lookup_path (cache, path_a, NULL);
+  g_assert (t1 == t2);
+  ctpl_template_unref (t2);
+  /* a GFile for the same path gives the same template */
+  file = g_file_new_for_path (path_a);
+  t2 = ctpl_template_cache_lookup_file (cache, file, NULL);
+  g_assert (t1 == t2);
+  ctpl_template_unref (t2);
+  
+  /* a change is picked up, and the old template stays usable */
+  g_assert (g_file_set_contents (path_a, "A{x}{x}", -1, NULL));
+  t2 = ctpl_template_cache_lookup_path (cache, path_a, NULL);
+  g_assert (t2 != NULL && t2 != t1);
+  data = render_template (t1, env);
+  g_assert_cmpstr (data, ==, "a1");
+  g_free (data);
+  data = render_template (t2, env);
+  g_assert_cmpstr (data, ==, "A11");
+  g_free (data);
+  g_assert_cmpuint (ctpl_template_cache_get_size (cache), ==, 7);
+  ctpl_template_unref (t1);
+  
+  /* so is a rewrite in place of the same size, even within the same second */
+  g_usleep (50000);
+  fd = open (path_a, O_WRONLY);
+  g_assert (fd >= 0);
+  g_assert (write (fd, "B", 1) == 1);
+  close (fd);
+  t1 = ctpl_template_cache_lookup_path (cache, path_a, NULL);
+  g_assert (t1 != NULL && t1 != t2);
+  data = render_template (t1, env);
+  g_assert_cmpstr (data, ==, "B11");
+  g_free (data);
+  ctpl_template_unref (t1);
+  ctpl_template_unref (t2);
+  
+  g_assert (ctpl_template_cache_lookup_path (cache, missing, &err) == NULL);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_clear_error (&err);
+  
+  ctpl_template_cache_invalidate (cache, file);
+  g_assert_cmpuint (ctpl_template_cache_get_size (cache), ==, 0);
+  ctpl_template_cache_unref (cache);
+  
+  /* the least recently used templates are evicted to fit in the budget */
+  cache = ctpl_template_cache_new (10);
+  t1 = ctpl_template_cache_lookup_path (cache, path_a, NULL);
+  t2 = ctpl_template_cache_lookup_path (cache, path_b, NULL);
+  g_assert_cmpuint (ctpl_template_cache_get_size (cache), ==, 5);
+  t3 = ctpl_template_cache_lookup_path (cache, path_b, NULL);
+  g_assert (t2 == t3);
+  ctpl_template_unref (t3);
+  t3 = ctpl_template_cache_lookup_path (cache, path_a, NULL);
+  g_assert (t1 != t3);
+  g_assert_cmpuint (ctpl_template_cache_get_size (cache), ==, 7);
+  ctpl_template_unref (t1);
+  ctpl_template_unref (t2);
+  ctpl_template_unref (t3);
+  ctpl_template_cache_unref (cache);
+  
+  g_object_unref (file);
+  ctpl_environ_unref (env);
+  g_unlink (path_a);
+  g_unlink (path_b);
+  g_free (missing);
+  g_free (path_a);
+  g_free (path_b);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_template_cache ();
+  
+  return 0;
+}
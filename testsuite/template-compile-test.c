@@ -0,0 +1,116 @@
+/* Checks for ctpl_template_save() and ctpl_template_load() */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "../src/ctpl.h"
+
+
+/* renders a template */
+static gchar *
+render_template (CtplTemplate *tmpl,
+                 CtplEnviron  *env)
+{
+  return ctpl_parser_parse_to_string (ctpl_template_get_tree (tmpl), env, NULL,
+                                      NULL);
+}
+
+/* checks that compiled templates render like the text they were compiled from
+ * and that damaged ones are rejected */
+static void
+check_template_compile (void)
+{
+  static const gchar *source = "{for i in items}[{i}{if i > 1}>{end}]{end} "
+                               "{name|html} {items[1] * 2}{\"!\"}{0.5}\\{";
+  GOutputStream        *ostream;
+  GMemoryOutputStream  *mstream;
+  CtplOutputStream     *stream;
+  CtplInputStream      *istream;
+  CtplTemplate         *tmpl;
+  CtplTemplate         *loaded;
+  CtplEnviron          *env;
+  GError               *err = NULL;
+  gchar                *path;
+  gchar                *compiled;
+  gchar                *expected;
+  gchar                *data;
+  gsize                 size;
+  gint                  fd;
+  
+  env = ctpl_environ_new ();
+  g_assert (ctpl_environ_add_from_string (env, "items = [1, 2, 3];"
+                                               "name = \"<a&b>\";", NULL));
+  istream = ctpl_input_stream_new_for_memory (source, -1, NULL, "source");
+  tmpl = ctpl_template_load (istream, NULL);
+  ctpl_input_stream_unref (istream);
+  g_assert (tmpl != NULL);
+  expected = render_template (tmpl, env);
+  g_assert (expected != NULL);
+  
+  ostream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = ctpl_output_stream_new (ostream);
+  g_assert (ctpl_template_save (tmpl, stream, NULL));
+  g_assert (ctpl_output_stream_close (stream, NULL));
+  ctpl_output_stream_unref (stream);
+  mstream = G_MEMORY_OUTPUT_STREAM (ostream);
+  size = g_memory_output_stream_get_data_size (mstream);
+  compiled = g_memory_output_stream_steal_data (mstream);
+  g_object_unref (ostream);
+  ctpl_template_unref (tmpl);
+  
+  fd = g_file_open_tmp ("ctpl-XXXXXX.ctplc", &path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  /* from a mapped file */
+  g_assert (g_file_set_contents (path, compiled, size, NULL));
+  loaded = ctpl_template_load_path (path, &err);
+  g_assert_no_error (err);
+  data = render_template (loaded, env);
+  g_assert_cmpstr (data, ==, expected);
+  g_free (data);
+  ctpl_template_unref (loaded);
+  /* from a plain stream */
+  istream = ctpl_input_stream_new_for_memory (compiled, (gssize) size, NULL,
+                                              "compiled");
+  loaded = ctpl_template_load (istream, &err);
+  ctpl_input_stream_unref (istream);
+  g_assert_no_error (err);
+  data = render_template (loaded, env);
+  g_assert_cmpstr (data, ==, expected);
+  g_free (data);
+  ctpl_template_unref (loaded);
+  
+  /* truncated */
+  g_assert (g_file_set_contents (path, compiled, (gssize) size - 1, NULL));
+  g_assert (ctpl_template_load_path (path, &err) == NULL);
+  g_assert_error (err, CTPL_TEMPLATE_ERROR, CTPL_TEMPLATE_ERROR_INVALID);
+  g_clear_error (&err);
+  /* from a future version */
+  compiled[8] = 0x7f;
+  g_assert (g_file_set_contents (path, compiled, (gssize) size, NULL));
+  g_assert (ctpl_template_load_path (path, &err) == NULL);
+  g_assert_error (err, CTPL_TEMPLATE_ERROR,
+                  CTPL_TEMPLATE_ERROR_UNSUPPORTED_VERSION);
+  g_clear_error (&err);
+  
+  g_unlink (path);
+  g_free (path);
+  g_free (compiled);
+  g_free (expected);
+  ctpl_environ_unref (env);
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  
+  check_template_compile ();
+  
+  return 0;
+}
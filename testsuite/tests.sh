@@ -21,6 +21,14 @@ TESTPRG="${top_srcdir}/libtool execute ${top_srcdir}/src/ctpl"
 
 ARGS="-e ${srcdir}/environ"
 
+# the code generated by --emit-c is checked only if we know how to build it
+if [ -n "$CC" ] && [ -n "$GLIB_LIBS" ]; then
+  EMIT_C=true
+else
+  EMIT_C=false
+  echo "*** CC or GLIB_LIBS not set, not checking generated C code" >&2
+fi
+
 # display error on exit
 trap "
 echo                             >&2
@@ -45,6 +53,37 @@ for f in $(ls "${srcdir}/"success/* | grep -v -e '-output$'); do
       fi
     fi
   fi
+  if $success; then
+    compiled="$(mktemp)"
+    compiled_output="$(mktemp)"
+    
+    echo "  * checking compiled template..."
+    if ! $TESTPRG --compile -o "$compiled" "$f" ||
+       ! $TESTPRG $ARGS "$compiled" > "$compiled_output" ||
+       ! diff -u "$output_real" "$compiled_output"; then
+      echo "*** Compiled template does not render like the original" >&2
+      success=false
+    fi
+    rm -f "$compiled" "$compiled_output"
+  fi
+  if $success && $EMIT_C; then
+    emit_dir="$(mktemp -d)"
+    
+    echo "  * checking generated C code..."
+    # the generated code includes <ctpl/ctpl.h>
+    ln -s "$(cd "${top_srcdir}/src" && pwd)" "$emit_dir/ctpl"
+    if ! $TESTPRG --emit-c=ctpl_test_render -o "$emit_dir/render.c" "$f" ||
+       ! ${top_srcdir}/libtool --mode=link $CC -I"$emit_dir" $GLIB_CFLAGS \
+           -o "$emit_dir/render" "${srcdir}/emit-c-main.c" \
+           "$emit_dir/render.c" "${top_srcdir}/src/libctpl.la" $GLIB_LIBS ||
+       ! ${top_srcdir}/libtool execute "$emit_dir/render" "${srcdir}/environ" \
+           > "$emit_dir/output" ||
+       ! diff -u "$output_real" "$emit_dir/output"; then
+      echo "*** Generated C code does not render like the original" >&2
+      success=false
+    fi
+    rm -rf "$emit_dir"
+  fi
   rm -f "$output_real"
   $success || exit 1
 done